@@ -24,6 +24,9 @@ struct TestSemantic : public EarleyParser::Interpretator {
     std::string name_;
   };
 
+  //! Тип списка деревьев вывода, каждое задано списком поддеревьев символов правой части.
+  typedef std::list<TreeContext::ChildList> TreeList;
+
   void PrintContext(EarleyParser::Context::Ptr context, const std::string& indent) {
     TreeContext* tree_context = static_cast<TreeContext*>(context.get());
     std::cout << indent << tree_context->name_ << "\n";
@@ -32,6 +35,48 @@ struct TestSemantic : public EarleyParser::Interpretator {
     }
   }
 
+  /*!
+   * \brief Построение всех деревьев вывода ситуации.
+   *
+   * Дерево строится для каждого сочетания вывода префикса правила (по lptr_) и вывода последнего символа
+   * (по каждой ссылке из rptrs_), поэтому при неоднозначном разборе печатаются все деревья, а не только первые.
+   *
+   * \param[in]   item    Ситуация.
+   * \param[out]  trees   Деревья вывода символов правой части правила до метки.
+   */
+  void GetTrees(const EarleyParser::Item* item, TreeList& trees) {
+    trees.clear();
+    if (not item->lptr_) {
+      trees.push_back(TreeContext::ChildList());
+      return;
+    }
+
+    TreeList prefixes;
+    GetTrees(item->lptr_, prefixes);
+    for (EarleyParser::Item::Rptrs::const_iterator rptr = item->rptrs_.begin(); rptr != item->rptrs_.end(); ++rptr) {
+      // Ссылка без ситуации -- сдвиг терминала, его контекст построен в HandleTerminal.
+      TreeContext::ChildList symbols;
+      if (not rptr->item_) {
+        symbols.push_back(rptr->context_);
+      } else {
+        TreeList subtrees;
+        GetTrees(rptr->item_, subtrees);
+        for (TreeList::iterator it = subtrees.begin(); it != subtrees.end(); ++it) {
+          TreeContext* context = new TreeContext(parser_->grammar_->GetSymbolName(parser_->grammar_->GetLhsOfRule(rptr->item_->rule_id_)));
+          context->children_.swap(*it);
+          symbols.push_back(EarleyParser::Context::Ptr(context));
+        }
+      }
+
+      for (TreeList::const_iterator prefix = prefixes.begin(); prefix != prefixes.end(); ++prefix) {
+        for (TreeContext::ChildList::const_iterator symbol = symbols.begin(); symbol != symbols.end(); ++symbol) {
+          trees.push_back(*prefix);
+          trees.back().push_back(*symbol);
+        }
+      }
+    }
+  }
+
   /*!
    * \brief Начало работы алгоритма.
    *
@@ -48,13 +93,13 @@ struct TestSemantic : public EarleyParser::Interpretator {
    */
   void End(const EarleyParser::Item* item) {
     if (item and not item->rptrs_.empty()) {
-      TreeContext* context = new TreeContext(parser_->grammar_->GetSymbolName(parser_->grammar_->GetLhsOfRule(item->rule_id_)));
-      for (const EarleyParser::Item* cur = item; cur; cur = cur->lptr_) {
-        if (not cur->rptrs_.empty()) {
-          context->children_.push_back(cur->rptrs_.front().context_);
-        }
+      TreeList trees;
+      GetTrees(item, trees);
+      for (TreeList::iterator it = trees.begin(); it != trees.end(); ++it) {
+        TreeContext* context = new TreeContext(parser_->grammar_->GetSymbolName(parser_->grammar_->GetLhsOfRule(item->rule_id_)));
+        context->children_.swap(*it);
+        PrintContext(EarleyParser::Context::Ptr(context), "");
       }
-      PrintContext(EarleyParser::Context::Ptr(context), "");
     }
   }
 
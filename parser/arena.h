@@ -0,0 +1,287 @@
+
+#ifndef ARENA_H__
+#define ARENA_H__
+
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+namespace parser {
+
+/*!
+ * \brief Блочный распределитель однотипных элементов.
+ *
+ * Элементы выделяются подряд из блоков фиксированного размера. Освобожденный по одному элемент
+ * попадает в список свободных и выдается следующим выделением. Reset возвращает все элементы сразу,
+ * сохраняя блоки, поэтому повторное использование распределителя не выделяет память, пока число
+ * элементов не превысит достигнутое ранее. Выделенный элемент сохраняет значение, оставшееся от
+ * предыдущего использования, и должен быть проинициализирован.
+ */
+template <class Element>
+class Arena {
+public:
+  /*!
+   * \brief Конструктор распределителя.
+   *
+   * \param[in] block_size Количество элементов в блоке.
+   */
+  explicit Arena(size_t block_size)
+    : block_size_(block_size ? block_size : 1)
+    , num_of_blocks_(0)
+    , block_pos_(0)
+    , size_(0)
+  {}
+
+  //! Выделение элемента.
+  Element* Allocate() {
+    if (not free_.empty()) {
+      Element* elem = free_.back();
+      free_.pop_back();
+      return elem;
+    }
+
+    // Переходим к следующему блоку, выделяя память только если блоков от предыдущих использований не осталось.
+    if (block_pos_ >= block_size_ or num_of_blocks_ == 0) {
+      if (num_of_blocks_ == blocks_.size()) {
+        blocks_.push_back(Block());
+        blocks_.back().resize(block_size_);
+      }
+      ++num_of_blocks_;
+      block_pos_ = 0;
+    }
+
+    ++size_;
+    return &blocks_[num_of_blocks_ - 1][block_pos_++];
+  }
+
+  /*!
+   * \brief Освобождение одного элемента для повторного выделения.
+   *
+   * Элемент остается в блоке, поэтому доступен по порядковому номеру до Reset.
+   *
+   * \param[in] elem Элемент, выделенный этим распределителем.
+   */
+  void Free(Element* elem) {
+    free_.push_back(elem);
+  }
+
+  //! Получение элемента по порядковому номеру выделения.
+  Element& operator[](size_t index) {
+    return blocks_[index / block_size_][index % block_size_];
+  }
+
+  //! Получение количества элементов, выделенных из блоков, включая освобожденные по одному.
+  size_t GetSize() const {
+    return size_;
+  }
+
+  //! Получение количества блоков, из которых выделялись элементы с последнего Reset.
+  size_t GetNumOfBlocks() const {
+    return num_of_blocks_;
+  }
+
+  //! Возврат всех элементов с сохранением блоков.
+  void Reset() {
+    num_of_blocks_ = 0;
+    block_pos_ = 0;
+    size_ = 0;
+    free_.clear();
+  }
+
+  //! Возврат всех элементов с освобождением памяти блоков.
+  void Release() {
+    Reset();
+    std::deque<Block>().swap(blocks_);
+    std::vector<Element*>().swap(free_);
+  }
+
+private:
+  //! Тип блока элементов.
+  typedef std::vector<Element> Block;
+
+  std::deque<Block> blocks_;        //!< Блоки элементов.
+  size_t            block_size_;    //!< Количество элементов в блоке.
+  size_t            num_of_blocks_; //!< Количество используемых блоков.
+  size_t            block_pos_;     //!< Позиция следующего свободного элемента в последнем используемом блоке.
+  size_t            size_;          //!< Количество выделенных элементов.
+  std::vector<Element*> free_;      //!< Элементы, освобожденные по одному.
+};
+
+/*!
+ * \brief Кольцевой односвязный список, узлы которого выделяются из блочного распределителя.
+ *
+ * Объект списка занимает одно слово: хранится только последний узел, а первым узлом считается следующий
+ * за ним. Список не владеет узлами: удаленные из списка узлы остаются в распределителе до его Reset, если
+ * не возвращены в него явно. Копирование списка копирует только указатель на последний узел, поэтому
+ * после изменения копии исходный список использовать нельзя. Обход выполняется внешними итераторами,
+ * поэтому один список можно обходить одновременно несколькими циклами.
+ */
+template <class Element>
+class ArenaList {
+public:
+  //! Узел списка.
+  struct Node {
+    Element elem_;  //!< Элемент.
+    Node*   next_;  //!< Следующий узел, у последнего -- первый.
+
+    //! Инициализация по умолчанию.
+    Node()
+      : next_(NULL)
+    {}
+  };
+
+  //! Тип распределителя узлов.
+  typedef Arena<Node> Pool;
+
+  //! Итератор по элементам списка.
+  class const_iterator {
+  public:
+    //! Конструктор итератора, указывающего на узел списка с данным последним узлом.
+    explicit const_iterator(const Node* node = NULL, const Node* last = NULL)
+      : node_(node)
+      , last_(last)
+    {}
+
+    const Element& operator*() const { return node_->elem_; }
+    const Element* operator->() const { return &node_->elem_; }
+
+    const_iterator& operator++() {
+      node_ = node_ == last_ ? NULL : node_->next_;
+      return *this;
+    }
+
+    bool operator==(const const_iterator& rhs) const { return node_ == rhs.node_; }
+    bool operator!=(const const_iterator& rhs) const { return node_ != rhs.node_; }
+
+  private:
+    const Node* node_; //!< Текущий узел.
+    const Node* last_; //!< Последний узел списка.
+  };
+
+  //! Итератор по элементам списка с возможностью их изменения.
+  class iterator {
+  public:
+    //! Конструктор итератора, указывающего на узел списка с данным последним узлом.
+    explicit iterator(Node* node = NULL, Node* last = NULL)
+      : node_(node)
+      , last_(last)
+    {}
+
+    Element& operator*() const { return node_->elem_; }
+    Element* operator->() const { return &node_->elem_; }
+
+    iterator& operator++() {
+      node_ = node_ == last_ ? NULL : node_->next_;
+      return *this;
+    }
+
+    bool operator==(const iterator& rhs) const { return node_ == rhs.node_; }
+    bool operator!=(const iterator& rhs) const { return node_ != rhs.node_; }
+
+    //! Преобразование в константный итератор.
+    operator const_iterator() const { return const_iterator(node_, last_); }
+
+  private:
+    Node* node_; //!< Текущий узел.
+    Node* last_; //!< Последний узел списка.
+  };
+
+  //! Конструктор пустого списка.
+  ArenaList()
+    : last_(NULL)
+  {}
+
+  //! Проверка на пустоту.
+  bool empty() const {
+    return last_ == NULL;
+  }
+
+  //! Получение первого элемента непустого списка.
+  Element& front() {
+    return last_->next_->elem_;
+  }
+
+  //! Получение первого элемента непустого списка.
+  const Element& front() const {
+    return last_->next_->elem_;
+  }
+
+  //! Итератор на первый элемент.
+  const_iterator begin() const {
+    return const_iterator(last_ ? last_->next_ : NULL, last_);
+  }
+
+  //! Итератор за последним элементом.
+  const_iterator end() const {
+    return const_iterator();
+  }
+
+  //! Итератор на первый элемент.
+  iterator begin() {
+    return iterator(last_ ? last_->next_ : NULL, last_);
+  }
+
+  //! Итератор за последним элементом.
+  iterator end() {
+    return iterator();
+  }
+
+  /*!
+   * \brief Добавление элемента в конец списка.
+   *
+   * \param[in] elem    Элемент.
+   * \param[in] pool    Распределитель, из которого выделяется узел.
+   */
+  void push_back(const Element& elem, Pool& pool) {
+    Node* node = pool.Allocate();
+    node->elem_ = elem;
+    if (last_) {
+      node->next_ = last_->next_;
+      last_->next_ = node;
+    } else {
+      node->next_ = node;
+    }
+    last_ = node;
+  }
+
+  //! Удаление первого элемента непустого списка, узел остается в распределителе.
+  Element pop_front() {
+    return Unlink()->elem_;
+  }
+
+  /*!
+   * \brief Удаление первого элемента непустого списка с возвратом узла в распределитель.
+   *
+   * \param[in] pool    Распределитель, из которого был выделен узел.
+   * \return            Удаленный элемент.
+   */
+  Element pop_front(Pool& pool) {
+    Node* node = Unlink();
+    Element elem = node->elem_;
+    pool.Free(node);
+    return elem;
+  }
+
+  //! Удаление всех элементов, узлы остаются в распределителе.
+  void clear() {
+    last_ = NULL;
+  }
+
+private:
+  //! Исключение первого узла непустого списка.
+  Node* Unlink() {
+    Node* first = last_->next_;
+    if (first == last_) {
+      last_ = NULL;
+    } else {
+      last_->next_ = first->next_;
+    }
+    return first;
+  }
+
+  Node* last_;  //!< Последний узел.
+};
+
+} // namespace parser
+
+#endif // ARENA_H__
@@ -0,0 +1,120 @@
+
+#include <exception>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "batch_parser.h"
+using parser::BatchParser;
+
+/*!
+ * \brief Конструктор с созданием анализаторов для всех потоков.
+ *
+ * \param[in] grammar         Грамматика, общая для всех потоков.
+ * \param[in] factory         Фабрика лексических анализаторов и интерпретаторов.
+ * \param[in] options         Настройки анализаторов.
+ * \param[in] num_of_threads  Количество потоков, 0 -- по числу процессорных ядер.
+ */
+BatchParser::BatchParser(const Grammar* grammar, Factory* factory, const EarleyParser::Options& options, size_t num_of_threads)
+  : factory_(factory)
+{
+  if (num_of_threads == 0) {
+    num_of_threads = boost::thread::hardware_concurrency();
+  }
+  if (num_of_threads == 0) {
+    num_of_threads = 1;
+  }
+
+  // Лексический анализатор у каждого входа свой, он передается анализатору потока перед разбором.
+  for (size_t i = 0; i < num_of_threads; ++i) {
+    Worker* worker = new Worker();
+    workers_.push_back(worker);
+    worker->interpretator_.reset(factory_->CreateInterpretator());
+    worker->parser_.reset(new EarleyParser(grammar, NULL, worker->interpretator_.get(), options));
+  }
+}
+
+//! Деструктор с освобождением анализаторов потоков.
+BatchParser::~BatchParser() {
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    delete workers_[i];
+  }
+}
+
+//! Разбор списка входных цепочек.
+void BatchParser::Parse(const InputList& inputs, ResultList& results) {
+  results.assign(inputs.size(), Result());
+
+  // Раздаем входы потокам непрерывными частями, чтобы соседние входы разбирались одним анализатором.
+  size_t num_of_workers = workers_.size();
+  for (size_t i = 0; i < num_of_workers; ++i) {
+    workers_[i]->queue_.clear();
+    for (size_t index = inputs.size() * i / num_of_workers; index < inputs.size() * (i + 1) / num_of_workers; ++index) {
+      workers_[i]->queue_.push_back(index);
+    }
+  }
+
+  // С одним потоком разбираем в вызывающем потоке.
+  if (num_of_workers == 1) {
+    Work(0, &inputs, &results);
+    return;
+  }
+
+  boost::thread_group threads;
+  for (size_t i = 0; i < num_of_workers; ++i) {
+    threads.create_thread(boost::bind(&BatchParser::Work, this, i, &inputs, &results));
+  }
+  threads.join_all();
+}
+
+//! Получение номера следующего входа для потока.
+bool BatchParser::TakeInput(size_t worker_id, size_t& index) {
+  // Сначала берем вход из начала своей очереди.
+  Worker* worker = workers_[worker_id];
+  {
+    boost::mutex::scoped_lock lock(worker->mutex_);
+    if (not worker->queue_.empty()) {
+      index = worker->queue_.front();
+      worker->queue_.pop_front();
+      return true;
+    }
+  }
+
+  // Своя очередь пуста -- забираем вход с конца очереди другого потока. Новые входы в очереди не добавляются,
+  // поэтому если пусты все очереди, работа закончена.
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker* victim = workers_[(worker_id + i) % workers_.size()];
+    boost::mutex::scoped_lock lock(victim->mutex_);
+    if (not victim->queue_.empty()) {
+      index = victim->queue_.back();
+      victim->queue_.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//! Разбор входов потоком до исчерпания всех очередей.
+void BatchParser::Work(size_t worker_id, const InputList* inputs, ResultList* results) {
+  EarleyParser* parser = workers_[worker_id]->parser_.get();
+  EarleyParser::Interpretator* interpretator = workers_[worker_id]->interpretator_.get();
+
+  size_t index = 0;
+  while (TakeInput(worker_id, index)) {
+    // Каждый вход пишет только в свой результат, поэтому результаты не блокируются.
+    Result& result = (*results)[index];
+    try {
+      boost::scoped_ptr<Lexer> lexer(factory_->CreateLexer((*inputs)[index]));
+      parser->SetLexer(lexer.get());
+      result.accepted_ = parser->Parse();
+      result.status_ = parser->GetStatus();
+      result.stats_ = parser->GetStats();
+      result.context_ = factory_->TakeResult(interpretator, result.accepted_);
+    } catch (std::exception& err) {
+      result.accepted_ = false;
+      result.error_ = err.what();
+    }
+    parser->SetLexer(NULL);
+  }
+}
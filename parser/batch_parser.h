@@ -0,0 +1,141 @@
+
+#ifndef BATCH_PARSER_H__
+#define BATCH_PARSER_H__
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "grammar.h"
+#include "lexer.h"
+#include "earley_parser.h"
+
+namespace parser {
+
+/*!
+ * \brief Пакетный синтаксический анализ независимых входных цепочек несколькими потоками.
+ *
+ * Все потоки разделяют одну неизменяемую грамматику. У каждого потока свой объект EarleyParser со своими
+ * диспетчерами состояний и ситуаций, память которых переиспользуется от входа к входу и между вызовами
+ * Parse. Входы раздаются потокам равными непрерывными частями. Поток, разобравший свою часть, забирает
+ * входы с конца очередей других потоков, поэтому длинные входы не задерживают весь пакет.
+ */
+class BatchParser {
+public:
+  typedef std::vector<std::string> InputList; //!< Тип списка входных цепочек.
+
+  //! Результат разбора одной входной цепочки.
+  struct Result {
+    bool                        accepted_;  //!< Установлен в true, если цепочка разобрана.
+    EarleyParser::ParseStatus   status_;    //!< Результат разбора, отличает остановку по ограничению ресурсов от отказа.
+    EarleyParser::Stats         stats_;     //!< Счетчики разбора, для метрик складываются методом Stats::Add.
+    EarleyParser::Context::Ptr  context_;   //!< Семантический результат, полученный от фабрики.
+    std::string                 error_;     //!< Текст исключения, прервавшего разбор, или пустая строка.
+
+    //! Инициализация по умолчанию.
+    Result()
+      : accepted_(false)
+      , status_(EarleyParser::kRejected)
+    {}
+  };
+
+  typedef std::vector<Result> ResultList; //!< Тип списка результатов.
+
+  /*!
+   * \brief Фабрика объектов, которые нельзя разделять между потоками.
+   *
+   * Методы CreateLexer и TakeResult вызываются из рабочих потоков одновременно и должны быть потокобезопасными.
+   */
+  struct Factory {
+    //! Виртуальный деструктор для абстрактного типа.
+    virtual ~Factory() {
+    }
+
+    /*!
+     * \brief Создание лексического анализатора для входной цепочки.
+     *
+     * \param[in] input Входная цепочка.
+     * \return          Лексический анализатор, его освобождает пакетный анализатор после разбора.
+     */
+    virtual Lexer* CreateLexer(const std::string& input) = 0;
+
+    /*!
+     * \brief Создание интерпретатора для одного потока.
+     *
+     * \return Интерпретатор, его освобождает пакетный анализатор.
+     */
+    virtual EarleyParser::Interpretator* CreateInterpretator() = 0;
+
+    /*!
+     * \brief Получение семантического результата у интерпретатора после разбора очередной цепочки.
+     *
+     * \param[in] interpretator Интерпретатор потока, разобравшего цепочку.
+     * \param[in] accepted      Признак того, что цепочка разобрана.
+     * \return                  Семантический результат разбора.
+     */
+    virtual EarleyParser::Context::Ptr TakeResult(EarleyParser::Interpretator* interpretator, bool accepted) = 0;
+  };
+
+  /*!
+   * \brief Конструктор с созданием анализаторов для всех потоков.
+   *
+   * \param[in] grammar         Грамматика, общая для всех потоков.
+   * \param[in] factory         Фабрика лексических анализаторов и интерпретаторов.
+   * \param[in] options         Настройки анализаторов.
+   * \param[in] num_of_threads  Количество потоков, 0 -- по числу процессорных ядер.
+   */
+  BatchParser(const Grammar* grammar, Factory* factory, const EarleyParser::Options& options = EarleyParser::Options(), size_t num_of_threads = 0);
+
+  //! Деструктор с освобождением анализаторов потоков.
+  ~BatchParser();
+
+  /*!
+   * \brief Разбор списка входных цепочек.
+   *
+   * \param[in]  inputs  Входные цепочки.
+   * \param[out] results Результаты разбора в порядке входных цепочек.
+   */
+  void Parse(const InputList& inputs, ResultList& results);
+
+  //! Получение количества потоков.
+  size_t GetNumOfThreads() const {
+    return workers_.size();
+  }
+
+private:
+  //! Рабочий поток: анализатор с интерпретатором и очередь номеров входов.
+  struct Worker {
+    boost::scoped_ptr<EarleyParser::Interpretator>  interpretator_; //!< Интерпретатор потока.
+    boost::scoped_ptr<EarleyParser>                 parser_;        //!< Анализатор потока.
+    std::deque<size_t>                              queue_;         //!< Номера входов, назначенных потоку.
+    boost::mutex                                    mutex_;         //!< Блокировка очереди.
+  };
+
+  typedef std::vector<Worker*> WorkerList; //!< Тип списка рабочих потоков.
+
+  /*!
+   * \brief Получение номера следующего входа для потока.
+   *
+   * \param[in]  worker_id Номер потока.
+   * \param[out] index     Номер входа.
+   * \return               false если необработанных входов не осталось.
+   */
+  bool TakeInput(size_t worker_id, size_t& index);
+
+  //! Разбор входов потоком до исчерпания всех очередей.
+  void Work(size_t worker_id, const InputList* inputs, ResultList* results);
+
+  // Копирование запрещено.
+  BatchParser(const BatchParser&);
+  BatchParser& operator=(const BatchParser&);
+
+  Factory*    factory_; //!< Фабрика лексических анализаторов и интерпретаторов.
+  WorkerList  workers_; //!< Рабочие потоки.
+};
+
+} // namespace parser
+
+#endif // BATCH_PARSER_H__
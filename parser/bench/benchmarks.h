@@ -0,0 +1,474 @@
+#ifndef BENCHMARKS_H__
+#define BENCHMARKS_H__
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <parser/public_grammar.h>
+#include <parser/lexer.h>
+#include <parser/c_grammar.h>
+
+/*!
+ * \brief Грамматики и генераторы входов бенчмарков синтаксического анализатора.
+ *
+ * Используются бенчмарком parser_bench и тестами parser_tests. Грамматика языка C требует сборки c_grammar.cpp
+ * вместе с использующей цель.
+ */
+namespace bench {
+
+using parser::PublicGrammar;
+using parser::Lexer;
+using parser::Token;
+
+/*!
+ * \brief Лексический анализатор готовой последовательности токенов.
+ *
+ * Токен с номером i занимает позицию i входного потока, поэтому поиск следующих токенов не зависит
+ * от длины входа.
+ */
+class TokenListLexer : public Lexer {
+public:
+  //! Конструктор по внешним идентификаторам терминалов.
+  explicit TokenListLexer(const std::vector<PublicGrammar::MapId>& types) {
+    for (size_t i = 0; i < types.size(); ++i) {
+      tokens_.push_back(Token::Ptr(new Token(types[i], i, std::string(1, 't'))));
+    }
+  }
+
+  TokenList GetTokens(Token::Ptr token) {
+    TokenList next;
+    size_t position = token->abs_pos_ + token->length_;
+    if (position < tokens_.size()) {
+      next.push_back(tokens_[position]);
+    }
+    return next;
+  }
+
+  bool IsEnd(Token::Ptr token) {
+    return not tokens_.empty() and token == tokens_.back();
+  }
+
+private:
+  TokenList tokens_; //!< Токены входа.
+};
+
+//! Детерминированный генератор псевдослучайных чисел, чтобы входы совпадали между сборками и платформами.
+class Random {
+public:
+  explicit Random(unsigned seed)
+    : state_(seed)
+  {}
+
+  //! Число от 0 до bound - 1.
+  unsigned Next(unsigned bound) {
+    state_ = state_ * 1103515245u + 12345u;
+    return (state_ >> 16) % bound;
+  }
+
+private:
+  unsigned state_; //!< Состояние линейного конгруэнтного генератора.
+};
+
+//! Добавление правила с правой частью из не более чем четырех символов, нулевые идентификаторы пропускаются.
+inline void AddRule(PublicGrammar* grammar, PublicGrammar::MapId id, const char* name, PublicGrammar::MapId lhs,
+             PublicGrammar::MapId rhs0 = 0, PublicGrammar::MapId rhs1 = 0, PublicGrammar::MapId rhs2 = 0, PublicGrammar::MapId rhs3 = 0) {
+  grammar->AddRule(id, name);
+  grammar->AddLhsSymbol(id, lhs);
+  PublicGrammar::MapId rhs[] = {rhs0, rhs1, rhs2, rhs3};
+  for (size_t i = 0; i < sizeof(rhs) / sizeof(rhs[0]) and rhs[i]; ++i) {
+    grammar->AddRhsSymbol(id, rhs[i]);
+  }
+}
+
+/*!
+ * \brief Входы и грамматика одного бенчмарка.
+ *
+ * Размер входа задается числом повторений его единицы: выражений, строк, функций.
+ */
+struct Benchmark {
+  virtual ~Benchmark() {
+  }
+
+  //! Имя бенчмарка в отчете.
+  virtual const char* GetName() const = 0;
+
+  //! Построение грамматики.
+  virtual void InitGrammar(PublicGrammar* grammar) const = 0;
+
+  //! Размеры входов в порядке возрастания до масштабирования.
+  virtual std::vector<size_t> GetSizes() const = 0;
+
+  //! Создание лексического анализатора для входа данного размера.
+  virtual Lexer* CreateLexer(size_t size, size_t& num_of_tokens) const = 0;
+};
+
+//! Базовый класс бенчмарков, входы которых строятся сразу последовательностью токенов.
+struct TokenBenchmark : public Benchmark {
+  Lexer* CreateLexer(size_t size, size_t& num_of_tokens) const {
+    std::vector<PublicGrammar::MapId> types;
+    Generate(size, types);
+    num_of_tokens = types.size();
+    return new TokenListLexer(types);
+  }
+
+  //! Построение последовательности внешних идентификаторов терминалов.
+  virtual void Generate(size_t size, std::vector<PublicGrammar::MapId>& types) const = 0;
+};
+
+/*!
+ * \brief Неоднозначная грамматика A --> A A | a.
+ *
+ * Число выводов растет экспоненциально, число ситуаций -- квадратично, время -- кубически от длины входа.
+ */
+struct AmbiguousBenchmark : public TokenBenchmark {
+  enum { a = 1, A };
+
+  const char* GetName() const {
+    return "ambiguous";
+  }
+
+  void InitGrammar(PublicGrammar* grammar) const {
+    grammar->AddTerminal(a, "a");
+    grammar->AddNonterminal(A, "A");
+    grammar->SetStartSymbolId(A);
+    AddRule(grammar, 1, "A --> A A", A, A, A);
+    AddRule(grammar, 2, "A --> a", A, a);
+  }
+
+  std::vector<size_t> GetSizes() const {
+    size_t sizes[] = {25, 50, 100};
+    return std::vector<size_t>(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+  }
+
+  void Generate(size_t size, std::vector<PublicGrammar::MapId>& types) const {
+    types.assign(size, a);
+  }
+};
+
+/*!
+ * \brief Праворекурсивная грамматика выражений A --> M + A | M, M --> N * M | N.
+ *
+ * Число ситуаций в состоянии растет с глубиной правой рекурсии, если не используются ситуации Лео.
+ */
+struct ExpressionBenchmark : public TokenBenchmark {
+  enum { integer = 1, real, add, mul, A, M, N };
+
+  const char* GetName() const {
+    return "expression";
+  }
+
+  void InitGrammar(PublicGrammar* grammar) const {
+    grammar->AddTerminal(integer, "integer");
+    grammar->AddTerminal(real, "real");
+    grammar->AddTerminal(add, "+");
+    grammar->AddTerminal(mul, "*");
+    grammar->AddNonterminal(A, "A");
+    grammar->AddNonterminal(M, "M");
+    grammar->AddNonterminal(N, "N");
+    grammar->SetStartSymbolId(A);
+    AddRule(grammar, 1, "A --> M + A", A, M, add, A);
+    AddRule(grammar, 2, "A --> M", A, M);
+    AddRule(grammar, 3, "M --> N * M", M, N, mul, M);
+    AddRule(grammar, 4, "M --> N", M, N);
+    AddRule(grammar, 5, "N --> integer", N, integer);
+    AddRule(grammar, 6, "N --> real", N, real);
+  }
+
+  std::vector<size_t> GetSizes() const {
+    size_t sizes[] = {250, 500, 1000};
+    return std::vector<size_t>(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+  }
+
+  void Generate(size_t size, std::vector<PublicGrammar::MapId>& types) const {
+    Random random(size);
+    for (size_t i = 0; i < size; ++i) {
+      if (i) {
+        types.push_back(random.Next(2) ? add : mul);
+      }
+      types.push_back(random.Next(2) ? integer : real);
+    }
+  }
+};
+
+/*!
+ * \brief Грамматика с пустыми правилами: S --> x L, L --> L A B C | e, A --> a | e, B --> b | e, C --> A B | c.
+ *
+ * Почти каждый символ выводит пустую цепочку, поэтому выводы неоднозначны, а операция Predictor сдвигает
+ * метку через пустые выводы.
+ */
+struct EpsilonBenchmark : public TokenBenchmark {
+  enum { x = 1, a, b, c, S, L, A, B, C };
+
+  const char* GetName() const {
+    return "epsilon";
+  }
+
+  void InitGrammar(PublicGrammar* grammar) const {
+    grammar->AddTerminal(x, "x");
+    grammar->AddTerminal(a, "a");
+    grammar->AddTerminal(b, "b");
+    grammar->AddTerminal(c, "c");
+    grammar->AddNonterminal(S, "S");
+    grammar->AddNonterminal(L, "L");
+    grammar->AddNonterminal(A, "A");
+    grammar->AddNonterminal(B, "B");
+    grammar->AddNonterminal(C, "C");
+    grammar->SetStartSymbolId(S);
+    AddRule(grammar, 1, "S --> x L", S, x, L);
+    AddRule(grammar, 2, "L --> L A B C", L, L, A, B, C);
+    AddRule(grammar, 3, "L -->", L);
+    AddRule(grammar, 4, "A --> a", A, a);
+    AddRule(grammar, 5, "A -->", A);
+    AddRule(grammar, 6, "B --> b", B, b);
+    AddRule(grammar, 7, "B -->", B);
+    AddRule(grammar, 8, "C --> A B", C, A, B);
+    AddRule(grammar, 9, "C --> c", C, c);
+  }
+
+  std::vector<size_t> GetSizes() const {
+    size_t sizes[] = {500, 2000, 8000};
+    return std::vector<size_t>(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+  }
+
+  void Generate(size_t size, std::vector<PublicGrammar::MapId>& types) const {
+    types.push_back(x);
+    for (size_t i = 0; i < size; ++i) {
+      types.push_back(a);
+      types.push_back(b);
+      types.push_back(c);
+    }
+  }
+};
+
+/*!
+ * \brief Грамматика с цепочками необязательных символов: S --> S T | T, T --> P Q R t, P --> p | e и т.д.
+ *
+ * Выводы однозначны, но перед каждым терминалом предсказываются и пропускаются пустые выводы.
+ */
+struct OptionalBenchmark : public TokenBenchmark {
+  enum { p = 1, q, r, t, S, T, P, Q, R };
+
+  const char* GetName() const {
+    return "optional";
+  }
+
+  void InitGrammar(PublicGrammar* grammar) const {
+    grammar->AddTerminal(p, "p");
+    grammar->AddTerminal(q, "q");
+    grammar->AddTerminal(r, "r");
+    grammar->AddTerminal(t, "t");
+    grammar->AddNonterminal(S, "S");
+    grammar->AddNonterminal(T, "T");
+    grammar->AddNonterminal(P, "P");
+    grammar->AddNonterminal(Q, "Q");
+    grammar->AddNonterminal(R, "R");
+    grammar->SetStartSymbolId(S);
+    AddRule(grammar, 1, "S --> S T", S, S, T);
+    AddRule(grammar, 2, "S --> T", S, T);
+    AddRule(grammar, 3, "T --> P Q R t", T, P, Q, R, t);
+    AddRule(grammar, 4, "P --> p", P, p);
+    AddRule(grammar, 5, "P -->", P);
+    AddRule(grammar, 6, "Q --> q", Q, q);
+    AddRule(grammar, 7, "Q -->", Q);
+    AddRule(grammar, 8, "R --> r", R, r);
+    AddRule(grammar, 9, "R -->", R);
+  }
+
+  std::vector<size_t> GetSizes() const {
+    size_t sizes[] = {1000, 4000, 16000};
+    return std::vector<size_t>(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+  }
+
+  void Generate(size_t size, std::vector<PublicGrammar::MapId>& types) const {
+    Random random(size);
+    for (size_t i = 0; i < size; ++i) {
+      if (random.Next(2)) types.push_back(p);
+      if (random.Next(2)) types.push_back(q);
+      if (random.Next(2)) types.push_back(r);
+      types.push_back(t);
+    }
+  }
+};
+
+/*!
+ * \brief Грамматика со списками EBNF: S --> [ {E ,}* ], E --> a+ | S.
+ *
+ * Списки строятся вспомогательными нетерминалами Grammar, размер входа -- число элементов внешнего списка.
+ */
+struct ListBenchmark : public TokenBenchmark {
+  enum { a = 1, comma, open, close, S, E };
+
+  const char* GetName() const {
+    return "list";
+  }
+
+  void InitGrammar(PublicGrammar* grammar) const {
+    grammar->AddTerminal(a, "a");
+    grammar->AddTerminal(comma, ",");
+    grammar->AddTerminal(open, "[");
+    grammar->AddTerminal(close, "]");
+    grammar->AddNonterminal(S, "S");
+    grammar->AddNonterminal(E, "E");
+    grammar->SetStartSymbolId(S);
+
+    grammar->AddRule(1, "S --> [ {E ,}* ]");
+    grammar->AddLhsSymbol(1, S);
+    grammar->AddRhsSymbol(1, open);
+    grammar->AddRhsList(1, E, comma, PublicGrammar::kZeroOrMore);
+    grammar->AddRhsSymbol(1, close);
+
+    grammar->AddRule(2, "E --> a+");
+    grammar->AddLhsSymbol(2, E);
+    grammar->AddRhsSymbol(2, a, PublicGrammar::kOneOrMore);
+
+    AddRule(grammar, 3, "E --> S", E, S);
+  }
+
+  std::vector<size_t> GetSizes() const {
+    size_t sizes[] = {2000, 8000, 32000};
+    return std::vector<size_t>(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+  }
+
+  void Generate(size_t size, std::vector<PublicGrammar::MapId>& types) const {
+    Random random(size);
+    types.push_back(open);
+    for (size_t i = 0; i < size; ++i) {
+      if (i) types.push_back(comma);
+
+      // Каждый четвертый элемент -- вложенный список, остальные -- цепочки из одного-трех a.
+      if (random.Next(4) == 0) {
+        types.push_back(open);
+        for (size_t j = random.Next(8); j; --j) {
+          types.push_back(a);
+          types.push_back(j > 1 ? comma : close);
+        }
+        if (types.back() == open) types.push_back(close);
+      } else {
+        for (size_t j = random.Next(3) + 1; j; --j) types.push_back(a);
+      }
+    }
+    types.push_back(close);
+  }
+};
+
+/*!
+ * \brief Грамматика языка C из c_grammar::init_grammar на сгенерированных исходных текстах.
+ *
+ * Размер входа -- число функций. Текст разбирается лексическим анализатором c_grammar::CLexer до замера времени.
+ */
+struct CBenchmark : public Benchmark {
+  const char* GetName() const {
+    return "c";
+  }
+
+  void InitGrammar(PublicGrammar* grammar) const {
+    c_grammar::init_grammar(grammar);
+  }
+
+  std::vector<size_t> GetSizes() const {
+    size_t sizes[] = {10, 40, 160};
+    return std::vector<size_t>(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+  }
+
+  Lexer* CreateLexer(size_t size, size_t& num_of_tokens) const {
+    std::istringstream source(GenerateSource(size));
+    c_grammar::CLexer* lexer = new c_grammar::CLexer(source);
+    num_of_tokens = lexer->get_num_of_tokens();
+    return lexer;
+  }
+
+  //! Генерация исходного текста из заданного числа функций.
+  static std::string GenerateSource(size_t num_of_functions) {
+    Random random(num_of_functions);
+    std::ostringstream out;
+    out << "/* generated by parser_bench */\n";
+    out << "static int table[64];\n\n";
+    for (size_t f = 0; f < num_of_functions; ++f) {
+      out << "int f" << f << "(int a, int b, char *s)\n{\n";
+      out << "  int i;\n  int n;\n  long acc;\n";
+      out << "  acc = 0;\n";
+      size_t num_of_statements = 3 + random.Next(5);
+      for (size_t i = 0; i < num_of_statements; ++i) {
+        GenerateStatement(random, out, 1, f);
+      }
+      out << "  return acc + " << GenerateExpression(random, 2, f) << ";\n}\n\n";
+    }
+    return out.str();
+  }
+
+private:
+  //! Генерация выражения ограниченной глубины.
+  static std::string GenerateExpression(Random& random, int depth, size_t function) {
+    static const char* operators[] = {"+", "-", "*", "/", "%", "<<", ">>", "&", "|", "^", "<", ">", "==", "!=", "&&", "||"};
+    std::ostringstream out;
+    if (depth <= 0 or random.Next(4) == 0) {
+      switch (random.Next(6)) {
+      case 0: out << "a"; break;
+      case 1: out << "b"; break;
+      case 2: out << "table[i & 63]"; break;
+      case 3: out << "s[n]"; break;
+      case 4: out << random.Next(1000); break;
+      default: out << "0x" << std::hex << random.Next(4096); break;
+      }
+      return out.str();
+    }
+    switch (random.Next(5)) {
+    case 0:
+      out << "(" << GenerateExpression(random, depth - 1, function) << ")";
+      break;
+    case 1:
+      out << (function ? "f" : "table[") << (function ? random.Next(function) : random.Next(64))
+          << (function ? "(" : "]");
+      if (function) {
+        out << GenerateExpression(random, depth - 1, function) << ", " << GenerateExpression(random, depth - 1, function) << ", s)";
+      }
+      break;
+    default:
+      out << GenerateExpression(random, depth - 1, function) << " "
+          << operators[random.Next(sizeof(operators) / sizeof(operators[0]))] << " "
+          << GenerateExpression(random, depth - 1, function);
+      break;
+    }
+    return out.str();
+  }
+
+  //! Генерация оператора с вложенными блоками ограниченной глубины.
+  static void GenerateStatement(Random& random, std::ostream& out, int depth, size_t function) {
+    std::string indent(2 * depth, ' ');
+    switch (depth < 3 ? random.Next(6) : 0) {
+    case 0:
+    case 1:
+      out << indent << "acc = acc + " << GenerateExpression(random, 3, function) << ";\n";
+      break;
+    case 2:
+      out << indent << "if (" << GenerateExpression(random, 2, function) << ") {\n";
+      GenerateStatement(random, out, depth + 1, function);
+      out << indent << "} else {\n";
+      GenerateStatement(random, out, depth + 1, function);
+      out << indent << "}\n";
+      break;
+    case 3:
+      out << indent << "for (i = 0; i < a; i++) {\n";
+      GenerateStatement(random, out, depth + 1, function);
+      GenerateStatement(random, out, depth + 1, function);
+      out << indent << "}\n";
+      break;
+    case 4:
+      out << indent << "while (n < b && s[n] != 0) {\n";
+      out << indent << "  n++;\n";
+      GenerateStatement(random, out, depth + 1, function);
+      out << indent << "}\n";
+      break;
+    default:
+      out << indent << "switch (a) {\n" << indent << "case 1:\n";
+      GenerateStatement(random, out, depth + 1, function);
+      out << indent << "  break;\n" << indent << "default:\n" << indent << "  acc = -acc;\n" << indent << "}\n";
+      break;
+    }
+  }
+};
+
+} // namespace bench
+
+#endif // BENCHMARKS_H__
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <parser/public_grammar.h>
+#include <parser/grammar_optimizer.h>
+#include <parser/grammar.h>
+#include <parser/earley_parser.h>
+
+#include "benchmarks.h"
+#include "c_grammar_tables.h"
+
+using parser::PublicGrammar;
+using parser::GrammarOptimizer;
+using parser::Grammar;
+using parser::EarleyParser;
+using parser::Lexer;
+using namespace bench;
+
+namespace {
+
+//! Режим алгоритма, выбираемый ключом --mode.
+struct Mode {
+  const char*           name_;    //!< Имя режима в отчете.
+  EarleyParser::Options options_; //!< Настройки алгоритма.
+};
+
+//! Все режимы алгоритма, первый -- режим по умолчанию.
+std::vector<Mode> GetModes() {
+  std::vector<Mode> modes;
+  Mode mode;
+
+  mode.name_ = "item";
+  mode.options_ = EarleyParser::Options();
+  modes.push_back(mode);
+
+  mode.name_ = "leo";
+  mode.options_ = EarleyParser::Options();
+  mode.options_.use_leo_items_ = true;
+  modes.push_back(mode);
+
+  mode.name_ = "lr0";
+  mode.options_ = EarleyParser::Options();
+  mode.options_.engine_ = EarleyParser::Options::kLr0Engine;
+  modes.push_back(mode);
+
+  mode.name_ = "forest";
+  mode.options_ = EarleyParser::Options();
+  mode.options_.build_forest_ = true;
+  modes.push_back(mode);
+
+  mode.name_ = "deferred";
+  mode.options_ = EarleyParser::Options();
+  mode.options_.defer_semantics_ = true;
+  modes.push_back(mode);
+
+  return modes;
+}
+
+//! Результат одного бенчмарка на входе одного размера.
+struct Result {
+  std::string name_;          //!< Имя бенчмарка.
+  std::string mode_;          //!< Имя режима алгоритма.
+  size_t      size_;          //!< Размер входа.
+  size_t      num_of_tokens_; //!< Число токенов входа.
+  bool        accepted_;      //!< Вход разобран.
+  size_t      repeat_;        //!< Число запусков разбора.
+  double      best_seconds_;  //!< Наименьшее время разбора.
+  double      mean_seconds_;  //!< Среднее время разбора.
+  double      total_seconds_; //!< Суммарное время разбора по всем запускам.
+  size_t      peak_items_;    //!< Наибольшее число ситуаций, выделенных за один разбор.
+  long        peak_rss_kb_;   //!< Пиковый размер резидентной памяти процесса после бенчмарка.
+  bool        embedded_;      //!< Грамматика создана из таблиц, встроенных при сборке.
+  double      grammar_seconds_; //!< Время построения грамматики.
+  EarleyParser::Stats stats_; //!< Счетчики разбора, сложенные по всем запускам.
+};
+
+//! Пиковый размер резидентной памяти процесса в килобайтах.
+long GetPeakRss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+//! Разбор одного входа несколько раз одним объектом парсера, как при повторном использовании в сервере.
+Result Run(const Benchmark& benchmark, const Grammar& grammar, const Mode& mode, size_t size, size_t repeat) {
+  Result result;
+  result.name_ = benchmark.GetName();
+  result.mode_ = mode.name_;
+  result.size_ = size;
+  result.repeat_ = repeat;
+  result.accepted_ = true;
+  result.best_seconds_ = 0;
+  result.mean_seconds_ = 0;
+  result.total_seconds_ = 0;
+  result.peak_items_ = 0;
+
+  boost::scoped_ptr<Lexer> lexer(benchmark.CreateLexer(size, result.num_of_tokens_));
+  EarleyParser::ForestRecorder interpretator;
+  EarleyParser parser(&grammar, lexer.get(), &interpretator, mode.options_);
+  for (size_t i = 0; i < repeat; ++i) {
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    bool accepted = parser.Parse();
+    double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+
+    result.accepted_ = result.accepted_ and accepted;
+    result.best_seconds_ = i ? std::min(result.best_seconds_, seconds) : seconds;
+    result.mean_seconds_ += seconds / repeat;
+    result.total_seconds_ += seconds;
+    result.peak_items_ = std::max(result.peak_items_, parser.item_disp_.items_.GetSize());
+    result.stats_.Add(parser.GetStats());
+  }
+  parser.Reset();
+  result.peak_rss_kb_ = GetPeakRss();
+  return result;
+}
+
+//! Скорость обработки, при нулевом времени -- ноль.
+double Rate(size_t count, double seconds) {
+  return seconds > 0 ? count / seconds : 0;
+}
+
+/*!
+ * \brief Печать результата объектом JSON, счетчики разбора -- средние по запускам.
+ *
+ * Скорость построения ситуаций -- число ситуаций, созданных во всех запусках, к их суммарному времени. В режиме lr0
+ * это LR(0) ситуации, как и в EarleyParser::Stats::num_of_items_.
+ */
+void PrintResult(const Result& result, std::ostream& out) {
+  const EarleyParser::Stats& stats = result.stats_;
+  out << "    {\"benchmark\": \"" << result.name_ << "\""
+      << ", \"mode\": \"" << result.mode_ << "\""
+      << ", \"size\": " << result.size_
+      << ", \"tokens\": " << result.num_of_tokens_
+      << ", \"accepted\": " << (result.accepted_ ? "true" : "false")
+      << ", \"repeat\": " << result.repeat_
+      << ", \"best_seconds\": " << result.best_seconds_
+      << ", \"mean_seconds\": " << result.mean_seconds_
+      << ", \"tokens_per_second\": " << Rate(result.num_of_tokens_, result.best_seconds_)
+      << ", \"items_per_second\": " << Rate(stats.num_of_items_, result.total_seconds_)
+      << ", \"peak_items\": " << result.peak_items_
+      << ", \"peak_rss_kb\": " << result.peak_rss_kb_
+      << ", \"grammar\": \"" << (result.embedded_ ? "embedded" : "built") << "\""
+      << ", \"grammar_seconds\": " << result.grammar_seconds_
+      << ", \"stats\": {"
+      << "\"states\": " << stats.num_of_states_ / stats.num_of_parses_
+      << ", \"max_state_items\": " << stats.max_state_items_
+      << ", \"duplicate_items\": " << stats.duplicate_items_ / stats.num_of_parses_
+      << ", \"completer_calls\": " << stats.completer_calls_ / stats.num_of_parses_
+      << ", \"predictor_calls\": " << stats.predictor_calls_ / stats.num_of_parses_
+      << ", \"scanner_calls\": " << stats.scanner_calls_ / stats.num_of_parses_
+      << ", \"nullable_items\": " << stats.nullable_items_ / stats.num_of_parses_
+      << ", \"interpretator_calls\": " << (stats.terminal_calls_ + stats.nonterminal_calls_) / stats.num_of_parses_
+      << ", \"item_blocks\": " << stats.item_blocks_
+      << ", \"recognition_seconds\": " << stats.recognition_seconds_ / stats.num_of_parses_
+      << ", \"derivation_seconds\": " << stats.derivation_seconds_ / stats.num_of_parses_
+      << "}"
+      << "}";
+}
+
+} // namespace
+
+/*!
+ * \brief Бенчмарки синтаксического анализатора.
+ *
+ * Использование: parser_bench [--repeat <n>] [--scale <k>] [--filter <имя>] [--mode <режим>] [--optimize]
+ *
+ * Для каждой грамматики входы растущего размера генерируются детерминированно, поэтому результаты разных
+ * сборок сравнимы. Каждый вход разбирается repeat раз одним объектом парсера, время -- наименьшее и среднее
+ * по запускам. Размеры входов умножаются на scale. Пиковая резидентная память -- общая для процесса и не
+ * уменьшается между бенчмарками, для отдельного замера нужно выбрать один бенчмарк ключом --filter.
+ * С ключом --optimize грамматики перед построением Grammar преобразуются GrammarOptimizer, иначе грамматика языка C
+ * создается из таблиц, встроенных при сборке (c_grammar_tables.h).
+ * Ключ --mode выбирает режим алгоритма: item (по умолчанию), leo, lr0, forest, deferred или all -- все режимы
+ * подряд для каждого входа. Результаты печатаются в стандартный вывод в формате JSON, по строке на вход и режим.
+ */
+int main(int argc, char* argv[]) {
+  size_t repeat = 5;
+  size_t scale = 1;
+  std::string filter;
+  std::string mode_name = "item";
+  bool optimize = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 < argc and arg == "--repeat") {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (i + 1 < argc and arg == "--scale") {
+      scale = std::max(1, std::atoi(argv[++i]));
+    } else if (i + 1 < argc and arg == "--filter") {
+      filter = argv[++i];
+    } else if (i + 1 < argc and arg == "--mode") {
+      mode_name = argv[++i];
+    } else if (arg == "--optimize") {
+      optimize = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--repeat <n>] [--scale <k>] [--filter <name>] [--mode <mode>] [--optimize]\n";
+      return 1;
+    }
+  }
+
+  std::vector<Mode> modes;
+  std::vector<Mode> all_modes = GetModes();
+  for (size_t i = 0; i < all_modes.size(); ++i) {
+    if (mode_name == "all" or mode_name == all_modes[i].name_) {
+      modes.push_back(all_modes[i]);
+    }
+  }
+  if (modes.empty()) {
+    std::cerr << "Unknown mode " << mode_name << ", expected item, leo, lr0, forest, deferred or all\n";
+    return 1;
+  }
+
+  AmbiguousBenchmark ambiguous;
+  ExpressionBenchmark expression;
+  EpsilonBenchmark epsilon;
+  OptionalBenchmark optional;
+  ListBenchmark list;
+  CBenchmark c;
+  const Benchmark* benchmarks[] = {&c, &ambiguous, &expression, &epsilon, &optional, &list};
+
+  try {
+    std::cout << "{\n  \"results\": [\n";
+    bool first = true;
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); ++b) {
+      if (not filter.empty() and filter != benchmarks[b]->GetName()) {
+        continue;
+      }
+
+      PublicGrammar public_grammar(benchmarks[b]->GetName());
+      benchmarks[b]->InitGrammar(&public_grammar);
+
+      GrammarOptimizer optimizer;
+      PublicGrammar optimized_grammar(benchmarks[b]->GetName());
+      if (optimize) {
+        optimizer.Optimize(public_grammar, &optimized_grammar);
+      }
+
+      // Грамматика языка C без оптимизации создается из таблиц, встроенных при сборке, остальные строятся по PublicGrammar.
+      bool embedded = not optimize and benchmarks[b] == &c;
+      boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+      boost::scoped_ptr<Grammar> grammar(embedded ? c_grammar::CreateGrammar() : new Grammar(optimize ? &optimized_grammar : &public_grammar));
+      double grammar_seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+
+      std::vector<size_t> sizes = benchmarks[b]->GetSizes();
+      for (size_t i = 0; i < sizes.size(); ++i) {
+        for (size_t m = 0; m < modes.size(); ++m) {
+          Result result = Run(*benchmarks[b], *grammar, modes[m], sizes[i] * scale, repeat);
+          result.embedded_ = embedded;
+          result.grammar_seconds_ = grammar_seconds;
+          std::cout << (first ? "" : ",\n");
+          PrintResult(result, std::cout);
+          std::cout.flush();
+          first = false;
+        }
+      }
+    }
+    std::cout << "\n  ]\n}\n";
+  } catch (std::exception& err) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
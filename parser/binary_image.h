@@ -0,0 +1,224 @@
+
+#ifndef BINARY_IMAGE_H__
+#define BINARY_IMAGE_H__
+
+#include <vector>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+#include <boost/dynamic_bitset.hpp>
+
+namespace parser {
+
+/*!
+ * \brief Запись плоских таблиц в двоичный образ.
+ *
+ * Образ состоит из 64-битных слов и таблиц. Таблица записывается как количество элементов, за которым
+ * следуют сами элементы во внутреннем представлении, дополненные нулями до границы слова. Образ
+ * предназначен для чтения той же сборкой, поэтому порядок байтов и размеры типов не преобразуются,
+ * а только проверяются при чтении по заголовку, который записывает владелец образа.
+ */
+class ImageWriter {
+public:
+  typedef boost::uint64_t Word; //!< Тип слова образа.
+
+  //! Конструктор записи в поток, открытый в двоичном режиме.
+  explicit ImageWriter(std::ostream& stream)
+    : stream_(stream)
+  {}
+
+  //! Запись слова.
+  void WriteWord(Word value) {
+    stream_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  //! Запись таблицы элементов простого типа.
+  template <class T>
+  void WriteTable(const std::vector<T>& table) {
+    WriteWord(table.size());
+    if (not table.empty()) {
+      WriteBytes(&table[0], table.size() * sizeof(T));
+    }
+  }
+
+  //! Запись таблицы признаков, по байту на признак.
+  void WriteFlags(const std::vector<bool>& flags) {
+    std::vector<char> bytes(flags.begin(), flags.end());
+    WriteTable(bytes);
+  }
+
+  /*!
+   * \brief Запись таблицы множеств одинаковой длины.
+   *
+   * Блоки всех множеств записываются подряд, поэтому при чтении длина одного множества задает шаг.
+   */
+  template <class Block>
+  void WriteSets(const std::vector< boost::dynamic_bitset<Block> >& sets, size_t num_of_bits) {
+    std::vector<Block> blocks;
+    blocks.reserve(sets.size() * ((num_of_bits + sizeof(Block) * 8 - 1) / (sizeof(Block) * 8)));
+    for (size_t i = 0; i < sets.size(); ++i) {
+      boost::to_block_range(sets[i], std::back_inserter(blocks));
+    }
+    WriteWord(sets.size());
+    WriteWord(num_of_bits);
+    WriteTable(blocks);
+  }
+
+private:
+  //! Запись байтов с дополнением до границы слова.
+  void WriteBytes(const void* data, size_t size) {
+    static const char padding[sizeof(Word)] = {0};
+    stream_.write(static_cast<const char*>(data), size);
+    if (size % sizeof(Word)) {
+      stream_.write(padding, sizeof(Word) - size % sizeof(Word));
+    }
+  }
+
+  std::ostream& stream_;  //!< Поток, в который записывается образ.
+};
+
+/*!
+ * \brief Чтение двоичного образа, записанного ImageWriter, из области памяти.
+ *
+ * Область обычно является отображением файла в память. Таблицы копируются из нее одним блоком, поэтому
+ * после чтения область можно освободить. Выход за границу области, как и прочитанные индексы и смещения
+ * за границами своих таблиц (CheckIndices, CheckOffsets), означает поврежденный образ и приводит к
+ * исключению std::runtime_error.
+ */
+class ImageReader {
+public:
+  typedef ImageWriter::Word Word; //!< Тип слова образа.
+
+  //! Конструктор чтения из области памяти.
+  ImageReader(const void* data, size_t size)
+    : pos_(static_cast<const char*>(data))
+    , end_(static_cast<const char*>(data) + size)
+  {}
+
+  //! Чтение слова.
+  Word ReadWord() {
+    Word value;
+    std::memcpy(&value, Take(sizeof(value)), sizeof(value));
+    return value;
+  }
+
+  //! Чтение таблицы элементов простого типа.
+  template <class T>
+  void ReadTable(std::vector<T>& table) {
+    Word size = ReadWord();
+    if (size > static_cast<Word>(end_ - pos_) / sizeof(T)) {
+      Fail("table size exceeds the image");
+    }
+    table.resize(size);
+    if (size) {
+      std::memcpy(&table[0], Take(Padded(size * sizeof(T))), size * sizeof(T));
+    }
+  }
+
+  //! Чтение таблицы признаков.
+  void ReadFlags(std::vector<bool>& flags) {
+    std::vector<char> bytes;
+    ReadTable(bytes);
+    flags.assign(bytes.begin(), bytes.end());
+  }
+
+  //! Чтение таблицы множеств одинаковой длины.
+  template <class Block>
+  void ReadSets(std::vector< boost::dynamic_bitset<Block> >& sets) {
+    Word num_of_sets = ReadWord();
+    Word num_of_bits = ReadWord();
+    std::vector<Block> blocks;
+    ReadTable(blocks);
+
+    // Число множеств проверяется делением, чтобы поврежденные слова не давали переполнения.
+    if (num_of_bits > blocks.size() * sizeof(Block) * 8) {
+      Fail("set table size mismatch");
+    }
+    size_t stride = (num_of_bits + sizeof(Block) * 8 - 1) / (sizeof(Block) * 8);
+    if (stride ? blocks.size() % stride or blocks.size() / stride != num_of_sets : num_of_sets != 0) {
+      Fail("set table size mismatch");
+    }
+    sets.assign(num_of_sets, boost::dynamic_bitset<Block>(num_of_bits));
+    for (size_t i = 0; i < sets.size(); ++i) {
+      boost::from_block_range(blocks.begin() + i * stride, blocks.begin() + (i + 1) * stride, sets[i]);
+    }
+  }
+
+  /*!
+   * \brief Проверка индексов, прочитанных из образа.
+   *
+   * \param[in] table Таблица индексов.
+   * \param[in] bound Размер индексируемой таблицы, все индексы должны быть меньше него.
+   * \param[in] what  Описание ошибки.
+   */
+  template <class T>
+  static void CheckIndices(const std::vector<T>& table, size_t bound, const char* what) {
+    for (size_t i = 0; i < table.size(); ++i) {
+      if (table[i] >= bound) {
+        Fail(what);
+      }
+    }
+  }
+
+  /*!
+   * \brief Проверка таблицы смещений начал списков, уложенных подряд.
+   *
+   * Смещения должны начинаться с нуля, не убывать и заканчиваться размером таблицы списков.
+   *
+   * \param[in] offsets Таблица смещений, последнее -- конец последнего списка.
+   * \param[in] size    Размер таблицы списков.
+   * \param[in] what    Описание ошибки.
+   */
+  template <class T>
+  static void CheckOffsets(const std::vector<T>& offsets, size_t size, const char* what) {
+    if (offsets.empty() or offsets.front() != 0 or offsets.back() != size) {
+      Fail(what);
+    }
+    for (size_t i = 1; i < offsets.size(); ++i) {
+      if (offsets[i] < offsets[i - 1]) {
+        Fail(what);
+      }
+    }
+  }
+
+  //! Проверка слова образа, несовпадение означает несовместимый образ.
+  void Expect(Word expected, const char* what) {
+    if (ReadWord() != expected) {
+      Fail(what);
+    }
+  }
+
+  //! Выброс исключения о поврежденном или несовместимом образе.
+  static void Fail(const char* what) {
+    std::stringstream st;
+    st << "Invalid grammar image: " << what;
+    throw std::runtime_error(st.str().c_str());
+  }
+
+private:
+  //! Размер с дополнением до границы слова.
+  static size_t Padded(size_t size) {
+    return (size + sizeof(Word) - 1) / sizeof(Word) * sizeof(Word);
+  }
+
+  //! Получение очередных байтов образа.
+  const char* Take(size_t size) {
+    if (size > static_cast<size_t>(end_ - pos_)) {
+      Fail("unexpected end of image");
+    }
+    const char* data = pos_;
+    pos_ += size;
+    return data;
+  }
+
+  const char* pos_; //!< Текущая позиция чтения.
+  const char* end_; //!< Конец области.
+};
+
+} // namespace parser
+
+#endif // BINARY_IMAGE_H__
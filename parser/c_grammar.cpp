@@ -2,7 +2,9 @@
 
 #include <sstream>
 #include <cstdlib>
+#include <cstdio>
 #include <stdexcept>
+#include <algorithm>
 
 #include "c_grammar.h"
 using namespace c_grammar;
@@ -11,19 +13,20 @@ static const char* token_names_buffer_[ SYMBOL_TABLE_LAST + 2 ];
 static const char** token_names_ = token_names_buffer_ + 1;
 
 // print token to the ostream
-void parser::token::print( std::ostream& _str )
+void c_grammar::print_token( const parser::Token& _token, std::ostream& _str )
 {
-  _str << token_names_[ type_ ] << ": (" << line_pos_ << "," << col_pos_ << ")";
-  if( type_ == IDENTIFIER || type_ == HEX || type_ == OCTAL || type_ == INTEGER ||
-    type_ == REAL || type_ == CHARACTER_LITERAL || type_ == STRING_LITERAL )
+  int type = _token.type_;
+  _str << token_names_[ type ] << ": (" << _token.line_pos_ << "," << _token.col_pos_ << ")";
+  if( type == IDENTIFIER || type == HEX || type == OCTAL || type == INTEGER ||
+    type == REAL || type == CHARACTER_LITERAL || type == STRING_LITERAL )
   {
-    _str << " \"" << str_value_ << "\"";
+    _str << " \"" << _token.text_ << "\"";
   }
   
   _str << std::endl;
 }
 
-void lexer::init_tokens()
+void CLexer::init_tokens()
 {
   token_names_[ EN_EOF ] = "EOF";
   token_names_[ UNKNOWN ] = "UNKNOWN";
@@ -117,9 +120,10 @@ void lexer::init_tokens()
 }
 
 // read next character from the input
-char lexer::next_char()
+char CLexer::next_char()
 {
   cur_char_ = in_.get();
+  if( EOF != cur_char_ ) ++ abs_pos_;
   
   // if current symbol is printable increase position
   if(
@@ -146,13 +150,13 @@ char lexer::next_char()
 }
 
 // peek next character from the input
-char lexer::peek_next()
+char CLexer::peek_next()
 {
   return in_.peek();
 }
 
 // put back read character
-void lexer::put_back()
+void CLexer::put_back()
 {
   // we descease the position only if the symbol read is printable
   if(
@@ -170,11 +174,14 @@ void lexer::put_back()
     pos_ = prev_line_len_;
   }
   
+  if( EOF == cur_char_ ) return;
+  
+  -- abs_pos_;
   in_.putback( cur_char_ );
 }
 
 // throw the error
-void lexer::error( const std::string& error )
+void CLexer::error( const std::string& error )
 {
   std::stringstream st;
   st << "LEXER ERROR:\n";
@@ -184,14 +191,14 @@ void lexer::error( const std::string& error )
   throw std::runtime_error( st.str().c_str() );
 }
 
-void lexer::skip_comments()
+void CLexer::skip_comments()
 {
   skip_ws();
   
-  // skip comments  
-  if( cur_char_ == '/' )
+  for( ;; )
   {
-    if( peek_next() == '*' )
+    // skip comments
+    if( cur_char_ == '/' && peek_next() == '*' )
     {
       next_char();
       bool is_end_of_comment = false;
@@ -208,26 +215,30 @@ void lexer::skip_comments()
           is_end_of_comment = true;
         }
       } while ( ! is_end_of_comment );
+      
+      skip_ws();
+      continue;
     }
     
-    skip_ws();
-  }
-  
-  // skip any preprocessor directive
-  if ( cur_char_ == '#' )
-  {
-    for( next_char(); cur_char_ != '\n'; next_char() )
+    // skip any preprocessor directive
+    if ( cur_char_ == '#' )
     {
-      if ( cur_char_ == '\\' )
-        if( peek_next() == '\n' ) next_char();
-      if ( cur_char_ == EOF ) error ( "the preprocessor directive is not finished in the file" );
+      for( next_char(); cur_char_ != '\n'; next_char() )
+      {
+        if ( cur_char_ == '\\' )
+          if( peek_next() == '\n' ) next_char();
+        if ( cur_char_ == EOF ) error ( "the preprocessor directive is not finished in the file" );
+      }
+      
+      skip_ws();
+      continue;
     }
-
-    next_char();
+    
+    break;
   }
 }
 
-void lexer::skip_ws()
+void CLexer::skip_ws()
 {
   for( next_char();
             cur_char_ == ' '
@@ -239,38 +250,72 @@ void lexer::skip_ws()
      next_char() )
      {
       if ( cur_char_ == '\\' )
+      {
         if( peek_next() == '\n' ) next_char();
         else break;
+      }
      }
 }
 
-bool lexer::isodigit( int _char )
+bool CLexer::isodigit( int _char )
 {
   switch( _char )
   {
-    case 0:case 1:case 2:case 3:case 4:case 5:case 6:case 7: return true;
+    case '0':case '1':case '2':case '3':case '4':case '5':case '6':case '7': return true;
   }
   
   return false;
 }
 
-parser::token lexer::create_token( int _type, const std::string& _str )
+parser::Token::Ptr CLexer::create_token( int _type, const std::string& _str )
 {
-  cur_token_ = parser::token( _type, start_token_pos_, line_num_, _str );
+  cur_token_.reset( new parser::Token( _type, start_token_pos_, line_num_, start_token_abs_pos_, abs_pos_ - start_token_abs_pos_, _str ) );
   return cur_token_;
 }
 
-bool lexer::is_end()
+bool CLexer::is_end()
+{
+  return cur_token_ && cur_token_->type_ == parser::Grammar::SymbolId( EN_EOF );
+}
+
+// read all tokens of the input
+void CLexer::read_tokens()
+{
+  for( get_token(); ! is_end(); get_token() )
+  {
+    if( UNKNOWN == int( cur_token_->type_ ) ) error( "unknown character" );
+    tokens_.push_back( cur_token_ );
+  }
+}
+
+// comparison of tokens by the absolute position
+static bool token_pos_less( const parser::Token::Ptr& _token, unsigned int _pos )
+{
+  return _token->abs_pos_ < _pos;
+}
+
+// return the tokens following the passed one
+parser::Lexer::TokenList CLexer::GetTokens( parser::Token::Ptr _token )
+{
+  TokenList next;
+  TokenList::iterator it = std::lower_bound( tokens_.begin(), tokens_.end(), _token->abs_pos_ + _token->length_, token_pos_less );
+  if( it != tokens_.end() ) next.push_back( *it );
+  return next;
+}
+
+// is the passed token the last one?
+bool CLexer::IsEnd( parser::Token::Ptr _token )
 {
-  return cur_token_.type_ == EOF;
+  return ! tokens_.empty() && _token == tokens_.back();
 }
 
 // return the current token
-parser::token lexer::get_token()
+parser::Token::Ptr CLexer::get_token()
 {
   // skip nonprintable symbols
   skip_comments();
   
+  start_token_abs_pos_ = abs_pos_ - ( EOF == cur_char_ ? 0 : 1 );
   if( cur_char_ == EOF ) return create_token( EOF );
   
   start_token_pos_ = pos_;
@@ -461,7 +506,7 @@ parser::token lexer::get_token()
   if( '"' == cur_char_ )
   {
     std::string _str;
-    for( next_char(); cur_char_ != '"'; next_char() );
+    for( next_char(); cur_char_ != '"'; next_char() )
     {
       if( EOF == cur_char_ ) error( "EOF in constant" );
       else if( '\n' == cur_char_ ) error( "new line in constant" );
@@ -574,7 +619,7 @@ parser::token lexer::get_token()
   return create_token( UNKNOWN );
 }
 
-int lexer::get_keyword( const std::string& _str )
+int CLexer::get_keyword( const std::string& _str )
 {
   keywords_t::iterator it = keywords_.find( _str );
   if( it != keywords_.end() ) return (*it).second;
@@ -583,8 +628,9 @@ int lexer::get_keyword( const std::string& _str )
 }
 
 
-void lexer::init_keywords()
+void CLexer::init_keywords()
 {
+  keywords_[ "sizeof" ]    = SIZEOF;
   keywords_[ "typedef" ]    = TYPEDEF;
   keywords_[ "extern" ]    = EXTERN;
   keywords_[ "static" ]    = STATIC;
@@ -612,6 +658,7 @@ void lexer::init_keywords()
   keywords_[ "if" ]      = IF;
   keywords_[ "else" ]      = ELSE;
   keywords_[ "switch" ]    = SWITCH;
+  keywords_[ "while" ]    = WHILE;
   keywords_[ "do" ]      = DO;
   keywords_[ "for" ]      = FOR;
   keywords_[ "goto" ]      = GOTO;
@@ -622,9 +669,7 @@ void lexer::init_keywords()
 
 // initialize public grammar by c language grammar
 void c_grammar::init_grammar( parser::PublicGrammar* _gr ) {
-  // add terminals
-  _gr->AddTerminal( EN_EOF, "EOF" );
-  _gr->AddTerminal( UNKNOWN, "unknown" );
+  // add terminals, EN_EOF and UNKNOWN are lexer signals and not grammar symbols
   
   _gr->AddTerminal( IDENTIFIER, "IDENTIFIER" );
   
@@ -845,6 +890,7 @@ void c_grammar::init_grammar( parser::PublicGrammar* _gr ) {
   _gr->AddLhsSymbol( postfix_expr__postfix_expr_LEFT_SQ_BRACKET_expr_RIGHT_SQ_BRACKET, postfix_expr );
   _gr->AddRhsSymbol( postfix_expr__postfix_expr_LEFT_SQ_BRACKET_expr_RIGHT_SQ_BRACKET, postfix_expr );
   _gr->AddRhsSymbol( postfix_expr__postfix_expr_LEFT_SQ_BRACKET_expr_RIGHT_SQ_BRACKET, LEFT_SQ_BRACKET );
+  _gr->AddRhsSymbol( postfix_expr__postfix_expr_LEFT_SQ_BRACKET_expr_RIGHT_SQ_BRACKET, expr );
   _gr->AddRhsSymbol( postfix_expr__postfix_expr_LEFT_SQ_BRACKET_expr_RIGHT_SQ_BRACKET, RIGHT_SQ_BRACKET );
   
   _gr->AddRule( postfix_expr__postfix_expr_LEFT_BRACE_RIGHT_BRACE, "postfix_expr --> postfix_expr ( )" );
@@ -495,7 +495,8 @@ identifier
 *****************************************************************************************************************/
 
 #include <string>
-#include <fstream>
+#include <istream>
+#include <ostream>
 #include <map>
 
 #include "grammar.h"
@@ -684,43 +685,59 @@ enum{
 
 typedef std::map< std::string, int >  keywords_t;
 
+// C language lexer, the whole input is split into tokens by the constructor
 class CLexer : public parser::Lexer {
   int              cur_char_;      // the current character
-  std::ifstream        in_;        // input file
+  std::istream&        in_;        // input stream
   unsigned int        pos_;        // current position
+  unsigned int        abs_pos_;      // number of characters read from the input
   unsigned int        start_token_pos_;  // start position of token reading
+  unsigned int        start_token_abs_pos_;  // start absolute position of token reading
   unsigned int        line_num_;      // current line number
   unsigned int        prev_line_len_;    // the length of previous line
-  std::string          file_name_;      // the input file name
   
   keywords_t          keywords_;      // the keyword vs type table
   
-  parser::token        cur_token_;      // the last returned token
+  parser::Token::Ptr      cur_token_;      // the last returned token
+  TokenList          tokens_;      // all tokens of the input
   
 public:
   
-  lexer( const char* _file_name )
+  CLexer( std::istream& _in )
   :
-  file_name_(_file_name),
-  in_( _file_name, std::ios::binary|std::ios::in ),
   cur_char_(0),
+  in_( _in ),
   pos_(0),
+  abs_pos_(0),
   start_token_pos_(0),
+  start_token_abs_pos_(0),
   line_num_(1),
   prev_line_len_(0)
-  {init_tokens(); init_keywords();}
+  {init_tokens(); init_keywords(); read_tokens();}
 
-  // return the current token
-  parser::token        get_token();
+  // return the tokens following the passed one
+  TokenList            GetTokens( parser::Token::Ptr _token );
   
-  // is th end of input?
-  bool            is_end();
+  // is the passed token the last one?
+  bool            IsEnd( parser::Token::Ptr _token );
+
+  // return the number of tokens in the input
+  size_t            get_num_of_tokens() const {return tokens_.size();}
 
     unsigned int                get_line_num() const {return line_num_;}
     unsigned int                get_pos() const {return pos_;}
 
   
 private:
+  // read all tokens of the input
+  void            read_tokens();
+
+  // return the current token
+  parser::Token::Ptr        get_token();
+  
+  // is th end of input?
+  bool            is_end();
+
   // skip whitespaces
   void            skip_ws();
   
@@ -752,17 +769,20 @@ private:
   bool            isodigit( int _char );
   
   // create token of passed type and value
-  parser::token        create_token( int _type, const std::string& _str = "" );
+  parser::Token::Ptr        create_token( int _type, const std::string& _str = "" );
 };
 
+// print token to the ostream
+void              print_token( const parser::Token& _token, std::ostream& _str );
+
 // initialize public grammar by c language grammar
 void              init_grammar( parser::PublicGrammar* );
 
 enum rule{
 
-  // expressions
+  // expressions, rule identifiers start with 1 because 0 is PublicGrammar::kUnknownMapId
   
-  primary_expr__identifier,
+  primary_expr__identifier = 1,
   primary_expr__constant,
   primary_expr__STRING_LITERAL,
   primary_expr__LEFT_BRACE_expr_RIGHT_BRACE,
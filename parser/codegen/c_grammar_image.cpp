@@ -0,0 +1,32 @@
+#include <iostream>
+
+#include <parser/public_grammar.h>
+#include <parser/grammar.h>
+#include <parser/c_grammar.h>
+
+/*!
+ * \brief Запись двоичного образа грамматики языка C.
+ *
+ * Использование: c-grammar-image <образ>
+ *
+ * Грамматика строится c_grammar::init_grammar и сохраняется Grammar::Save. Образ затем превращается в
+ * заголовок программой grammar-codegen, см. add_grammar_tables.
+ */
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <image>\n";
+    return 1;
+  }
+
+  try {
+    parser::PublicGrammar public_grammar("c");
+    c_grammar::init_grammar(&public_grammar);
+    parser::Grammar grammar(&public_grammar);
+    grammar.Save(argv[1]);
+  } catch(const std::exception& err) {
+    std::cerr << err.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cctype>
+
+#include <boost/cstdint.hpp>
+
+#include <parser/grammar.h>
+
+/*!
+ * \brief Генератор заголовка со встроенным образом грамматики.
+ *
+ * Использование: grammar-codegen <образ> <пространство имен> <заголовок>
+ *
+ * Образ, записанный Grammar::Save, загружается для проверки и записывается в заголовок статическим
+ * массивом слов вместе с функцией CreateGrammar, которая строит грамматику из этого массива. Массив
+ * инициализируется константами, поэтому при запуске программы не выполняется никакой работы, а
+ * построение грамматики сводится к копированию таблиц.
+ */
+int main(int argc, char* argv[]) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " <image> <namespace> <header>\n";
+    return 1;
+  }
+
+  try {
+    const std::string image_name = argv[1];
+    const std::string name_space = argv[2];
+    const std::string header_name = argv[3];
+
+    // Загружаем грамматику, чтобы не встроить поврежденный или несовместимый образ, и записываем ее заново.
+    parser::Grammar grammar(image_name);
+    std::ostringstream image;
+    grammar.Save(image);
+    const std::string data = image.str();
+
+    std::string guard;
+    for (std::string::const_iterator it = name_space.begin(); it != name_space.end(); ++it) {
+      guard += std::isalnum(static_cast<unsigned char>(*it)) ? std::toupper(static_cast<unsigned char>(*it)) : '_';
+    }
+    guard += "_GRAMMAR_TABLES_H__";
+
+    std::ofstream out(header_name.c_str());
+    out << "\n"
+        << "// Файл сгенерирован grammar-codegen из " << image_name << ", не редактировать.\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n"
+        << "\n"
+        << "#include <boost/cstdint.hpp>\n"
+        << "\n"
+        << "#include <parser/grammar.h>\n"
+        << "\n"
+        << "namespace " << name_space << " {\n"
+        << "\n"
+        << "//! Двоичный образ грамматики, записанный parser::Grammar::Save.\n"
+        << "static const boost::uint32_t kGrammarImage[] = {";
+
+    // Образ состоит из 64-битных слов, поэтому его размер кратен четырем байтам.
+    std::vector<boost::uint32_t> words(data.size() / sizeof(boost::uint32_t));
+    std::copy(data.begin(), data.end(), reinterpret_cast<char*>(&words[0]));
+    out << std::hex << std::setfill('0');
+    for (size_t i = 0; i < words.size(); ++i) {
+      out << (i % 8 ? " " : "\n  ") << "0x" << std::setw(8) << words[i] << ",";
+    }
+    out << std::dec << "\n"
+        << "};\n"
+        << "\n"
+        << "//! Создание грамматики из встроенного образа.\n"
+        << "inline parser::Grammar* CreateGrammar() {\n"
+        << "  return new parser::Grammar(kGrammarImage, sizeof(kGrammarImage));\n"
+        << "}\n"
+        << "\n"
+        << "} // namespace " << name_space << "\n"
+        << "\n"
+        << "#endif // " << guard << "\n";
+
+    out.flush();
+    if (not out.good()) {
+      std::cerr << "Failed to write " << header_name << "\n";
+      return 1;
+    }
+  } catch(const std::exception& err) {
+    std::cerr << err.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,12 +1,15 @@
 
 
-#define DUMP_CONTENT
+//#define DUMP_CONTENT
+
+#include <algorithm>
 
 #include "earley_parser.h"
 using parser::EarleyParser;
+using parser::Sppf;
 
 //#ifdef DUMP_CONTENT
-void EarleyParser::Item::Dump(Grammar* grammar, std::ostream& out) {
+void EarleyParser::Item::Dump(const Grammar* grammar, std::ostream& out) {
   bool dot_printed = false;
   out << state_number_ << "." << order_number_ << " ";
   out << "[ " << grammar->GetSymbolName(grammar->GetLhsOfRule(rule_id_)) << " --> ";
@@ -30,14 +33,15 @@ void EarleyParser::Item::Dump(Grammar* grammar, std::ostream& out) {
   if (not rptrs_.empty()) {
     out << "<";
     bool first = true;
-    for (Rptr cur = rptrs_.get_first(); not rptrs_.is_end(); cur = rptrs_.get_next()) {
+    for (Rptrs::const_iterator it = rptrs_.begin(); it != rptrs_.end(); ++it) {
+      const Rptr& cur = *it;
       if (cur.item_) {
         if (first) {
           first = false;
         } else {
           out << ", ";
         }
-        out << "(" << cur.item_->state_number_ << "." << cur.item_->order_number_ << ")";
+        out << "(" << (cur.transitive_ ? "L " : "") << cur.item_->state_number_ << "." << cur.item_->order_number_ << ")";
       } else {
         out << "(T)";
       }
@@ -51,51 +55,63 @@ void EarleyParser::Item::Dump(Grammar* grammar, std::ostream& out) {
 }
 //#endif // DUMP_CONTENT
 
-inline EarleyParser::Item* EarleyParser::State::AddItem(EarleyParser* parser, Grammar::RuleId rule_id, unsigned dot, size_t origin, Item* lptr, Item* rptr, Context::Ptr context) {
+inline EarleyParser::Item* EarleyParser::State::AddItem(Grammar::RuleId rule_id, unsigned dot, size_t origin, Item* lptr, Item* rptr, Context::Ptr context) {
   // Получаем идентификатор символа в правой части правила. Если метка стоит в конце правила, то
   // будет возвращен 0, который используется как индекс для меток в конце правила.
   Grammar::SymbolId symbol_id = grammar_->GetRhsOfRule(rule_id, dot);
 
   // Инициализируем ситуацию.
   Item* item = disp_->GetItem(rule_id, dot, origin, lptr);
-  if (context.get()) item->rptrs_.push_back(Item::Rptr(context, rptr));
+  if (context.get()) item->rptrs_.push_back(Item::Rptr(context, rptr), disp_->rptr_pool_);
   item->order_number_ = num_of_items_;
   item->state_number_ = id_;
 
-  // И добавляем ее в соответствующий список.
+  // Внутренняя оценка вывода: оценка ситуации слева, к которой добавляется оценка ситуации "ниже", а у
+  // ситуации с меткой в начале правила -- вес правила.
+  item->score_ = (lptr ? lptr->score_ : grammar_->GetRuleWeight(rule_id)) + (rptr ? rptr->score_ : 0.0f);
+
+  // И добавляем ее в соответствующий список. У завершенной ситуации метку сдвинуть нельзя, для нее
+  // запоминается смещение конца правила.
   items_[symbol_id].elems_.push_back(item);
+  items_[symbol_id].next_offsets_.push_back(grammar_->GetSuffixOffset(rule_id, symbol_id == Grammar::kBadSymbolId ? dot : dot + 1));
   state_items_.push_back(item);
+  size_t capacity = index_.GetCapacity();
+  index_.Insert(item);
+  disp_->index_memory_ += (index_.GetCapacity() - capacity) * sizeof(Item*);
   ++num_of_items_;
 
   // Если символ в левой части правила -- начальный и метка в конце правила, то выставляем соответствующий флаг.
-  if (grammar_->GetLhsOfRule(item->rule_id_) == grammar_->GetStartSymbol() and item->origin_ == 0) {
+  if (symbol_id == Grammar::kBadSymbolId and grammar_->GetLhsOfRule(item->rule_id_) == grammar_->GetStartSymbol() and item->origin_ == 0) {
     is_completed_ = true;
   }
 
-  // Проверка на правило вида A --> epsilon.
-  if (dot == 0 and symbol_id == Grammar::kBadSymbolId) {
-    SymbolItemList& er_item_list = items_with_empty_rules_[grammar_->GetLhsOfRule(rule_id) - grammar_->GetNumOfTerminals() - 1];
-    for (Item* cur = er_item_list.elems_.get_first(); cur; cur = er_item_list.elems_.get_next()) {
-      if (*item == *cur) {
-        return item;
-      }
-    }
-    er_item_list.elems_.push_back(item);
-  }
+  return item;
+}
 
-  // Правило -- это правило вида A --> alpha * B beta. Надо добавить ситуацию для правила B --> epsilon в список
-  // необработанных ситуаций.
-  else if (symbol_id != Grammar::kBadSymbolId and grammar_->IsNonterminal(symbol_id)) {
-    SymbolItemList& er_item_list = items_with_empty_rules_[symbol_id - grammar_->GetNumOfTerminals() - 1];
-    for (Item* cur = er_item_list.elems_.get_first(); cur; cur = er_item_list.elems_.get_next()) {
-      parser->PutItemToNonhandledList(cur, true);
-    }
+inline EarleyParser::Item* EarleyParser::ShiftItem(State* state, Item* item, Item* rptr, Context::Ptr context) {
+  Item* new_item = state->FindItem(item->rule_id_, item->rhs_pos_ + 1, item->origin_, item);
+  if (new_item) {
+    new_item->AddRptr(context, rptr, item_disp_.rptr_pool_);
+    ++stats_.duplicate_items_;
+  } else {
+    new_item = state->AddItem(item->rule_id_, item->rhs_pos_ + 1, item->origin_, item, rptr, context);
+    PutItemToNonhandledList(new_item, true);
+    ++stats_.nullable_items_;
+#   ifdef DUMP_CONTENT
+    new_item->Dump(grammar_, std::cout);
+#   endif
   }
-
-  return item;
+  return new_item;
 }
 
 inline void EarleyParser::Completer(size_t state_id, Item* item) {
+  ++stats_.completer_calls_;
+
+  // Пустые выводы, порожденные в текущем состоянии, уже учтены операцией Predictor.
+  if (item->origin_ == state_id) {
+    return;
+  }
+
   // Текущее состояние.
   State* cur_state = state_disp_.GetState(state_id);
 
@@ -106,15 +122,57 @@ inline void EarleyParser::Completer(size_t state_id, Item* item) {
   // порождена данная ситуация.
   if (cur_state and origin_state) {
     // Список ситуаций с точкой перед символом в левой части правила переданной ситуации.
-    State::SymbolItemList& or_item_list = origin_state->items_[grammar_->GetLhsOfRule(item->rule_id_)];
-    for (Item* cur = or_item_list.elems_.get_first(); cur; cur = or_item_list.elems_.get_next()) {
+    Grammar::SymbolId lhs_symbol = grammar_->GetLhsOfRule(item->rule_id_);
+    BuildPredictedItems(origin_state, lhs_symbol);
+    State::SymbolItemList& or_item_list = origin_state->items_[lhs_symbol];
+
+    // Ситуация будет передана интерпретатору, поэтому ее вывод должен быть построен полностью.
+    if (not or_item_list.elems_.empty() and item->HasTransitiveRptrs()) {
+      ExpandTransitiveRptrs(cur_state, item);
+    }
+
+    // Если для нетерминала есть транзитивная ситуация, то сразу добавляем ситуацию на вершине цепочки.
+    if (options_.use_leo_items_ and not options_.beam_width_ and origin_state != cur_state) {
+      if (State::TransitiveItem* leo = GetTransitiveItem(origin_state, lhs_symbol)) {
+        Item* top = leo->top_;
+        if (not IsViable(cur_state, top->rule_id_, top->rhs_pos_ + 1)) {
+          return;
+        }
+        Item* new_item = cur_state->FindItem(top->rule_id_, top->rhs_pos_ + 1, top->origin_, top);
+        if (new_item) {
+          ++stats_.duplicate_items_;
+        } else {
+          new_item = cur_state->AddItem(top->rule_id_, top->rhs_pos_ + 1, top->origin_, top, NULL, Context::Ptr());
+          PutItemToNonhandledList(new_item, true);
+#         ifdef DUMP_CONTENT
+          new_item->Dump(grammar_, std::cout);
+#         endif
+        }
+        new_item->rptrs_.push_back(Item::Rptr(Context::Ptr(), item, true), item_disp_.rptr_pool_);
+        return;
+      }
+    }
+
+    // Список может пополняться во время обхода, если ситуация порождена в текущем состоянии.
+    for (size_t i = 0; i < or_item_list.elems_.size(); ++i) {
+      // Ситуация со сдвинутой меткой должна продолжаться одним из следующих токенов.
+      if (not IsViable(cur_state, or_item_list.next_offsets_[i])) {
+        continue;
+      }
+      Item* cur = or_item_list.elems_[i];
+
+      // В режиме пучка отбрасываем выводы с оценкой ниже порога.
+      if (not IsInBeam(cur_state, cur, cur->score_ + item->score_)) {
+        continue;
+      }
+
       // Спрашиваем у интерпретатора, нужно ли добавлять новое состояние.
-      Context::Ptr context = interpretator_->HandleNonTerminal(item, cur);
+      Context::Ptr context = HandleNonTerminal(item, cur);
 
       // В случае неоднозначности одна и та же ситуация может обрабатываться несколько раз, проверяем это.
-      if (context.get() and not IsItemInList(cur_state->items_[grammar_->GetRhsOfRule(cur->rule_id_, cur->rhs_pos_ + 1)], cur, item)) {
+      if (context.get() and not IsItemInList(cur_state, cur, item, context)) {
         // Сдвигаем символ после точки в обрабатываемой ситуации и добавляем ее в текущее состояние.
-        Item* new_item = cur_state->AddItem(this, cur->rule_id_, cur->rhs_pos_ + 1, cur->origin_, cur, item, context);
+        Item* new_item = cur_state->AddItem(cur->rule_id_, cur->rhs_pos_ + 1, cur->origin_, cur, item, context);
         PutItemToNonhandledList(new_item, true);
 #       ifdef DUMP_CONTENT
         new_item->Dump(grammar_, std::cout);
@@ -124,67 +182,424 @@ inline void EarleyParser::Completer(size_t state_id, Item* item) {
   }
 }
 
+inline EarleyParser::State::TransitiveItem* EarleyParser::GetTransitiveItem(State* state, Grammar::SymbolId symbol_id) {
+  State::TransitiveItem& leo = state->transitive_items_[symbol_id - grammar_->GetNumOfTerminals() - 1];
+
+  if (leo.status_ == State::TransitiveItem::kUnknown) {
+    leo.status_ = State::TransitiveItem::kAbsent;
+
+    // Ситуация с меткой перед нетерминалом должна быть единственной, а нетерминал -- последним символом правила.
+    // Цепочка продолжается только через более ранние состояния, что исключает циклы.
+    BuildPredictedItems(state, symbol_id);
+    State::SymbolItemList& item_list = state->items_[symbol_id];
+    if (item_list.elems_.size() == 1) {
+      Item* penult = item_list.elems_.front();
+      State* origin_state = state_disp_.GetState(penult->origin_);
+      if (origin_state and origin_state != state
+          and grammar_->GetRhsOfRule(penult->rule_id_, penult->rhs_pos_ + 1) == Grammar::kBadSymbolId) {
+        leo.status_ = State::TransitiveItem::kPresent;
+        leo.penult_ = penult;
+        leo.top_    = penult;
+
+        // Если цепочка продолжается в состоянии, где была порождена ситуация, то берем ее вершину.
+        if (State::TransitiveItem* upper = GetTransitiveItem(origin_state, grammar_->GetLhsOfRule(penult->rule_id_))) {
+          leo.top_ = upper->top_;
+        }
+      }
+    }
+  }
+
+  return leo.status_ == State::TransitiveItem::kPresent ? &leo : NULL;
+}
+
+void EarleyParser::ExpandTransitiveRptrs(State* state, Item* item) {
+  // Отделяем нераскрытые ссылки от остальных, чтобы повторный вход их уже не видел.
+  Item::Rptrs transitive_rptrs, direct_rptrs;
+  while (not item->rptrs_.empty()) {
+    Item::Rptr rptr = item->rptrs_.pop_front(item_disp_.rptr_pool_);
+    if (rptr.transitive_) {
+      transitive_rptrs.push_back(rptr, item_disp_.rptr_pool_);
+    } else {
+      direct_rptrs.push_back(rptr, item_disp_.rptr_pool_);
+    }
+  }
+  item->rptrs_ = direct_rptrs;
+
+  while (not transitive_rptrs.empty()) {
+    ExpandTransitiveRptr(state, item, transitive_rptrs.pop_front(item_disp_.rptr_pool_).item_);
+  }
+}
+
+void EarleyParser::ExpandTransitiveRptr(State* state, Item* top, Item* bottom) {
+  Item* below = bottom;
+  Grammar::SymbolId symbol_id = grammar_->GetLhsOfRule(bottom->rule_id_);
+  State* origin_state = state_disp_.GetState(bottom->origin_);
+
+  // Поднимаемся по цепочке транзитивных ситуаций, сдвигая метку в каждой ситуации с меткой перед последним символом.
+  while (State::TransitiveItem* leo = GetTransitiveItem(origin_state, symbol_id)) {
+    Item* penult = leo->penult_;
+
+    if (below->HasTransitiveRptrs()) {
+      ExpandTransitiveRptrs(state, below);
+    }
+
+    Context::Ptr context = HandleNonTerminal(below, penult);
+    if (not context.get()) {
+      return;
+    }
+
+    // Достигли вершины цепочки.
+    if (penult == top->lptr_) {
+      top->AddRptr(context, below, item_disp_.rptr_pool_);
+      return;
+    }
+
+    // Если промежуточная ситуация уже построена, то цепочка над ней тоже построена, и достаточно
+    // запомнить еще один вывод.
+    if (Item* next = state->FindItem(penult->rule_id_, penult->rhs_pos_ + 1, penult->origin_, penult)) {
+      next->AddRptr(context, below, item_disp_.rptr_pool_);
+      return;
+    }
+
+    below = state->AddItem(penult->rule_id_, penult->rhs_pos_ + 1, penult->origin_, penult, below, context);
+#   ifdef DUMP_CONTENT
+    below->Dump(grammar_, std::cout);
+#   endif
+
+    symbol_id = grammar_->GetLhsOfRule(penult->rule_id_);
+    origin_state = state_disp_.GetState(penult->origin_);
+  }
+}
+
 inline void EarleyParser::Predictor(size_t state_id, Item* item) {
+  ++stats_.predictor_calls_;
+
   // Текущее состояние.
   State* cur_state = state_disp_.GetState(state_id);
 
   // Символ после точки в правой части правила ситуации.
   unsigned sym_after_dot = grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_);
 
-  // Если текущая ситуация еще не была обработана операцией Predictor, то обрабатываем ее.
-  if (cur_state and not cur_state->items_[sym_after_dot].handled_by_predictor_) {
-    // Получаем список правил, в которых данный символ стоит в левой части.
-    Grammar::RuleIdList& rules_list = grammar_->GetSymRules(sym_after_dot - grammar_->GetNumOfTerminals());
-    for (unsigned cur = rules_list.get_first(); not rules_list.is_end(); cur = rules_list.get_next()) {
-      // Добавляем ситуацию на основе этого правила.
-      Item* new_item = cur_state->AddItem(this, cur, 0, cur_state->id_, NULL, NULL, Context::Ptr());
-      PutItemToNonhandledList(new_item, false);
+  if (not cur_state) {
+    return;
+  }
+
+  // Если символ еще не был предсказан в состоянии, то предсказываем сразу все его левоугловое замыкание,
+  // кроме нетерминалов, предсказанных ранее: правила каждого нетерминала добавляются в состояние один раз.
+  if (not cur_state->predicted_[sym_after_dot]) {
+    const Grammar::SymbolSet& closure = grammar_->GetPredictClosure(sym_after_dot - grammar_->GetNumOfTerminals());
+    predictor_symbols_ = closure;
+    predictor_symbols_ -= cur_state->predicted_;
+    cur_state->predicted_ |= closure;
 
+    for (size_t sym_id = predictor_symbols_.find_first(); sym_id != Grammar::SymbolSet::npos; sym_id = predictor_symbols_.find_next(sym_id)) {
+      // Получаем список правил, в которых данный символ стоит в левой части.
+      Grammar::RuleIdRange rules_list = grammar_->GetSymRules(sym_id - grammar_->GetNumOfTerminals());
+      for (Grammar::RuleIdRange::const_iterator rule_it = rules_list.begin(); rule_it != rules_list.end(); ++rule_it) {
+        Grammar::RuleId cur = *rule_it;
+        // Остальные ситуации остаются неявными до сдвига метки. Ситуация для правила могла быть уже построена
+        // при построении пустых выводов. Правила, которые не могут начинаться со следующих токенов, не
+        // предсказываем: их пустые выводы строятся отдельно.
+        if (not grammar_->IsNullable(grammar_->GetRhsOfRule(cur, 0))
+            or cur_state->FindItem(cur, 0, cur_state->id_, NULL) or not IsViable(cur_state, cur, 0)) {
+          continue;
+        }
+
+        // Добавляем ситуацию на основе этого правила.
+        Item* new_item = cur_state->AddItem(cur, 0, cur_state->id_, NULL, NULL, Context::Ptr());
+        PutItemToNonhandledList(new_item, false);
+
+#       ifdef DUMP_CONTENT
+        new_item->Dump(grammar_, std::cout);
+#       endif
+      }
+    }
+  }
+
+  // Если из символа после метки выводится пустая цепочка, то сразу сдвигаем через него метку.
+  if (grammar_->IsNullable(sym_after_dot) and IsViable(cur_state, item->rule_id_, item->rhs_pos_ + 1)) {
+    size_t begin = nullable_completions_.size();
+    GetNullableCompletions(cur_state, sym_after_dot, nullable_completions_);
+    for (size_t i = begin; i < nullable_completions_.size(); ++i) {
+      Item* completion = nullable_completions_[i];
+      Context::Ptr context = HandleNonTerminal(completion, item);
+      if (context.get()) {
+        ShiftItem(cur_state, item, completion, context);
+      }
+    }
+    nullable_completions_.resize(begin);
+  }
+}
+
+inline void EarleyParser::BuildPredictedItems(State* state, Grammar::SymbolId symbol_id) {
+  if (state->materialized_[symbol_id]) {
+    return;
+  }
+  state->materialized_.set(symbol_id);
+
+  // Предсказанная ситуация есть для каждого продолжаемого следующими токенами правила предсказанного
+  // нетерминала, поэтому ищем среди правил, правая часть которых начинается с символа.
+  Grammar::RuleIdRange rules_list = grammar_->GetRulesByFirstSymbol(symbol_id);
+  for (Grammar::RuleIdRange::const_iterator rule_it = rules_list.begin(); rule_it != rules_list.end(); ++rule_it) {
+    Grammar::RuleId cur = *rule_it;
+    if (not state->predicted_[grammar_->GetLhsOfRule(cur)]
+        or not IsViable(state, cur, 0) or state->FindItem(cur, 0, state->id_, NULL)) {
+      continue;
+    }
+
+    // Замыкание состояния уже построено, поэтому в очередь необработанных ситуация не ставится: символ
+    // после метки уже предсказан, а пустые выводы перед ним построены операцией Predictor.
+    const Item* new_item = state->AddItem(cur, 0, state->id_, NULL, NULL, Context::Ptr());
+    (void)new_item;
+
+#   ifdef DUMP_CONTENT
+    new_item->Dump(grammar_, std::cout);
+#   endif
+  }
+}
+
+void EarleyParser::GetNullableCompletions(State* state, Grammar::SymbolId symbol_id, ItemList& completions) {
+  // Для циклических пустых выводов строим только те, которые не проходят через сам нетерминал.
+  size_t nonterm_index = symbol_id - grammar_->GetNumOfTerminals() - 1;
+  if (nullable_in_progress_[nonterm_index]) {
+    return;
+  }
+  nullable_in_progress_[nonterm_index] = true;
+
+  Grammar::RuleIdRange rules_list = grammar_->GetSymRules(symbol_id - grammar_->GetNumOfTerminals());
+  for (Grammar::RuleIdRange::const_iterator rule_it = rules_list.begin(); rule_it != rules_list.end(); ++rule_it) {
+    Grammar::RuleId rule_id = *rule_it;
+    if (not grammar_->IsNullableRule(rule_id)) {
+      continue;
+    }
+
+    // Начальная ситуация правила.
+    Item* cur = state->FindItem(rule_id, 0, state->id_, NULL);
+    if (not cur) {
+      cur = state->AddItem(rule_id, 0, state->id_, NULL, NULL, Context::Ptr());
+      PutItemToNonhandledList(cur, true);
+      ++stats_.nullable_items_;
 #     ifdef DUMP_CONTENT
-      new_item->Dump(grammar_, std::cout);
+      cur->Dump(grammar_, std::cout);
 #     endif
     }
 
-    cur_state->items_[sym_after_dot].handled_by_predictor_ = true;
+    // Сдвигаем метку через каждый символ правой части, строя пустые выводы этих символов.
+    for (unsigned rhs_pos = 0; cur and grammar_->GetRhsOfRule(rule_id, rhs_pos) != Grammar::kBadSymbolId; ++rhs_pos) {
+      Item* next = state->FindItem(rule_id, rhs_pos + 1, state->id_, cur);
+      if (not next) {
+        // Пустые выводы символа кладутся в конец того же списка и убираются после сдвига метки.
+        size_t begin = completions.size();
+        GetNullableCompletions(state, grammar_->GetRhsOfRule(rule_id, rhs_pos), completions);
+        for (size_t i = begin; i < completions.size(); ++i) {
+          Context::Ptr context = HandleNonTerminal(completions[i], cur);
+          if (context.get()) {
+            next = ShiftItem(state, cur, completions[i], context);
+          }
+        }
+        completions.resize(begin);
+      }
+      cur = next;
+    }
+
+    if (cur) {
+      completions.push_back(cur);
+    }
   }
+
+  nullable_in_progress_[nonterm_index] = false;
 }
 
 inline bool EarleyParser::Scanner(size_t state_id, Token::Ptr token, size_t& new_state_id) {
+  if (not CheckBudget()) {
+    return false;
+  }
+  ++stats_.scanner_calls_;
+  if (options_.engine_ == Options::kLr0Engine) {
+    return ScannerLr0(state_id, token, new_state_id);
+  }
+
   // Идентификатор символа, по которому будет производиться сдвиг.
   unsigned cur_symbol_id = grammar_->GetInternalSymbolByExtrernalId(token->type_);
 
-  if (State* cur_state = state_disp_.GetState(state_id)) {
-    // Получаем список ситуаций, у которых точка стоит перед данным символом.
-    State::SymbolItemList& term_item_list = cur_state->items_[cur_symbol_id];
-    if (term_item_list.elems_.size()) {
-      // Создаем новое состояние для данного символа.
-      new_state_id = state_disp_.AddState(token);
-      if (State* next_state = state_disp_.GetState(new_state_id)) {
-        for (Item* cur = term_item_list.elems_.get_first(); cur; cur = term_item_list.elems_.get_next()) {
-          // Спрашиваем у интерпретатора, нужно ли добавлять новое состояние.
-          Context::Ptr context = interpretator_->HandleTerminal(token, cur);
-          if (context.get()) {
-            // Добавляем новую ситуацию со сдвинутой точкой в новое состояние.
-            Item* new_item = next_state->AddItem(this, cur->rule_id_, cur->rhs_pos_ + 1, cur->origin_, cur, NULL, context);
-            PutItemToNonhandledList(new_item, false);
+  State* cur_state = state_disp_.GetState(state_id);
+  if (not cur_state) {
+    return false;
+  }
 
-#           ifdef DUMP_CONTENT
-            new_item->Dump(grammar_, std::cout);
-#           endif
-          }
-        }
-        return true;
-      }
+  // Получаем список ситуаций, у которых точка стоит перед данным символом.
+  BuildPredictedItems(cur_state, cur_symbol_id);
+  State::SymbolItemList& term_item_list = cur_state->items_[cur_symbol_id];
+  if (term_item_list.elems_.empty()) {
+    return false;
+  }
+
+  // Следующие токены нужны до добавления ситуаций, чтобы отбросить те, которые ими не продолжаются. Если
+  // состояние для позиции конца токена уже создано, они у него уже есть.
+  State* next_state = FindPendingState(token->abs_pos_ + token->length_);
+  if (not next_state) {
+    GetLookahead(token, scanner_tokens_, scanner_lookahead_);
+  }
+  const Grammar::SymbolSet& lookahead = next_state ? next_state->lookahead_ : scanner_lookahead_;
+  bool viable = not options_.use_lookahead_;
+  for (size_t i = 0; i < term_item_list.elems_.size() and not viable; ++i) {
+    viable = grammar_->CanSuffixStartWith(term_item_list.next_offsets_[i], lookahead);
+  }
+  if (not viable) {
+    return false;
+  }
+
+  if (not next_state) {
+    // Создаем новое состояние для позиции конца токена. Обмен вместо копирования: буферы состояния
+    // от предыдущих разборов станут рабочими.
+    next_state = AddPendingState(token);
+    next_state->next_tokens_.swap(scanner_tokens_);
+    next_state->lookahead_.swap(scanner_lookahead_);
+  }
+  next_state->transitions_.push_back(State::Transition(state_id, token));
+  new_state_id = next_state->id_;
+
+  // В режиме пучка переносятся только лучшие ситуации.
+  size_t num_of_items = options_.beam_width_ ? SelectBeamItems(next_state, term_item_list) : term_item_list.elems_.size();
+  for (size_t n = 0; n < num_of_items; ++n) {
+    size_t i = options_.beam_width_ ? beam_items_[n].second : n;
+    if (not IsViable(next_state, term_item_list.next_offsets_[i])) {
+      continue;
+    }
+    Item* cur = term_item_list.elems_[i];
+    if (next_state->FindItem(cur->rule_id_, cur->rhs_pos_ + 1, cur->origin_, cur)) {
+      continue;
+    }
+
+    // Спрашиваем у интерпретатора, нужно ли добавлять новое состояние.
+    Context::Ptr context = HandleTerminal(token, cur);
+    if (context.get()) {
+      // Добавляем новую ситуацию со сдвинутой точкой в новое состояние. В очередь необработанных она
+      // попадет при замыкании состояния.
+      const Item* new_item = next_state->AddItem(cur->rule_id_, cur->rhs_pos_ + 1, cur->origin_, cur, NULL, context);
+      (void)new_item;
+
+#     ifdef DUMP_CONTENT
+      new_item->Dump(grammar_, std::cout);
+#     endif
     }
   }
+  return true;
+}
+
+namespace {
+
+//! Порядок ситуаций по убыванию оценки.
+struct ItemScoreGreater {
+  template <class ItemPtr>
+  bool operator()(ItemPtr lhs, ItemPtr rhs) const {
+    return lhs->score_ > rhs->score_;
+  }
+};
 
-  return false;
+//! Порядок пар (оценка, номер) по возрастанию номера.
+struct IndexLess {
+  bool operator()(const std::pair<float, size_t>& lhs, const std::pair<float, size_t>& rhs) const {
+    return lhs.second < rhs.second;
+  }
+};
+
+} // namespace
+
+size_t EarleyParser::SelectBeamItems(State* next_state, const State::SymbolItemList& item_list) {
+  beam_items_.clear();
+  for (size_t i = 0; i < item_list.elems_.size(); ++i) {
+    Item* cur = item_list.elems_[i];
+    if (IsViable(next_state, item_list.next_offsets_[i])
+        and not next_state->FindItem(cur->rule_id_, cur->rhs_pos_ + 1, cur->origin_, cur)) {
+      beam_items_.push_back(std::make_pair(GetBeamScore(cur->origin_, cur->score_), i));
+    }
+  }
+  if (beam_items_.empty()) {
+    return 0;
+  }
+
+  // Ширина пучка ограничивает ситуации состояния вместе с перенесенными ранее токенами той же длины.
+  size_t free_slots = options_.beam_width_ > next_state->state_items_.size() ? options_.beam_width_ - next_state->state_items_.size() : 0;
+  if (beam_items_.size() > free_slots) {
+    std::nth_element(beam_items_.begin(), beam_items_.begin() + free_slots, beam_items_.end(), BeamOrder());
+    beam_items_.resize(free_slots);
+  }
+
+  // Порог отсчитывается от лучшей незавершенной ситуации состояния.
+  for (size_t i = 0; i < beam_items_.size(); ++i) {
+    Item* cur = item_list.elems_[beam_items_[i].second];
+    if (beam_items_[i].first > next_state->best_score_
+        and grammar_->GetRhsOfRule(cur->rule_id_, cur->rhs_pos_ + 1) != Grammar::kBadSymbolId) {
+      next_state->best_score_ = beam_items_[i].first;
+    }
+  }
+  size_t num_of_items = 0;
+  for (size_t i = 0; i < beam_items_.size(); ++i) {
+    if (beam_items_[i].first >= next_state->best_score_ - options_.beam_threshold_) {
+      beam_items_[num_of_items++] = beam_items_[i];
+    }
+  }
+  beam_items_.resize(num_of_items);
+
+  // Порядок добавления ситуаций сохраняется таким же, как без пучка.
+  std::sort(beam_items_.begin(), beam_items_.end(), IndexLess());
+  return beam_items_.size();
+}
+
+inline EarleyParser::State* EarleyParser::FindPendingState(size_t position) {
+  // Незамкнутых состояний не больше, чем разных длин токенов, поэтому достаточно линейного поиска.
+  for (size_t i = 0; i < pending_states_.size(); ++i) {
+    if (pending_states_[i].first == position) {
+      return state_disp_.GetState(pending_states_[i].second);
+    }
+  }
+  return NULL;
+}
+
+inline EarleyParser::State* EarleyParser::AddPendingState(Token::Ptr token) {
+  size_t state_id = state_disp_.AddState(token);
+  State* state = state_disp_.GetState(state_id);
+  pending_states_.push_back(PendingState(state->position_, state_id));
+  return state;
+}
+
+inline bool EarleyParser::PopPendingState(size_t& state_id) {
+  if (pending_states_.empty()) {
+    return false;
+  }
+
+  size_t min_index = 0;
+  for (size_t i = 1; i < pending_states_.size(); ++i) {
+    if (pending_states_[i].first < pending_states_[min_index].first) {
+      min_index = i;
+    }
+  }
+  state_id = pending_states_[min_index].second;
+  pending_states_[min_index] = pending_states_.back();
+  pending_states_.pop_back();
+  return true;
 }
 
 inline void EarleyParser::Closure(size_t state_id) {
+  if (options_.engine_ == Options::kLr0Engine) {
+    ClosureLr0(state_id);
+    return;
+  }
+
+  // Ситуации, добавленные в состояние операцией Scanner, ставим в очередь необработанных.
+  State* state = state_disp_.GetState(state_id);
+  for (size_t i = 0; i < state->state_items_.size(); ++i) {
+    PutItemToNonhandledList(state->state_items_[i], true);
+  }
+
   // Проходим по необработанным ситуациям и обрабатываем их операциями Completer или Predictor.
   while (not nonhandled_items_.empty()) {
+    if (not CheckBudget()) {
+      return;
+    }
     Item* item = nonhandled_items_.pop();
+    item->queued_ = false;
     unsigned sym_index = grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_);
     // Если у ситуации точка в конце правила, то надо применить операцию Completer.
     if (sym_index == Grammar::kBadSymbolId) {
@@ -196,17 +611,57 @@ inline void EarleyParser::Closure(size_t state_id) {
   }
 }
 
+inline void EarleyParser::GetLookahead(Token::Ptr token, Lexer::TokenList& tokens, Grammar::SymbolSet& lookahead) {
+  lookahead.resize(grammar_->GetNumOfTerminals() + 1);
+
+  // Без лексического анализатора токены передаются по одному, и продолжением может быть любой терминал.
+  if (not lexer_) {
+    tokens.clear();
+    lookahead.set();
+    lookahead.reset(0);
+    return;
+  }
+
+  tokens = lexer_->GetTokens(token);
+  lookahead.reset();
+  for (Lexer::TokenList::const_iterator it = tokens.begin(); it != tokens.end(); ++it) {
+    Grammar::SymbolId symbol_id = grammar_->GetInternalSymbolByExtrernalId((*it)->type_);
+    if (not grammar_->IsNonterminal(symbol_id)) {
+      lookahead.set(symbol_id);
+    }
+  }
+}
+
 inline bool EarleyParser::InitFirstState(size_t& state_id) {
   state_id = state_disp_.AddState(Token::Ptr(new Token()));
   State* next_state = state_disp_.GetState(state_id);
-  Grammar::RuleIdList& rules_list = grammar_->GetSymRules(grammar_->GetStartSymbol() - grammar_->GetNumOfTerminals());
+  GetLookahead(next_state->token_, next_state->next_tokens_, next_state->lookahead_);
+
+  if (options_.engine_ == Options::kLr0Engine) {
+    const Lr0Automaton& automaton = grammar_->GetLr0Automaton();
+    if (automaton.GetStartState() == Lr0Automaton::kBadStateId) {
+      return false;
+    }
+    AddLr0Item(next_state, automaton.GetStartState(), state_id);
+    return true;
+  }
+
+  Grammar::RuleIdRange rules_list = grammar_->GetSymRules(grammar_->GetStartSymbol() - grammar_->GetNumOfTerminals());
+
+  // Оценка пустого префикса.
+  next_state->best_score_ = 0.0f;
 
   if (rules_list.empty()) {
     return false;
   }
 
-  for (unsigned cur = rules_list.get_first(); not rules_list.is_end(); cur = rules_list.get_next()) {
-    Item* new_item = next_state->AddItem(this, cur, 0, state_id, NULL, NULL, Context::Ptr());
+  for (Grammar::RuleIdRange::const_iterator rule_it = rules_list.begin(); rule_it != rules_list.end(); ++rule_it) {
+    Grammar::RuleId cur = *rule_it;
+    if (not IsViable(next_state, cur, 0)) {
+      continue;
+    }
+
+    Item* new_item = next_state->AddItem(cur, 0, state_id, NULL, NULL, Context::Ptr());
     PutItemToNonhandledList(new_item, false);
 
 #   ifdef DUMP_CONTENT
@@ -214,67 +669,1155 @@ inline bool EarleyParser::InitFirstState(size_t& state_id) {
 #   endif
   }
 
-  next_state->items_[grammar_->GetStartSymbol()].handled_by_predictor_ = true;
+  next_state->predicted_.set(grammar_->GetStartSymbol());
 
   return true;
 }
 
 bool EarleyParser::Parse() {
+  // Освобождаем состояния и ситуации предыдущего запуска.
+  Reset();
+  StartBudget();
+
   // Сообщаем интерпретатору о начале работы.
   interpretator_->Start(this);
 
-  // Инициализируем начальное состояние.
+  // В режиме построения леса разбора и отложенной семантики сдвиги символов принимаются без обращения к интерпретатору.
+  handler_ = (options_.build_forest_ or options_.defer_semantics_) ? &forest_recorder_ : interpretator_;
+
+  // Инициализируем начальное состояние, оно замыкается первым.
   size_t first_state_id = 0;
   if (not InitFirstState(first_state_id)) {
     return false;
   }
-  Closure(first_state_id);
-
-  // Проходим по цепочке (дереву при неоднозначности) терминалов, возвращаемой лексическим анализатором.
-  StateList cur_gen_states, res_states;
-  cur_gen_states.push_back(first_state_id);
-  while (not cur_gen_states.empty()) {
-    // Обрабатываем все состояния из текущего множества.
-    StateList next_gen_states;
-    while (not cur_gen_states.empty()) {
-      size_t state_id = cur_gen_states.pop_front();
-      State* state = state_disp_.GetState(state_id);
-
-      // Получаем список токенов, идущих за данным.
-      Lexer::TokenList tokens = lexer_->GetTokens(state->token_);
-      for (Lexer::TokenList::iterator it = tokens.begin(); it != tokens.end(); ++it) {
-        // Для каждого токена осуществляем сдвиг и итеративно применяем операции Completer и Predictor.
-        size_t new_state_id = 0;
-        if (Scanner(state_id, *it, new_state_id)) {
-          Closure(new_state_id);
-          next_gen_states.push_back(new_state_id);
-          if (lexer_->IsEnd(*it)) {
-            res_states.push_back(new_state_id);
-          }
-        }
+  pending_states_.push_back(PendingState(state_disp_.GetState(first_state_id)->position_, first_state_id));
+
+  return ParseStates();
+}
+
+bool EarleyParser::Reparse(size_t position) {
+  if (closed_states_.empty()) {
+    return Parse();
+  }
+
+  // Состояние сохраняется, если все следующие за ним токены заканчиваются до измененного участка: тогда
+  // ни оно, ни предшествующие ему состояния от изменения не зависят. Состояние без следующих токенов могло
+  // получиться из-за ошибки лексического анализа, которую могло исправить изменение, поэтому оно не сохраняется.
+  size_t keep_end = position;
+  for (size_t i = 0; i < closed_states_.size(); ++i) {
+    State* state = state_disp_.GetState(closed_states_[i]);
+    if (state->position_ >= keep_end) {
+      break;
+    }
+
+    bool unchanged = not state->next_tokens_.empty();
+    const Lexer::TokenList& tokens = state->next_tokens_;
+    for (Lexer::TokenList::const_iterator it = tokens.begin(); it != tokens.end() and unchanged; ++it) {
+      unchanged = (*it)->abs_pos_ + (*it)->length_ < position;
+    }
+    if (not unchanged) {
+      keep_end = state->position_;
+      break;
+    }
+  }
+
+  // Состояния замыкались в порядке позиций, поэтому сохраняемые образуют начало списка.
+  size_t num_of_kept = 0;
+  while (num_of_kept < closed_states_.size() and state_disp_.GetState(closed_states_[num_of_kept])->position_ < keep_end) {
+    ++num_of_kept;
+  }
+  if (num_of_kept == 0) {
+    return Parse();
+  }
+
+  // Освобождаем остальные состояния вместе с их ситуациями.
+  for (size_t i = num_of_kept; i < closed_states_.size(); ++i) {
+    State* state = state_disp_.GetState(closed_states_[i]);
+    for (size_t j = 0; j < state->state_items_.size(); ++j) {
+      item_disp_.FreeItem(state->state_items_[j]);
+    }
+    state_disp_.FreeState(closed_states_[i]);
+  }
+  closed_states_.resize(num_of_kept);
+  end_states_.clear();
+  forest_.Clear();
+
+  // Сохраненные состояния не должны ссылаться на освобожденные.
+  for (size_t i = 0; i < closed_states_.size(); ++i) {
+    std::vector<size_t>& descendants = state_disp_.GetState(closed_states_[i])->lr0_descendants_;
+    size_t num_of_valid = 0;
+    for (size_t j = 0; j < descendants.size(); ++j) {
+      if (state_disp_.GetState(descendants[j])) {
+        descendants[num_of_valid++] = descendants[j];
       }
     }
+    descendants.resize(num_of_valid);
+  }
+
+  interpretator_->Start(this);
+  handler_ = (options_.build_forest_ or options_.defer_semantics_) ? &forest_recorder_ : interpretator_;
+  StartBudget();
+
+  // Повторяем сдвиги из сохраненных состояний в освобожденные и продолжаем разбор.
+  {
+    PhaseTimer timer(stats_.recognition_seconds_);
+    for (size_t i = 0; i < closed_states_.size(); ++i) {
+      ScanTokens(closed_states_[i], keep_end);
+    }
+  }
+  return ParseStates();
+}
+
+inline void EarleyParser::ScanTokens(size_t state_id, size_t min_position) {
+  // Копия списка не нужна: состояния хранятся в деке и не перемещаются при добавлении новых.
+  const Lexer::TokenList& tokens = state_disp_.GetState(state_id)->next_tokens_;
+  for (Lexer::TokenList::const_iterator it = tokens.begin(); it != tokens.end(); ++it) {
+    if ((*it)->abs_pos_ + (*it)->length_ < min_position) {
+      continue;
+    }
+
+    size_t new_state_id = 0;
+    if (Scanner(state_id, *it, new_state_id) and lexer_->IsEnd(*it)
+        and std::find(end_states_.begin(), end_states_.end(), new_state_id) == end_states_.end()) {
+      end_states_.push_back(new_state_id);
+    }
+  }
+}
 
-    // Проделываем следующую итерацию над следующем множеством состояний.
-    cur_gen_states = next_gen_states;
+bool EarleyParser::ParseStates() {
+  // Проходим по решетке терминалов, возвращаемой лексическим анализатором. Состояния обрабатываются в порядке
+  // позиций во входном потоке: к моменту замыкания состояния в него сделаны сдвиги из всех предшествующих.
+  {
+    PhaseTimer timer(stats_.recognition_seconds_);
+    size_t state_id = 0;
+    while (not IsStopped() and PopPendingState(state_id)) {
+      // Итеративно применяем операции Completer и Predictor, затем сдвигаем каждый следующий токен
+      // в состояние позиции его конца.
+      Closure(state_id);
+      closed_states_.push_back(state_id);
+      ScanTokens(state_id, 0);
+    }
+  }
+  if (IsStopped()) {
+    Abort();
+    return false;
   }
 
   // Проходим по списку состояний, построенных для последних символов в потоке.
-  bool parse_well = false;
-  for (size_t state_id = res_states.get_first(); not res_states.is_end(); state_id = res_states.get_next()) {
-    State* state = state_disp_.GetState(state_id);
-    for (Item* item = state->state_items_.get_first(); not  state->state_items_.is_end(); item = state->state_items_.get_next()) {
-      if (grammar_->GetLhsOfRule(item->rule_id_) == grammar_->GetStartSymbol() and item->origin_ == 0) {
-        parse_well = true;
-        interpretator_->End(item);
+  std::vector<Item*> accepted_items;
+  {
+    PhaseTimer timer(stats_.derivation_seconds_);
+    for (size_t r = 0; r < end_states_.size(); ++r) {
+      State* state = state_disp_.GetState(end_states_[r]);
+
+      // В режиме LR(0) автомата восстанавливаем ситуации для выводов начального символа из начального состояния.
+      if (options_.engine_ == Options::kLr0Engine) {
+        Grammar::RuleIdRange rules_list = grammar_->GetSymRules(grammar_->GetStartSymbol() - grammar_->GetNumOfTerminals());
+        for (Grammar::RuleIdRange::const_iterator rule_it = rules_list.begin(); rule_it != rules_list.end(); ++rule_it) {
+          std::vector<Item*> items = DeriveItems(state, *rule_it, grammar_->GetRhsLength(*rule_it), 0);
+          accepted_items.insert(accepted_items.end(), items.begin(), items.end());
+        }
+        continue;
+      }
+
+      // Раскрываем цепочки транзитивных ситуаций, чтобы построить все завершенные ситуации состояния.
+      ItemList transitive_items;
+      for (size_t i = 0; i < state->state_items_.size(); ++i) {
+        if (state->state_items_[i]->HasTransitiveRptrs()) {
+          transitive_items.push_back(state->state_items_[i]);
+        }
+      }
+      for (size_t i = 0; i < transitive_items.size(); ++i) {
+        ExpandTransitiveRptrs(state, transitive_items[i]);
+      }
+
+      // Вывод успешен, если в состоянии есть завершенная ситуация для начального символа, порожденная в начальном состоянии.
+      for (size_t i = 0; i < state->state_items_.size(); ++i) {
+        Item* item = state->state_items_[i];
+        if (grammar_->GetLhsOfRule(item->rule_id_) == grammar_->GetStartSymbol() and item->origin_ == 0
+            and grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_) == Grammar::kBadSymbolId) {
+          accepted_items.push_back(item);
+        }
       }
     }
+
+    if (options_.beam_width_ and options_.engine_ != Options::kLr0Engine) {
+      SelectBestDerivations(accepted_items);
+    }
+
+    if (options_.defer_semantics_) {
+      EvaluateDeferred(accepted_items);
+    }
+
+    // Лес строится до вызовов End, чтобы интерпретатор получил его целиком.
+    if (options_.build_forest_) {
+      BuildForest(accepted_items);
+    }
+  }
+
+  // Ограничения проверяются и при восстановлении ситуаций LR(0) автомата и построении леса.
+  if (IsStopped()) {
+    Abort();
+    return false;
+  }
+  CollectStateStats();
+
+  {
+    PhaseTimer timer(stats_.end_seconds_);
+    for (size_t i = 0; i < accepted_items.size(); ++i) {
+      interpretator_->End(accepted_items[i]);
+    }
+    stats_.end_calls_ += accepted_items.size();
   }
 
-  return parse_well;
+  status_ = accepted_items.empty() ? kRejected : kAccepted;
+  boost::mutex::scoped_lock lock(cancel_mutex_);
+  cancel_requested_ = false;
+  return not accepted_items.empty();
 }
 
-void EarleyParser::Reset() {
+bool EarleyParser::StartPush() {
+  Reset();
+  StartBudget();
+  SetLexer(NULL);
+  interpretator_->Start(this);
+  handler_ = (options_.build_forest_ or options_.defer_semantics_) ? &forest_recorder_ : interpretator_;
+
+  if (not InitFirstState(push_state_id_)) {
+    return false;
+  }
+  PhaseTimer timer(stats_.recognition_seconds_);
+  Closure(push_state_id_);
+  closed_states_.push_back(push_state_id_);
+  push_release_limit_ = 2 * closed_states_.size() + kMinReleaseInterval;
+  return true;
+}
+
+bool EarleyParser::PushToken(Token::Ptr token) {
+  PhaseTimer timer(stats_.recognition_seconds_);
+  size_t new_state_id = 0;
+  if (not Scanner(push_state_id_, token, new_state_id)) {
+    if (IsStopped()) {
+      Abort();
+    }
+    return false;
+  }
+
+  // Состояние создано, но интерпретатор мог отказаться от всех сдвигов -- тогда токен отбрасывается.
+  pending_states_.clear();
+  Closure(new_state_id);
+  if (IsStopped()) {
+    Abort();
+    return false;
+  }
+  State* state = state_disp_.GetState(new_state_id);
+  if (state->state_items_.empty() and state->lr0_items_.empty()) {
+    state_disp_.FreeState(new_state_id);
+    return false;
+  }
+  closed_states_.push_back(new_state_id);
+  push_state_id_ = new_state_id;
+
+  // Недостижимые состояния освобождаются, когда их число сравнивается с числом живых, поэтому обход живых
+  // ситуаций в среднем занимает постоянное время на токен.
+  if (CanReleaseStates() and closed_states_.size() >= push_release_limit_) {
+    ReleaseStates();
+    push_release_limit_ = 2 * closed_states_.size() + kMinReleaseInterval;
+  }
+  return true;
+}
+
+void EarleyParser::GetExpectedTerminals(std::vector<Grammar::SymbolId>& terminals) {
+  terminals.clear();
+  State* state = state_disp_.GetState(push_state_id_);
+  if (not state) {
+    return;
+  }
+
+  Grammar::SymbolSet expected(grammar_->GetNumOfTerminals() + 1);
+  if (options_.engine_ == Options::kLr0Engine) {
+    const Lr0Automaton& automaton = grammar_->GetLr0Automaton();
+    for (size_t i = 0; i < state->lr0_items_.size(); ++i) {
+      for (Grammar::SymbolId symbol_id = 1; symbol_id <= grammar_->GetNumOfTerminals(); ++symbol_id) {
+        if (automaton.Goto(state->lr0_items_[i].dfa_state_, symbol_id) != Lr0Automaton::kBadStateId) {
+          expected.set(symbol_id);
+        }
+      }
+    }
+  } else {
+    // Ситуации с меткой перед терминалом хранятся в списке этого терминала.
+    for (Grammar::SymbolId symbol_id = 1; symbol_id <= grammar_->GetNumOfTerminals(); ++symbol_id) {
+      BuildPredictedItems(state, symbol_id);
+      if (not state->items_[symbol_id].elems_.empty()) {
+        expected.set(symbol_id);
+      }
+    }
+  }
+
+  for (size_t symbol_id = expected.find_first(); symbol_id != Grammar::SymbolSet::npos; symbol_id = expected.find_next(symbol_id)) {
+    terminals.push_back(grammar_->GetIdBySymbol(symbol_id));
+  }
+}
+
+bool EarleyParser::FinishPush() {
+  end_states_.assign(1, push_state_id_);
+  return ParseStates();
+}
+
+void EarleyParser::ReleaseStates() {
+  // Помечаем живые состояния и ситуации, начиная с последнего состояния.
+  boost::unordered_set<size_t> live_states;
+  boost::unordered_set<Item*> live_items;
+  StateList stack(1, push_state_id_);
+  live_states.insert(push_state_id_);
+  while (not stack.empty()) {
+    size_t state_id = stack.back();
+    State* state = state_disp_.GetState(state_id);
+    stack.pop_back();
+    for (size_t i = 0; i < state->state_items_.size(); ++i) {
+      Item* item = state->state_items_[i];
+      // Цепочку lptr_ интерпретатор обходит при завершении правила, поэтому ее ситуации сохраняются и из
+      // освобождаемых состояний.
+      Item* cur = item;
+      while (cur and live_items.insert(cur).second) {
+        cur = cur->lptr_;
+      }
+
+      // Состояние порождения нужно операции Completer, только если метка ситуации еще может сдвинуться: в
+      // последнем состоянии -- перед любым символом, в остальных -- перед нетерминалом.
+      Grammar::SymbolId symbol_id = grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_);
+      bool active = state_id == push_state_id_ ? symbol_id != Grammar::kBadSymbolId : grammar_->IsNonterminal(symbol_id);
+      if (active and live_states.insert(item->origin_).second) {
+        stack.push_back(item->origin_);
+      }
+    }
+  }
+
+  // Освобождаем остальные состояния. Ситуации живых состояний все помечены, поэтому непомеченные
+  // ситуации принадлежат освобождаемым.
+  size_t num_of_live = 0;
+  for (size_t i = 0; i < closed_states_.size(); ++i) {
+    size_t state_id = closed_states_[i];
+    if (live_states.count(state_id)) {
+      closed_states_[num_of_live++] = state_id;
+      continue;
+    }
+
+    State* state = state_disp_.GetState(state_id);
+    for (size_t j = 0; j < state->state_items_.size(); ++j) {
+      if (live_items.count(state->state_items_[j])) {
+        released_items_.push_back(state->state_items_[j]);
+      } else {
+        item_disp_.FreeItem(state->state_items_[j]);
+      }
+    }
+    state_disp_.FreeState(state_id);
+  }
+  closed_states_.resize(num_of_live);
+
+  // Ситуации, сохраненные из освобожденных ранее состояний, освобождаются, когда выходят из цепочек.
+  size_t num_of_released = 0;
+  for (size_t i = 0; i < released_items_.size(); ++i) {
+    if (live_items.count(released_items_[i])) {
+      released_items_[num_of_released++] = released_items_[i];
+    } else {
+      item_disp_.FreeItem(released_items_[i]);
+    }
+  }
+  released_items_.resize(num_of_released);
+
+  for (boost::unordered_set<Item*>::const_iterator it = live_items.begin(); it != live_items.end(); ++it) {
+    for (Item::Rptrs::iterator rptr = (*it)->rptrs_.begin(); rptr != (*it)->rptrs_.end(); ++rptr) {
+      if (rptr->item_ and not live_items.count(rptr->item_)) {
+        rptr->item_ = NULL;
+      }
+    }
+  }
+}
+
+Sppf::NodeId EarleyParser::GetForestNode(const Item* item) {
+  if (grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_) == Grammar::kBadSymbolId) {
+    return forest_.AddSymbolNode(grammar_->GetLhsOfRule(item->rule_id_), item->origin_, item->state_number_);
+  }
+  return forest_.AddIntermediateNode(item->rule_id_, item->rhs_pos_, item->origin_, item->state_number_);
+}
+
+void EarleyParser::SelectBestDerivations(std::vector<Item*>& roots) {
+  // Оценки, увеличенные после построения ситуаций, не распространялись в построенные из них ситуации,
+  // поэтому сначала пересчитываем оценки всех ситуаций выводов. Оценки только растут, а циклы выводов
+  // с неположительным весом их не увеличивают, поэтому хватает числа проходов, равного числу ситуаций.
+  std::vector<Item*> items;
+  boost::unordered_set<Item*> reached;
+  for (size_t i = 0; i < roots.size(); ++i) {
+    if (reached.insert(roots[i]).second) {
+      items.push_back(roots[i]);
+    }
+  }
+  for (size_t i = 0; i < items.size(); ++i) {
+    Item* item = items[i];
+    if (item->lptr_ and reached.insert(item->lptr_).second) {
+      items.push_back(item->lptr_);
+    }
+    for (Item::Rptrs::const_iterator it = item->rptrs_.begin(); it != item->rptrs_.end(); ++it) {
+      if (it->item_ and reached.insert(it->item_).second) {
+        items.push_back(it->item_);
+      }
+    }
+  }
+  bool changed = true;
+  for (size_t pass = 0; changed and pass < items.size(); ++pass) {
+    changed = false;
+    for (size_t i = items.size(); i > 0; --i) {
+      Item* item = items[i - 1];
+      if (not item->lptr_) {
+        continue;
+      }
+      for (Item::Rptrs::const_iterator it = item->rptrs_.begin(); it != item->rptrs_.end(); ++it) {
+        float score = item->lptr_->score_ + (it->item_ ? it->item_->score_ : 0.0f);
+        if (score > item->score_) {
+          item->score_ = score;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  std::stable_sort(roots.begin(), roots.end(), ItemScoreGreater());
+  if (options_.k_best_ and roots.size() > options_.k_best_) {
+    roots.resize(options_.k_best_);
+  }
+
+  // Обходим ситуации выводов и оставляем у каждой не больше k_best_ лучших ссылок, лучшую -- первой.
+  // Ссылки с равными оценками сохраняют исходный порядок.
+  boost::unordered_set<Item*> visited;
+  std::vector<Item*> stack(roots.begin(), roots.end());
+  std::vector<Item::Rptr> rptrs;
+  std::vector<std::pair<float, size_t> > order;
+  while (not stack.empty()) {
+    Item* item = stack.back();
+    stack.pop_back();
+    if (not item or not visited.insert(item).second) {
+      continue;
+    }
+    stack.push_back(item->lptr_);
+
+    rptrs.clear();
+    order.clear();
+    while (not item->rptrs_.empty()) {
+      const Item::Rptr& rptr = item->rptrs_.front();
+      order.push_back(std::make_pair(-(rptr.item_ ? rptr.item_->score_ : 0.0f), rptrs.size()));
+      rptrs.push_back(rptr);
+      item->rptrs_.pop_front(item_disp_.rptr_pool_);
+    }
+    std::sort(order.begin(), order.end());
+    if (options_.k_best_ and order.size() > options_.k_best_) {
+      order.resize(options_.k_best_);
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+      const Item::Rptr& rptr = rptrs[order[i].second];
+      item->rptrs_.push_back(rptr, item_disp_.rptr_pool_);
+      stack.push_back(rptr.item_);
+    }
+  }
+}
+
+void EarleyParser::EvaluateDeferred(std::vector<Item*>& roots) {
+  // Обход в глубину без рекурсии: ситуация вычисляется, когда вычислены ее lptr и все ситуации из rptrs.
+  typedef std::pair<Item*, bool> StackEntry;
+  std::vector<StackEntry> stack;
+  DeferredStatusMap status;
+  for (size_t i = roots.size(); i > 0; --i) {
+    stack.push_back(StackEntry(roots[i - 1], false));
+  }
+
+  while (not stack.empty()) {
+    StackEntry entry = stack.back();
+    stack.pop_back();
+    Item* item = entry.first;
+    if (entry.second) {
+      EvaluateDeferredItem(item, status);
+      continue;
+    }
+    if (not status.insert(std::make_pair(item, kDeferredVisiting)).second) {
+      continue;
+    }
+
+    if (options_.use_leo_items_ and item->HasTransitiveRptrs()) {
+      ExpandTransitiveRptrs(state_disp_.GetState(item->state_number_), item);
+    }
+    stack.push_back(StackEntry(item, true));
+    if (item->lptr_) {
+      stack.push_back(StackEntry(item->lptr_, false));
+    }
+    for (Item::Rptrs::const_iterator it = item->rptrs_.begin(); it != item->rptrs_.end(); ++it) {
+      if (it->item_) {
+        stack.push_back(StackEntry(it->item_, false));
+      }
+    }
+  }
+
+  // Оставляем только те завершенные ситуации, у которых есть принятые интерпретатором выводы.
+  std::vector<Item*> alive;
+  for (size_t i = 0; i < roots.size(); ++i) {
+    if (status[roots[i]] == kDeferredAlive) {
+      alive.push_back(roots[i]);
+    }
+  }
+  roots.swap(alive);
+}
+
+void EarleyParser::EvaluateDeferredItem(Item* item, DeferredStatusMap& status) {
+  // Предсказанная ситуация не имеет выводов и существует всегда.
+  if (item->rhs_pos_ == 0) {
+    status[item] = kDeferredAlive;
+    return;
+  }
+
+  // Ситуация, метка которой сдвигается, должна быть уже вычислена и принята.
+  DeferredStatusMap::const_iterator left = status.find(item->lptr_);
+  bool left_alive = item->lptr_->rhs_pos_ == 0 or (left != status.end() and left->second == kDeferredAlive);
+
+  // Заново вызываем интерпретатор для каждого вывода и оставляем только принятые.
+  Item::Rptrs accepted;
+  State* state = state_disp_.GetState(item->state_number_);
+  while (not item->rptrs_.empty()) {
+    Item::Rptr rptr = item->rptrs_.pop_front(item_disp_.rptr_pool_);
+    if (not left_alive) {
+      continue;
+    }
+
+    Context::Ptr context;
+    if (rptr.item_) {
+      // Завершенная ситуация должна быть принята, циклические выводы пропускаем.
+      DeferredStatusMap::const_iterator right = status.find(rptr.item_);
+      if (right == status.end() or right->second != kDeferredAlive) {
+        continue;
+      }
+      if (IsOperatorShift(rptr.item_, item->lptr_)) {
+        context = forest_recorder_.accepted_;
+      } else {
+        context = interpretator_->HandleNonTerminal(rptr.item_, item->lptr_);
+        ++stats_.nonterminal_calls_;
+      }
+    } else {
+      if (not accepted.empty()) {
+        continue;
+      }
+      Grammar::SymbolId symbol_id = grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_ - 1);
+      context = interpretator_->HandleTerminal(state->GetToken(item->lptr_->state_number_, symbol_id), item->lptr_);
+      ++stats_.terminal_calls_;
+    }
+
+    if (context.get()) {
+      accepted.push_back(Item::Rptr(context, rptr.item_), item_disp_.rptr_pool_);
+    }
+  }
+
+  status[item] = accepted.empty() ? kDeferredDead : kDeferredAlive;
+  item->rptrs_ = accepted;
+}
+
+void EarleyParser::BuildForest(const std::vector<Item*>& roots) {
+  // Обходим ситуации без рекурсии: глубина выводов может быть порядка длины входной цепочки.
+  std::vector<Item*> stack(roots.begin(), roots.end());
+  boost::unordered_set<Item*> visited;
+  for (size_t i = 0; i < roots.size(); ++i) {
+    forest_.AddRoot(GetForestNode(roots[i]));
+  }
+
+  while (not stack.empty()) {
+    if (not CheckBudget()) {
+      return;
+    }
+    Item* item = stack.back();
+    stack.pop_back();
+    if (not visited.insert(item).second) {
+      continue;
+    }
+
+    State* state = state_disp_.GetState(item->state_number_);
+    if (options_.use_leo_items_ and item->HasTransitiveRptrs()) {
+      ExpandTransitiveRptrs(state, item);
+    }
+    Sppf::NodeId node = GetForestNode(item);
+
+    // Завершенная ситуация пустого правила -- единственный вывод без потомков.
+    if (item->rhs_pos_ == 0) {
+      forest_.AddPackedNode(node, Sppf::PackedNode(item->rule_id_, item->origin_, Sppf::kNoNode, Sppf::kNoNode));
+      continue;
+    }
+
+    // Левый потомок -- префикс правила без последнего символа, если он не пуст.
+    size_t split = item->lptr_->state_number_;
+    Sppf::NodeId left = Sppf::kNoNode;
+    if (item->rhs_pos_ > 1) {
+      left = GetForestNode(item->lptr_);
+      stack.push_back(item->lptr_);
+    }
+
+    // Правый потомок -- токен или завершенная ситуация для последнего символа префикса.
+    for (Item::Rptrs::const_iterator it = item->rptrs_.begin(); it != item->rptrs_.end(); ++it) {
+      const Item::Rptr& rptr = *it;
+      Sppf::NodeId right = Sppf::kNoNode;
+      if (rptr.item_) {
+        right = GetForestNode(rptr.item_);
+        stack.push_back(rptr.item_);
+      } else {
+        Grammar::SymbolId symbol_id = grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_ - 1);
+        right = forest_.AddTerminalNode(symbol_id, state->GetToken(split, symbol_id), split, item->state_number_);
+      }
+      forest_.AddPackedNode(node, Sppf::PackedNode(item->rule_id_, split, left, right));
+    }
+  }
+}
+
+inline void EarleyParser::AddLr0Item(State* state, Lr0Automaton::StateId dfa_state, size_t origin) {
+  const Lr0Automaton& automaton = grammar_->GetLr0Automaton();
+
+  // Предсказанные правила порождаются в текущем состоянии.
+  Lr0Automaton::StateId epsilon = automaton.GetEpsilonState(dfa_state);
+  State::Lr0Item items[] = { State::Lr0Item(dfa_state, origin), State::Lr0Item(epsilon, state->id_) };
+
+  for (size_t i = 0; i < 2; ++i) {
+    if (items[i].dfa_state_ == Lr0Automaton::kBadStateId
+        or not State::Lr0ItemIndexTraits::IsEmpty(state->lr0_index_.Find(items[i]))) {
+      continue;
+    }
+    size_t capacity = state->lr0_index_.GetCapacity();
+    state->lr0_index_.Insert(items[i]);
+    item_disp_.index_memory_ += (state->lr0_index_.GetCapacity() - capacity) * sizeof(State::Lr0Item);
+    ++item_disp_.num_of_lr0_items_;
+
+    state->lr0_items_.push_back(items[i]);
+    std::vector<Lr0Automaton::StateId>& origin_states = state->lr0_origins_[items[i].origin_];
+    if (origin_states.empty()) {
+      // Состояние, где порождена ситуация, запоминает все состояния, в которые она перешла.
+      state_disp_.GetState(items[i].origin_)->lr0_descendants_.push_back(state->id_);
+    }
+    origin_states.push_back(items[i].dfa_state_);
+
+    // Операция Completer обращается только к ситуациям с переходом по завершенному нетерминалу.
+    if (state->lr0_gotos_.empty()) {
+      state->lr0_gotos_.resize(grammar_->GetNumOfNonterminals());
+    }
+    const Lr0Automaton::SymbolIdTable& moves = automaton.GetMoves(items[i].dfa_state_);
+    for (size_t j = 0; j < moves.size(); ++j) {
+      if (grammar_->IsNonterminal(moves[j])) {
+        state->lr0_gotos_[moves[j] - grammar_->GetNumOfTerminals() - 1].push_back(items[i]);
+      }
+    }
+  }
+}
+
+inline bool EarleyParser::ScannerLr0(size_t state_id, Token::Ptr token, size_t& new_state_id) {
+  const Lr0Automaton& automaton = grammar_->GetLr0Automaton();
+  Grammar::SymbolId cur_symbol_id = grammar_->GetInternalSymbolByExtrernalId(token->type_);
+
+  State* cur_state = state_disp_.GetState(state_id);
+  if (not cur_state) {
+    return false;
+  }
+
+  State* next_state = NULL;
+  for (size_t i = 0; i < cur_state->lr0_items_.size(); ++i) {
+    State::Lr0Item cur = cur_state->lr0_items_[i];
+    Lr0Automaton::StateId target = automaton.Goto(cur.dfa_state_, cur_symbol_id);
+    if (target == Lr0Automaton::kBadStateId) {
+      continue;
+    }
+
+    // Состояние для позиции конца токена создается только при наличии сдвига по данному символу.
+    if (not next_state) {
+      next_state = FindPendingState(token->abs_pos_ + token->length_);
+      if (not next_state) {
+        next_state = AddPendingState(token);
+        GetLookahead(token, next_state->next_tokens_, next_state->lookahead_);
+      }
+      next_state->transitions_.push_back(State::Transition(state_id, token));
+      new_state_id = next_state->id_;
+    }
+    AddLr0Item(next_state, target, cur.origin_);
+  }
+
+  return next_state != NULL;
+}
+
+inline void EarleyParser::ClosureLr0(size_t state_id) {
+  const Lr0Automaton& automaton = grammar_->GetLr0Automaton();
+  State* state = state_disp_.GetState(state_id);
+
+  // Вектор ситуаций служит и очередью: добавленные ситуации обрабатываются в том же цикле.
+  for (size_t i = 0; i < state->lr0_items_.size(); ++i) {
+    if (not CheckBudget()) {
+      return;
+    }
+    State::Lr0Item cur = state->lr0_items_[i];
+
+    // Завершения пустых выводов уже учтены в автомате сдвигом метки через символы, выводящие пустую цепочку.
+    if (cur.origin_ == state_id) {
+      continue;
+    }
+    ++stats_.completer_calls_;
+
+    // Обходим только ситуации состояния порождения, из которых есть переход по завершенному нетерминалу.
+    State* origin_state = state_disp_.GetState(cur.origin_);
+    const Lr0Automaton::SymbolIdTable& completed = automaton.GetCompleted(cur.dfa_state_);
+    for (size_t j = 0; j < completed.size(); ++j) {
+      const State::Lr0ItemVector& parents = origin_state->lr0_gotos_[completed[j] - grammar_->GetNumOfTerminals() - 1];
+      for (size_t k = 0; k < parents.size(); ++k) {
+        AddLr0Item(state, automaton.Goto(parents[k].dfa_state_, completed[j]), parents[k].origin_);
+      }
+    }
+  }
+}
+
+bool EarleyParser::ContainsLr0(State* state, Grammar::RuleId rule_id, unsigned dot, size_t origin) const {
+  const Lr0Automaton& automaton = grammar_->GetLr0Automaton();
+  size_t dotted_rule = grammar_->GetOffsetByRule(rule_id) + dot + 1;
+
+  State::Lr0OriginIndex::const_iterator it = state->lr0_origins_.find(origin);
+  if (it == state->lr0_origins_.end()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < it->second.size(); ++i) {
+    if (automaton.Contains(it->second[i], dotted_rule)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void EarleyParser::CollectSplits(State* state, const State::ItemKey& key, State::Derivation& derivation, DerivationKeyVector& deps) {
+  derivation.present_ = ContainsLr0(state, key.rule_id_, key.rhs_pos_, key.origin_);
+  if (not derivation.present_ or key.rhs_pos_ == 0) {
+    return;
+  }
+
+  State::ItemKey left_key(key.rule_id_, key.rhs_pos_ - 1, key.origin_, NULL);
+  Grammar::SymbolId symbol_id = grammar_->GetRhsOfRule(key.rule_id_, key.rhs_pos_ - 1);
+
+  if (not grammar_->IsNonterminal(symbol_id)) {
+    // Терминал слева от метки -- это токен одного из переходов, по которым получено состояние.
+    for (size_t i = 0; i < state->transitions_.size(); ++i) {
+      const State::Transition& transition = state->transitions_[i];
+      if (grammar_->GetInternalSymbolByExtrernalId(transition.token_->type_) == symbol_id) {
+        derivation.splits_.push_back(State::Derivation::Split(transition.prev_id_, i));
+        deps.push_back(DerivationKey(state_disp_.GetState(transition.prev_id_), left_key));
+      }
+    }
+    return;
+  }
+
+  // Нетерминал слева от метки. Точка разбиения -- состояние, в котором есть левая часть правила и в котором
+  // порождено завершенное правило нетерминала. Перебираем меньшее из двух множеств: состояния, содержащие
+  // ситуации, порожденные в origin, или состояния, где порождены завершенные правила нетерминала.
+  const Lr0Automaton& automaton = grammar_->GetLr0Automaton();
+  if (not state->lr0_completed_built_) {
+    for (size_t i = 0; i < state->lr0_items_.size(); ++i) {
+      const Lr0Automaton::SymbolIdTable& completed = automaton.GetCompleted(state->lr0_items_[i].dfa_state_);
+      for (size_t j = 0; j < completed.size(); ++j) {
+        state->lr0_completed_[completed[j]].push_back(state->lr0_items_[i].origin_);
+      }
+    }
+    for (State::Lr0CompletedIndex::iterator it = state->lr0_completed_.begin(); it != state->lr0_completed_.end(); ++it) {
+      std::sort(it->second.begin(), it->second.end());
+      it->second.erase(std::unique(it->second.begin(), it->second.end()), it->second.end());
+    }
+    state->lr0_completed_built_ = true;
+  }
+
+  State::Lr0CompletedIndex::const_iterator completed = state->lr0_completed_.find(symbol_id);
+  if (completed == state->lr0_completed_.end()) {
+    return;
+  }
+  const std::vector<size_t>& descendants = state_disp_.GetState(key.origin_)->lr0_descendants_;
+  const std::vector<size_t>& candidates = descendants.size() < completed->second.size() ? descendants : completed->second;
+
+  // Номера состояний после Reparse не возрастают вместе с позицией, поэтому точки разбиения перебираем по
+  // позициям: порядок выводов, а значит и первый вывод каждой ситуации, не зависит от истории разбора.
+  std::vector<std::pair<size_t, size_t> >& splits = split_positions_;
+  splits.clear();
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    splits.push_back(std::make_pair(state_disp_.GetState(candidates[i])->position_, candidates[i]));
+  }
+  std::sort(splits.begin(), splits.end());
+
+  std::vector<Grammar::RuleId>& rules = split_rules_;
+  for (size_t i = 0; i < splits.size(); ++i) {
+    State::Lr0OriginIndex::const_iterator found = state->lr0_origins_.find(splits[i].second);
+    State* split_state = state_disp_.GetState(splits[i].second);
+    if (found == state->lr0_origins_.end() or not ContainsLr0(split_state, key.rule_id_, key.rhs_pos_ - 1, key.origin_)) {
+      continue;
+    }
+
+    // Завершенные правила нетерминала берутся из списков завершенных правил состояний автомата, которых
+    // обычно единицы, а не проверяются по всем правилам нетерминала. Порядок -- по идентификаторам правил.
+    rules.clear();
+    for (size_t k = 0; k < found->second.size(); ++k) {
+      const Lr0Automaton::RuleIdTable& completed_rules = automaton.GetCompletedRules(found->second[k]);
+      for (size_t r = 0; r < completed_rules.size(); ++r) {
+        if (grammar_->GetLhsOfRule(completed_rules[r]) == symbol_id) {
+          rules.push_back(completed_rules[r]);
+        }
+      }
+    }
+    if (found->second.size() > 1) {
+      std::sort(rules.begin(), rules.end());
+      rules.erase(std::unique(rules.begin(), rules.end()), rules.end());
+    }
+
+    for (size_t r = 0; r < rules.size(); ++r) {
+      derivation.splits_.push_back(State::Derivation::Split(splits[i].second, rules[r]));
+      deps.push_back(DerivationKey(state, State::ItemKey(rules[r], grammar_->GetRhsLength(rules[r]), splits[i].second, NULL)));
+    }
+    if (not rules.empty()) {
+      deps.push_back(DerivationKey(split_state, left_key));
+    }
+  }
+}
+
+bool EarleyParser::BuildDerivation(State* state, const State::ItemKey& key, State::Derivation& derivation) {
+  derivation.status_ = State::Derivation::kDone;
+  if (not derivation.present_) {
+    return false;
+  }
+
+  if (key.rhs_pos_ == 0) {
+    // Предсказанное правило, у ситуации нет ссылок.
+    if (not derivation.items_.empty()) {
+      return false;
+    }
+    Item* item = state->FindItem(key.rule_id_, 0, key.origin_, NULL);
+    if (not item) {
+      item = state->AddItem(key.rule_id_, 0, key.origin_, NULL, NULL, Context::Ptr());
+    }
+    derivation.items_.push_back(item);
+    return true;
+  }
+
+  State::ItemKey left_key(key.rule_id_, key.rhs_pos_ - 1, key.origin_, NULL);
+  bool terminal = not grammar_->IsNonterminal(grammar_->GetRhsOfRule(key.rule_id_, key.rhs_pos_ - 1));
+  bool changed = false;
+  for (size_t i = 0; i < derivation.splits_.size(); ++i) {
+    const State::Derivation::Split& split = derivation.splits_[i];
+    const std::vector<Item*>& lptrs = GetDerivation(state_disp_.GetState(split.first), left_key).items_;
+
+    // Сдвиг терминала.
+    if (terminal) {
+      for (size_t l = 0; l < lptrs.size(); ++l) {
+        if (state->FindItem(key.rule_id_, key.rhs_pos_, key.origin_, lptrs[l])) {
+          continue;
+        }
+        Context::Ptr context = HandleTerminal(state->transitions_[split.second].token_, lptrs[l]);
+        if (context.get()) {
+          derivation.items_.push_back(state->AddItem(key.rule_id_, key.rhs_pos_, key.origin_, lptrs[l], NULL, context));
+          changed = true;
+        }
+      }
+      continue;
+    }
+
+    // Сдвиг нетерминала по завершенному правилу, порожденному в точке разбиения.
+    State::ItemKey completion_key(split.second, grammar_->GetRhsLength(split.second), split.first, NULL);
+    const std::vector<Item*>& completions = GetDerivation(state, completion_key).items_;
+    for (size_t l = 0; l < lptrs.size(); ++l) {
+      for (size_t c = 0; c < completions.size(); ++c) {
+        Item* item = state->FindItem(key.rule_id_, key.rhs_pos_, key.origin_, lptrs[l]);
+        if (item and item->HasRptr(completions[c])) {
+          continue;
+        }
+        if (key.origin_ == state->id_ and ReachesEmptyItem(completions[c], key)) {
+          continue;
+        }
+
+        Context::Ptr context = HandleNonTerminal(completions[c], lptrs[l]);
+        if (not context.get()) {
+          continue;
+        }
+
+        if (item) {
+          item->AddRptr(context, completions[c], item_disp_.rptr_pool_);
+        } else {
+          derivation.items_.push_back(state->AddItem(key.rule_id_, key.rhs_pos_, key.origin_, lptrs[l], completions[c], context));
+        }
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+bool EarleyParser::ReachesEmptyItem(const Item* item, const State::ItemKey& key) const {
+  std::vector<const Item*> stack(1, item);
+  boost::unordered_set<const Item*> visited;
+  while (not stack.empty()) {
+    const Item* cur = stack.back();
+    stack.pop_back();
+    if (not visited.insert(cur).second) {
+      continue;
+    }
+    if (cur->rule_id_ == key.rule_id_ and cur->rhs_pos_ == key.rhs_pos_ and cur->origin_ == key.origin_) {
+      return true;
+    }
+
+    // У пустой ситуации все ссылки тоже на пустые ситуации того же состояния.
+    if (cur->lptr_) {
+      stack.push_back(cur->lptr_);
+    }
+    for (Item::Rptrs::const_iterator it = cur->rptrs_.begin(); it != cur->rptrs_.end(); ++it) {
+      if (it->item_) {
+        stack.push_back(it->item_);
+      }
+    }
+  }
+  return false;
+}
+
+std::vector<EarleyParser::Item*> EarleyParser::DeriveItems(State* state, Grammar::RuleId rule_id, unsigned dot, size_t origin) {
+  // Обход в глубину без рекурсии: цепочки зависимостей имеют длину порядка длины входа. Помеченные правила
+  // собираются в порядке выхода из обхода, поэтому при построении их зависимости уже построены. Зависимость
+  // от правила, которое еще в стеке обхода, возникает только для циклических выводов вида A -->+ A: такое
+  // правило строится позже, поэтому после первого прохода построение повторяется до тех пор, пока
+  // добавляются новые выводы. Записи индексов derivations_ ищутся один раз и запоминаются в стеке обхода.
+  State::ItemKey root_key(rule_id, dot, origin, NULL);
+  State::Derivation& root = GetDerivation(state, root_key);
+  std::vector<DerivationFrame> order;
+  std::vector<DerivationFrame> stack;
+  DerivationKeyVector deps;
+  bool cyclic = false;
+
+  if (root.status_ == State::Derivation::kUnknown) {
+    root.status_ = State::Derivation::kInProgress;
+    CollectSplits(state, root_key, root, deps);
+    stack.push_back(DerivationFrame(DerivationKey(state, root_key), &root, 0));
+  }
+
+  while (not stack.empty()) {
+    if (not CheckBudget()) {
+      return std::vector<Item*>();
+    }
+    DerivationFrame& top = stack.back();
+    if (top.next_ == deps.size()) {
+      top.derivation_->status_ = State::Derivation::kCollected;
+      deps.erase(deps.begin() + top.begin_, deps.end());
+      order.push_back(top);
+      stack.pop_back();
+      continue;
+    }
+
+    DerivationKey dep = deps[top.next_++];
+    State::Derivation& derivation = GetDerivation(dep.first, dep.second);
+    if (derivation.status_ == State::Derivation::kUnknown) {
+      derivation.status_ = State::Derivation::kInProgress;
+      size_t begin = deps.size();
+      CollectSplits(dep.first, dep.second, derivation, deps);
+      stack.push_back(DerivationFrame(dep, &derivation, begin));
+    } else if (derivation.status_ == State::Derivation::kInProgress) {
+      cyclic = true;
+    }
+  }
+
+  bool changed = true;
+  for (bool first = true; changed and (first or cyclic); first = false) {
+    changed = false;
+    for (size_t i = 0; i < order.size(); ++i) {
+      if (not CheckBudget()) {
+        return std::vector<Item*>();
+      }
+      changed = BuildDerivation(order[i].key_.first, order[i].key_.second, *order[i].derivation_) or changed;
+    }
+  }
+
+  return root.items_;
+}
+
+EarleyParser::State::Derivation& EarleyParser::GetDerivation(State* state, const State::ItemKey& key) {
+  State::Derivation* derivation = state->derivations_.Find(key);
+  if (derivation) {
+    return *derivation;
+  }
+
+  // Запись из распределителя сохраняет память списков от предыдущих разборов и должна быть очищена.
+  derivation = derivation_pool_.Allocate();
+  derivation->key_ = key;
+  derivation->status_ = State::Derivation::kUnknown;
+  derivation->present_ = false;
+  derivation->splits_.clear();
+  derivation->items_.clear();
+
+  size_t capacity = state->derivations_.GetCapacity();
+  state->derivations_.Insert(derivation);
+  item_disp_.index_memory_ += (state->derivations_.GetCapacity() - capacity) * sizeof(State::Derivation*);
+  return *derivation;
+}
+
+void EarleyParser::StartBudget() {
+  status_ = kRejected;
+  budget_checks_ = 0;
+  stats_.Clear();
+  stats_.num_of_parses_ = 1;
+  if (options_.time_limit_ms_) {
+    deadline_ = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(options_.time_limit_ms_);
+  }
+}
+
+inline bool EarleyParser::CheckBudget() {
+  if (IsStopped()) {
+    return false;
+  }
+
+  // Число ситуаций и состояний проверяется каждый раз, время и запрос отмены -- реже, начиная с первой проверки.
+  if (options_.max_items_ and item_disp_.items_.GetSize() + item_disp_.num_of_lr0_items_ > options_.max_items_) {
+    status_ = kItemLimit;
+  } else if (options_.max_states_ and state_disp_.GetNumOfStates() > options_.max_states_) {
+    status_ = kStateLimit;
+  } else if (options_.max_memory_ and GetMemoryUsage() > options_.max_memory_) {
+    status_ = kMemoryLimit;
+  } else if (budget_checks_++ % kBudgetCheckInterval == 0) {
+    if (options_.time_limit_ms_ and boost::posix_time::microsec_clock::universal_time() > deadline_) {
+      status_ = kTimeLimit;
+    } else {
+      boost::mutex::scoped_lock lock(cancel_mutex_);
+      if (cancel_requested_) {
+        status_ = kCancelled;
+      }
+    }
+  }
+  return not IsStopped();
+}
+
+size_t EarleyParser::GetMemoryUsage() const {
+  // Кроме самой ситуации учитываются указатели на нее в списках состояния и смещение остатка правила.
+  // Ситуация LR(0) автомата хранится в очереди состояния, в списке переходов по нетерминалу и в списке
+  // состояний автомата по состоянию порождения. Ячейки хэш-индексов учитываются по их фактическому числу.
+  size_t item_size = sizeof(Item) + 2 * sizeof(Item*) + sizeof(unsigned);
+  size_t lr0_item_size = 2 * sizeof(State::Lr0Item) + sizeof(Lr0Automaton::StateId);
+  size_t state_size = sizeof(State) + (grammar_->GetNumOfTerminals() + grammar_->GetNumOfNonterminals() + 1) * sizeof(State::SymbolItemList);
+  return item_disp_.items_.GetSize() * item_size
+       + item_disp_.rptr_pool_.GetSize() * sizeof(Item::Rptrs::Node)
+       + item_disp_.num_of_lr0_items_ * lr0_item_size
+       + item_disp_.index_memory_
+       + derivation_pool_.GetSize() * sizeof(State::Derivation)
+       + state_disp_.GetNumOfStates() * state_size
+       + forest_.GetMemoryUsage();
+}
+
+void EarleyParser::Abort() {
+  CollectStateStats();
+  Reset();
+  state_disp_.Release();
+  item_disp_.Release();
+  derivation_pool_.Release();
+  boost::mutex::scoped_lock lock(cancel_mutex_);
+  cancel_requested_ = false;
+}
+
+void EarleyParser::CollectStateStats() {
+  stats_.num_of_states_ = closed_states_.size();
+  stats_.num_of_items_ = 0;
+  stats_.max_state_items_ = 0;
+  stats_.state_items_.clear();
+  for (size_t i = 0; i < closed_states_.size(); ++i) {
+    const State* state = state_disp_.GetState(closed_states_[i]);
+    if (not state) {
+      continue;
+    }
+    size_t num_of_items = options_.engine_ == Options::kLr0Engine ? state->lr0_items_.size() : state->num_of_items_;
+    stats_.state_items_.push_back(num_of_items);
+    stats_.num_of_items_ += num_of_items;
+    stats_.max_state_items_ = std::max(stats_.max_state_items_, num_of_items);
+  }
+
+  // Блоки диспетчера не освобождаются до конца разбора, поэтому их текущее число -- наибольшее.
+  stats_.item_blocks_ = item_disp_.items_.GetNumOfBlocks();
+  stats_.rptr_blocks_ = item_disp_.rptr_pool_.GetNumOfBlocks();
+}
+
+void EarleyParser::Stats::Clear() {
+  num_of_parses_ = 0;
+  num_of_states_ = 0;
+  num_of_items_ = 0;
+  max_state_items_ = 0;
+  state_items_.clear();
+  duplicate_items_ = 0;
+  completer_calls_ = 0;
+  predictor_calls_ = 0;
+  scanner_calls_ = 0;
+  nullable_items_ = 0;
+  terminal_calls_ = 0;
+  nonterminal_calls_ = 0;
+  end_calls_ = 0;
+  item_blocks_ = 0;
+  rptr_blocks_ = 0;
+  recognition_seconds_ = 0;
+  derivation_seconds_ = 0;
+  end_seconds_ = 0;
+}
+
+void EarleyParser::Stats::Add(const Stats& stats) {
+  num_of_parses_ += stats.num_of_parses_;
+  num_of_states_ += stats.num_of_states_;
+  num_of_items_ += stats.num_of_items_;
+  max_state_items_ = std::max(max_state_items_, stats.max_state_items_);
+  duplicate_items_ += stats.duplicate_items_;
+  completer_calls_ += stats.completer_calls_;
+  predictor_calls_ += stats.predictor_calls_;
+  scanner_calls_ += stats.scanner_calls_;
+  nullable_items_ += stats.nullable_items_;
+  terminal_calls_ += stats.terminal_calls_;
+  nonterminal_calls_ += stats.nonterminal_calls_;
+  end_calls_ += stats.end_calls_;
+  item_blocks_ = std::max(item_blocks_, stats.item_blocks_);
+  rptr_blocks_ = std::max(rptr_blocks_, stats.rptr_blocks_);
+  recognition_seconds_ += stats.recognition_seconds_;
+  derivation_seconds_ += stats.derivation_seconds_;
+  end_seconds_ += stats.end_seconds_;
+}
+
+void EarleyParser::GetChildContexts(const Item* item, std::vector<Context::Ptr>& contexts) const {
+  // Цепочки lptr_ обходятся справа налево. Встретив вложенный вспомогательный нетерминал, откладываем
+  // остаток цепочки и обходим сначала его ситуацию, поэтому контексты собираются в обратном порядке.
+  std::vector<const Item*> chains(1, item);
+  std::vector<Context::Ptr> reversed;
+  while (not chains.empty()) {
+    const Item* cur = chains.back();
+    chains.pop_back();
+    if (not cur) {
+      continue;
+    }
+
+    bool expand = grammar_->IsOperatorSymbol(grammar_->GetLhsOfRule(cur->rule_id_));
+    for (; cur; cur = cur->lptr_) {
+      if (cur->rptrs_.empty()) {
+        continue;
+      }
+
+      const Item::Rptr& rptr = cur->rptrs_.front();
+      if (expand and rptr.item_ and grammar_->IsOperatorSymbol(grammar_->GetLhsOfRule(rptr.item_->rule_id_))) {
+        chains.push_back(cur->lptr_);
+        chains.push_back(rptr.item_);
+        break;
+      }
+      reversed.push_back(rptr.context_);
+    }
+  }
+
+  contexts.insert(contexts.end(), reversed.rbegin(), reversed.rend());
+}
+
+void EarleyParser::Reset() {
+  state_disp_.Reset();
+  item_disp_.Reset();
+  derivation_pool_.Reset();
+  pending_states_.clear();
+  closed_states_.clear();
+  end_states_.clear();
+  released_items_.clear();
+  while (not nonhandled_items_.empty()) {
+    nonhandled_items_.pop();
+  }
+  forest_.Clear();
 }
 
 
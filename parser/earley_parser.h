@@ -7,19 +7,26 @@
 #define EARLEY_PARSER_H__
 
 #include "grammar.h"
-#include "list.h"
-#include "queue.h"
 #include "stack.h"
 #include "tree.h"
 #include "lexer.h"
 #include "allocator.h"
 #include "ast.h"
+#include "sppf.h"
+#include "arena.h"
+#include "hash_index.h"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <vector>
 #include <deque>
 #include <iostream>
+#include <limits>
 
 namespace parser {
 
@@ -53,37 +60,55 @@ public:
   struct Item {
     //! Структура для хранения пар (контекст, указатель на ситуацию "ниже").
     struct Rptr {
-      Context::Ptr  context_; //!< Указатель на предоставляемый интерпретатором объект контекста.
-      Item*         item_;    //!< Указатель на объект класса ситуации Эрли.
+      Context::Ptr  context_;     //!< Указатель на предоставляемый интерпретатором объект контекста.
+      Item*         item_;        //!< Указатель на объект класса ситуации Эрли.
+      bool          transitive_;  //!< Ссылка через цепочку транзитивных ситуаций Лео, еще не раскрытая.
 
       //! Инициализация по умолчанию.
       Rptr()
-        : item_(NULL) {
+        : item_(NULL)
+        , transitive_(false) {
       }
 
       //! Инициализация всех полей.
-      Rptr(Context::Ptr context, Item* item)
+      Rptr(Context::Ptr context, Item* item, bool transitive = false)
         : context_(context)
         , item_(item)
+        , transitive_(transitive)
       {}
     };
 
-    //! Тип списка объектов Rptr.
-    typedef parser::list<Rptr> Rptrs;
+    //! Тип списка объектов Rptr, узлы которого выделяются диспетчером ситуаций.
+    typedef ArenaList<Rptr> Rptrs;
+
+    // Поля упорядочены так, чтобы 32-битные номера занимали одно выравнивание перед указателями: ситуация
+    // занимает 40 байт на 64-битной платформе, а узлы ссылок rptrs_ выделяются только для сдвигов. Позиция
+    // метки вместе с признаком очереди занимает одно 32-битное поле, длина правил ограничена Grammar::kMaxRhsLength.
 
     // Элементы ситуации из классического определения.
     Grammar::RuleId rule_id_;     //!< Идентификатор правила.
-    unsigned        rhs_pos_;     //!< Позиция метки в правой части правила.
-    size_t          origin_;      //!< Номер состояния, в котором данная ситуация была порождена.
+    unsigned short  rhs_pos_;     //!< Позиция метки в правой части правила.
+    bool            queued_;      //!< Признак того, что ситуация находится в очереди необработанных.
+    unsigned        origin_;      //!< Номер состояния, в котором данная ситуация была порождена.
+
+    // Служебные поля.
+    unsigned        order_number_;//!< Порядковый номер данной ситуации в состоянии.
+    unsigned        state_number_;//!< Номер состояния, котроому принадлежит ситуация.
+
+    /*!
+     * \brief Внутренняя оценка: логарифм вероятности лучшего вывода ситуации.
+     *
+     * Складывается из весов правил вывода. При добавлении вывода к существующей ситуации оценка
+     * увеличивается, но в уже построенные из нее ситуации распространяется только при выборе лучших выводов
+     * в режиме пучка, см. Options::k_best_. Для ситуаций, построенных
+     * через транзитивные ситуации Лео, веса промежуточных правил цепочки не учитываются.
+     */
+    float           score_;
 
     // Элементы ситуации из расширенного определения.
     Item*           lptr_;        //!< Указатель на ситуацию, у которой метка стоит на символ левее.
     Rptrs           rptrs_;       //!< Список указателей на ситуации, которые послужили причиной сдвига метки.
 
-    // Служебные поля.
-    size_t          order_number_;//!< Порядковый номер данной ситуации в состоянии.
-    size_t          state_number_;//!< Номер состояния, котроому принадлежит ситуация.
-
 //#   ifdef DUMP_CONTENT
     /*!
      * \brief Печать содержимого ситуации.
@@ -91,9 +116,48 @@ public:
      * \param[in] grammar Указатель на объект грамматики, у которой берутся символьные имена элементов.
      * \param[in] out Поток для вывода.
      */
-    void Dump(Grammar* grammar, std::ostream& out);
+    void Dump(const Grammar* grammar, std::ostream& out);
 //#   endif // DUMP_CONTENT
 
+    //! Проверка наличия нераскрытых ссылок через транзитивные ситуации Лео.
+    bool HasTransitiveRptrs() const {
+      for (Rptrs::const_iterator it = rptrs_.begin(); it != rptrs_.end(); ++it) {
+        if (it->transitive_) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    //! Проверка наличия раскрытой ссылки на ситуацию "ниже".
+    bool HasRptr(const Item* rptr) const {
+      for (Rptrs::const_iterator it = rptrs_.begin(); it != rptrs_.end(); ++it) {
+        if (it->item_ == rptr and not it->transitive_) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /*!
+     * \brief Добавление ссылки на ситуацию "ниже", если такой ссылки еще нет.
+     *
+     * \param[in] context   Указатель на контекст интерпретатора.
+     * \param[in] rptr      Указатель на ситуацию, послужившую причиной сдвига метки.
+     * \param[in] pool      Распределитель узлов списка ссылок.
+     */
+    void AddRptr(Context::Ptr context, Item* rptr, Rptrs::Pool& pool) {
+      if (HasRptr(rptr)) {
+        return;
+      }
+      rptrs_.push_back(Rptr(context, rptr), pool);
+
+      // Новый вывод может оказаться лучше найденных ранее.
+      if (lptr_ and rptr and lptr_->score_ + rptr->score_ > score_) {
+        score_ = lptr_->score_ + rptr->score_;
+      }
+    }
+
     //! Оператор сравнения.
     bool operator==(const Item& rhs) {
         return  rule_id_ == rhs.rule_id_
@@ -104,29 +168,31 @@ public:
   };
 
   //! Тип списка объектов ситуаций Эрли.
-  typedef parser::list<Item*> ItemList;
+  typedef std::vector<Item*> ItemList;
 
-  //! Диспетчер ситуаций Эрли, выделяет и освобождает память для ситуаций.
+  /*!
+   * \brief Диспетчер ситуаций Эрли, выделяет и освобождает память для ситуаций и их ссылок rptrs_.
+   *
+   * Ситуации и узлы списков ссылок выделяются из блоков, которые сохраняются между разборами,
+   * поэтому разбор не выделяет память под каждую ситуацию.
+   */
   struct ItemDispatcher {
-    //! Тип блока ситуаций Эрли.
-    typedef std::vector<Item> ItemBlock;
-
-    //! Тип списка блоков ситуаций Эрли.
-    typedef std::deque<ItemBlock> BlockList;
-
-    BlockList block_list_;  //!< Список блоков ситуаций Эрли.
-    size_t    block_size_;  //!< Размер блока.
-    ItemList  free_list_;   //!< Список свободных ситуаций Эрли.
-    size_t    block_pos_;   //!< Текущая позиция свободного элемента в блоке.
+    Arena<Item>       items_;       //!< Блоки ситуаций Эрли.
+    Item::Rptrs::Pool rptr_pool_;   //!< Блоки узлов списков ссылок rptrs_.
+    ItemList          free_list_;   //!< Список свободных ситуаций Эрли.
+    size_t            num_of_lr0_items_;  //!< Число ситуаций LR(0) автомата, добавленных в состояния с начала разбора.
+    size_t            index_memory_;      //!< Память ячеек хэш-индексов состояний, выделенная с начала разбора.
 
     /*!
-     * \brief При инициализации передается размер репозитория.
+     * \brief При инициализации передается размер блока.
      *
-     * \param[in] sz размер репозитория в элементах.
+     * \param[in] sz размер блока в элементах.
      */
     ItemDispatcher( size_t sz )
-      : block_size_(sz)
-      , block_pos_(0)
+      : items_(sz)
+      , rptr_pool_(sz)
+      , num_of_lr0_items_(0)
+      , index_memory_(0)
     {}
 
     /*!
@@ -145,20 +211,15 @@ public:
         item = free_list_.back();
         free_list_.pop_back();
       } else {
-        // Выделяем память для ситуации, если это необходимо.
-        if (block_pos_ >= block_size_ or block_list_.empty()) {
-          block_list_.push_back(ItemBlock());
-          block_list_[block_list_.size()-1].resize(block_size_);
-          block_pos_ = 0;
-        }
-
-        item = &block_list_[block_list_.size()-1][block_pos_++];
+        item = items_.Allocate();
       }
 
       item->rule_id_  = rule_id;
       item->rhs_pos_  = dot;
       item->origin_   = origin;
       item->lptr_     = lptr;
+      item->queued_   = false;
+      item->rptrs_.clear();
 
       return item;
     }
@@ -169,7 +230,37 @@ public:
      * \param[in] item Указатель на ситуацию.
      */
     void FreeItem(Item* item) {
-      free_list_.push_front(item);
+      // Узлы ссылок возвращаются в пул вместе с освобождением контекстов интерпретатора.
+      while (not item->rptrs_.empty()) {
+        item->rptrs_.front().context_.reset();
+        item->rptrs_.pop_front(rptr_pool_);
+      }
+      free_list_.push_back(item);
+    }
+
+    /*!
+     * \brief Освобождение всех ситуаций с сохранением блоков для следующих разборов.
+     *
+     * Память блоков не освобождается, у выделенных узлов списков ссылок только освобождаются
+     * контексты интерпретатора, чтобы они не жили дольше разбора.
+     */
+    void Reset() {
+      for (size_t i = 0; i < rptr_pool_.GetSize(); ++i) {
+        rptr_pool_[i].elem_.context_.reset();
+      }
+      rptr_pool_.Reset();
+      items_.Reset();
+      free_list_.clear();
+      num_of_lr0_items_ = 0;
+      index_memory_ = 0;
+    }
+
+    //! Освобождение всех ситуаций вместе с памятью блоков.
+    void Release() {
+      Reset();
+      rptr_pool_.Release();
+      items_.Release();
+      ItemList().swap(free_list_);
     }
   };
 
@@ -184,46 +275,265 @@ public:
     /*!
      * \brief Реализация списка ситуаций с меткой перед конкретным символом.
      *
-     * Кроме, собственно, списка ситуаций, структура содержит поле handled_by_predictor_, которое
-     * позволяет не обрабатывать несколько раз одну и ту ситуацию операцией Predictor.
+     * Параллельно списку хранятся смещения остатков правил после сдвига метки, поэтому операции Scanner и Completer
+     * отбрасывают ситуации, не продолжаемые следующими токенами, не обращаясь к самим ситуациям.
      */
     struct SymbolItemList {
-      ItemList  elems_;                 //!< Список ситуаций.
-      bool      handled_by_predictor_;  //!< Флаг обработки операцией Predictor.
+      ItemList              elems_;         //!< Список ситуаций.
+      std::vector<unsigned> next_offsets_;  //!< Смещения остатков правил ситуаций после сдвига метки.
 
-      //! Конструктор по умолчанию необходим для стандартных контейнеров.
-      SymbolItemList()
-        : handled_by_predictor_(false) {
-      }
-
-      //! Аналог деструктора, используется т.к. память реально не освобождается.
-      void Uninit(ItemDispatcher* disp) {
-        while (not elems_.empty()) {
-          disp->FreeItem(elems_.pop_back());
-        }
-        handled_by_predictor_ = false;
+      //! Аналог деструктора. Сами ситуации остаются в блоках диспетчера и освобождаются вместе с ними.
+      void Uninit() {
+        elems_.clear();
+        next_offsets_.clear();
       }
     };
 
     //! Индексированный список списков ситуаций для каждого символа.
     typedef std::vector<SymbolItemList>  ItemVector;
 
+    /*!
+     * \brief Ключ для поиска ситуации в состоянии.
+     *
+     * Ситуация в состоянии однозначно определяется правилом, позицией метки, номером состояния,
+     * в котором она была порождена, и указателем на ситуацию с меткой на символ левее.
+     */
+    struct ItemKey {
+      Grammar::RuleId rule_id_; //!< Идентификатор правила.
+      unsigned        rhs_pos_; //!< Позиция метки в правой части правила.
+      size_t          origin_;  //!< Номер состояния, в котором ситуация была порождена.
+      Item*           lptr_;    //!< Указатель на ситуацию, у которой метка стоит на символ левее.
+
+      //! Инициализация всех полей.
+      ItemKey(Grammar::RuleId rule_id, unsigned rhs_pos, size_t origin, Item* lptr)
+        : rule_id_(rule_id)
+        , rhs_pos_(rhs_pos)
+        , origin_(origin)
+        , lptr_(lptr)
+      {}
+
+      //! Оператор сравнения.
+      bool operator==(const ItemKey& rhs) const {
+        return  rule_id_ == rhs.rule_id_
+                and rhs_pos_ == rhs.rhs_pos_
+                and origin_ == rhs.origin_
+                and lptr_ == rhs.lptr_;
+      }
+    };
+
+    //! Функция хэширования ключа ситуации.
+    struct ItemKeyHash {
+      size_t operator()(const ItemKey& key) const {
+        size_t seed = 0;
+        boost::hash_combine(seed, key.rule_id_);
+        boost::hash_combine(seed, key.rhs_pos_);
+        boost::hash_combine(seed, key.origin_);
+        boost::hash_combine(seed, key.lptr_);
+        return seed;
+      }
+    };
+
+    //! Функции хэш-индекса ситуаций состояния.
+    struct ItemIndexTraits {
+      static Item* Empty() { return NULL; }
+      static bool IsEmpty(const Item* item) { return item == NULL; }
+      static size_t Hash(const ItemKey& key) { return ItemKeyHash()(key); }
+
+      static size_t Hash(const Item* item) {
+        return ItemKeyHash()(ItemKey(item->rule_id_, item->rhs_pos_, item->origin_, item->lptr_));
+      }
+
+      static bool Equal(const Item* item, const ItemKey& key) {
+        return  item->rule_id_ == key.rule_id_
+                and item->rhs_pos_ == key.rhs_pos_
+                and item->origin_ == key.origin_
+                and item->lptr_ == key.lptr_;
+      }
+    };
+
+    //! Тип хэш-индекса ситуаций состояния.
+    typedef HashIndex<Item*, ItemIndexTraits> ItemIndex;
+
+    /*!
+     * \brief Транзитивная ситуация Лео для нетерминала.
+     *
+     * Транзитивная ситуация для нетерминала A существует в состоянии i, если в нем ровно одна ситуация
+     * с меткой перед A, и A -- последний символ ее правила: [B --> alpha * A, k]. Тогда завершение A,
+     * порожденного в состоянии i, детерминированно завершает B, порожденный в состоянии k, и так далее
+     * по цепочке. Структура хранит начало такой цепочки в данном состоянии и ее вершину -- ситуацию,
+     * завершение которой добавляется в текущее состояние вместо всех промежуточных ситуаций.
+     */
+    struct TransitiveItem {
+      //! Состояние вычисления транзитивной ситуации.
+      enum Status {
+        kUnknown, //!< Еще не вычислялась.
+        kAbsent,  //!< Транзитивной ситуации нет.
+        kPresent  //!< Транзитивная ситуация есть.
+      };
+
+      Status  status_;  //!< Состояние вычисления.
+      Item*   penult_;  //!< Единственная ситуация [B --> alpha * A, k] данного состояния.
+      Item*   top_;     //!< Ситуация с меткой перед последним символом на вершине цепочки.
+
+      //! Инициализация по умолчанию.
+      TransitiveItem()
+        : status_(kUnknown)
+        , penult_(NULL)
+        , top_(NULL)
+      {}
+    };
+
+    //! Тип вектора транзитивных ситуаций, индексированного нетерминалами.
+    typedef std::vector<TransitiveItem> TransitiveItemVector;
+
+    /*!
+     * \brief Ситуация Эрли в режиме LR(0) автомата.
+     *
+     * Вместо одного помеченного правила ситуация хранит состояние автомата, то есть сразу все помеченные
+     * правила, порожденные в одном и том же состоянии Эрли.
+     */
+    struct Lr0Item {
+      Lr0Automaton::StateId dfa_state_; //!< Состояние LR(0) автомата.
+      unsigned              origin_;    //!< Номер состояния Эрли, в котором ситуация была порождена.
+
+      //! Инициализация всех полей.
+      Lr0Item(Lr0Automaton::StateId dfa_state, size_t origin)
+        : dfa_state_(dfa_state)
+        , origin_(origin)
+      {}
+    };
+
+    //! Тип вектора LR(0) ситуаций, он же очередь их обработки.
+    typedef std::vector<Lr0Item> Lr0ItemVector;
+
+    //! Функции индекса LR(0) ситуаций, пустая ячейка содержит отсутствующее состояние автомата.
+    struct Lr0ItemIndexTraits {
+      static Lr0Item Empty() { return Lr0Item(Lr0Automaton::kBadStateId, 0); }
+      static bool IsEmpty(const Lr0Item& item) { return item.dfa_state_ == Lr0Automaton::kBadStateId; }
+
+      static size_t Hash(const Lr0Item& item) {
+        size_t seed = 0;
+        boost::hash_combine(seed, item.dfa_state_);
+        boost::hash_combine(seed, item.origin_);
+        return seed;
+      }
+
+      static bool Equal(const Lr0Item& lhs, const Lr0Item& rhs) {
+        return lhs.dfa_state_ == rhs.dfa_state_ and lhs.origin_ == rhs.origin_;
+      }
+    };
+
+    //! Тип индекса LR(0) ситуаций для поиска дубликатов.
+    typedef HashIndex<Lr0Item, Lr0ItemIndexTraits> Lr0ItemIndex;
+
+    //! Тип индекса состояний автомата по номеру состояния Эрли, где порождена ситуация.
+    typedef boost::unordered_map<size_t, std::vector<Lr0Automaton::StateId> > Lr0OriginIndex;
+
+    //! Тип индекса LR(0) ситуаций по нетерминалам, по которым из их состояний автомата есть переход.
+    typedef std::vector<Lr0ItemVector> Lr0GotoIndex;
+
+    //! Тип индекса номеров состояний порождения завершенных правил по нетерминалу.
+    typedef boost::unordered_map<Grammar::SymbolId, std::vector<size_t> > Lr0CompletedIndex;
+
+    /*!
+     * \brief Обычные ситуации, восстановленные по LR(0) ситуациям для одного помеченного правила.
+     *
+     * Для помеченного правила и состояния, где оно порождено, хранятся все ситуации с разными lptr_, а также
+     * точки разбиения: состояния, в которых находится ситуация с меткой на символ левее, вместе с завершенным
+     * правилом для нетерминала перед меткой. Записи выделяются из EarleyParser::derivation_pool_ и сохраняют
+     * память списков для следующих разборов.
+     */
+    struct Derivation {
+      //! Состояние восстановления.
+      enum Status {
+        kUnknown,     //!< Еще не восстанавливалась.
+        kInProgress,  //!< Точки разбиения собраны, зависимости еще обходятся.
+        kCollected,   //!< Зависимости обойдены, ситуации еще не построены.
+        kDone         //!< Восстановлена.
+      };
+
+      //! Тип точки разбиения: номер состояния и правило для нетерминала или номер перехода для терминала.
+      typedef std::pair<size_t, Grammar::RuleId> Split;
+
+      ItemKey             key_;     //!< Помеченное правило с нулевым lptr_.
+      Status              status_;  //!< Состояние восстановления.
+      bool                present_; //!< Помеченное правило присутствует в LR(0) ситуациях состояния.
+      std::vector<Split>  splits_;  //!< Точки разбиения.
+      std::vector<Item*>  items_;   //!< Восстановленные ситуации.
+
+      //! Инициализация по умолчанию.
+      Derivation()
+        : key_(0, 0, 0, NULL)
+        , status_(kUnknown)
+        , present_(false)
+      {}
+    };
+
+    //! Функции хэш-индекса восстановленных ситуаций состояния.
+    struct DerivationIndexTraits {
+      static Derivation* Empty() { return NULL; }
+      static bool IsEmpty(const Derivation* derivation) { return derivation == NULL; }
+      static size_t Hash(const ItemKey& key) { return ItemKeyHash()(key); }
+      static size_t Hash(const Derivation* derivation) { return ItemKeyHash()(derivation->key_); }
+      static bool Equal(const Derivation* derivation, const ItemKey& key) { return derivation->key_ == key; }
+    };
+
+    //! Тип хэш-индекса восстановленных ситуаций, ключ строится с нулевым lptr_.
+    typedef HashIndex<Derivation*, DerivationIndexTraits> DerivationIndex;
+
+    //! Тип распределителя записей восстановленных ситуаций, общего для всех состояний.
+    typedef Arena<Derivation> DerivationPool;
+
+    //! Переход в состояние операцией Scanner.
+    struct Transition {
+      size_t      prev_id_; //!< Состояние, из которого выполнен сдвиг.
+      Token::Ptr  token_;   //!< Прочитанный токен.
+
+      //! Конструктор перехода.
+      Transition(size_t prev_id, Token::Ptr token)
+        : prev_id_(prev_id)
+        , token_(token)
+      {}
+    };
+
+    //! Тип списка переходов.
+    typedef std::vector<Transition> TransitionList;
+
     ItemVector      items_;                  //!< Список ситуаций для каждого символа грамматики.
-    ItemVector      items_with_empty_rules_; //!< Список ситуаций для правил с пустой правой частью.
     ItemList        state_items_;            //!< Список ситуаций в порядке их добавления в состояние.
+    ItemIndex       index_;                  //!< Хэш-индекс ситуаций для поиска дубликатов за O(1).
+    TransitiveItemVector transitive_items_;  //!< Транзитивные ситуации Лео для каждого нетерминала.
+    Lr0ItemVector   lr0_items_;              //!< Ситуации в режиме LR(0) автомата.
+    Lr0ItemIndex    lr0_index_;              //!< Индекс ситуаций в режиме LR(0) автомата.
+    Lr0OriginIndex  lr0_origins_;            //!< Состояния автомата по номеру состояния порождения.
+    Lr0GotoIndex    lr0_gotos_;              //!< Ситуации в режиме LR(0) автомата с переходом по каждому нетерминалу.
+    std::vector<size_t> lr0_descendants_;    //!< Состояния, содержащие ситуации, порожденные в данном.
+    Lr0CompletedIndex lr0_completed_;        //!< Строится при первом восстановлении ситуаций в состоянии.
+    bool            lr0_completed_built_;    //!< Индекс lr0_completed_ построен.
+    DerivationIndex derivations_;            //!< Обычные ситуации, восстановленные по LR(0) ситуациям.
     size_t          num_of_items_;           //!< Число ситуаций в состоянии.
+    float           best_score_;             //!< Лучшая оценка незавершенных ситуаций состояния в режиме пучка.
     bool            is_completed_;           //!< Флаг того, что состояние содержит ситуацию вида [S--> alpha *, 0, ...].
     size_t          id_;                     //!< Уникальный идентификатор данного состояния.
+    TransitionList  transitions_;            //!< Переходы в состояние по всем токенам, заканчивающимся в его позиции.
     Token::Ptr      token_;                  //!< Токен, послуживший инициатором создания этого состояния.
+    size_t          position_;               //!< Позиция во входном потоке, на которой заканчивается token_.
+    Lexer::TokenList next_tokens_;           //!< Токены, следующие за token_, полученные от лексического анализатора.
+    Grammar::SymbolSet lookahead_;           //!< Терминалы токенов next_tokens_.
+    Grammar::SymbolSet predicted_;           //!< Нетерминалы, правила которых уже предсказаны операцией Predictor.
+    Grammar::SymbolSet materialized_;        //!< Символы, для которых построены предсказанные ситуации с меткой перед ними.
     ItemDispatcher* disp_;                   //!< Указатель на объект диспетчера ситуаций.
-    Grammar*        grammar_;                //!< Указатель на объект грамматики.
+    const Grammar*  grammar_;                //!< Указатель на объект грамматики.
     bool            valid_;                  //!< Установлен в true, если состояние рабочее.
 
     //! Конструктор по умолчанию.
     State()
-      : num_of_items_(0)
+      : lr0_completed_built_(false)
+      , num_of_items_(0)
+      , best_score_(-std::numeric_limits<float>::infinity())
       , is_completed_(false)
       , id_(0)
+      , position_(0)
       , disp_(NULL)
       , grammar_(NULL)
       , valid_(false)
@@ -237,11 +547,13 @@ public:
      * \param[in] id      Уникальный идентификатор состояния.
      * \param[in] token   Токен для данного состояния.
      */
-    void Init(ItemDispatcher* disp, Grammar* grammar, size_t id, Token::Ptr token) {
+    void Init(ItemDispatcher* disp, const Grammar* grammar, size_t id, Token::Ptr token) {
       num_of_items_ = 0;
+      best_score_   = -std::numeric_limits<float>::infinity();
       is_completed_ = false;
       id_           = id;
       token_        = token;
+      position_     = token->abs_pos_ + token->length_;
       disp_         = disp;
       grammar_      = grammar;
       valid_        = true;
@@ -249,27 +561,44 @@ public:
       // Число списков для символов -- это число символов + 1 для метки в конце правила. Для этого
       // специального случая используется список с нулевым индексом.
       items_.resize(grammar_->GetNumOfTerminals() + grammar_->GetNumOfNonterminals() + 1);
+      predicted_.resize(items_.size());
+      materialized_.resize(items_.size());
 
-      // Ситуаций для правил с пустой правой частью ровно столько, сколько нетерминальных символов в грамматике.
-      items_with_empty_rules_.resize(grammar_->GetNumOfNonterminals());
+      // Транзитивные ситуации вычисляются по требованию, по одной на нетерминал.
+      transitive_items_.resize(grammar_->GetNumOfNonterminals());
     }
 
-    //! Деинициализация состояния.
+    //! Деинициализация состояния, память контейнеров сохраняется для следующего использования.
     void Uninit() {
+      // Списки ситуаций сохраняются вместе с выделенной памятью, грамматика у состояния не меняется.
       for (size_t i = 0; i < items_.size(); ++i) {
-        items_[i].Uninit(disp_);
+        items_[i].Uninit();
       }
-      items_.clear();
-
-      for (size_t i = 0; i < items_with_empty_rules_.size(); ++i) {
-        items_with_empty_rules_[i].Uninit(disp_);
+      state_items_.clear();
+
+      index_.Clear();
+      transitive_items_.clear();
+      lr0_items_.clear();
+      lr0_index_.Clear();
+      lr0_origins_.clear();
+      for (size_t i = 0; i < lr0_gotos_.size(); ++i) {
+        lr0_gotos_[i].clear();
       }
-      items_with_empty_rules_.clear();
+      lr0_descendants_.clear();
+      lr0_completed_.clear();
+      lr0_completed_built_ = false;
+      derivations_.Clear();
 
       num_of_items_ = 0;
       is_completed_ = false;
       id_           = 0;
-      token_        = Token::Ptr(new Token());
+      transitions_.clear();
+      token_        = Token::Ptr();
+      position_     = 0;
+      next_tokens_.clear();
+      lookahead_.clear();
+      predicted_.reset();
+      materialized_.reset();
       disp_         = NULL;
       grammar_      = NULL;
       valid_        = false;
@@ -278,7 +607,6 @@ public:
     /*!
      * \brief Добавление новой систуации в состояние.
      *
-     * \param[in] parser    Указатель на объект парсера.
      * \param[in] rule_id   Идентификатор правила для данной ситуации.
      * \param[in] dot       Позиция метки в правой части правила.
      * \param[in] origin    Номер состояния, в которое данная ситуация была первоначально добавлена.
@@ -286,14 +614,43 @@ public:
      * \param[in] rptr      Указатель на ситуацию, послужившую причиной сдвига нетерминала слева от метки.
      * \param[in] context   Указатель на контекст интерпретатора.
      */
-    inline Item* AddItem(EarleyParser* parser, Grammar::RuleId rule_id, unsigned dot, size_t origin, Item* lptr, Item* rptr, Context::Ptr context);
+    inline Item* AddItem(Grammar::RuleId rule_id, unsigned dot, size_t origin, Item* lptr, Item* rptr, Context::Ptr context);
+
+    /*!
+     * \brief Поиск ситуации в состоянии по хэш-индексу.
+     *
+     * \param[in] rule_id   Идентификатор правила для данной ситуации.
+     * \param[in] dot       Позиция метки в правой части правила.
+     * \param[in] origin    Номер состояния, в которое данная ситуация была первоначально добавлена.
+     * \param[in] lptr      Указатель на ситуацию с меткой на символ левее.
+     * \return              Указатель на найденную ситуацию или нуль.
+     */
+    Item* FindItem(Grammar::RuleId rule_id, unsigned dot, size_t origin, Item* lptr) const {
+      return index_.Find(ItemKey(rule_id, dot, origin, lptr));
+    }
+
+    /*!
+     * \brief Поиск токена, сдвигом которого из предыдущего состояния получены ситуации данного.
+     *
+     * \param[in] prev_id   Номер предыдущего состояния.
+     * \param[in] symbol_id Терминал, по которому выполнен сдвиг.
+     * \return              Токен или пустой указатель, если такого перехода нет.
+     */
+    Token::Ptr GetToken(size_t prev_id, Grammar::SymbolId symbol_id) const {
+      for (size_t i = 0; i < transitions_.size(); ++i) {
+        if (transitions_[i].prev_id_ == prev_id and grammar_->GetInternalSymbolByExtrernalId(transitions_[i].token_->type_) == symbol_id) {
+          return transitions_[i].token_;
+        }
+      }
+      return Token::Ptr();
+    }
 
 #   ifdef DUMP_CONTENT
     //! Печать содержимого состояния.
     void Dump(std::ostream& out) {
       out << "\n****** State number = " << id_ << " *** Number of items = " << num_of_items_ << " ******\n";
-      for (Item* item = state_items_.get_first(); item; item = state_items_.get_next()) {
-        item->Dump(grammar_, out);
+      for (size_t i = 0; i < state_items_.size(); ++i) {
+        state_items_[i]->Dump(grammar_, out);
       }
     }
 #   endif // DUMP_CONTENT
@@ -308,12 +665,12 @@ public:
     typedef std::pair<State*, size_t> StatePnt;
 
     //! Тип списка состояний.
-    typedef parser::list<StatePnt> StateList;
+    typedef std::vector<StatePnt> StateList;
 
     StateRepo       repo_;        //!< Репозиторий состояний.
     StateList       free_states_; //!< Список свободных состояний.
     ItemDispatcher* disp_;        //!< Указатель на объект диспетчера ситуаций.
-    Grammar*        grammar_;     //!< Указатель на объект грамматики.
+    const Grammar*  grammar_;     //!< Указатель на объект грамматики.
 
     /*!
      * \brief Конструктор репозитория.
@@ -321,7 +678,7 @@ public:
      * \param disp    Указатель на объект диспетчера ситуаций.
      * \param grammar Указатель на объект грамматики.
      */
-    StateDispatcher(ItemDispatcher* disp, Grammar* grammar)
+    StateDispatcher(ItemDispatcher* disp, const Grammar* grammar)
       : disp_(disp)
       , grammar_(grammar)
     {}
@@ -363,6 +720,48 @@ public:
       repo_[id].Init(disp_, grammar_, id, token);
       return id;
     }
+
+    /*!
+     * \brief Освобождение всех состояний с сохранением их для следующих разборов.
+     *
+     * Состояния помещаются в список свободных так, чтобы новые состояния получали идентификаторы
+     * по порядку, начиная с нуля.
+     */
+    void Reset() {
+      free_states_.clear();
+      for (size_t id = repo_.size(); id > 0; --id) {
+        State& state = repo_[id - 1];
+        if (state.valid_) {
+          state.Uninit();
+        }
+        free_states_.push_back(StatePnt(&state, id - 1));
+      }
+    }
+
+    //! Освобождение всех состояний вместе с их памятью.
+    void Release() {
+      Reset();
+      StateList().swap(free_states_);
+      StateRepo().swap(repo_);
+    }
+
+    //! Получение количества используемых состояний.
+    size_t GetNumOfStates() const {
+      return repo_.size() - free_states_.size();
+    }
+
+    /*!
+     * \brief Освобождение одного состояния с сохранением его для следующих разборов.
+     *
+     * \param[in] index Индекс состояния.
+     */
+    void FreeState(size_t index) {
+      State& state = repo_[index];
+      if (state.valid_) {
+        state.Uninit();
+        free_states_.push_back(StatePnt(&state, index));
+      }
+    }
   };
 
   //! Интерфейс для взаимодействия с интерпретатором.
@@ -406,15 +805,388 @@ public:
     virtual Context::Ptr HandleNonTerminal(const Item* rule_item, const Item* left_item) = 0;
   };
 
-  typedef queue<Item*> ItemQueue;
-  typedef parser::list<size_t> StateList;
+  /*!
+   * \brief Интерпретатор, принимающий все символы без построения семантики.
+   *
+   * Используется при построении леса разбора: все сдвиги записываются в ситуации с одним общим контекстом,
+   * а выводы потом собираются в лес.
+   */
+  struct ForestRecorder : public Interpretator {
+    Context::Ptr accepted_; //!< Общий контекст для всех принятых символов.
+
+    //! Конструктор с созданием общего контекста.
+    ForestRecorder()
+      : accepted_(new Context())
+    {}
+
+    void Start(EarleyParser*) {}
+    void End(const Item*) {}
+
+    Context::Ptr HandleTerminal(Token::Ptr, const Item*) {
+      return accepted_;
+    }
+
+    Context::Ptr HandleNonTerminal(const Item*, const Item*) {
+      return accepted_;
+    }
+  };
+
+  //! Результат последнего запуска разбора.
+  enum ParseStatus {
+    kAccepted,          //!< Входная цепочка разобрана.
+    kRejected,          //!< Входная цепочка не принадлежит языку.
+    kCancelled,         //!< Разбор прерван вызовом Cancel.
+    kItemLimit,         //!< Превышено ограничение Options::max_items_.
+    kStateLimit,        //!< Превышено ограничение Options::max_states_.
+    kMemoryLimit,       //!< Превышено ограничение Options::max_memory_.
+    kTimeLimit          //!< Превышено ограничение Options::time_limit_ms_.
+  };
+
+  /*!
+   * \brief Счетчики одного запуска разбора.
+   *
+   * Собираются при каждом запуске Parse, Reparse или разбора потока токенов и доступны через GetStats до
+   * следующего запуска. Счетчики увеличиваются в операциях алгоритма, а время этапов замеряется несколько
+   * раз за разбор, поэтому сбор не замедляет разбор заметно. Reparse учитывает только повторно выполненную
+   * работу, кроме числа ситуаций в состояниях. Статистики разных разборов складываются методом Add.
+   */
+  struct Stats {
+    size_t  num_of_parses_;     //!< Число запусков разбора, сложенных в статистику.
+    size_t  num_of_states_;     //!< Число замкнутых состояний, сохраненных к концу разбора.
+    size_t  num_of_items_;      //!< Число ситуаций в этих состояниях, в режиме kLr0Engine -- LR(0) ситуаций.
+    size_t  max_state_items_;   //!< Наибольшее число ситуаций в одном состоянии.
+
+    /*!
+     * \brief Число ситуаций в каждом замкнутом состоянии в порядке позиций во входном потоке.
+     *
+     * Включает предсказанные ситуации, построенные после замыкания состояния. Состояния, освобожденные
+     * при разборе потока токенов, не учитываются. Add этот список не складывает.
+     */
+    std::vector<size_t> state_items_;
+
+    size_t  duplicate_items_;   //!< Сдвиги метки, давшие ситуацию, которая уже есть в состоянии (IsItemInList).
+    size_t  completer_calls_;   //!< Вызовы операции Completer, в режиме kLr0Engine -- обработанные LR(0) ситуации.
+    size_t  predictor_calls_;   //!< Вызовы операции Predictor, в режиме kLr0Engine предсказания заложены в автомат.
+    size_t  scanner_calls_;     //!< Вызовы операции Scanner.
+    size_t  nullable_items_;    //!< Ситуации, поставленные в очередь при сдвиге метки через пустые выводы.
+    size_t  terminal_calls_;    //!< Вызовы Interpretator::HandleTerminal, в режимах леса и отложенной семантики -- и записи сдвигов.
+    size_t  nonterminal_calls_; //!< Вызовы Interpretator::HandleNonTerminal, см. terminal_calls_.
+    size_t  end_calls_;         //!< Вызовы Interpretator::End.
+    size_t  item_blocks_;       //!< Наибольшее число блоков ситуаций ItemDispatcher::items_.
+    size_t  rptr_blocks_;       //!< Наибольшее число блоков ссылок ItemDispatcher::rptr_pool_.
+
+    double  recognition_seconds_; //!< Время построения состояний операциями Closure и Scanner.
+    double  derivation_seconds_;  //!< Время построения выводов после распознавания: ситуации Лео и LR(0), пучок, лес, отложенная семантика.
+    double  end_seconds_;         //!< Время вызовов Interpretator::End.
+
+    //! Инициализация нулями.
+    Stats() {
+      Clear();
+    }
+
+    //! Обнуление счетчиков с сохранением памяти списка state_items_.
+    void Clear();
+
+    /*!
+     * \brief Прибавление счетчиков другого разбора.
+     *
+     * Числа и время складываются, для наибольших значений берется наибольшее.
+     *
+     * \param[in] stats Статистика, которая прибавляется к этой.
+     */
+    void Add(const Stats& stats);
+  };
+
+  //! Настройки алгоритма.
+  struct Options {
+    /*!
+     * \brief Использовать транзитивные ситуации Лео.
+     *
+     * Операция Completer для праворекурсивных правил сразу добавляет ситуацию на вершине цепочки
+     * детерминированных завершений, что делает разбор праворекурсивных грамматик линейным. Промежуточные
+     * ситуации цепочки строятся только тогда, когда ситуация на вершине передается интерпретатору, и
+     * для последних состояний перед вызовом Interpretator::End. Поэтому отказ интерпретатора от
+     * нетерминала внутри цепочки учитывается только при ее раскрытии.
+     */
+    bool use_leo_items_;
+
+    /*!
+     * \brief Отбрасывать ситуации, которые не могут быть продолжены следующими токенами.
+     *
+     * Операции Predictor, Completer и Scanner не добавляют ситуацию, если остаток ее правила после метки
+     * не выводит пустую цепочку и не может начинаться ни с одного терминала из токенов, которые лексический
+     * анализатор возвращает для состояния. Интерпретатор не получает вызовов для таких ситуаций.
+     */
+    bool use_lookahead_;
+
+    //! Алгоритм построения состояний Эрли.
+    enum Engine {
+      kItemEngine,  //!< Ситуации с одним помеченным правилом.
+      kLr0Engine    //!< Ситуации с состоянием LR(0) автомата грамматики (Aycock, Horspool).
+    };
+
+    /*!
+     * \brief Алгоритм построения состояний Эрли.
+     *
+     * В режиме kLr0Engine распознавание выполняется над ситуациями с состояниями LR(0) автомата, а
+     * интерпретатору ничего не передается. Для последних состояний, содержащих вывод начального символа,
+     * по ним восстанавливаются обычные ситуации, участвующие в выводах, и только для них вызываются
+     * HandleTerminal и HandleNonTerminal. Поэтому отказ интерпретатора не сокращает распознавание, а лишь
+     * исключает выводы. Настройка use_leo_items_ в этом режиме не используется.
+     *
+     * Сейчас режим kLr0Engine медленнее kItemEngine: распознавание быстрее, но восстановление обычных
+     * ситуаций после него занимает большую часть времени, и на бенчмарке c размера 160 разбор выходит
+     * примерно в 3-4 раза дольше. Выигрыш режима -- примерно вдвое меньшее число ситуаций.
+     */
+    Engine engine_;
+
+    /*!
+     * \brief Строить разделяемый упакованный лес разбора.
+     *
+     * Во время разбора HandleTerminal и HandleNonTerminal не вызываются. После разбора по ситуациям,
+     * участвующим в выводах начального символа, строится лес, доступный через GetForest, и только затем
+     * для каждой такой ситуации вызывается Interpretator::End. Семантика при этом вычисляется обходом леса,
+     * размер которого полиномиален даже при экспоненциальном числе деревьев разбора. Вместе с настройкой
+     * defer_semantics_ лес строится только из выводов, принятых интерпретатором.
+     */
+    bool build_forest_;
+
+    /*!
+     * \brief Откладывать вызовы интерпретатора до окончания разбора.
+     *
+     * Во время разбора сдвиги символов только запоминаются в ситуациях. После разбора HandleTerminal и
+     * HandleNonTerminal вызываются лишь для ситуаций, достижимых из завершенных ситуаций начального символа,
+     * причем для каждой ситуации -- после всех ситуаций, на которые она ссылается. Вывод, от которого
+     * интерпретатор отказался, удаляется, а ситуация без выводов считается отсутствующей. В отличие от
+     * обычного режима, контекст сохраняется и для повторных выводов уже существующей ситуации. Выводы
+     * через циклы грамматики (A -->+ A) не передаются интерпретатору.
+     */
+    bool defer_semantics_;
+
+    /*!
+     * \brief Количество ситуаций в блоке памяти диспетчера ситуаций.
+     *
+     * Блоки выделяются по мере необходимости и сохраняются между разборами, поэтому при повторном
+     * использовании объекта парсера память под ситуации больше не выделяется.
+     */
+    size_t item_block_size_;
+
+    /*!
+     * \brief Ширина пучка.
+     *
+     * Если не ноль, то операция Scanner переносит в каждое состояние не больше beam_width_ ситуаций с
+     * наибольшими внутренними оценками Item::score_, а операции Scanner и Completer не добавляют ситуации,
+     * оценка которых ниже лучшей оценки состояния более чем на beam_threshold_. Тогда размер состояний
+     * меньше зависит от неоднозначности входа, но часть выводов теряется. В режиме
+     * пучка транзитивные ситуации Лео не используются, в режиме kLr0Engine пучок не применяется.
+     */
+    size_t beam_width_;
+
+    //! Порог оценки в режиме пучка, см. beam_width_.
+    float beam_threshold_;
+
+    /*!
+     * \brief Количество лучших выводов, сохраняемых в режиме пучка.
+     *
+     * Перед вызовами Interpretator::End оценки ситуаций выводов пересчитываются по всем их ссылкам,
+     * завершенные ситуации начального символа упорядочиваются по убыванию оценки, и интерпретатору
+     * передаются не более k_best_ из них. У каждой ситуации их выводов остаются k_best_ ссылок rptrs_
+     * с лучшими оценками, первая из которых -- лучшая. Ноль сохраняет все.
+     */
+    size_t k_best_;
+
+    /*!
+     * \brief Ограничения ресурсов одного разбора, ноль -- без ограничения.
+     *
+     * Проверяются операциями Closure и Scanner, а также при восстановлении ситуаций в режиме kLr0Engine и
+     * при построении леса разбора. При превышении разбор останавливается со статусом GetStatus,
+     * соответствующим ограничению, см. Cancel. Число ситуаций -- это выделенные из блоков ситуации вместе
+     * с ситуациями LR(0) автомата, добавленными в состояния. Память оценивается по размеру ситуаций обоих
+     * видов, ссылок rptrs_, состояний, ячеек их хэш-индексов и леса разбора. Время отсчитывается от
+     * начала Parse, Reparse или StartPush и проверяется раз в kBudgetCheckInterval проверок.
+     */
+    size_t max_items_;
+    size_t max_states_;   //!< Наибольшее число состояний, см. max_items_.
+    size_t max_memory_;   //!< Наибольшая оценка памяти в байтах, см. max_items_.
+    size_t time_limit_ms_;//!< Наибольшее время разбора в миллисекундах, см. max_items_.
+
+    //! Настройки по умолчанию.
+    Options()
+      : use_leo_items_(false)
+      , use_lookahead_(true)
+      , engine_(kItemEngine)
+      , build_forest_(false)
+      , defer_semantics_(false)
+      , item_block_size_(4096)
+      , beam_width_(0)
+      , beam_threshold_(std::numeric_limits<float>::infinity())
+      , k_best_(0)
+      , max_items_(0)
+      , max_states_(0)
+      , max_memory_(0)
+      , time_limit_ms_(0)
+    {}
+  };
+
+  /*!
+   * \brief Очередь необработанных ситуаций.
+   *
+   * Очередь хранится в векторе и опустошается в конце каждой операции Closure, после чего память
+   * вектора используется заново.
+   */
+  struct ItemQueue {
+    ItemList  items_; //!< Ситуации очереди.
+    size_t    head_;  //!< Позиция первой необработанной ситуации.
+
+    //! Конструктор пустой очереди.
+    ItemQueue()
+      : head_(0)
+    {}
+
+    //! Проверка на пустоту.
+    bool empty() const {
+      return head_ == items_.size();
+    }
+
+    //! Добавление ситуации в конец очереди.
+    void push(Item* item) {
+      items_.push_back(item);
+    }
+
+    //! Извлечение ситуации из начала непустой очереди.
+    Item* pop() {
+      Item* item = items_[head_++];
+      if (head_ == items_.size()) {
+        clear();
+      }
+      return item;
+    }
+
+    //! Удаление всех ситуаций.
+    void clear() {
+      items_.clear();
+      head_ = 0;
+    }
+  };
+
+  typedef std::vector<size_t> StateList;
+
+  //! Тип пары (позиция во входном потоке, номер состояния).
+  typedef std::pair<size_t, size_t> PendingState;
+
+  //! Тип списка незамкнутых состояний.
+  typedef std::vector<PendingState> PendingStateList;
+
+  //! Наименьшее число новых состояний между освобождениями недостижимых при разборе потока токенов.
+  static const size_t kMinReleaseInterval = 64;
 
-  Grammar*          grammar_;           //!< Указатель на объект грамматики.
+  //! Число проверок ограничений ресурсов между проверками времени и запроса отмены.
+  static const size_t kBudgetCheckInterval = 1024;
+
+  const Grammar*    grammar_;           //!< Указатель на объект грамматики.
   Lexer*            lexer_;             //!< Указатель на объект лексического анализатора.
   Interpretator*    interpretator_;     //!< Указатель на объект интерпретатора.
+  Interpretator*    handler_;           //!< Интерпретатор, получающий сдвиги символов во время разбора.
   StateDispatcher   state_disp_;        //!< Диспетчер состояний.
   ItemDispatcher    item_disp_;         //!< Диспетчер ситуаций.
   ItemQueue         nonhandled_items_;  //!< Очередь необработанных ситуаций.
+  Options           options_;           //!< Настройки алгоритма.
+  std::vector<bool> nullable_in_progress_; //!< Нетерминалы, для которых сейчас строятся пустые выводы.
+  ItemList          nullable_completions_; //!< Стек завершенных ситуаций пустых выводов для GetNullableCompletions.
+  PendingStateList  pending_states_;    //!< Созданные операцией Scanner, но еще не замкнутые состояния.
+  StateList         closed_states_;     //!< Замкнутые состояния в порядке позиций во входном потоке.
+  StateList         end_states_;        //!< Состояния, полученные сдвигом последних токенов потока.
+  ItemList          released_items_;    //!< Ситуации цепочек lptr_, сохраненные из освобожденных состояний.
+  size_t            push_state_id_;     //!< Последнее состояние разбора потока токенов, передаваемых по одному.
+  size_t            push_release_limit_;//!< Число замкнутых состояний, при котором освобождаются недостижимые.
+  Lexer::TokenList  scanner_tokens_;    //!< Рабочий буфер операции Scanner для следующих токенов.
+  Grammar::SymbolSet scanner_lookahead_; //!< Рабочий буфер операции Scanner для множества следующих терминалов.
+  Grammar::SymbolSet predictor_symbols_; //!< Рабочий буфер операции Predictor для вновь предсказанных нетерминалов.
+  std::vector<std::pair<size_t, size_t> > split_positions_; //!< Рабочий буфер CollectSplits для точек разбиения с их позициями.
+  std::vector<Grammar::RuleId> split_rules_; //!< Рабочий буфер CollectSplits для завершенных правил точки разбиения.
+  std::vector<std::pair<float, size_t> > beam_items_; //!< Рабочий буфер операции Scanner: оценки и номера ситуаций, попавших в пучок.
+  ForestRecorder    forest_recorder_;   //!< Интерпретатор для режима построения леса разбора.
+  Sppf              forest_;            //!< Лес разбора последнего запуска Parse.
+  State::DerivationPool derivation_pool_; //!< Записи обычных ситуаций, восстановленных в режиме kLr0Engine.
+  ParseStatus       status_;            //!< Результат последнего запуска разбора.
+  size_t            budget_checks_;     //!< Число проверок ограничений ресурсов с начала разбора.
+  boost::posix_time::ptime deadline_;   //!< Момент, после которого разбор останавливается по времени.
+  boost::mutex      cancel_mutex_;      //!< Блокировка запроса отмены.
+  bool              cancel_requested_;  //!< Запрос отмены, еще не обработанный разбором.
+  Stats             stats_;             //!< Счетчики текущего или последнего запуска разбора.
+
+  //! Начало отсчета ограничений ресурсов и счетчиков для нового запуска разбора.
+  void StartBudget();
+
+  //! Замер этапа разбора: время жизни объекта прибавляется к счетчику Stats.
+  class PhaseTimer {
+  public:
+    //! Начало замера, время прибавляется к seconds.
+    explicit PhaseTimer(double& seconds)
+      : seconds_(seconds)
+      , start_(boost::posix_time::microsec_clock::universal_time())
+    {}
+
+    ~PhaseTimer() {
+      seconds_ += (boost::posix_time::microsec_clock::universal_time() - start_).total_microseconds() / 1e6;
+    }
+
+  private:
+    double&                   seconds_; //!< Счетчик времени этапа.
+    boost::posix_time::ptime  start_;   //!< Начало замера.
+  };
+
+  //! Сохранение в stats_ числа ситуаций замкнутых состояний и блоков диспетчера ситуаций.
+  void CollectStateStats();
+
+  //! Передача сдвига терминала интерпретатору handler_ с подсчетом вызова.
+  Context::Ptr HandleTerminal(Token::Ptr token, const Item* item) {
+    ++stats_.terminal_calls_;
+    return handler_->HandleTerminal(token, item);
+  }
+
+  /*!
+   * \brief Передача сдвига нетерминала интерпретатору handler_ с подсчетом вызова.
+   *
+   * Сдвиги вспомогательных нетерминалов EBNF внутри их собственных правил интерпретатору не передаются и
+   * получают общий контекст, их раскрывает GetChildContexts.
+   */
+  Context::Ptr HandleNonTerminal(const Item* rule_item, const Item* left_item) {
+    if (IsOperatorShift(rule_item, left_item)) {
+      return forest_recorder_.accepted_;
+    }
+    ++stats_.nonterminal_calls_;
+    return handler_->HandleNonTerminal(rule_item, left_item);
+  }
+
+  //! Проверка, что завершенная ситуация вспомогательного нетерминала EBNF сдвигается в правиле такого же нетерминала.
+  bool IsOperatorShift(const Item* rule_item, const Item* left_item) const {
+    return grammar_->IsOperatorSymbol(grammar_->GetLhsOfRule(rule_item->rule_id_))
+           and grammar_->IsOperatorSymbol(grammar_->GetLhsOfRule(left_item->rule_id_));
+  }
+
+  /*!
+   * \brief Проверка ограничений ресурсов и запроса отмены.
+   *
+   * \return false если разбор нужно остановить, причина сохраняется в status_.
+   */
+  inline bool CheckBudget();
+
+  //! Проверка, остановлен ли разбор до завершения.
+  bool IsStopped() const {
+    return status_ > kRejected;
+  }
+
+  /*!
+   * \brief Освобождение ресурсов остановленного разбора.
+   *
+   * Освобождаются состояния, ситуации и контексты интерпретатора, а также память блоков диспетчеров, чтобы
+   * разбор, остановленный из-за ограничения, не удерживал ее до следующего запуска.
+   */
+  void Abort();
+
+  //! Оценка памяти текущего разбора: ситуации, ссылки, состояния с хэш-индексами и лес разбора, см. Options::max_memory_.
+  size_t GetMemoryUsage() const;
 
   /*!
    * \brief Реализация операции Completer.
@@ -427,59 +1199,424 @@ public:
   /*!
    * \brief Реализацию операции Predictor.
    *
+   * Если символ после метки выводит пустую цепочку, то метка сразу сдвигается через него (Aycock--Horspool),
+   * поэтому операции Completer не нужно обрабатывать завершения, порожденные в текущем состоянии.
+   *
+   * Предсказанные ситуации [A --> * alpha, i] хранятся неявно множеством предсказанных нетерминалов
+   * состояния и строятся функцией BuildPredictedItems, когда метку в них нужно сдвинуть. Сразу строятся
+   * только ситуации, у которых первый символ правила выводит пустую цепочку: метка в них сдвигается
+   * при замыкании состояния.
+   *
    * \param[in] state_id  Идентификатор состояния, которому принадлежит ситуация.
    * \param[in] item      Ситуация, которую необходимо обработать.
    */
   inline void Predictor(size_t state_id, Item* item);
 
+  /*!
+   * \brief Построение неявных предсказанных ситуаций с меткой перед символом.
+   *
+   * Вызывается перед обходом списка ситуаций состояния для символа, когда замыкание состояния уже
+   * построено. Для каждого символа ситуации строятся один раз.
+   *
+   * \param[in] state     Замкнутое состояние.
+   * \param[in] symbol_id Символ, перед которым стоит метка.
+   */
+  inline void BuildPredictedItems(State* state, Grammar::SymbolId symbol_id);
+
+  /*!
+   * \brief Получение завершенных ситуаций пустых выводов нетерминала в данном состоянии.
+   *
+   * Недостающие ситуации пустых выводов строятся по правилам, правая часть которых выводит пустую
+   * цепочку. Повторный вызов находит построенные ситуации по хэш-индексу состояния.
+   *
+   * \param[in]  state       Состояние, в котором строятся ситуации.
+   * \param[in]  symbol_id   Нетерминал, из которого выводится пустая цепочка.
+   * \param[out] completions Список, в конец которого добавляются завершенные ситуации вида [symbol_id --> alpha *, state].
+   */
+  void GetNullableCompletions(State* state, Grammar::SymbolId symbol_id, ItemList& completions);
+
+  /*!
+   * \brief Сдвиг метки в ситуации с добавлением полученной ситуации в состояние, если ее там еще нет.
+   *
+   * \param[in] state     Состояние, в которое добавляется ситуация.
+   * \param[in] item      Ситуация, в которой сдвигается метка.
+   * \param[in] rptr      Ситуация, послужившая причиной сдвига метки.
+   * \param[in] context   Указатель на контекст интерпретатора.
+   * \return              Ситуация со сдвинутой меткой.
+   */
+  inline Item* ShiftItem(State* state, Item* item, Item* rptr, Context::Ptr context);
+
   /*!
    * \brief реализация процедуры Scanner.
    *
+   * Все токены, заканчивающиеся в одной позиции входного потока, сдвигаются в одно состояние. Оно создается
+   * первым таким сдвигом и замыкается операцией Closure после сдвигов из всех состояний с меньшими позициями.
+   *
    * \param[in] state_id      Идентификатор состояния, для которого вызывается процедура.
    * \param[in] token         Токен для обработки.
-   * \param[in] new_state_id  Идентификатор состояния, которое было добавлено в результате выполнения процедуры.
-   * \return                  true если в результате было добавлено новое состояние.
+   * \param[in] new_state_id  Идентификатор состояния, в которое были добавлены ситуации.
+   * \return                  true если в результате были добавлены ситуации.
    */
   inline bool Scanner(size_t state_id, Token::Ptr token, size_t& new_state_id);
 
+  /*!
+   * \brief Поиск незамкнутого состояния для позиции во входном потоке.
+   *
+   * \param[in] position Позиция во входном потоке.
+   * \return             Указатель на состояние или нуль.
+   */
+  inline State* FindPendingState(size_t position);
+
+  /*!
+   * \brief Создание незамкнутого состояния для позиции конца токена.
+   *
+   * \param[in] token Токен, которым заканчивается состояние.
+   * \return          Указатель на новое состояние.
+   */
+  inline State* AddPendingState(Token::Ptr token);
+
+  /*!
+   * \brief Извлечение незамкнутого состояния с наименьшей позицией во входном потоке.
+   *
+   * \param[out] state_id Идентификатор состояния.
+   * \return              false если незамкнутых состояний нет.
+   */
+  inline bool PopPendingState(size_t& state_id);
+
+  /*!
+   * \brief Сдвиг токенов, следующих за состоянием.
+   *
+   * \param[in] state_id      Идентификатор состояния.
+   * \param[in] min_position  Сдвигаются только токены, заканчивающиеся не раньше этой позиции.
+   */
+  inline void ScanTokens(size_t state_id, size_t min_position);
+
+  /*!
+   * \brief Замыкание незамкнутых состояний в порядке позиций и проверка результата разбора.
+   *
+   * \return true если входная цепочка разобрана.
+   */
+  bool ParseStates();
+
   //! Итеративное выполнение операций Completer и Predictor.
   inline void Closure(size_t state_id);
 
+  /*!
+   * \brief Освобождение состояний, к которым разбор потока токенов больше не обратится.
+   *
+   * Сохраняются последнее состояние и состояния, в которых порождены ситуации сохраняемых, метка которых
+   * еще может сдвинуться: к ним обратится операция Completer. Из остальных состояний сохраняются только
+   * ситуации цепочек lptr_, которые интерпретатор обходит при завершении правила. Ссылки rptrs_ на
+   * освобожденные ситуации обнуляются, контексты интерпретатора в них остаются.
+   */
+  void ReleaseStates();
+
+  //! Проверка, что для настроек алгоритма ситуации освобожденных состояний не нужны после разбора.
+  bool CanReleaseStates() const {
+    return  options_.engine_ == Options::kItemEngine
+            and not options_.use_leo_items_
+            and not options_.build_forest_
+            and not options_.defer_semantics_;
+  }
+
+  /*!
+   * \brief Получение транзитивной ситуации Лео для нетерминала в данном состоянии.
+   *
+   * Транзитивные ситуации вычисляются по требованию и запоминаются в состоянии. Состояние к этому
+   * моменту должно быть полностью построено.
+   *
+   * \param[in] state     Состояние, в котором ищется транзитивная ситуация.
+   * \param[in] symbol_id Нетерминал, завершение которого обрабатывается.
+   * \return              Указатель на транзитивную ситуацию или нуль, если ее нет.
+   */
+  inline State::TransitiveItem* GetTransitiveItem(State* state, Grammar::SymbolId symbol_id);
+
+  /*!
+   * \brief Раскрытие всех ссылок через транзитивные ситуации у ситуации на вершине цепочки.
+   *
+   * \param[in] state     Состояние, которому принадлежит ситуация.
+   * \param[in] item      Ситуация на вершине цепочки.
+   */
+  void ExpandTransitiveRptrs(State* state, Item* item);
+
+  /*!
+   * \brief Построение промежуточных ситуаций цепочки детерминированных завершений.
+   *
+   * \param[in] state     Состояние, которому принадлежат ситуации цепочки.
+   * \param[in] top       Ситуация на вершине цепочки.
+   * \param[in] bottom    Завершенная ситуация, с которой начинается цепочка.
+   */
+  void ExpandTransitiveRptr(State* state, Item* top, Item* bottom);
+
   //! Инициализация начального состояния.
   inline bool InitFirstState(size_t& state_id);
 
+  //! Получение узла леса, соответствующего ситуации: узла символа для завершенной, промежуточного для остальных.
+  Sppf::NodeId GetForestNode(const Item* item);
+
+  /*!
+   * \brief Построение леса разбора по ситуациям, участвующим в выводах начального символа.
+   *
+   * \param[in] roots     Завершенные ситуации для начального символа из последних состояний.
+   */
+  void BuildForest(const std::vector<Item*>& roots);
+
+  //! Состояние ситуации при отложенном вычислении семантики.
+  enum DeferredStatus {
+    kDeferredVisiting,  //!< Ситуация обходится, ее зависимости еще не вычислены.
+    kDeferredAlive,     //!< Ситуация вычислена и имеет хотя бы один принятый вывод.
+    kDeferredDead       //!< Интерпретатор отказался от всех выводов ситуации.
+  };
+
+  //! Тип отображения ситуаций в их состояние при отложенном вычислении семантики.
+  typedef boost::unordered_map<Item*, DeferredStatus> DeferredStatusMap;
+
+  /*!
+   * \brief Отложенный вызов интерпретатора для ситуаций, участвующих в выводах начального символа.
+   *
+   * \param[in,out] roots  Завершенные ситуации для начального символа. Ситуации, от всех выводов
+   *                       которых отказался интерпретатор, удаляются.
+   */
+  void EvaluateDeferred(std::vector<Item*>& roots);
+
+  //! Порядок ситуаций по убыванию оценки, при равных оценках -- по номеру в списке.
+  struct BeamOrder {
+    bool operator()(const std::pair<float, size_t>& lhs, const std::pair<float, size_t>& rhs) const {
+      return lhs.first > rhs.first or (lhs.first == rhs.first and lhs.second < rhs.second);
+    }
+  };
+
+  /*!
+   * \brief Выбор ситуаций, переносимых операцией Scanner в режиме пучка.
+   *
+   * \param[in] next_state Состояние, в которое переносятся ситуации.
+   * \param[in] item_list  Ситуации с меткой перед терминалом токена.
+   * \return               Число выбранных ситуаций, их номера в item_list по возрастанию -- в beam_items_[i].second.
+   */
+  size_t SelectBeamItems(State* next_state, const State::SymbolItemList& item_list);
+
+  /*!
+   * \brief Сохранение k лучших выводов перед вызовами Interpretator::End.
+   *
+   * \param[in,out] roots  Завершенные ситуации для начального символа, упорядочиваются по убыванию оценки.
+   */
+  void SelectBestDerivations(std::vector<Item*>& roots);
+
+  /*!
+   * \brief Вызов интерпретатора для всех выводов ситуации, зависимости которой уже вычислены.
+   *
+   * \param[in] item       Ситуация.
+   * \param[in,out] status Состояния ситуаций.
+   */
+  void EvaluateDeferredItem(Item* item, DeferredStatusMap& status);
+
+  /*!
+   * \brief Получение следующих токенов и множества терминалов для предпросмотра.
+   *
+   * \param[in] token       Токен, за которым следуют получаемые токены.
+   * \param[out] tokens     Следующие токены.
+   * \param[out] lookahead  Множество терминалов следующих токенов.
+   */
+  inline void GetLookahead(Token::Ptr token, Lexer::TokenList& tokens, Grammar::SymbolSet& lookahead);
+
+  /*!
+   * \brief Проверка, может ли ситуация с данной позицией метки быть продолжена в состоянии.
+   *
+   * \param[in] state     Состояние, в которое добавляется ситуация.
+   * \param[in] rule_id   Идентификатор правила.
+   * \param[in] dot       Позиция метки в правой части правила.
+   * \return              true если ситуацию надо добавлять.
+   */
+  bool IsViable(State* state, Grammar::RuleId rule_id, unsigned dot) const {
+    return not options_.use_lookahead_ or grammar_->CanStartWith(rule_id, dot, state->lookahead_);
+  }
+
+  /*!
+   * \brief Проверка IsViable по смещению остатка правила из SymbolItemList::next_offsets_.
+   *
+   * \param[in] state     Состояние, в которое добавляется ситуация.
+   * \param[in] offset    Смещение остатка правила после метки.
+   * \return              true если ситуацию надо добавлять.
+   */
+  bool IsViable(State* state, size_t offset) const {
+    return not options_.use_lookahead_ or grammar_->CanSuffixStartWith(offset, state->lookahead_);
+  }
+
+  /*!
+   * \brief Оценка ситуации для сравнения в пучке.
+   *
+   * Внутренние оценки ситуаций одного состояния с разными начальными состояниями несравнимы, поэтому к
+   * внутренней оценке прибавляется лучшая оценка незавершенных ситуаций начального состояния, то есть
+   * префикса входа вместе с правилами, которые могли предсказать ситуацию. Завершенные ситуации в эту
+   * оценку не входят: они не предсказывают правил, и их оценка не учитывает правил над ними.
+   */
+  float GetBeamScore(size_t origin, float score) {
+    return state_disp_.GetState(origin)->best_score_ + score;
+  }
+
+  /*!
+   * \brief Проверка по порогу пучка ситуации, которая получится сдвигом метки.
+   *
+   * \param[in] state  Состояние, в которое добавляется ситуация.
+   * \param[in] cur    Ситуация, метка которой сдвигается.
+   * \param[in] score  Внутренняя оценка новой ситуации.
+   * \return           Прошла ли ситуация проверку. Незавершенная ситуация учитывается в лучшей оценке состояния.
+   */
+  bool IsInBeam(State* state, const Item* cur, float score) {
+    if (not options_.beam_width_) {
+      return true;
+    }
+    float beam_score = GetBeamScore(cur->origin_, score);
+    if (beam_score < state->best_score_ - options_.beam_threshold_) {
+      return false;
+    }
+    if (beam_score > state->best_score_ and grammar_->GetRhsOfRule(cur->rule_id_, cur->rhs_pos_ + 1) != Grammar::kBadSymbolId) {
+      state->best_score_ = beam_score;
+    }
+    return true;
+  }
+
+  /*!
+   * \brief Добавление LR(0) ситуации и ситуации для перехода по пустой цепочке.
+   *
+   * \param[in] state     Состояние, в которое добавляется ситуация.
+   * \param[in] dfa_state Состояние LR(0) автомата.
+   * \param[in] origin    Номер состояния, в котором ситуация была порождена.
+   */
+  inline void AddLr0Item(State* state, Lr0Automaton::StateId dfa_state, size_t origin);
+
+  //! Реализация процедуры Scanner в режиме LR(0) автомата.
+  inline bool ScannerLr0(size_t state_id, Token::Ptr token, size_t& new_state_id);
+
+  //! Реализация операции Completer в режиме LR(0) автомата.
+  inline void ClosureLr0(size_t state_id);
+
+  /*!
+   * \brief Проверка присутствия помеченного правила в состоянии в режиме LR(0) автомата.
+   *
+   * \param[in] state     Состояние, в котором производится поиск.
+   * \param[in] rule_id   Идентификатор правила.
+   * \param[in] dot       Позиция метки в правой части правила.
+   * \param[in] origin    Номер состояния, в котором правило было порождено.
+   * \return              true если помеченное правило присутствует.
+   */
+  bool ContainsLr0(State* state, Grammar::RuleId rule_id, unsigned dot, size_t origin) const;
+
+  //! Тип ключа восстановления: состояние и помеченное правило с нулевым lptr_.
+  typedef std::pair<State*, State::ItemKey> DerivationKey;
+
+  //! Тип вектора ключей восстановления.
+  typedef std::vector<DerivationKey> DerivationKeyVector;
+
+  /*!
+   * \brief Элемент стека обхода при восстановлении ситуаций.
+   *
+   * Зависимости всех помеченных правил в стеке хранятся в одном векторе: зависимости правила на вершине стека
+   * идут последними, поэтому при снятии правила со стека вектор укорачивается до начала его зависимостей.
+   */
+  struct DerivationFrame {
+    DerivationKey       key_;         //!< Восстанавливаемое помеченное правило.
+    State::Derivation*  derivation_;  //!< Его запись в State::derivations_, записи при росте индекса не перемещаются.
+    size_t              begin_;       //!< Индекс первой зависимости в векторе зависимостей обхода.
+    size_t              next_;        //!< Индекс следующей зависимости для обхода.
+
+    //! Инициализация ключом восстановления и началом зависимостей.
+    DerivationFrame(const DerivationKey& key, State::Derivation* derivation, size_t begin)
+      : key_(key)
+      , derivation_(derivation)
+      , begin_(begin)
+      , next_(begin)
+    {}
+  };
+
+  /*!
+   * \brief Поиск точек разбиения помеченного правила в режиме LR(0) автомата.
+   *
+   * \param[in] state       Состояние, в котором восстанавливаются ситуации.
+   * \param[in] key         Помеченное правило с номером состояния порождения.
+   * \param[in] derivation  Запись помеченного правила в State::derivations_.
+   * \param[out] deps       Помеченные правила, ситуации для которых нужны для построения, добавляются в конец.
+   */
+  void CollectSplits(State* state, const State::ItemKey& key, State::Derivation& derivation, DerivationKeyVector& deps);
+
+  /*!
+   * \brief Построение ситуаций помеченного правила по найденным точкам разбиения.
+   *
+   * Повторный вызов добавляет только выводы, которых еще нет, и только для них вызывает интерпретатор.
+   *
+   * \param[in] state       Состояние, в котором восстанавливаются ситуации.
+   * \param[in] key         Помеченное правило с номером состояния порождения.
+   * \param[in] derivation  Запись помеченного правила в State::derivations_.
+   * \return                true если добавлена ситуация или ссылка rptrs_.
+   */
+  bool BuildDerivation(State* state, const State::ItemKey& key, State::Derivation& derivation);
+
+  /*!
+   * \brief Поиск записи восстановленных ситуаций помеченного правила, отсутствующая запись добавляется.
+   *
+   * \param[in] state     Состояние, в котором восстанавливаются ситуации.
+   * \param[in] key       Помеченное правило с номером состояния порождения и нулевым lptr_.
+   * \return              Запись в State::derivations_.
+   */
+  State::Derivation& GetDerivation(State* state, const State::ItemKey& key);
+
+  /*!
+   * \brief Проверка, ссылается ли пустая ситуация (прямо или через другие пустые) на помеченное правило.
+   *
+   * Используется, чтобы, как и в GetNullableCompletions, не строить пустых выводов вида A -->+ A.
+   *
+   * \param[in] item      Ситуация с пустым выводом.
+   * \param[in] key       Помеченное правило, порожденное в состоянии ситуации.
+   */
+  bool ReachesEmptyItem(const Item* item, const State::ItemKey& key) const;
+
+  /*!
+   * \brief Восстановление обычных ситуаций для помеченного правила по LR(0) ситуациям.
+   *
+   * Ситуации строятся вместе с ситуациями, на которые они ссылаются через lptr_ и rptrs_, при этом
+   * интерпретатору передаются все сдвиги символов. Результат запоминается в состоянии.
+   *
+   * \param[in] state     Состояние, в котором восстанавливаются ситуации.
+   * \param[in] rule_id   Идентификатор правила.
+   * \param[in] dot       Позиция метки в правой части правила.
+   * \param[in] origin    Номер состояния, в котором правило было порождено.
+   * \return              Все ситуации для помеченного правила, отличающиеся lptr_.
+   */
+  std::vector<Item*> DeriveItems(State* state, Grammar::RuleId rule_id, unsigned dot, size_t origin);
+
   /*!
    * \brief Положить ситуацию в список необработанных с необязательной проверкой на присутствие в списке.
    *
+   * Присутствие ситуации в очереди отслеживается флагом Item::queued_, поэтому проверка не требует
+   * просмотра очереди.
+   *
    * \param[in] item  Указатель на объект стиуации.
    * \param[in] check Проверять или нет присутствие ситуации в списке.
    */
   inline void PutItemToNonhandledList(Item* item, bool check) {
-    if (not check or not nonhandled_items_.find(item)) {
+    if (not check or not item->queued_) {
       nonhandled_items_.push(item);
+      item->queued_ = true;
     }
   }
 
   /*!
-   * \brief Проверка на присутствие состояния в переданном списке.
+   * \brief Проверка на присутствие в состоянии ситуации со сдвинутой меткой.
    *
-   * \param[in] item_list Список ситуаций, в котором надо произвести поиск.
-   * \param[in] item      Ситуация, которую надо искать.
+   * Ищется ситуация, полученная из переданной сдвигом метки на один символ вправо. Поиск производится
+   * по хэш-индексу состояния.
+   *
+   * \param[in] state     Состояние, в котором надо произвести поиск.
+   * \param[in] item      Ситуация, метку которой надо сдвинуть.
    * \param[in] rptr      Ситуация для добавления, если искомая ситуация найдена.
+   * \param[in] context   Контекст интерпретатора для добавляемого вывода.
    * \return              true если ситауация найдена.
    */
-  inline bool IsItemInList(State::SymbolItemList& item_list, Item* item, Item* rptr) {
-    Item tmp_item;
-    tmp_item.rhs_pos_   = item->rhs_pos_ + 1;
-    tmp_item.rule_id_   = item->rule_id_;
-    tmp_item.origin_    = item->origin_;
-    tmp_item.lptr_      = item;
-
-    for (Item* cur = item_list.elems_.get_first(); cur; cur = item_list.elems_.get_next()) {
-      if (tmp_item == *cur) {
-        cur->rptrs_.push_back(Item::Rptr(Context::Ptr(), rptr));
-        return true;
-      }
+  inline bool IsItemInList(State* state, Item* item, Item* rptr, Context::Ptr context) {
+    if (Item* cur = state->FindItem(item->rule_id_, item->rhs_pos_ + 1, item->origin_, item)) {
+      cur->AddRptr(context, rptr, item_disp_.rptr_pool_);
+      ++stats_.duplicate_items_;
+      return true;
     }
     return false;
   }
@@ -490,24 +1627,149 @@ public:
    * \param grammar       Указатель на объект грамматики.
    * \param lexer         Указатель на объект лексического анализатора.
    * \param interpretator Указатель на объект интерпретатора.
+   * \param options       Настройки алгоритма.
    */
-  EarleyParser(Grammar* grammar, Lexer* lexer, Interpretator* interpretator)
+  EarleyParser(const Grammar* grammar, Lexer* lexer, Interpretator* interpretator, const Options& options = Options())
     : grammar_(grammar)
     , lexer_(lexer)
     , interpretator_(interpretator)
+    , handler_(interpretator)
     , state_disp_(&item_disp_, grammar_)
-    , item_disp_(1024*1024) {
+    , item_disp_(options.item_block_size_)
+    , options_(options)
+    , nullable_in_progress_(grammar->GetNumOfNonterminals(), false)
+    , push_state_id_(0)
+    , push_release_limit_(0)
+    , derivation_pool_(options.item_block_size_)
+    , status_(kRejected)
+    , budget_checks_(0)
+    , cancel_requested_(false) {
   }
 
   /*!
    * \brief Синтаксический анализ потока терминальных символов, предоставляемого объектом Lexer.
    *
+   * Состояния и ситуации предыдущего запуска освобождаются вызовом Reset, поэтому один объект парсера
+   * можно использовать для разбора многих цепочек.
+   *
    * \return true если входная цепочка разобрана.
    */
   bool Parse();
 
+  /*!
+   * \brief Повторный синтаксический анализ после изменения входного потока.
+   *
+   * Лексический анализатор должен уже возвращать токены измененного потока. Состояния предыдущего
+   * запуска Parse или Reparse, все следующие токены которых заканчиваются до позиции изменения,
+   * сохраняются вместе с ситуациями и контекстами интерпретатора. Остальные состояния строятся заново.
+   * Если сохранить нечего, выполняется полный разбор.
+   *
+   * \param[in] position Позиция во входном потоке, с которой начинается измененный участок.
+   * \return true если входная цепочка разобрана.
+   */
+  bool Reparse(size_t position);
+
+  /*!
+   * \brief Начало разбора потока токенов, передаваемых по одному методом PushToken.
+   *
+   * Лексический анализатор сбрасывается, и перед следующим Parse его надо снова установить SetLexer. Без него
+   * предпросмотр следующих токенов не выполняется. Интерпретатор получает сдвиги символов по мере передачи
+   * токенов. В режиме по умолчанию (обычные ситуации без ситуаций Лео, без леса разбора и отложенной семантики)
+   * состояния, к которым разбор больше не обратится, освобождаются, и память ограничена размером живых
+   * ситуаций, а не длиной потока. В остальных режимах все состояния нужны после окончания разбора и
+   * сохраняются до FinishPush.
+   *
+   * \return false если у начального символа грамматики нет правил.
+   */
+  bool StartPush();
+
+  /*!
+   * \brief Сдвиг очередного токена потока.
+   *
+   * \param[in] token Токен, следующий за переданными ранее.
+   * \return          true если переданные токены остаются префиксом цепочки языка. Иначе токен
+   *                  отбрасывается, и разбор можно продолжить другим токеном.
+   */
+  bool PushToken(Token::Ptr token);
+
+  /*!
+   * \brief Получение терминалов, которыми может продолжаться переданный префикс.
+   *
+   * \param[out] terminals Внешние идентификаторы терминалов в порядке возрастания внутренних.
+   */
+  void GetExpectedTerminals(std::vector<Grammar::SymbolId>& terminals);
+
+  /*!
+   * \brief Окончание разбора потока токенов.
+   *
+   * Переданные токены считаются всей входной цепочкой: интерпретатор получает Interpretator::End для
+   * выводов начального символа, как после Parse.
+   *
+   * \return true если переданные токены образуют цепочку языка.
+   */
+  bool FinishPush();
+
+  /*!
+   * \brief Получение результата последнего запуска Parse, Reparse или FinishPush, а также причины остановки в PushToken.
+   *
+   * Позволяет отличить отказ в разборе от остановки по ограничению ресурсов или отмене.
+   */
+  ParseStatus GetStatus() const {
+    return status_;
+  }
+
+  //! Получение счетчиков последнего запуска разбора, см. Stats.
+  const Stats& GetStats() const {
+    return stats_;
+  }
+
+  /*!
+   * \brief Запрос отмены разбора, может вызываться из другого потока.
+   *
+   * Идущий разбор останавливается при ближайшей проверке ограничений ресурсов со статусом kCancelled:
+   * Parse возвращает false, интерпретатор не получает Interpretator::End, а ресурсы разбора освобождаются.
+   * Если разбор не идет, то отменяется следующий. Запрос снимается по окончании любого запуска разбора.
+   */
+  void Cancel() {
+    boost::mutex::scoped_lock lock(cancel_mutex_);
+    cancel_requested_ = true;
+  }
+
+  /*!
+   * \brief Замена лексического анализатора для следующих запусков Parse.
+   *
+   * Позволяет разбирать разные входы одним объектом парсера, сохраняя память его диспетчеров.
+   *
+   * \param[in] lexer Указатель на объект лексического анализатора.
+   */
+  void SetLexer(Lexer* lexer) {
+    lexer_ = lexer;
+  }
+
+  //! Получение леса разбора, построенного последним запуском Parse с настройкой build_forest_.
+  const Sppf& GetForest() const {
+    return forest_;
+  }
+
+  /*!
+   * \brief Получение контекстов символов правой части ситуации слева направо.
+   *
+   * Для каждой позиции до метки берется контекст первого вывода, как при обходе цепочки lptr_. В ситуации
+   * вспомогательного нетерминала оператора EBNF (Grammar::IsOperatorSymbol) вложенные вспомогательные
+   * нетерминалы раскрываются, поэтому для X* возвращаются контексты всех X, а для {X s}+ -- контексты
+   * X и разделителей по очереди. Интерпретатор вызывает метод в HandleNonTerminal, чтобы построить
+   * плоский узел списка вместо дерева из вложенных правил. Обход не рекурсивный, длина списка не ограничена.
+   *
+   * \param[in]  item      Ситуация, обычно завершенная ситуация из HandleNonTerminal.
+   * \param[out] contexts  Список, в конец которого добавляются контексты.
+   */
+  void GetChildContexts(const Item* item, std::vector<Context::Ptr>& contexts) const;
+
   /*!
    * \brief Освобождение всех ресурсов, выделенных под предыдущий запуск Parse.
+   *
+   * Состояния и блоки ситуаций возвращаются диспетчерам и используются следующими запусками Parse без
+   * повторного выделения памяти. Контексты интерпретатора и лес разбора освобождаются.
    */
   void Reset();
 };
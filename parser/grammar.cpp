@@ -1,8 +1,207 @@
 
+#include <algorithm>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "grammar.h"
+#include "binary_image.h"
 using parser::Grammar;
+using parser::PublicGrammar;
+using parser::ImageWriter;
+using parser::ImageReader;
+
+const uint32_t Grammar::kImageVersion;
+const size_t Grammar::kMaxRhsLength;
+const Grammar::RuleId Grammar::kNoName;
+
+namespace {
+
+//! Сигнатура двоичного образа грамматики ("EZGR"), записывается в начале и в конце образа.
+const ImageWriter::Word kImageMagic = 0x455A4752;
+
+//! Слово для проверки порядка байтов: при другом порядке читается иное значение.
+const ImageWriter::Word kImageByteOrder = 0x01020304;
+
+/*!
+ * \brief Замена операторов EBNF вспомогательными нетерминалами.
+ *
+ * Повторения строятся леворекурсивными правилами: в алгоритме Эрли левая рекурсия добавляет в состояние
+ * одно завершение на элемент списка, а правая без ситуаций Лео -- завершение для каждого предыдущего
+ * элемента, что делает разбор длинных списков квадратичным. Одинаковые операторы над одним символом во
+ * всех правилах заменяются одним нетерминалом H:
+ *  - X?     : H --> | X
+ *  - X*     : H --> | H X
+ *  - X+     : H --> X | H X
+ *  - {X s}+ : H --> X | H s X
+ *  - {X s}* : H --> | H1, где H1 -- нетерминал для {X s}+.
+ *
+ * Вспомогательным символам и правилам выдаются идентификаторы больше наибольших идентификаторов исходной
+ * грамматики, исходного правила у вспомогательных правил нет. Имена хранятся в объекте и нужны только до
+ * возврата из Grammar::Initialize, которая копирует их в таблицы грамматики.
+ */
+class OperatorLowering {
+public:
+  typedef PublicGrammar::MapId MapId;
+
+  //! Построение грамматики target без операторов EBNF по грамматике source.
+  OperatorLowering(const PublicGrammar& source, PublicGrammar* target)
+    : target_(target)
+    , next_symbol_id_(source.GetMaxSymbolId() + 1)
+    , next_rule_id_(source.GetMaxRuleId() + 1)
+  {
+    const PublicGrammar::SymbolTable& symbols = source.GetSymbolTable();
+    for (PublicGrammar::SymbolTable::const_iterator sym_it = symbols.begin(); sym_it != symbols.end(); ++sym_it) {
+      if (sym_it->second.nonterminal_) {
+        target_->AddNonterminal(sym_it->first, sym_it->second.name_);
+      } else {
+        target_->AddTerminal(sym_it->first, sym_it->second.name_);
+      }
+    }
+
+    const PublicGrammar::RuleTable& rules = source.GetRuleTable();
+    for (PublicGrammar::RuleTable::const_iterator rule_it = rules.begin(); rule_it != rules.end(); ++rule_it) {
+      const PublicGrammar::Rule& rule = rule_it->second;
+      target_->AddRule(rule_it->first, rule.name_);
+      if (rule.lhs_symbol_ != PublicGrammar::kUnknownMapId) {
+        target_->AddLhsSymbol(rule_it->first, rule.lhs_symbol_);
+      }
+
+      size_t rhs_pos = 0;
+      for (PublicGrammar::MapIdList::const_iterator rhs_it = rule.rhs_list_.begin(); rhs_it != rule.rhs_list_.end(); ++rhs_it, ++rhs_pos) {
+        PublicGrammar::RhsOperatorTable::const_iterator operator_it = rule.rhs_operators_.find(rhs_pos);
+        target_->AddRhsSymbol(rule_it->first, operator_it == rule.rhs_operators_.end() ? *rhs_it : GetHelper(*rhs_it, operator_it->second));
+      }
+
+      target_->SetRuleWeight(rule_it->first, rule.weight_);
+      target_->SetSourceRule(rule_it->first, rule.source_rule_);
+    }
+
+    target_->SetStartSymbolId(source.GetStartSymbolId());
+  }
+
+  //! Получение идентификаторов вспомогательных нетерминалов.
+  const std::vector<MapId>& GetHelpers() const { return helpers_; }
+
+  //! Проверка, есть ли в грамматике символы с операторами EBNF.
+  static bool HasOperators(const PublicGrammar& grammar) {
+    const PublicGrammar::RuleTable& rules = grammar.GetRuleTable();
+    for (PublicGrammar::RuleTable::const_iterator rule_it = rules.begin(); rule_it != rules.end(); ++rule_it) {
+      if (not rule_it->second.rhs_operators_.empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  //! Ключ вспомогательного нетерминала: символ, повторение и разделитель.
+  typedef std::pair<MapId, std::pair<int, MapId> > HelperKey;
+
+  //! Получение вспомогательного нетерминала для оператора над символом, при первом обращении -- с его правилами.
+  MapId GetHelper(MapId symbol, const PublicGrammar::RhsOperator& rhs_operator) {
+    HelperKey key(symbol, std::make_pair(int(rhs_operator.repetition_), rhs_operator.separator_));
+    std::map<HelperKey, MapId>::const_iterator helper_it = helper_map_.find(key);
+    if (helper_it != helper_map_.end()) {
+      return helper_it->second;
+    }
+
+    std::string name = GetName(symbol);
+    MapId separator = rhs_operator.separator_;
+    MapId helper = PublicGrammar::kUnknownMapId;
+    switch (rhs_operator.repetition_) {
+    case PublicGrammar::kOnce:
+      return symbol;
+
+    case PublicGrammar::kOptional:
+      helper = AddHelper(name + "?");
+      AddHelperRule(helper);
+      AddHelperRule(helper, symbol);
+      break;
+
+    case PublicGrammar::kZeroOrMore:
+      if (separator != PublicGrammar::kUnknownMapId) {
+        MapId list = GetHelper(symbol, PublicGrammar::RhsOperator(PublicGrammar::kOneOrMore, separator));
+        helper = AddHelper("{" + name + " " + GetName(separator) + "}*");
+        AddHelperRule(helper);
+        AddHelperRule(helper, list);
+      } else {
+        helper = AddHelper(name + "*");
+        AddHelperRule(helper);
+        AddHelperRule(helper, helper, symbol);
+      }
+      break;
+
+    case PublicGrammar::kOneOrMore:
+      if (separator != PublicGrammar::kUnknownMapId) {
+        helper = AddHelper("{" + name + " " + GetName(separator) + "}+");
+        AddHelperRule(helper, symbol);
+        AddHelperRule(helper, helper, separator, symbol);
+      } else {
+        helper = AddHelper(name + "+");
+        AddHelperRule(helper, symbol);
+        AddHelperRule(helper, helper, symbol);
+      }
+      break;
+    }
+
+    helper_map_[key] = helper;
+    return helper;
+  }
+
+  //! Добавление вспомогательного нетерминала.
+  MapId AddHelper(const std::string& name) {
+    MapId helper = next_symbol_id_++;
+    target_->AddNonterminal(helper, StoreName(name));
+    helpers_.push_back(helper);
+    return helper;
+  }
+
+  //! Добавление правила вспомогательного нетерминала, нулевые идентификаторы завершают правую часть.
+  void AddHelperRule(MapId lhs, MapId rhs0 = 0, MapId rhs1 = 0, MapId rhs2 = 0) {
+    MapId rhs[] = {rhs0, rhs1, rhs2};
+    std::string name = GetName(lhs) + " -->";
+    for (size_t i = 0; i < 3 and rhs[i] != PublicGrammar::kUnknownMapId; ++i) {
+      name += " " + GetName(rhs[i]);
+    }
+
+    MapId rule_id = next_rule_id_++;
+    target_->AddRule(rule_id, StoreName(name));
+    target_->AddLhsSymbol(rule_id, lhs);
+    for (size_t i = 0; i < 3 and rhs[i] != PublicGrammar::kUnknownMapId; ++i) {
+      target_->AddRhsSymbol(rule_id, rhs[i]);
+    }
+    target_->SetSourceRule(rule_id, PublicGrammar::kUnknownMapId);
+  }
+
+  //! Получение имени символа, для символа без имени -- "?".
+  std::string GetName(MapId symbol) const {
+    const char* name = target_->GetSymbolTable().find(symbol)->second.name_;
+    return name ? name : "?";
+  }
+
+  //! Сохранение строки имени на время жизни объекта.
+  const char* StoreName(const std::string& name) {
+    names_.push_back(name);
+    return names_.back().c_str();
+  }
+
+  PublicGrammar*              target_;          //!< Грамматика без операторов.
+  MapId                       next_symbol_id_;  //!< Идентификатор следующего вспомогательного символа.
+  MapId                       next_rule_id_;    //!< Идентификатор следующего вспомогательного правила.
+  std::map<HelperKey, MapId>  helper_map_;      //!< Вспомогательные нетерминалы по операторам.
+  std::vector<MapId>          helpers_;         //!< Идентификаторы вспомогательных нетерминалов.
+  std::deque<std::string>     names_;           //!< Имена вспомогательных символов и правил.
+};
+
+} // namespace
 
 /*!
  * \brief Конструктор инициализируются объектом PublicGrammar.
@@ -17,37 +216,278 @@ Grammar::Grammar( const PublicGrammar* public_grammar )
   , num_of_nonterminals_(kBadSymbolId)
   , num_of_rules_(kBadSymbolId)
   , rules_space_(kBadSymbolId)
-  , public_grammar_(public_grammar)
 {
-    Initialize();
+    Initialize(*public_grammar);
+}
+
+/*!
+ * \brief Конструктор загружает грамматику из двоичного образа, записанного Save.
+ *
+ * Файл отображается в память только на время чтения: таблицы копируются из отображения целиком,
+ * после чего грамматика не зависит от файла.
+ *
+ * \param[in] file_name Имя файла образа.
+ */
+Grammar::Grammar( const std::string& file_name )
+  : start_symbol_index_(kBadSymbolId)
+  , max_symbol_id_(kBadSymbolId)
+  , max_rule_id_(kBadSymbolId)
+  , min_symbol_id_(kBadSymbolId)
+  , min_rule_id_(kBadSymbolId)
+  , num_of_terminals_(kBadSymbolId)
+  , num_of_nonterminals_(kBadSymbolId)
+  , num_of_rules_(kBadSymbolId)
+  , rules_space_(kBadSymbolId)
+{
+  using namespace boost::interprocess;
+  file_mapping file(file_name.c_str(), read_only);
+  mapped_region region(file, read_only);
+  ImageReader reader(region.get_address(), region.get_size());
+  Read(reader);
+}
+
+/*!
+ * \brief Конструктор загружает грамматику из двоичного образа в памяти.
+ *
+ * \param[in] image Начало образа.
+ * \param[in] size  Размер образа в байтах.
+ */
+Grammar::Grammar( const void* image, size_t size )
+  : start_symbol_index_(kBadSymbolId)
+  , max_symbol_id_(kBadSymbolId)
+  , max_rule_id_(kBadSymbolId)
+  , min_symbol_id_(kBadSymbolId)
+  , min_rule_id_(kBadSymbolId)
+  , num_of_terminals_(kBadSymbolId)
+  , num_of_nonterminals_(kBadSymbolId)
+  , num_of_rules_(kBadSymbolId)
+  , rules_space_(kBadSymbolId)
+{
+  ImageReader reader(image, size);
+  Read(reader);
+}
+
+/*!
+ * \brief Сохранение всех таблиц грамматики в двоичный образ.
+ *
+ * \param[in] file_name Имя файла образа, существующий файл перезаписывается.
+ */
+void Grammar::Save( const std::string& file_name ) const {
+  std::ofstream stream(file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  Save(stream);
+  stream.flush();
+  if (not stream.good()) {
+    std::stringstream st;
+    st << "Failed to write the grammar image \"" << file_name << "\"";
+    throw std::runtime_error(st.str().c_str());
+  }
+}
+
+//! Запись двоичного образа в поток, открытый в двоичном режиме.
+void Grammar::Save( std::ostream& stream ) const {
+  ImageWriter writer(stream);
+  Write(writer);
+}
+
+//! Запись всех таблиц в двоичный образ.
+void Grammar::Write( ImageWriter& writer ) const {
+  // Заголовок: сигнатура, версия и параметры сборки, от которых зависит представление таблиц.
+  writer.WriteWord(kImageMagic);
+  writer.WriteWord(kImageVersion);
+  writer.WriteWord(kImageByteOrder);
+  writer.WriteWord(sizeof(SymbolId));
+  writer.WriteWord(sizeof(size_t));
+  writer.WriteWord(sizeof(SymbolSet::block_type));
+
+  writer.WriteWord(start_symbol_index_);
+  writer.WriteWord(max_symbol_id_);
+  writer.WriteWord(max_rule_id_);
+  writer.WriteWord(min_symbol_id_);
+  writer.WriteWord(min_rule_id_);
+  writer.WriteWord(num_of_terminals_);
+  writer.WriteWord(num_of_nonterminals_);
+  writer.WriteWord(num_of_rules_);
+  writer.WriteWord(rules_space_);
+
+  writer.WriteTable(symbols_);
+  writer.WriteTable(rules_);
+  writer.WriteTable(external_to_internal_symbols_map_);
+  writer.WriteTable(rule_to_offset_map_);
+  writer.WriteTable(offset_to_rule_map_);
+  writer.WriteTable(id_to_internal_rule_map_);
+  writer.WriteTable(internal_rule_to_id_map_);
+
+  writer.WriteFlags(nullable_symbols_);
+  writer.WriteFlags(nullable_rules_);
+  writer.WriteFlags(nullable_suffixes_);
+  writer.WriteFlags(operator_symbols_);
+  writer.WriteSets(first_sets_, num_of_terminals_ + 1);
+  writer.WriteSets(suffix_first_sets_, num_of_terminals_ + 1);
+  writer.WriteTable(rule_weights_);
+  writer.WriteTable(source_rules_);
+
+  writer.WriteTable(symbol_names_);
+  writer.WriteTable(symbol_name_offsets_);
+
+  predict_cache_.Write(writer);
+  lr0_automaton_.Write(writer);
+
+  writer.WriteWord(kImageMagic);
+}
+
+/*!
+ * \brief Чтение всех таблиц из двоичного образа.
+ *
+ * Проверяются заголовок, согласованность размеров таблиц и все индексы и смещения, по которым таблицы
+ * адресуют друг друга, поэтому поврежденный образ не приводит к обращению за границы таблиц. Остальное
+ * содержимое, например множества FIRST, не проверяется: образ считается записанным Save той же сборкой.
+ */
+void Grammar::Read( ImageReader& reader ) {
+  reader.Expect(kImageMagic, "bad signature");
+  reader.Expect(kImageVersion, "unsupported version");
+  reader.Expect(kImageByteOrder, "byte order mismatch");
+  reader.Expect(sizeof(SymbolId), "symbol id size mismatch");
+  reader.Expect(sizeof(size_t), "size_t size mismatch");
+  reader.Expect(sizeof(SymbolSet::block_type), "bitset block size mismatch");
+
+  start_symbol_index_   = reader.ReadWord();
+  max_symbol_id_        = reader.ReadWord();
+  max_rule_id_          = reader.ReadWord();
+  min_symbol_id_        = reader.ReadWord();
+  min_rule_id_          = reader.ReadWord();
+  num_of_terminals_     = reader.ReadWord();
+  num_of_nonterminals_  = reader.ReadWord();
+  num_of_rules_         = reader.ReadWord();
+  rules_space_          = reader.ReadWord();
+
+  reader.ReadTable(symbols_);
+  reader.ReadTable(rules_);
+  reader.ReadTable(external_to_internal_symbols_map_);
+  reader.ReadTable(rule_to_offset_map_);
+  reader.ReadTable(offset_to_rule_map_);
+  reader.ReadTable(id_to_internal_rule_map_);
+  reader.ReadTable(internal_rule_to_id_map_);
+
+  reader.ReadFlags(nullable_symbols_);
+  reader.ReadFlags(nullable_rules_);
+  reader.ReadFlags(nullable_suffixes_);
+  reader.ReadFlags(operator_symbols_);
+  reader.ReadSets(first_sets_);
+  reader.ReadSets(suffix_first_sets_);
+  reader.ReadTable(rule_weights_);
+  reader.ReadTable(source_rules_);
+
+  reader.ReadTable(symbol_names_);
+  reader.ReadTable(symbol_name_offsets_);
+
+  size_t num_of_symbols = num_of_terminals_ + num_of_nonterminals_ + 1;
+  if (symbols_.size() != num_of_symbols or nullable_symbols_.size() != num_of_symbols or operator_symbols_.size() != num_of_symbols
+      or first_sets_.size() != num_of_symbols or symbol_name_offsets_.size() != num_of_symbols
+      or rules_.size() != rules_space_ or offset_to_rule_map_.size() != rules_space_
+      or nullable_suffixes_.size() != rules_space_ or suffix_first_sets_.size() != rules_space_
+      or rule_to_offset_map_.size() != num_of_rules_ or internal_rule_to_id_map_.size() != num_of_rules_
+      or nullable_rules_.size() != num_of_rules_ or rule_weights_.size() != num_of_rules_
+      or source_rules_.size() != num_of_rules_ or start_symbol_index_ >= num_of_symbols
+      or external_to_internal_symbols_map_.size() != SymbolId(max_symbol_id_ - min_symbol_id_ + 1)
+      or id_to_internal_rule_map_.size() != RuleId(max_rule_id_ - min_rule_id_ + 1)) {
+    ImageReader::Fail("inconsistent table sizes");
+  }
+  if ((not first_sets_.empty() and first_sets_.front().size() != num_of_terminals_ + 1)
+      or (not suffix_first_sets_.empty() and suffix_first_sets_.front().size() != num_of_terminals_ + 1)) {
+    ImageReader::Fail("inconsistent FIRST sets");
+  }
+
+  // Каждое правило в буфере начинается нетерминалом и завершается разделителем, тогда обход правой части
+  // по смещению правила не выходит за буфер.
+  ImageReader::CheckIndices(rules_, num_of_symbols, "rule symbol out of range");
+  ImageReader::CheckIndices(rule_to_offset_map_, rules_space_, "rule offset out of range");
+  if (not rules_.empty() and rules_.back() != kBadSymbolId) {
+    ImageReader::Fail("unterminated rule");
+  }
+  for (RuleId rule_id = 0; rule_id < num_of_rules_; ++rule_id) {
+    if (not IsNonterminal(GetLhsOfRule(rule_id))) {
+      ImageReader::Fail("rule lhs is not a nonterminal");
+    }
+  }
+  if (not IsNonterminal(start_symbol_index_)) {
+    ImageReader::Fail("start symbol is not a nonterminal");
+  }
+
+  // Неиспользуемые элементы отображений идентификаторов равны нулю.
+  ImageReader::CheckIndices(offset_to_rule_map_, std::max<size_t>(num_of_rules_, 1), "rule id out of range");
+  ImageReader::CheckIndices(id_to_internal_rule_map_, std::max<size_t>(num_of_rules_, 1), "rule id out of range");
+  ImageReader::CheckIndices(external_to_internal_symbols_map_, num_of_symbols, "symbol id out of range");
+
+  // Имя символа читается до нулевого байта, поэтому последнее имя должно им завершаться.
+  if (not symbol_names_.empty() and symbol_names_.back() != '\0') {
+    ImageReader::Fail("unterminated symbol name");
+  }
+  for (size_t i = 0; i < symbol_name_offsets_.size(); ++i) {
+    if (symbol_name_offsets_[i] != kNoName and symbol_name_offsets_[i] >= symbol_names_.size()) {
+      ImageReader::Fail("symbol name offset out of range");
+    }
+  }
+
+  predict_cache_.Read(reader, *this);
+  lr0_automaton_.Read(reader, *this);
+
+  reader.Expect(kImageMagic, "bad trailer");
+}
+
+//! Копирование имен символов из PublicGrammar.
+void Grammar::InitNames( const PublicGrammar& public_grammar ) {
+  const PublicGrammar::SymbolTable& sym_table = public_grammar.GetSymbolTable();
+  symbol_names_.clear();
+  symbol_name_offsets_.assign(symbols_.size(), kNoName);
+  for (SymbolId sym_id = 1; sym_id < symbols_.size(); ++sym_id) {
+    const char* name = sym_table.find(symbols_[sym_id])->second.name_;
+    if (name) {
+      symbol_name_offsets_[sym_id] = symbol_names_.size();
+      symbol_names_.insert(symbol_names_.end(), name, name + std::strlen(name) + 1);
+    }
+  }
 }
 
 
 //! Инициалиизация грамматики -- преобразование из PublicGrammar.
-void Grammar::Initialize() {
+void Grammar::Initialize( const PublicGrammar& public_grammar ) {
+  // Символы с операторами EBNF заменяем вспомогательными нетерминалами и строим таблицы по грамматике без операторов.
+  if (OperatorLowering::HasOperators(public_grammar)) {
+    PublicGrammar lowered("EBNF");
+    OperatorLowering lowering(public_grammar, &lowered);
+    Initialize(lowered);
+
+    const std::vector<PublicGrammar::MapId>& helpers = lowering.GetHelpers();
+    for (size_t i = 0; i < helpers.size(); ++i) {
+      operator_symbols_[GetInternalSymbolByExtrernalId(helpers[i])] = true;
+    }
+    return;
+  }
+
   // Берем необходимую конфигурацию из PublicGrammar.
-  max_symbol_id_        = public_grammar_->GetMaxSymbolId();
-  max_rule_id_          = public_grammar_->GetMaxRuleId();
-  min_symbol_id_        = public_grammar_->GetMinSymbolId();
-  min_rule_id_          = public_grammar_->GetMinRuleId();
-  num_of_terminals_     = public_grammar_->GetNumOfTerminals();
-  num_of_nonterminals_  = public_grammar_->GetNumOfNonterminals();
+  max_symbol_id_        = public_grammar.GetMaxSymbolId();
+  max_rule_id_          = public_grammar.GetMaxRuleId();
+  min_symbol_id_        = public_grammar.GetMinSymbolId();
+  min_rule_id_          = public_grammar.GetMinRuleId();
+  num_of_terminals_     = public_grammar.GetNumOfTerminals();
+  num_of_nonterminals_  = public_grammar.GetNumOfNonterminals();
 
   // Запоняем таблицу символов...
 
   // Выделяем память для хранения символов грамматики. Нулевой элемент таблицы
   // зарезирвирован и не используется в качестве идентификатора.
   symbols_.resize(num_of_terminals_ + num_of_nonterminals_ + 1);
+  operator_symbols_.assign(num_of_terminals_ + num_of_nonterminals_ + 1, false);
 
   // Выделяем память для соответствия:
   //   внешний идентификатор символа (PublicGrammar) -- > индекс в массиве symbols_.
-  external_to_internal_symbols_map_.resize(public_grammar_->GetSymbolIdInterval() + 1);
+  external_to_internal_symbols_map_.resize(public_grammar.GetSymbolIdInterval() + 1);
 
   // Заполняем таблицу символов терминалами. Первый элемент таблицы под индексом 0 зарезервирован.
   SymbolId cur_sym_index = 1;
 
   // Проходим по таблице символов и получаем идентификаторы терминалов.
-  const PublicGrammar::SymbolTable& sym_table = public_grammar_->GetSymbolTable();
+  const PublicGrammar::SymbolTable& sym_table = public_grammar.GetSymbolTable();
   for (PublicGrammar::SymbolTable::const_iterator sym_it = sym_table.begin(); sym_it != sym_table.end(); ++sym_it) {
     // Добавляем только терминалы.
     if (not sym_it->second.nonterminal_) {
@@ -68,7 +508,7 @@ void Grammar::Initialize() {
   }
 
   // Заполняем таблицу правил...
-  const PublicGrammar::RuleTable& rules_table = public_grammar_->GetRuleTable();
+  const PublicGrammar::RuleTable& rules_table = public_grammar.GetRuleTable();
   num_of_rules_ = rules_table.size();
 
   // Сначала подсчитываем память, необходимую для вектора правил.
@@ -79,6 +519,12 @@ void Grammar::Initialize() {
 
     // Подситываем количество памяти, необходимое для символов в правой части правила.
     rules_space_ += rule_it->second.rhs_list_.size();
+
+    if (rule_it->second.rhs_list_.size() > kMaxRhsLength) {
+      std::stringstream st;
+      st << "The rule with id = \"" << rule_it->first << "\" has more than " << kMaxRhsLength << " symbols";
+      throw std::invalid_argument(st.str().c_str());
+    }
   }
 
   // Теперь мы знаем, сколько памяти необходимо для вектора правил, заполняем таблицы соответствий.
@@ -86,11 +532,9 @@ void Grammar::Initialize() {
   rule_to_offset_map_.resize(num_of_rules_);
   offset_to_rule_map_.resize(rules_space_);
   internal_rule_to_id_map_.resize(num_of_rules_);
-  id_to_internal_rule_map_.resize(public_grammar_->GetRuleIdInterval() + 1);
-
-  // Не забываем инициализировать кэш Predictor. Мы начинаем нумеровать символы с единицы,
-  // поэтому передаем на единицу больше.
-  predict_cache_.Init(num_of_nonterminals_ + 1);
+  rule_weights_.resize(num_of_rules_);
+  source_rules_.resize(num_of_rules_);
+  id_to_internal_rule_map_.resize(public_grammar.GetRuleIdInterval() + 1);
 
   RuleId cur_rule_id = kBadSymbolId; // Идентифкатор правила.
   size_t cur_rule_offset = 0; // Смещение от начала массива правил.
@@ -99,13 +543,14 @@ void Grammar::Initialize() {
     rule_to_offset_map_[cur_rule_id] = cur_rule_offset;
     offset_to_rule_map_[cur_rule_offset] = cur_rule_id;
 
-    // Добавляем символ в левой части правил и заполняем кэш предиктора для этого символа.
+    // Добавляем символ в левой части правил.
     rules_[cur_rule_offset] = GetInternalSymbolByExtrernalId(rule_it->second.lhs_symbol_);
-    predict_cache_.AddSymRule(rules_[cur_rule_offset] - GetNumOfTerminals(), cur_rule_id);
     ++cur_rule_offset;
 
     // Заполняем отношение внутренний идентификатор правил --> идентфикатор правила в PublicGrammar и обратное.
     internal_rule_to_id_map_[cur_rule_id] = rule_it->first;
+    rule_weights_[cur_rule_id] = rule_it->second.weight_;
+    source_rules_[cur_rule_id] = rule_it->second.source_rule_;
     id_to_internal_rule_map_[rule_it->first - min_rule_id_] = cur_rule_id;
 
     // Проходим по правой части правила и добавляем соответствующие индексы в таблицу.
@@ -119,5 +564,194 @@ void Grammar::Initialize() {
   }
 
   // Задаем идентификатор начального нетерминала грамматики.
-  start_symbol_index_ = GetInternalSymbolByExtrernalId(public_grammar_->GetStartSymbolId());
+  start_symbol_index_ = GetInternalSymbolByExtrernalId(public_grammar.GetStartSymbolId());
+
+  // Копируем имена символов, чтобы грамматика не зависела от PublicGrammar после построения.
+  InitNames(public_grammar);
+
+  // Вычисляем символы, из которых выводится пустая цепочка, и множества FIRST.
+  InitNullable();
+  InitFirst();
+
+  // Заполняем кэш Predictor, левоугловое замыкание использует множество символов, выводящих пустую цепочку.
+  predict_cache_.Build(*this);
+
+  // Строим LR(0) автомат, он использует множество символов, выводящих пустую цепочку.
+  lr0_automaton_.Build(*this);
+}
+
+//! Вычисление множества символов и правил, из которых выводится пустая цепочка.
+void Grammar::InitNullable() {
+  nullable_symbols_.assign(num_of_terminals_ + num_of_nonterminals_ + 1, false);
+  nullable_rules_.assign(num_of_rules_, false);
+
+  // Правило выводит пустую цепочку, если все символы его правой части выводят пустую цепочку. Повторяем
+  // проход по правилам, пока множество таких правил растет.
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (RuleId rule_id = 0; rule_id < num_of_rules_; ++rule_id) {
+      if (nullable_rules_[rule_id]) {
+        continue;
+      }
+
+      bool nullable = true;
+      for (SymbolId rhs_pos = 0; GetRhsOfRule(rule_id, rhs_pos) != kBadSymbolId; ++rhs_pos) {
+        if (not nullable_symbols_[GetRhsOfRule(rule_id, rhs_pos)]) {
+          nullable = false;
+          break;
+        }
+      }
+
+      if (nullable) {
+        nullable_rules_[rule_id] = true;
+        nullable_symbols_[GetLhsOfRule(rule_id)] = true;
+        changed = true;
+      }
+    }
+  }
+}
+
+//! Вычисление множеств FIRST для символов и остатков правил.
+void Grammar::InitFirst() {
+  // Множества индексируются идентификаторами терминалов, нулевой бит не используется.
+  SymbolSet empty_set(num_of_terminals_ + 1);
+  first_sets_.assign(num_of_terminals_ + num_of_nonterminals_ + 1, empty_set);
+  for (SymbolId sym_id = 1; sym_id <= num_of_terminals_; ++sym_id) {
+    first_sets_[sym_id].set(sym_id);
+  }
+
+  // FIRST нетерминала объединяет FIRST символов правых частей его правил до первого символа, из которого
+  // не выводится пустая цепочка. Повторяем проход по правилам, пока множества растут.
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (RuleId rule_id = 0; rule_id < num_of_rules_; ++rule_id) {
+      SymbolSet& lhs_set = first_sets_[GetLhsOfRule(rule_id)];
+      for (SymbolId rhs_pos = 0; GetRhsOfRule(rule_id, rhs_pos) != kBadSymbolId; ++rhs_pos) {
+        SymbolId sym_id = GetRhsOfRule(rule_id, rhs_pos);
+        if (not first_sets_[sym_id].is_subset_of(lhs_set)) {
+          lhs_set |= first_sets_[sym_id];
+          changed = true;
+        }
+        if (not nullable_symbols_[sym_id]) {
+          break;
+        }
+      }
+    }
+  }
+
+  // Для остатков правил проходим каждое правило справа налево. Разделитель в конце правила -- пустой остаток.
+  suffix_first_sets_.assign(rules_space_, empty_set);
+  nullable_suffixes_.assign(rules_space_, false);
+  for (RuleId rule_id = 0; rule_id < num_of_rules_; ++rule_id) {
+    size_t offset = GetOffsetByRule(rule_id) + 1;
+    while (rules_[offset] != kBadSymbolId) {
+      ++offset;
+    }
+    nullable_suffixes_[offset] = true;
+
+    for (--offset; offset > GetOffsetByRule(rule_id); --offset) {
+      SymbolId sym_id = rules_[offset];
+      suffix_first_sets_[offset] = first_sets_[sym_id];
+      if (nullable_symbols_[sym_id]) {
+        suffix_first_sets_[offset] |= suffix_first_sets_[offset + 1];
+        nullable_suffixes_[offset] = nullable_suffixes_[offset + 1];
+      }
+    }
+  }
+}
+
+//! Построение кэша по правилам грамматики.
+void Grammar::PredictCache::Build( const Grammar& grammar ) {
+  // Нетерминалы нумеруются с единицы, поэтому смещений на два больше, чем нетерминалов.
+  RuleId num_of_nonterms = grammar.GetNumOfNonterminals();
+  offsets_.assign(num_of_nonterms + 2, 0);
+
+  // Подсчитываем количество правил каждого нетерминала, сдвигая счетчики на одну позицию,
+  // чтобы после суммирования offsets_[id] указывал на начало списка нетерминала id.
+  for (RuleId rule_id = 0; rule_id < grammar.GetNumOfRules(); ++rule_id) {
+    ++offsets_[grammar.GetLhsOfRule(rule_id) - grammar.GetNumOfTerminals() + 1];
+  }
+  for (RuleId id = 1; id < offsets_.size(); ++id) {
+    offsets_[id] += offsets_[id - 1];
+  }
+
+  // Раскладываем правила по спискам в порядке их идентификаторов.
+  rules_.resize(grammar.GetNumOfRules());
+  RuleIdTable positions(offsets_.begin(), offsets_.end() - 1);
+  for (RuleId rule_id = 0; rule_id < grammar.GetNumOfRules(); ++rule_id) {
+    rules_[positions[grammar.GetLhsOfRule(rule_id) - grammar.GetNumOfTerminals()]++] = rule_id;
+  }
+
+  // Непосредственные левые углы: нетерминал правой части, перед которым выводится пустая цепочка.
+  SymbolSet empty_set(grammar.GetNumOfTerminals() + num_of_nonterms + 1);
+  closures_.assign(num_of_nonterms + 1, empty_set);
+  for (RuleId id = 1; id <= num_of_nonterms; ++id) {
+    closures_[id].set(id + grammar.GetNumOfTerminals());
+  }
+  for (RuleId rule_id = 0; rule_id < grammar.GetNumOfRules(); ++rule_id) {
+    SymbolSet& closure = closures_[grammar.GetLhsOfRule(rule_id) - grammar.GetNumOfTerminals()];
+    for (SymbolId rhs_pos = 0; grammar.GetRhsOfRule(rule_id, rhs_pos) != kBadSymbolId; ++rhs_pos) {
+      SymbolId sym_id = grammar.GetRhsOfRule(rule_id, rhs_pos);
+      if (grammar.IsNonterminal(sym_id)) {
+        closure.set(sym_id);
+      }
+      if (not grammar.IsNullable(sym_id)) {
+        break;
+      }
+    }
+  }
+
+  // Списки правил по первому символу правой части раскладываем так же, как списки по левой части.
+  // Пустые правила попадают в список разделителя kBadSymbolId.
+  RuleId num_of_symbols = grammar.GetNumOfTerminals() + num_of_nonterms + 1;
+  first_offsets_.assign(num_of_symbols + 1, 0);
+  for (RuleId rule_id = 0; rule_id < grammar.GetNumOfRules(); ++rule_id) {
+    ++first_offsets_[grammar.GetRhsOfRule(rule_id, 0) + 1];
+  }
+  for (RuleId id = 1; id < first_offsets_.size(); ++id) {
+    first_offsets_[id] += first_offsets_[id - 1];
+  }
+  first_rules_.resize(grammar.GetNumOfRules());
+  RuleIdTable first_positions(first_offsets_.begin(), first_offsets_.end() - 1);
+  for (RuleId rule_id = 0; rule_id < grammar.GetNumOfRules(); ++rule_id) {
+    first_rules_[first_positions[grammar.GetRhsOfRule(rule_id, 0)]++] = rule_id;
+  }
+
+  // Транзитивное замыкание алгоритмом Уоршелла: если в замыкание A входит B, то входит и замыкание B.
+  for (RuleId k = 1; k <= num_of_nonterms; ++k) {
+    for (RuleId id = 1; id <= num_of_nonterms; ++id) {
+      if (id != k and closures_[id][k + grammar.GetNumOfTerminals()]) {
+        closures_[id] |= closures_[k];
+      }
+    }
+  }
+}
+
+//! Запись кэша в двоичный образ грамматики.
+void Grammar::PredictCache::Write( ImageWriter& writer ) const {
+  writer.WriteTable(rules_);
+  writer.WriteTable(offsets_);
+  writer.WriteSets(closures_, closures_.empty() ? 0 : closures_.front().size());
+  writer.WriteTable(first_rules_);
+  writer.WriteTable(first_offsets_);
+}
+
+//! Чтение кэша из двоичного образа грамматики вместо построения.
+void Grammar::PredictCache::Read( ImageReader& reader, const Grammar& grammar ) {
+  reader.ReadTable(rules_);
+  reader.ReadTable(offsets_);
+  reader.ReadSets(closures_);
+  reader.ReadTable(first_rules_);
+  reader.ReadTable(first_offsets_);
+
+  RuleId num_of_symbols = grammar.GetNumOfTerminals() + grammar.GetNumOfNonterminals() + 1;
+  if (offsets_.size() != grammar.GetNumOfNonterminals() + 2 or closures_.size() + 1 != offsets_.size()
+      or closures_.front().size() != num_of_symbols or first_offsets_.size() != num_of_symbols + 1
+      or rules_.size() != grammar.GetNumOfRules() or first_rules_.size() != rules_.size()) {
+    ImageReader::Fail("inconsistent predict cache");
+  }
+  ImageReader::CheckOffsets(offsets_, rules_.size(), "inconsistent predict cache");
+  ImageReader::CheckOffsets(first_offsets_, first_rules_.size(), "inconsistent predict cache");
+  ImageReader::CheckIndices(rules_, rules_.size(), "predict cache rule out of range");
+  ImageReader::CheckIndices(first_rules_, first_rules_.size(), "predict cache rule out of range");
 }
@@ -3,12 +3,19 @@
 #define GRAMMAR_H__
 
 #include <vector>
+#include <string>
+#include <ostream>
+
+#include <boost/dynamic_bitset.hpp>
 
 #include "public_grammar.h"
-#include "list.h"
+#include "lr0_automaton.h"
 
 namespace parser {
 
+class ImageWriter;
+class ImageReader;
+
 /*!
  * \brief Класс представляет собой оптимизированную для целей синтаксического анализа реализацию грамматики.
  *
@@ -16,64 +23,144 @@ namespace parser {
  * символ в левой части правила, затем символы в правой части, а затем символ разделитель с идентификатором
  * kBadSymbolId.
  *
+ * Символы правой части с операторами EBNF (PublicGrammar::RhsOperator) заменяются вспомогательными
+ * нетерминалами с леворекурсивными правилами, которые отмечаются признаком IsOperatorSymbol. Анализатор
+ * не передает интерпретатору сдвиги вспомогательных нетерминалов внутри их собственных правил, а
+ * EarleyParser::GetChildContexts раскрывает их, поэтому список виден интерпретатору одним плоским узлом.
+ *
+ * Все вычисленные таблицы, включая кэш Predictor, множества FIRST и LR(0) автомат, можно сохранить в
+ * двоичный образ методом Save и затем загрузить конструктором от имени файла. Загрузка отображает файл
+ * в память и копирует таблицы целиком, не обращаясь к PublicGrammar и не повторяя вычислений.
  */
 class Grammar {
  public:
   typedef PublicGrammar::MapId RuleId;            //!< Тип идентификаторов правила.
   typedef PublicGrammar::MapId SymbolId;          //!< Тип идентификаторов символа.
-  typedef parser::list<RuleId> RuleIdList;        //!< Тип списка правил грамматики.
-  typedef std::vector<RuleIdList> NontermVector;  //!< Тип вектора списка правил.
+  typedef std::vector<SymbolId> SymbolIdTable;  //!< Тип таблицы символов.
+  typedef std::vector<RuleId>   RuleIdTable;    //!< Тип таблицы правил.
+  typedef std::vector<bool>     FlagTable;      //!< Тип таблицы признаков символов или правил.
+  typedef std::vector<float>    WeightTable;    //!< Тип таблицы весов правил.
+  typedef boost::dynamic_bitset<> SymbolSet;    //!< Тип множества терминалов, индексированного их идентификаторами.
+  typedef std::vector<SymbolSet> SymbolSetTable;//!< Тип таблицы множеств терминалов.
+
+  /*!
+   * \brief Диапазон идентификаторов правил.
+   *
+   * Диапазон не хранит состояния обхода, поэтому его можно обходить одновременно из нескольких
+   * потоков и вложенных циклов.
+   */
+  class RuleIdRange {
+  public:
+    typedef RuleIdTable::const_iterator const_iterator; //!< Тип итератора по правилам.
+
+    //! Конструктор диапазона по паре итераторов.
+    RuleIdRange( const_iterator begin, const_iterator end )
+      : begin_(begin)
+      , end_(end)
+    {}
+
+    //! Итератор на первое правило.
+    const_iterator begin() const { return begin_; }
+
+    //! Итератор за последним правилом.
+    const_iterator end() const { return end_; }
+
+    //! Проверка на пустоту.
+    bool empty() const { return begin_ == end_; }
+
+    //! Получение количества правил.
+    size_t size() const { return end_ - begin_; }
+
+  private:
+    const_iterator begin_;  //!< Первое правило.
+    const_iterator end_;    //!< Конец диапазона.
+  };
 
   /*!
    * \brief Класс представляет кэш помеченных правил, используемых в операции predictor.
    *
-   * Для каждого нетерминального символа грамматики вектор nonterm_vector_ содержит список правил,
-   * в которых данный символ стоит в левой части, а также правил, которые наследуются из таких
-   * правил следующим образом:
-   *   Если символ A принадлежит грамматике, то включаем в список все правила вида A --> X1 X2 .. Xn,
-   *   а также правила вида B --> Y1 Y2 ... Yk, если имеется правило A --> B ... для каждого нетерминала
-   *   B. Это делаем рекурсивно до тех пор, пока в спимок можно добавить новые правила.
+   * Для каждого нетерминального символа грамматики кэш содержит список правил, в которых данный символ
+   * стоит в левой части. Списки всех нетерминалов хранятся подряд в одном векторе rules_, список
+   * нетерминала id занимает отрезок [offsets_[id], offsets_[id + 1]).
+   *
+   * Кроме того, для каждого нетерминала A хранится его левоугловое замыкание -- множество нетерминалов,
+   * правила которых предсказываются вместе с правилами A:
+   *   Включаем в множество сам A, а также нетерминал B, если имеется правило A --> alpha B ..., где из
+   *   alpha выводится пустая цепочка. Это делаем рекурсивно до тех пор, пока в множество можно добавить
+   *   новые нетерминалы.
+   * Множества индексируются идентификаторами символов, поэтому объединяются с множеством нетерминалов,
+   * уже предсказанных в состоянии, одной операцией.
+   *
+   * Наконец, для каждого символа X хранится список правил вида A --> X ..., по которому предсказанные
+   * ситуации с меткой перед X строятся, только когда метку в них нужно сдвинуть. После построения кэш
+   * только читается.
    */
-  struct PredictCache {
-    //! Вектор списков правил грамматики для каждого нетерминала.
-    NontermVector nonterm_vector_;
+  class PredictCache {
+  public:
+    /*!
+     * \brief Построение кэша по правилам грамматики.
+     *
+     * \param grammar Грамматика, буфер правил которой уже заполнен.
+     */
+    void Build( const Grammar& grammar );
+
+    //! Запись кэша в двоичный образ грамматики.
+    void Write( ImageWriter& writer ) const;
 
     /*!
-     * \brief Инициализация количеством нетерминальных символов грамматики.
+     * \brief Чтение кэша из двоичного образа грамматики вместо построения.
      *
-     * \param num_of_nonterms количество нетерминальных символов грамматики.
+     * \param reader  Чтение образа.
+     * \param grammar Грамматика, таблицы правил которой уже прочитаны и проверены.
      */
-    void Init( RuleId num_of_nonterms ) {
-      nonterm_vector_.resize(num_of_nonterms);
-    }
+    void Read( ImageReader& reader, const Grammar& grammar );
 
     /*!
-     * \brief Возвращает ссылку на список правил для переданного нетерминала.
+     * \brief Возвращает список правил для переданного нетерминала.
      *
      * \param   id          Идентификатор нетерминала.
-     * \return  RuleIdList  Список правил грамматики для переданного нетерминала.
+     * \return  RuleIdRange Список правил грамматики для переданного нетерминала.
      */
-    RuleIdList& GetSymRules( RuleId id ) {
-      return nonterm_vector_[id];
+    RuleIdRange GetSymRules( RuleId id ) const {
+      return RuleIdRange(rules_.begin() + offsets_[id], rules_.begin() + offsets_[id + 1]);
     }
 
     /*!
-     * \brief Добавление правила для данного нетерминала.
+     * \brief Возвращает левоугловое замыкание нетерминала.
+     *
+     * \param   id          Идентификатор нетерминала, как для GetSymRules.
+     * \return  SymbolSet   Множество идентификаторов нетерминалов, включающее сам нетерминал.
+     */
+    const SymbolSet& GetClosure( RuleId id ) const { return closures_[id]; }
+
+    /*!
+     * \brief Возвращает список правил, правая часть которых начинается с символа.
      *
-     * \param sym_id  Идентификатор символа, для которого добавляется правило.
-     * \param rule_id Идентификатор добавляемого правила.
+     * \param   id          Идентификатор символа.
+     * \return  RuleIdRange Список правил в порядке их идентификаторов.
      */
-    void AddSymRule( SymbolId sym_id, RuleId rule_id ) {
-      nonterm_vector_[sym_id].push_back(rule_id);
+    RuleIdRange GetFirstRules( SymbolId id ) const {
+      return RuleIdRange(first_rules_.begin() + first_offsets_[id], first_rules_.begin() + first_offsets_[id + 1]);
     }
-  };
 
-  typedef std::vector<SymbolId> SymbolIdTable;  //!< Тип таблицы символов.
-  typedef std::vector<RuleId>   RuleIdTable;    //!< Тип таблицы правил.
+  private:
+    RuleIdTable     rules_;     //!< Списки правил всех нетерминалов подряд.
+    RuleIdTable     offsets_;   //!< Для каждого нетерминала -- смещение начала его списка в rules_.
+    SymbolSetTable  closures_;  //!< Для каждого нетерминала -- его левоугловое замыкание.
+    RuleIdTable     first_rules_;   //!< Списки правил по первому символу правой части подряд.
+    RuleIdTable     first_offsets_; //!< Для каждого символа -- смещение начала его списка в first_rules_.
+  };
 
   //! Идентификатор "плохого символа" грамматики.
   static const SymbolId kBadSymbolId = 0;
 
+  //! Версия формата двоичного образа грамматики, увеличивается при любом изменении состава таблиц.
+  static const uint32_t kImageVersion = 6;
+
+  //! Наибольшая длина правой части правила, ограничена размером позиции метки в ситуации Эрли.
+  static const size_t kMaxRhsLength = 0xFFFF;
+
+ private:
   SymbolId  start_symbol_index_;  //!< Индекс начального нетерминала грамматики.
   SymbolId  max_symbol_id_;       //!< Индекс символа грамматики с максимальным значением.
   RuleId    max_rule_id_;         //!< Индекс правила грамматики с максимальным значением.
@@ -93,17 +180,63 @@ class Grammar {
   RuleIdTable   id_to_internal_rule_map_;          //!< Внутренние идентфикаторы правил --> идентфикаторы PublicGrammar.
   RuleIdTable   internal_rule_to_id_map_;          //!< Идентфикаторы правил PublicGrammar --> внутренние идентфикаторы.
 
-  const PublicGrammar*  public_grammar_;  //!< Указатель на объект интерфейсной грамматики.
-  PredictCache          predict_cache_;   //!< Кэш для операции Predictor.
+  FlagTable     nullable_symbols_;  //!< Для каждого символа признак того, что из него выводится пустая цепочка.
+  FlagTable     nullable_rules_;    //!< Для каждого правила признак того, что из его правой части выводится пустая цепочка.
+  FlagTable     nullable_suffixes_; //!< Для каждого смещения в буфере правил признак того, что из остатка правила выводится пустая цепочка.
+  FlagTable     operator_symbols_;  //!< Для каждого символа признак вспомогательного нетерминала оператора EBNF.
+
+  WeightTable   rule_weights_;      //!< Для каждого правила его вес -- логарифм вероятности.
+  RuleIdTable   source_rules_;      //!< Для каждого правила идентификатор исходного правила PublicGrammar.
+
+  SymbolSetTable first_sets_;         //!< Для каждого символа множество FIRST терминалов, с которых начинаются его выводы.
+  SymbolSetTable suffix_first_sets_;  //!< Для каждого смещения в буфере правил множество FIRST остатка правила.
+
+  std::vector<char>     symbol_names_;        //!< Имена символов подряд, каждое завершено нулевым байтом.
+  RuleIdTable           symbol_name_offsets_; //!< Для каждого символа смещение имени в symbol_names_ или kNoName.
+  PredictCache          predict_cache_;       //!< Кэш для операции Predictor.
+  Lr0Automaton          lr0_automaton_;   //!< LR(0) автомат для режима практического алгоритма Эрли.
 
 public:
   /*!
    * \brief Конструктор инициализируются объектом PublicGrammar.
    *
+   * После конструктора грамматика не изменяется, поэтому один объект можно использовать
+   * одновременно из нескольких анализаторов в разных потоках.
+   *
    * \param[in] public_grammar Указатель на объект PublicGrammar.
    */
   explicit Grammar( const PublicGrammar* public_grammar );
 
+  /*!
+   * \brief Конструктор загружает грамматику из двоичного образа, записанного Save.
+   *
+   * Образ должен быть записан той же сборкой библиотеки: версия формата, порядок байтов и размеры типов
+   * проверяются, при несовпадении или повреждении образа выбрасывается std::runtime_error.
+   *
+   * \param[in] file_name Имя файла образа.
+   */
+  explicit Grammar( const std::string& file_name );
+
+  /*!
+   * \brief Конструктор загружает грамматику из двоичного образа в памяти.
+   *
+   * Используется для образов, встроенных в программу заголовком, который генерирует grammar_codegen.
+   *
+   * \param[in] image Начало образа.
+   * \param[in] size  Размер образа в байтах.
+   */
+  Grammar( const void* image, size_t size );
+
+  /*!
+   * \brief Сохранение всех таблиц грамматики в двоичный образ.
+   *
+   * \param[in] file_name Имя файла образа, существующий файл перезаписывается.
+   */
+  void Save( const std::string& file_name ) const;
+
+  //! Запись двоичного образа в поток, открытый в двоичном режиме.
+  void Save( std::ostream& stream ) const;
+
   //! Проверка, является ли данный символ нетерминальным.
   bool IsNonterminal( SymbolId id ) const { return id > num_of_terminals_; }
 
@@ -128,11 +261,35 @@ public:
   //! Получение внутреннего идентификатора по внешнему.
   RuleId GetInternalIdByRule( RuleId id ) const { return internal_rule_to_id_map_[id]; }
 
+  /*!
+   * \brief Получение идентификатора правила пользовательской грамматики по внутреннему идентификатору.
+   *
+   * Для грамматики, построенной без GrammarOptimizer, совпадает с GetInternalIdByRule. Для правил,
+   * полученных оптимизацией, возвращает правило пользователя, из которого они получены, а для
+   * вспомогательных правил вынесения общих префиксов -- PublicGrammar::kUnknownMapId.
+   */
+  RuleId GetSourceRule( RuleId id ) const { return source_rules_[id]; }
+
   //! Получение количества терминальных символов грамматики.
   SymbolId GetNumOfTerminals() const { return num_of_terminals_; }
 
   //! Получение количества нетерминальных символов грамматики.
   SymbolId GetNumOfNonterminals() const { return num_of_nonterminals_; }
+
+  //! Получение количества правил грамматики.
+  RuleId GetNumOfRules() const { return num_of_rules_; }
+
+  //! Получение символа по смещению в буфере правил.
+  SymbolId GetSymbolByOffset( size_t offset ) const { return rules_[offset]; }
+
+  //! Получение количества символов в правой части правила.
+  SymbolId GetRhsLength( RuleId id ) const {
+    SymbolId length = 0;
+    while (GetRhsOfRule(id, length) != kBadSymbolId) {
+      ++length;
+    }
+    return length;
+  }
   
   //! Получение идентификатора символа левой части правила.
   SymbolId GetLhsOfRule( RuleId id ) const { return rules_[GetOffsetByRule(id)]; }
@@ -140,16 +297,91 @@ public:
   //! Получение идентификатора символа в правой части правила.
   SymbolId GetRhsOfRule( RuleId rule_id, SymbolId rhs_num ) const { return rules_[GetOffsetByRule(rule_id) + rhs_num + 1]; }
 
+  //! Проверка, выводится ли из символа пустая цепочка.
+  bool IsNullable( SymbolId id ) const { return nullable_symbols_[id]; }
+
+  //! Проверка, является ли символ вспомогательным нетерминалом оператора EBNF.
+  bool IsOperatorSymbol( SymbolId id ) const { return operator_symbols_[id]; }
+
+  //! Проверка, выводится ли из правой части правила пустая цепочка.
+  bool IsNullableRule( RuleId id ) const { return nullable_rules_[id]; }
+
+  //! Получение веса правила -- логарифма его вероятности.
+  float GetRuleWeight( RuleId id ) const { return rule_weights_[id]; }
+
+  //! Получить множество терминалов, с которых начинаются выводы символа.
+  const SymbolSet& GetFirstSet( SymbolId id ) const { return first_sets_[id]; }
+
+  /*!
+   * \brief Проверка, может ли остаток правила начинаться с одного из терминалов множества.
+   *
+   * Остаток, из которого выводится пустая цепочка, подходит для любого множества, так как
+   * ситуация с ним может быть завершена без чтения терминалов.
+   *
+   * \param[in] rule_id   Идентификатор правила.
+   * \param[in] rhs_pos   Позиция метки в правой части правила, с которой начинается остаток.
+   * \param[in] lookahead Множество терминалов.
+   * \return              true если остаток выводит пустую цепочку или цепочку, начинающуюся с терминала из множества.
+   */
+  bool CanStartWith( RuleId rule_id, SymbolId rhs_pos, const SymbolSet& lookahead ) const {
+    return CanSuffixStartWith(GetSuffixOffset(rule_id, rhs_pos), lookahead);
+  }
+
+  //! Получение смещения в буфере правил остатка правила, начинающегося с позиции метки.
+  size_t GetSuffixOffset( RuleId rule_id, SymbolId rhs_pos ) const { return GetOffsetByRule(rule_id) + rhs_pos + 1; }
+
+  /*!
+   * \brief Проверка CanStartWith для остатка правила, заданного смещением.
+   *
+   * \param[in] offset    Смещение остатка, полученное GetSuffixOffset.
+   * \param[in] lookahead Множество терминалов.
+   * \return              true если остаток выводит пустую цепочку или цепочку, начинающуюся с терминала из множества.
+   */
+  bool CanSuffixStartWith( size_t offset, const SymbolSet& lookahead ) const {
+    return nullable_suffixes_[offset] or suffix_first_sets_[offset].intersects(lookahead);
+  }
+
+  //! Получить LR(0) автомат грамматики.
+  const Lr0Automaton& GetLr0Automaton() const { return lr0_automaton_; }
+
   //! Получить список правил для данного символ из кэша Predictor.
-  RuleIdList&  GetSymRules( SymbolId id ) { return predict_cache_.GetSymRules(id); }
+  RuleIdRange GetSymRules( SymbolId id ) const { return predict_cache_.GetSymRules(id); }
+
+  //! Получить левоугловое замыкание для данного символа из кэша Predictor, символ задается как для GetSymRules.
+  const SymbolSet& GetPredictClosure( SymbolId id ) const { return predict_cache_.GetClosure(id); }
+
+  //! Получить список правил, правая часть которых начинается с данного символа.
+  RuleIdRange GetRulesByFirstSymbol( SymbolId id ) const { return predict_cache_.GetFirstRules(id); }
+
+  //! Получение размера буфера правил.
+  size_t GetRulesSpace() const { return rules_space_; }
 
   //! Получить имя символа.
   const char* GetSymbolName( SymbolId id ) const {
-    return (public_grammar_->GetSymbolTable().find(symbols_[id]))->second.name_;
+    return symbol_name_offsets_[id] == kNoName ? NULL : &symbol_names_[symbol_name_offsets_[id]];
   }
 
+private:
+  //! Смещение имени символа, у которого имя не задано.
+  static const RuleId kNoName = ~RuleId(0);
+
   //! Инициалиизация грамматики -- преобразование из PublicGrammar.
-  void Initialize();
+  void Initialize( const PublicGrammar& public_grammar );
+
+  //! Копирование имен символов из PublicGrammar.
+  void InitNames( const PublicGrammar& public_grammar );
+
+  //! Запись всех таблиц в двоичный образ.
+  void Write( ImageWriter& writer ) const;
+
+  //! Чтение всех таблиц из двоичного образа.
+  void Read( ImageReader& reader );
+
+  //! Вычисление множества символов и правил, из которых выводится пустая цепочка.
+  void InitNullable();
+
+  //! Вычисление множеств FIRST для символов и остатков правил.
+  void InitFirst();
 };
 
 } // namespace parser
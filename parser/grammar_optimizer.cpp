@@ -0,0 +1,428 @@
+
+#include <map>
+#include <set>
+
+#include "grammar_optimizer.h"
+
+using parser::GrammarOptimizer;
+using parser::PublicGrammar;
+
+//! Конструктор с настройками преобразований.
+GrammarOptimizer::GrammarOptimizer(const Options& options)
+  : options_(options)
+  , start_symbol_(PublicGrammar::kUnknownMapId)
+  , next_symbol_id_(PublicGrammar::kUnknownMapId)
+  , next_rule_id_(PublicGrammar::kUnknownMapId)
+{}
+
+//! Построение преобразованной грамматики.
+void GrammarOptimizer::Optimize(const PublicGrammar& source, PublicGrammar* target) {
+  Load(source);
+
+  if (options_.remove_useless_) {
+    RemoveUseless();
+  }
+  if (options_.collapse_unit_rules_) {
+    CollapseUnitRules();
+
+    // Устранение цепных правил оставляет нетерминалы, которые были достижимы только через них.
+    if (options_.remove_useless_) {
+      RemoveUseless();
+    }
+  }
+  if (options_.left_factor_) {
+    LeftFactor();
+  }
+
+  Store(target);
+}
+
+//! Копирование символов и правил исходной грамматики.
+void GrammarOptimizer::Load(const PublicGrammar& source) {
+  stats_ = Stats();
+  names_.clear();
+  rules_.clear();
+
+  symbols_ = source.GetSymbolTable();
+  start_symbol_ = source.GetStartSymbolId();
+  next_symbol_id_ = source.GetMaxSymbolId() + 1;
+  next_rule_id_ = source.GetMaxRuleId() + 1;
+
+  const PublicGrammar::RuleTable& rule_table = source.GetRuleTable();
+  rules_.reserve(rule_table.size());
+  for (PublicGrammar::RuleTable::const_iterator rule_it = rule_table.begin(); rule_it != rule_table.end(); ++rule_it) {
+    Rule rule;
+    rule.id_ = rule_it->first;
+    rule.lhs_ = rule_it->second.lhs_symbol_;
+    rule.rhs_.assign(rule_it->second.rhs_list_.begin(), rule_it->second.rhs_list_.end());
+    rule.operators_.assign(rule.rhs_.size(), PublicGrammar::RhsOperator());
+    const PublicGrammar::RhsOperatorTable& operators = rule_it->second.rhs_operators_;
+    for (PublicGrammar::RhsOperatorTable::const_iterator operator_it = operators.begin(); operator_it != operators.end(); ++operator_it) {
+      rule.operators_[operator_it->first] = operator_it->second;
+    }
+    rule.weight_ = rule_it->second.weight_;
+    rule.source_ = rule_it->second.source_rule_;
+    rule.name_ = rule_it->second.name_;
+    rules_.push_back(rule);
+  }
+}
+
+/*!
+ * \brief Удаление бесполезных нетерминалов и их правил.
+ *
+ * Если из начального нетерминала не выводится ни одна терминальная цепочка, грамматика не меняется:
+ * язык пуст, и анализатор все равно отвергнет любой вход.
+ */
+void GrammarOptimizer::RemoveUseless() {
+  if (not IsNonterminal(start_symbol_)) {
+    return;
+  }
+
+  // Продуктивные нетерминалы и правила: правило продуктивно, если все символы его правой части -- терминалы
+  // или продуктивные нетерминалы. Символы X? и X*, а также разделители списков могут не выводиться вовсе,
+  // поэтому не учитываются. Повторяем проходы, пока множество продуктивных нетерминалов растет.
+  std::set<MapId> productive;
+  std::vector<bool> productive_rules(rules_.size(), false);
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (size_t i = 0; i < rules_.size(); ++i) {
+      if (productive_rules[i]) {
+        continue;
+      }
+
+      const Rule& rule = rules_[i];
+      bool all_productive = true;
+      for (size_t pos = 0; pos < rule.rhs_.size() and all_productive; ++pos) {
+        PublicGrammar::Repetition repetition = rule.operators_[pos].repetition_;
+        all_productive = repetition == PublicGrammar::kOptional or repetition == PublicGrammar::kZeroOrMore
+                         or not IsNonterminal(rule.rhs_[pos]) or productive.count(rule.rhs_[pos]);
+      }
+
+      if (all_productive) {
+        productive_rules[i] = true;
+        changed = productive.insert(rule.lhs_).second or changed;
+      }
+    }
+  }
+
+  if (not productive.count(start_symbol_)) {
+    return;
+  }
+
+  // Достижимые нетерминалы по продуктивным правилам, включая непродуктивные символы под операторами X? и X*:
+  // они остаются без правил.
+  std::map<MapId, std::vector<size_t> > lhs_rules;
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    if (productive_rules[i]) {
+      lhs_rules[rules_[i].lhs_].push_back(i);
+    }
+  }
+
+  std::set<MapId> reachable;
+  std::vector<MapId> stack(1, start_symbol_);
+  reachable.insert(start_symbol_);
+  while (not stack.empty()) {
+    const std::vector<size_t>& indices = lhs_rules[stack.back()];
+    stack.pop_back();
+    for (size_t i = 0; i < indices.size(); ++i) {
+      const Rule& rule = rules_[indices[i]];
+      for (size_t pos = 0; pos < rule.rhs_.size(); ++pos) {
+        MapId symbols[] = {rule.rhs_[pos], rule.operators_[pos].separator_};
+        for (size_t i = 0; i < 2; ++i) {
+          if (IsNonterminal(symbols[i]) and reachable.insert(symbols[i]).second) {
+            stack.push_back(symbols[i]);
+          }
+        }
+      }
+    }
+  }
+
+  // Оставляем правила достижимых нетерминалов, все символы которых продуктивны и, следовательно, достижимы.
+  RuleList useful;
+  useful.reserve(rules_.size());
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    if (productive_rules[i] and reachable.count(rules_[i].lhs_)) {
+      useful.push_back(rules_[i]);
+    }
+  }
+  stats_.removed_rules_ += rules_.size() - useful.size();
+  rules_.swap(useful);
+
+  // Терминалы сохраняются всегда, так как их идентификаторы возвращает лексический анализатор.
+  for (PublicGrammar::SymbolTable::iterator sym_it = symbols_.begin(); sym_it != symbols_.end(); ) {
+    if (sym_it->second.nonterminal_ and not reachable.count(sym_it->first)) {
+      symbols_.erase(sym_it++);
+      ++stats_.removed_symbols_;
+    } else {
+      ++sym_it;
+    }
+  }
+}
+
+/*!
+ * \brief Устранение цепных правил.
+ *
+ * Для каждого нетерминала A находятся нетерминалы B, выводимые из него цепочками устраняемых цепных правил,
+ * с наибольшим суммарным весом цепочки. Так как веса не больше нуля, поиск с ослаблением по очереди
+ * завершается и на циклах цепных правил. Правила B, кроме устраняемых цепных, копируются в A.
+ */
+void GrammarOptimizer::CollapseUnitRules() {
+  // Число вхождений каждого нетерминала в правые части правил.
+  std::map<MapId, size_t> references;
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    for (size_t pos = 0; pos < rules_[i].rhs_.size(); ++pos) {
+      ++references[rules_[i].rhs_[pos]];
+      if (rules_[i].operators_[pos].separator_ != PublicGrammar::kUnknownMapId) {
+        ++references[rules_[i].operators_[pos].separator_];
+      }
+    }
+  }
+
+  // Цепное правило A --> B устраняется, если B не начальный нетерминал и других вхождений B нет, то есть
+  // правила B переносятся в A без копирования. Иначе -- только если разрешено копирование правил.
+  std::vector<bool> collapsible(rules_.size(), false);
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    const Rule& rule = rules_[i];
+    collapsible[i] = IsUnitRule(rule) and rule.rhs_[0] != start_symbol_
+                     and (options_.collapse_shared_unit_rules_ or references[rule.rhs_[0]] == 1);
+  }
+
+  std::map<MapId, std::vector<size_t> > unit_rules;   // A --> индексы устраняемых цепных правил A --> B.
+  std::map<MapId, std::vector<size_t> > proper_rules; // B --> индексы остальных правил B --> β.
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    if (collapsible[i]) {
+      unit_rules[rules_[i].lhs_].push_back(i);
+      ++stats_.unit_rules_;
+    } else {
+      proper_rules[rules_[i].lhs_].push_back(i);
+    }
+  }
+
+  if (unit_rules.empty()) {
+    return;
+  }
+
+  RuleList collapsed;
+  collapsed.reserve(rules_.size());
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    if (not collapsible[i]) {
+      collapsed.push_back(rules_[i]);
+    }
+  }
+
+  for (std::map<MapId, std::vector<size_t> >::const_iterator unit_it = unit_rules.begin(); unit_it != unit_rules.end(); ++unit_it) {
+    // Наибольший вес цепочки цепных правил A -->* B для каждого B.
+    std::map<MapId, double> best;
+    std::vector<MapId> queue(1, unit_it->first);
+    best[unit_it->first] = 0.0;
+    while (not queue.empty()) {
+      MapId symbol = queue.back();
+      queue.pop_back();
+
+      std::map<MapId, std::vector<size_t> >::const_iterator next_it = unit_rules.find(symbol);
+      if (next_it == unit_rules.end()) {
+        continue;
+      }
+
+      for (size_t i = 0; i < next_it->second.size(); ++i) {
+        const Rule& unit = rules_[next_it->second[i]];
+        double weight = best[symbol] + unit.weight_;
+        std::map<MapId, double>::iterator best_it = best.find(unit.rhs_[0]);
+        if (best_it == best.end() or best_it->second < weight) {
+          best[unit.rhs_[0]] = weight;
+          queue.push_back(unit.rhs_[0]);
+        }
+      }
+    }
+
+    // Правила A --> β для всех остальных правил B --> β.
+    for (std::map<MapId, double>::const_iterator best_it = best.begin(); best_it != best.end(); ++best_it) {
+      if (best_it->first == unit_it->first) {
+        continue;
+      }
+
+      const std::vector<size_t>& indices = proper_rules[best_it->first];
+      for (size_t i = 0; i < indices.size(); ++i) {
+        Rule rule = rules_[indices[i]];
+        rule.id_ = next_rule_id_++;
+        rule.lhs_ = unit_it->first;
+        rule.weight_ += best_it->second;
+        rule.name_ = NULL;
+        collapsed.push_back(rule);
+        ++stats_.collapsed_rules_;
+      }
+    }
+  }
+
+  rules_.swap(collapsed);
+}
+
+/*!
+ * \brief Вынесение общих префиксов правил.
+ *
+ * Правила нетерминала группируются по первому символу правой части, для каждой группы из нескольких
+ * правил выносится их наибольший общий префикс. Новый нетерминал обрабатывается так же, поэтому правила,
+ * совпадающие дальше префикса только частично, выносятся в следующий нетерминал.
+ */
+void GrammarOptimizer::LeftFactor() {
+  std::map<MapId, std::vector<size_t> > lhs_rules;
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    lhs_rules[rules_[i].lhs_].push_back(i);
+  }
+
+  std::vector<MapId> queue;
+  for (std::map<MapId, std::vector<size_t> >::const_iterator lhs_it = lhs_rules.begin(); lhs_it != lhs_rules.end(); ++lhs_it) {
+    queue.push_back(lhs_it->first);
+  }
+
+  size_t min_prefix_length = options_.min_prefix_length_ ? options_.min_prefix_length_ : 1;
+  while (not queue.empty()) {
+    MapId symbol = queue.back();
+    queue.pop_back();
+
+    std::map<MapId, std::vector<size_t> > groups;
+    std::vector<size_t> remaining;
+    const std::vector<size_t>& indices = lhs_rules[symbol];
+    for (size_t i = 0; i < indices.size(); ++i) {
+      if (rules_[indices[i]].rhs_.empty()) {
+        remaining.push_back(indices[i]);
+      } else {
+        groups[rules_[indices[i]].rhs_[0]].push_back(indices[i]);
+      }
+    }
+
+    for (std::map<MapId, std::vector<size_t> >::const_iterator group_it = groups.begin(); group_it != groups.end(); ++group_it) {
+      const std::vector<size_t>& group = group_it->second;
+
+      // Длина наибольшего общего префикса правых частей группы.
+      const std::vector<MapId>& first_rhs = rules_[group[0]].rhs_;
+      size_t length = first_rhs.size();
+      for (size_t i = 1; i < group.size(); ++i) {
+        const std::vector<MapId>& rhs = rules_[group[i]].rhs_;
+        size_t common = 0;
+        while (common < length and common < rhs.size() and rhs[common] == first_rhs[common]
+               and rules_[group[i]].operators_[common] == rules_[group[0]].operators_[common]) {
+          ++common;
+        }
+        length = common;
+      }
+
+      if (group.size() < 2 or length < min_prefix_length) {
+        remaining.insert(remaining.end(), group.begin(), group.end());
+        continue;
+      }
+
+      // A --> α A', правила группы становятся правилами A' без префикса.
+      MapId factored = AddNonterminal(symbol);
+
+      Rule head;
+      head.id_ = next_rule_id_++;
+      head.lhs_ = symbol;
+      head.rhs_.assign(first_rhs.begin(), first_rhs.begin() + length);
+      head.rhs_.push_back(factored);
+      head.operators_.assign(rules_[group[0]].operators_.begin(), rules_[group[0]].operators_.begin() + length);
+      head.operators_.push_back(PublicGrammar::RhsOperator());
+      head.weight_ = 0.0;
+      head.source_ = PublicGrammar::kUnknownMapId;
+      head.name_ = NULL;
+
+      for (size_t i = 0; i < group.size(); ++i) {
+        Rule& rule = rules_[group[i]];
+        rule.lhs_ = factored;
+        rule.rhs_.erase(rule.rhs_.begin(), rule.rhs_.begin() + length);
+        rule.operators_.erase(rule.operators_.begin(), rule.operators_.begin() + length);
+        rule.name_ = NULL;
+      }
+
+      remaining.push_back(rules_.size());
+      rules_.push_back(head);
+      lhs_rules[factored] = group;
+      queue.push_back(factored);
+      ++stats_.factored_prefixes_;
+    }
+
+    lhs_rules[symbol].swap(remaining);
+  }
+}
+
+//! Добавление символов и правил результата в грамматику.
+void GrammarOptimizer::Store(PublicGrammar* target) {
+  for (PublicGrammar::SymbolTable::const_iterator sym_it = symbols_.begin(); sym_it != symbols_.end(); ++sym_it) {
+    if (sym_it->second.nonterminal_) {
+      target->AddNonterminal(sym_it->first, sym_it->second.name_);
+    } else {
+      target->AddTerminal(sym_it->first, sym_it->second.name_);
+    }
+  }
+
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    const Rule& rule = rules_[i];
+    target->AddRule(rule.id_, rule.name_ ? rule.name_ : MakeRuleName(rule));
+    target->AddLhsSymbol(rule.id_, rule.lhs_);
+    for (size_t pos = 0; pos < rule.rhs_.size(); ++pos) {
+      const PublicGrammar::RhsOperator& rhs_operator = rule.operators_[pos];
+      if (rhs_operator.separator_ != PublicGrammar::kUnknownMapId) {
+        target->AddRhsList(rule.id_, rule.rhs_[pos], rhs_operator.separator_, rhs_operator.repetition_);
+      } else {
+        target->AddRhsSymbol(rule.id_, rule.rhs_[pos], rhs_operator.repetition_);
+      }
+    }
+    target->SetRuleWeight(rule.id_, rule.weight_);
+    target->SetSourceRule(rule.id_, rule.source_);
+  }
+
+  target->SetStartSymbolId(start_symbol_);
+}
+
+//! Проверка, является ли символ нетерминалом.
+bool GrammarOptimizer::IsNonterminal(MapId id) const {
+  PublicGrammar::SymbolTable::const_iterator sym_it = symbols_.find(id);
+  return sym_it != symbols_.end() and sym_it->second.nonterminal_;
+}
+
+//! Проверка, является ли правило цепным.
+bool GrammarOptimizer::IsUnitRule(const Rule& rule) const {
+  return rule.rhs_.size() == 1 and IsNonterminal(rule.rhs_[0]) and rule.operators_[0].repetition_ == PublicGrammar::kOnce;
+}
+
+//! Добавление нового нетерминала, имя которого строится по имени данного.
+GrammarOptimizer::MapId GrammarOptimizer::AddNonterminal(MapId base) {
+  const char* base_name = symbols_[base].name_;
+  MapId id = next_symbol_id_++;
+  symbols_[id] = PublicGrammar::Symbol(StoreName(std::string(base_name ? base_name : "?") + "'"), true);
+  return id;
+}
+
+//! Построение имени правила по именам его символов.
+const char* GrammarOptimizer::MakeRuleName(const Rule& rule) {
+  const char* lhs_name = symbols_[rule.lhs_].name_;
+  std::string name = lhs_name ? lhs_name : "?";
+  name += " -->";
+  for (size_t pos = 0; pos < rule.rhs_.size(); ++pos) {
+    const char* rhs_name = symbols_[rule.rhs_[pos]].name_;
+    const PublicGrammar::RhsOperator& rhs_operator = rule.operators_[pos];
+
+    // Операторы EBNF печатаются как в PublicGrammar::Print: X?, X*, X+, {X s}* и {X s}+.
+    if (rhs_operator.separator_ != PublicGrammar::kUnknownMapId) {
+      const char* separator_name = symbols_[rhs_operator.separator_].name_;
+      name += " {";
+      name += rhs_name ? rhs_name : "?";
+      name += " ";
+      name += separator_name ? separator_name : "?";
+      name += "}";
+    } else {
+      name += " ";
+      name += rhs_name ? rhs_name : "?";
+    }
+    if (rhs_operator.repetition_ != PublicGrammar::kOnce) {
+      name += rhs_operator.repetition_ == PublicGrammar::kOptional ? "?" : rhs_operator.repetition_ == PublicGrammar::kZeroOrMore ? "*" : "+";
+    }
+  }
+  return StoreName(name);
+}
+
+//! Сохранение строки имени до следующего вызова Optimize.
+const char* GrammarOptimizer::StoreName(const std::string& name) {
+  names_.push_back(name);
+  return names_.back().c_str();
+}
@@ -0,0 +1,165 @@
+
+#ifndef GRAMMAR_OPTIMIZER_H__
+#define GRAMMAR_OPTIMIZER_H__
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "public_grammar.h"
+
+namespace parser {
+
+/*!
+ * \brief Преобразование PublicGrammar, уменьшающее состояния Эрли, перед построением Grammar.
+ *
+ * Преобразования выполняются в порядке:
+ *  - удаление бесполезных нетерминалов -- тех, из которых не выводится терминальная цепочка, и тех,
+ *    которые недостижимы из начального нетерминала, вместе с их правилами;
+ *  - устранение цепных правил A --> B: для каждого вывода A -->+ B цепочкой устраняемых цепных правил
+ *    и остального правила B --> β добавляется правило A --> β, а устраняемые цепные правила удаляются.
+ *    По умолчанию устраняются только правила A --> B, где B больше нигде не встречается, что не
+ *    увеличивает грамматику: копирование правил B во все A, из которых B выводится цепочкой (например,
+ *    уровни приоритета операций в выражениях), увеличивает число предсказанных ситуаций больше, чем
+ *    сокращает завершения;
+ *  - повторное удаление бесполезных нетерминалов, ставших недостижимыми после устранения цепных правил;
+ *  - вынесение общих префиксов, только с Options::left_factor_: правила A --> α β1 | ... | α βn с префиксом α
+ *    длины не меньше Options::min_prefix_length_ заменяются правилами A --> α A' и A' --> β1 | ... | βn.
+ *
+ * Операторы EBNF сохраняются: символ X* считается продуктивным независимо от X, цепным считается только
+ * правило A --> B без оператора, а общий префикс должен совпадать вместе с операторами.
+ *
+ * Терминалы и их идентификаторы сохраняются, поэтому лексический анализатор не меняется. Правила,
+ * оставшиеся без изменений, сохраняют свои идентификаторы. Новым символам и правилам выдаются
+ * идентификаторы больше наибольших идентификаторов исходной грамматики.
+ *
+ * Для каждого правила результата запоминается исходное правило (PublicGrammar::SetSourceRule), которое
+ * интерпретатор получает через Grammar::GetSourceRule:
+ *  - правило A --> β, полученное устранением цепных правил, отображается в правило B --> β пользователя,
+ *    а его вес равен весу B --> β плюс наибольший вес цепочки цепных правил A -->+ B;
+ *  - правило A' --> βi отображается в правило A --> α βi и сохраняет его идентификатор и вес;
+ *  - вспомогательное правило A --> α A' не имеет исходного правила (PublicGrammar::kUnknownMapId).
+ *
+ * Интерпретатор не получает вызовов для устраненных цепных правил, поэтому их семантика должна быть
+ * тождественной. Выводы через циклы устраненных цепных правил (A -->+ A) исчезают.
+ *
+ * Вспомогательный нетерминал A', в отличие от нетерминалов операторов EBNF, интерпретатору не прозрачен:
+ * вывод правила с вынесенным префиксом передается в два шага, сдвиги символов α относятся к
+ * вспомогательному правилу, а завершение A' -- к исходному. Поэтому вынесение префиксов выключено по
+ * умолчанию и подходит интерпретаторам, которым не важно разбиение вывода на правила, например распознавателю.
+ */
+class GrammarOptimizer {
+public:
+  typedef PublicGrammar::MapId MapId; //!< Тип идентификатора символа или правила.
+
+  //! Настройки преобразований.
+  struct Options {
+    bool    remove_useless_;              //!< Удалять бесполезные нетерминалы и их правила.
+    bool    collapse_unit_rules_;         //!< Устранять цепные правила A --> B, где B больше нигде не встречается.
+    bool    collapse_shared_unit_rules_;  //!< Вместе с collapse_unit_rules_ устранять все цепные правила, копируя правила B.
+    bool    left_factor_;                 //!< Выносить общие префиксы правил, меняя вызовы интерпретатора (см. описание класса).
+    size_t  min_prefix_length_;           //!< Наименьшая длина общего префикса, который выносится в новый нетерминал.
+
+    //! Инициализация по умолчанию: включены преобразования, не меняющие вызовы интерпретатора для правил пользователя.
+    Options()
+      : remove_useless_(true)
+      , collapse_unit_rules_(true)
+      , collapse_shared_unit_rules_(false)
+      , left_factor_(false)
+      , min_prefix_length_(2)
+    {}
+  };
+
+  //! Счетчики последнего вызова Optimize.
+  struct Stats {
+    size_t  removed_symbols_;     //!< Удалено бесполезных нетерминалов.
+    size_t  removed_rules_;       //!< Удалено правил бесполезных нетерминалов.
+    size_t  unit_rules_;          //!< Устранено цепных правил.
+    size_t  collapsed_rules_;     //!< Добавлено правил при устранении цепных правил.
+    size_t  factored_prefixes_;   //!< Вынесено общих префиксов, столько же добавлено нетерминалов.
+
+    //! Инициализация нулями.
+    Stats()
+      : removed_symbols_(0)
+      , removed_rules_(0)
+      , unit_rules_(0)
+      , collapsed_rules_(0)
+      , factored_prefixes_(0)
+    {}
+  };
+
+  //! Конструктор с настройками преобразований.
+  explicit GrammarOptimizer(const Options& options = Options());
+
+  /*!
+   * \brief Построение преобразованной грамматики.
+   *
+   * Имена новых символов и правил хранятся в оптимизаторе до следующего вызова Optimize, поэтому
+   * target можно использовать только до него. Grammar копирует имена, после ее построения
+   * оптимизатор не нужен.
+   *
+   * \param[in]  source Исходная грамматика, в ней должен быть задан начальный нетерминал.
+   * \param[out] target Пустая грамматика, в которую добавляются символы и правила результата.
+   */
+  void Optimize(const PublicGrammar& source, PublicGrammar* target);
+
+  //! Получение счетчиков последнего вызова Optimize.
+  const Stats& GetStats() const { return stats_; }
+
+private:
+  //! Правило во время преобразований.
+  struct Rule {
+    MapId               id_;      //!< Идентификатор правила.
+    MapId               lhs_;     //!< Символ левой части.
+    std::vector<MapId>  rhs_;     //!< Символы правой части.
+    std::vector<PublicGrammar::RhsOperator> operators_; //!< Операторы EBNF символов правой части.
+    double              weight_;  //!< Вес правила.
+    MapId               source_;  //!< Исходное правило пользователя или kUnknownMapId.
+    const char*         name_;    //!< Имя правила или NULL, если правило изменено и имя нужно построить.
+  };
+
+  typedef std::vector<Rule> RuleList; //!< Тип списка правил.
+
+  //! Копирование символов и правил исходной грамматики.
+  void Load(const PublicGrammar& source);
+
+  //! Удаление бесполезных нетерминалов и их правил.
+  void RemoveUseless();
+
+  //! Устранение цепных правил.
+  void CollapseUnitRules();
+
+  //! Вынесение общих префиксов правил.
+  void LeftFactor();
+
+  //! Добавление символов и правил результата в грамматику.
+  void Store(PublicGrammar* target);
+
+  //! Проверка, является ли символ нетерминалом.
+  bool IsNonterminal(MapId id) const;
+
+  //! Проверка, является ли правило цепным.
+  bool IsUnitRule(const Rule& rule) const;
+
+  //! Добавление нового нетерминала, имя которого строится по имени данного.
+  MapId AddNonterminal(MapId base);
+
+  //! Построение имени правила по именам его символов.
+  const char* MakeRuleName(const Rule& rule);
+
+  //! Сохранение строки имени до следующего вызова Optimize.
+  const char* StoreName(const std::string& name);
+
+  Options                   options_;         //!< Настройки преобразований.
+  Stats                     stats_;           //!< Счетчики последнего вызова Optimize.
+  PublicGrammar::SymbolTable symbols_;        //!< Символы результата.
+  RuleList                  rules_;           //!< Правила результата.
+  MapId                     start_symbol_;    //!< Начальный нетерминал.
+  MapId                     next_symbol_id_;  //!< Идентификатор следующего нового символа.
+  MapId                     next_rule_id_;    //!< Идентификатор следующего нового правила.
+  std::deque<std::string>   names_;           //!< Имена новых символов и правил.
+};
+
+} // namespace parser
+
+#endif // GRAMMAR_OPTIMIZER_H__
@@ -0,0 +1,114 @@
+
+#ifndef HASH_INDEX_H__
+#define HASH_INDEX_H__
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace parser {
+
+/*!
+ * \brief Хэш-индекс с открытой адресацией.
+ *
+ * Элементы хранятся прямо в массиве ячеек, коллизии разрешаются линейным пробированием, поэтому вставка
+ * выделяет память только при редких удвоениях массива. Очистка сохраняет массив для повторного
+ * использования. Удаление отдельных элементов не поддерживается.
+ *
+ * Класс Traits задает пустую ячейку Traits::Empty() и ее проверку Traits::IsEmpty(element), хэш элемента
+ * Traits::Hash(element), хэш ключа Traits::Hash(key) и сравнение элемента с ключом Traits::Equal(element, key).
+ */
+template <class Element, class Traits>
+class HashIndex {
+public:
+  //! Конструктор пустого индекса.
+  HashIndex()
+    : size_(0)
+  {}
+
+  /*!
+   * \brief Поиск элемента по ключу.
+   *
+   * \param[in] key Ключ.
+   * \return        Найденный элемент или Traits::Empty().
+   */
+  template <class Key>
+  Element Find(const Key& key) const {
+    if (slots_.empty()) {
+      return Traits::Empty();
+    }
+
+    size_t mask = slots_.size() - 1;
+    for (size_t pos = Traits::Hash(key) & mask; ; pos = (pos + 1) & mask) {
+      const Element& slot = slots_[pos];
+      if (Traits::IsEmpty(slot)) {
+        return Traits::Empty();
+      }
+      if (Traits::Equal(slot, key)) {
+        return slot;
+      }
+    }
+  }
+
+  /*!
+   * \brief Добавление элемента, которого еще нет в индексе.
+   *
+   * \param[in] element Элемент.
+   */
+  void Insert(const Element& element) {
+    // Заполненность не больше половины, чтобы цепочки пробирования оставались короткими.
+    if ((size_ + 1) * 2 > slots_.size()) {
+      Grow();
+    }
+    Place(element);
+    ++size_;
+  }
+
+  //! Удаление всех элементов с сохранением массива ячеек.
+  void Clear() {
+    if (size_) {
+      std::fill(slots_.begin(), slots_.end(), Traits::Empty());
+      size_ = 0;
+    }
+  }
+
+  //! Получение количества элементов.
+  size_t GetSize() const {
+    return size_;
+  }
+
+  //! Получение количества ячеек, их массив сохраняется при Clear.
+  size_t GetCapacity() const {
+    return slots_.size();
+  }
+
+private:
+  //! Размещение элемента в первой свободной ячейке его цепочки пробирования.
+  void Place(const Element& element) {
+    size_t mask = slots_.size() - 1;
+    size_t pos = Traits::Hash(element) & mask;
+    while (not Traits::IsEmpty(slots_[pos])) {
+      pos = (pos + 1) & mask;
+    }
+    slots_[pos] = element;
+  }
+
+  //! Удвоение массива ячеек с перестановкой элементов.
+  void Grow() {
+    std::vector<Element> old_slots;
+    old_slots.swap(slots_);
+    slots_.assign(old_slots.empty() ? 16 : old_slots.size() * 2, Traits::Empty());
+    for (size_t i = 0; i < old_slots.size(); ++i) {
+      if (not Traits::IsEmpty(old_slots[i])) {
+        Place(old_slots[i]);
+      }
+    }
+  }
+
+  std::vector<Element> slots_;  //!< Ячейки, их число -- степень двойки.
+  size_t               size_;   //!< Количество элементов.
+};
+
+} // namespace parser
+
+#endif // HASH_INDEX_H__
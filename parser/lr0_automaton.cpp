@@ -0,0 +1,286 @@
+
+#include <algorithm>
+
+#include "grammar.h"
+#include "lr0_automaton.h"
+#include "binary_image.h"
+using parser::Lr0Automaton;
+
+const Lr0Automaton::StateId Lr0Automaton::kBadStateId;
+
+/*!
+ * \brief Построение автомата для грамматики.
+ *
+ * Начальное состояние содержит правила для начального символа с меткой в начале. Для каждого состояния
+ * строятся переходы по всем символам, стоящим после метки, а для ядерных состояний еще и переход по пустой
+ * цепочке в состояние с предсказанными правилами.
+ *
+ * \param[in] grammar Грамматика с вычисленными таблицами правил и множеством символов, выводящих пустую цепочку.
+ */
+void Lr0Automaton::Build( const Grammar& grammar ) {
+  num_of_symbols_ = grammar.GetNumOfTerminals() + grammar.GetNumOfNonterminals() + 1;
+
+  // Правила для каждого символа левой части и соответствие помеченного правила идентификатору правила.
+  rules_by_lhs_.assign(num_of_symbols_, RuleIdTable());
+  dotted_to_rule_.assign(grammar.GetRulesSpace(), RuleId());
+  for (RuleId rule_id = 0; rule_id < grammar.GetNumOfRules(); ++rule_id) {
+    rules_by_lhs_[grammar.GetLhsOfRule(rule_id)].push_back(rule_id);
+
+    size_t offset = grammar.GetOffsetByRule(rule_id) + 1;
+    do {
+      dotted_to_rule_[offset] = rule_id;
+    } while (grammar.GetSymbolByOffset(offset++) != Grammar::kBadSymbolId);
+  }
+
+  // Нулевое состояние зарезервировано и означает отсутствие перехода.
+  states_.assign(1, State());
+  goto_table_.assign(num_of_symbols_, kBadStateId);
+  state_map_.clear();
+
+  StateIdTable queue;
+  DottedRules start_items;
+  const RuleIdTable& start_rules = rules_by_lhs_[grammar.GetStartSymbol()];
+  for (RuleIdTable::const_iterator it = start_rules.begin(); it != start_rules.end(); ++it) {
+    start_items.push_back(grammar.GetOffsetByRule(*it) + 1);
+  }
+  std::sort(start_items.begin(), start_items.end());
+  AdvanceNullable(grammar, start_items);
+  start_state_ = AddState(start_items, true, queue);
+
+  // Состояние может попасть в очередь дважды: сначала как неядерное, потом как ядерное. Переходы по символам
+  // строим один раз, переход по пустой цепочке -- когда состояние стало ядерным.
+  std::vector<bool> transitions_built;
+  while (not queue.empty()) {
+    StateId state_id = queue.back();
+    queue.pop_back();
+    transitions_built.resize(states_.size(), false);
+
+    if (states_[state_id].kernel_ and states_[state_id].epsilon_ == kBadStateId) {
+      DottedRules predicted;
+      Predict(grammar, states_[state_id].items_, predicted);
+      if (not predicted.empty()) {
+        StateId epsilon = AddState(predicted, false, queue);
+        states_[state_id].epsilon_ = epsilon;
+      }
+    }
+
+    if (transitions_built[state_id]) {
+      continue;
+    }
+    transitions_built[state_id] = true;
+
+    // Группируем помеченные правила по символу после метки.
+    std::map<SymbolId, DottedRules> moves;
+    const DottedRules items = states_[state_id].items_;
+    for (DottedRules::const_iterator it = items.begin(); it != items.end(); ++it) {
+      SymbolId symbol = grammar.GetSymbolByOffset(*it);
+      if (symbol != Grammar::kBadSymbolId) {
+        moves[symbol].push_back(*it + 1);
+      }
+    }
+
+    for (std::map<SymbolId, DottedRules>::iterator it = moves.begin(); it != moves.end(); ++it) {
+      AdvanceNullable(grammar, it->second);
+      StateId target = AddState(it->second, true, queue);
+      goto_table_[state_id * num_of_symbols_ + it->first] = target;
+      states_[state_id].moves_.push_back(it->first);
+    }
+  }
+
+  // Завершенные правила и признак допускающего состояния.
+  for (StateId state_id = 1; state_id < states_.size(); ++state_id) {
+    State& state = states_[state_id];
+    for (DottedRules::const_iterator it = state.items_.begin(); it != state.items_.end(); ++it) {
+      if (grammar.GetSymbolByOffset(*it) != Grammar::kBadSymbolId) {
+        continue;
+      }
+
+      SymbolId lhs = grammar.GetLhsOfRule(dotted_to_rule_[*it]);
+      if (std::find(state.completed_.begin(), state.completed_.end(), lhs) == state.completed_.end()) {
+        state.completed_.push_back(lhs);
+      }
+      if (lhs == grammar.GetStartSymbol()) {
+        state.accepting_ = true;
+      }
+    }
+  }
+
+  CollectCompletedRules(grammar);
+
+  state_map_.clear();
+  rules_by_lhs_.clear();
+}
+
+/*!
+ * \brief Добавление состояния с данным множеством помеченных правил, если такого еще нет.
+ *
+ * \param[in] items   Отсортированное множество помеченных правил.
+ * \param[in] kernel  Состояние получено переходом по символу.
+ * \param[out] queue  Очередь состояний, для которых надо построить переходы.
+ * \return            Идентификатор состояния.
+ */
+Lr0Automaton::StateId Lr0Automaton::AddState( const DottedRules& items, bool kernel, StateIdTable& queue ) {
+  StateMap::iterator it = state_map_.find(items);
+  if (it != state_map_.end()) {
+    State& state = states_[it->second];
+    if (kernel and not state.kernel_) {
+      state.kernel_ = true;
+      queue.push_back(it->second);
+    }
+    return it->second;
+  }
+
+  StateId state_id = states_.size();
+  states_.push_back(State());
+  states_.back().items_ = items;
+  states_.back().kernel_ = kernel;
+  goto_table_.resize(states_.size() * num_of_symbols_, kBadStateId);
+  state_map_.insert(std::make_pair(items, state_id));
+  queue.push_back(state_id);
+  return state_id;
+}
+
+/*!
+ * \brief Сдвиг метки через символы, выводящие пустую цепочку, с сохранением сортировки.
+ *
+ * \param[in] grammar     Грамматика.
+ * \param[in,out] items   Множество помеченных правил, в которое добавляются правила со сдвинутой меткой.
+ */
+void Lr0Automaton::AdvanceNullable( const Grammar& grammar, DottedRules& items ) const {
+  for (size_t i = 0; i < items.size(); ++i) {
+    size_t offset = items[i];
+    while (grammar.GetSymbolByOffset(offset) != Grammar::kBadSymbolId and grammar.IsNullable(grammar.GetSymbolByOffset(offset))) {
+      ++offset;
+      if (std::find(items.begin(), items.end(), offset) == items.end()) {
+        items.push_back(offset);
+      }
+    }
+  }
+  std::sort(items.begin(), items.end());
+}
+
+/*!
+ * \brief Построение множества правил, предсказанных из данного множества.
+ *
+ * Правила, предсказанные для нетерминала, добавляются вместе со своими предсказаниями и сдвигами метки через
+ * символы, выводящие пустую цепочку. Правило попадает в результат, даже если оно уже есть в исходном множестве:
+ * в неядерном состоянии оно начинается в текущей позиции, а не там, где начинается ядерное.
+ *
+ * \param[in] grammar     Грамматика.
+ * \param[in] items       Исходное множество помеченных правил.
+ * \param[out] predicted  Отсортированное множество предсказанных правил.
+ */
+void Lr0Automaton::Predict( const Grammar& grammar, const DottedRules& items, DottedRules& predicted ) const {
+  std::vector<bool> expanded(num_of_symbols_, false);
+  DottedRules queue(items);
+  predicted.clear();
+
+  while (not queue.empty()) {
+    SymbolId symbol = grammar.GetSymbolByOffset(queue.back());
+    queue.pop_back();
+    if (not grammar.IsNonterminal(symbol) or expanded[symbol]) {
+      continue;
+    }
+    expanded[symbol] = true;
+
+    const RuleIdTable& rules = rules_by_lhs_[symbol];
+    for (RuleIdTable::const_iterator it = rules.begin(); it != rules.end(); ++it) {
+      size_t offset = grammar.GetOffsetByRule(*it) + 1;
+      for (;;) {
+        predicted.push_back(offset);
+        queue.push_back(offset);
+        SymbolId next = grammar.GetSymbolByOffset(offset);
+        if (next == Grammar::kBadSymbolId or not grammar.IsNullable(next)) {
+          break;
+        }
+        ++offset;
+      }
+    }
+  }
+
+  std::sort(predicted.begin(), predicted.end());
+  predicted.erase(std::unique(predicted.begin(), predicted.end()), predicted.end());
+}
+
+//! Проверка, содержит ли состояние помеченное правило.
+bool Lr0Automaton::Contains( StateId state, size_t dotted_rule ) const {
+  const DottedRules& items = states_[state].items_;
+  return std::binary_search(items.begin(), items.end(), dotted_rule);
+}
+
+//! Запись таблиц автомата в двоичный образ грамматики.
+void Lr0Automaton::Write( ImageWriter& writer ) const {
+  writer.WriteWord(num_of_symbols_);
+  writer.WriteWord(start_state_);
+  writer.WriteTable(goto_table_);
+  writer.WriteTable(dotted_to_rule_);
+
+  // Состояния записываем поле за полем, списки помеченных правил и завершенных нетерминалов -- таблицами.
+  writer.WriteWord(states_.size());
+  for (StateVector::const_iterator it = states_.begin(); it != states_.end(); ++it) {
+    writer.WriteWord(it->epsilon_);
+    writer.WriteWord(it->kernel_);
+    writer.WriteWord(it->accepting_);
+    writer.WriteTable(it->items_);
+    writer.WriteTable(it->completed_);
+  }
+}
+
+//! Чтение таблиц автомата из двоичного образа грамматики вместо построения.
+void Lr0Automaton::Read( ImageReader& reader, const Grammar& grammar ) {
+  num_of_symbols_ = reader.ReadWord();
+  start_state_ = reader.ReadWord();
+  reader.ReadTable(goto_table_);
+  reader.ReadTable(dotted_to_rule_);
+
+  // Таблица переходов содержит по строке на состояние, что проверяем до выделения памяти под состояния.
+  // Число строк проверяется делением, чтобы поврежденные слова не давали переполнения.
+  ImageReader::Word num_of_states = reader.ReadWord();
+  if (num_of_symbols_ != grammar.GetNumOfTerminals() + grammar.GetNumOfNonterminals() + 1
+      or goto_table_.size() % num_of_symbols_ or goto_table_.size() / num_of_symbols_ != num_of_states
+      or start_state_ >= num_of_states or dotted_to_rule_.size() != grammar.GetRulesSpace()) {
+    ImageReader::Fail("inconsistent LR(0) automaton");
+  }
+  ImageReader::CheckIndices(goto_table_, num_of_states, "LR(0) state out of range");
+  ImageReader::CheckIndices(dotted_to_rule_, std::max<size_t>(grammar.GetNumOfRules(), 1), "LR(0) rule out of range");
+
+  states_.resize(num_of_states);
+  for (StateVector::iterator it = states_.begin(); it != states_.end(); ++it) {
+    it->epsilon_ = reader.ReadWord();
+    it->kernel_ = reader.ReadWord() != 0;
+    it->accepting_ = reader.ReadWord() != 0;
+    reader.ReadTable(it->items_);
+    reader.ReadTable(it->completed_);
+    if (it->epsilon_ >= num_of_states) {
+      ImageReader::Fail("LR(0) state out of range");
+    }
+    ImageReader::CheckIndices(it->items_, dotted_to_rule_.size(), "LR(0) item out of range");
+    ImageReader::CheckIndices(it->completed_, num_of_symbols_, "LR(0) symbol out of range");
+  }
+
+  // Символы переходов и завершенные правила в образ не записываются, а восстанавливаются по таблице переходов
+  // и помеченным правилам.
+  for (StateId state_id = 0; state_id < states_.size(); ++state_id) {
+    SymbolIdTable& moves = states_[state_id].moves_;
+    moves.clear();
+    for (SymbolId symbol = 0; symbol < num_of_symbols_; ++symbol) {
+      if (Goto(state_id, symbol) != kBadStateId) {
+        moves.push_back(symbol);
+      }
+    }
+  }
+  CollectCompletedRules(grammar);
+}
+
+//! Построение списков завершенных правил состояний по их помеченным правилам.
+void Lr0Automaton::CollectCompletedRules( const Grammar& grammar ) {
+  for (StateVector::iterator it = states_.begin(); it != states_.end(); ++it) {
+    it->completed_rules_.clear();
+    for (DottedRules::const_iterator item_it = it->items_.begin(); item_it != it->items_.end(); ++item_it) {
+      if (grammar.GetSymbolByOffset(*item_it) == Grammar::kBadSymbolId) {
+        it->completed_rules_.push_back(dotted_to_rule_[*item_it]);
+      }
+    }
+    std::sort(it->completed_rules_.begin(), it->completed_rules_.end());
+  }
+}
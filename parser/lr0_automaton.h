@@ -0,0 +1,149 @@
+
+#ifndef LR0_AUTOMATON_H__
+#define LR0_AUTOMATON_H__
+
+#include <map>
+#include <vector>
+
+#include "public_grammar.h"
+
+namespace parser {
+
+class Grammar;
+class ImageWriter;
+class ImageReader;
+
+/*!
+ * \brief LR(0) автомат с расщеплением по пустым переходам (split epsilon-DFA).
+ *
+ * Автомат используется в режиме "практического" алгоритма Эрли (Aycock, Horspool. Practical Earley Parsing),
+ * в котором ситуация Эрли хранит состояние автомата вместо одного помеченного правила. Состояние автомата --
+ * это множество помеченных правил, замкнутое относительно сдвига метки через символы, из которых выводится
+ * пустая цепочка. Предсказанные правила вынесены в отдельное (неядерное) состояние, переход в которое из
+ * ядерного состояния выполняется без чтения символа.
+ *
+ * Помеченное правило кодируется смещением символа после метки в буфере правил Grammar, то есть для правила
+ * rule_id и позиции метки dot это GetOffsetByRule(rule_id) + dot + 1.
+ */
+class Lr0Automaton {
+public:
+  typedef PublicGrammar::MapId    StateId;      //!< Тип идентификатора состояния автомата.
+  typedef PublicGrammar::MapId    SymbolId;     //!< Тип идентификатора символа грамматики.
+  typedef PublicGrammar::MapId    RuleId;       //!< Тип идентификатора правила грамматики.
+  typedef std::vector<size_t>     DottedRules;  //!< Тип отсортированного списка помеченных правил.
+  typedef std::vector<SymbolId>   SymbolIdTable;//!< Тип таблицы символов.
+  typedef std::vector<StateId>    StateIdTable; //!< Тип таблицы состояний.
+  typedef std::vector<RuleId>     RuleIdTable;  //!< Тип таблицы правил.
+
+  //! Идентификатор "плохого состояния", означает отсутствие перехода.
+  static const StateId kBadStateId = 0;
+
+  //! Состояние автомата.
+  struct State {
+    DottedRules   items_;     //!< Отсортированный список помеченных правил состояния.
+    SymbolIdTable completed_; //!< Нетерминалы в левых частях правил, метка в которых стоит в конце.
+    RuleIdTable   completed_rules_; //!< Правила, метка в которых стоит в конце, по возрастанию.
+    SymbolIdTable moves_;     //!< Символы, по которым есть переходы из состояния, по возрастанию.
+    StateId       epsilon_;   //!< Состояние с предсказанными правилами или kBadStateId.
+    bool          kernel_;    //!< Состояние получено переходом по символу или является начальным.
+    bool          accepting_; //!< Состояние содержит завершенное правило для начального символа.
+
+    //! Инициализация по умолчанию.
+    State()
+      : epsilon_(kBadStateId)
+      , kernel_(false)
+      , accepting_(false)
+    {}
+  };
+
+  //! Тип вектора состояний автомата.
+  typedef std::vector<State> StateVector;
+
+  StateVector   states_;          //!< Состояния автомата, нулевое зарезервировано.
+  StateIdTable  goto_table_;      //!< Таблица переходов: states_.size() строк по num_of_symbols_ элементов.
+  RuleIdTable   dotted_to_rule_;  //!< Для помеченного правила -- идентификатор правила.
+  size_t        num_of_symbols_;  //!< Количество символов грамматики с учетом зарезервированного нулевого.
+  StateId       start_state_;     //!< Начальное состояние автомата.
+
+public:
+  //! Конструктор пустого автомата.
+  Lr0Automaton()
+    : num_of_symbols_(0)
+    , start_state_(kBadStateId)
+  {}
+
+  /*!
+   * \brief Построение автомата для грамматики.
+   *
+   * \param[in] grammar Грамматика с вычисленными таблицами правил и множеством символов, выводящих пустую цепочку.
+   */
+  void Build(const Grammar& grammar);
+
+  //! Запись таблиц автомата в двоичный образ грамматики.
+  void Write( ImageWriter& writer ) const;
+
+  /*!
+   * \brief Чтение таблиц автомата из двоичного образа грамматики вместо построения.
+   *
+   * \param[in] reader  Чтение образа.
+   * \param[in] grammar Грамматика, таблицы правил которой уже прочитаны и проверены.
+   */
+  void Read( ImageReader& reader, const Grammar& grammar );
+
+  //! Получение начального состояния автомата.
+  StateId GetStartState() const { return start_state_; }
+
+  //! Получение количества состояний автомата, включая зарезервированное нулевое.
+  size_t GetNumOfStates() const { return states_.size(); }
+
+  //! Переход из состояния по символу, kBadStateId если перехода нет.
+  StateId Goto( StateId state, SymbolId symbol ) const { return goto_table_[state * num_of_symbols_ + symbol]; }
+
+  //! Переход по пустой цепочке в состояние с предсказанными правилами.
+  StateId GetEpsilonState( StateId state ) const { return states_[state].epsilon_; }
+
+  //! Проверка, содержит ли состояние завершенное правило для начального символа.
+  bool IsAccepting( StateId state ) const { return states_[state].accepting_; }
+
+  //! Нетерминалы, правила которых завершены в данном состоянии.
+  const SymbolIdTable& GetCompleted( StateId state ) const { return states_[state].completed_; }
+
+  //! Символы, по которым есть переходы из данного состояния.
+  const SymbolIdTable& GetMoves( StateId state ) const { return states_[state].moves_; }
+
+  //! Правила, завершенные в данном состоянии, по возрастанию идентификаторов.
+  const RuleIdTable& GetCompletedRules( StateId state ) const { return states_[state].completed_rules_; }
+
+  //! Проверка, содержит ли состояние помеченное правило.
+  bool Contains( StateId state, size_t dotted_rule ) const;
+
+private:
+  //! Тип словаря множеств помеченных правил в состояния.
+  typedef std::map<DottedRules, StateId> StateMap;
+
+  /*!
+   * \brief Добавление состояния с данным множеством помеченных правил, если такого еще нет.
+   *
+   * \param[in] items   Отсортированное множество помеченных правил.
+   * \param[in] kernel  Состояние получено переходом по символу.
+   * \param[out] queue  Очередь состояний, для которых надо построить переходы.
+   * \return            Идентификатор состояния.
+   */
+  StateId AddState( const DottedRules& items, bool kernel, StateIdTable& queue );
+
+  //! Сдвиг метки через символы, выводящие пустую цепочку, с сохранением сортировки.
+  void AdvanceNullable( const Grammar& grammar, DottedRules& items ) const;
+
+  //! Построение множества правил, предсказанных из данного множества.
+  void Predict( const Grammar& grammar, const DottedRules& items, DottedRules& predicted ) const;
+
+  //! Построение списков завершенных правил состояний по их помеченным правилам.
+  void CollectCompletedRules( const Grammar& grammar );
+
+  std::vector<RuleIdTable>  rules_by_lhs_;  //!< Правила грамматики для каждого символа левой части.
+  StateMap                  state_map_;     //!< Состояния по множеству правил, используется только при построении.
+};
+
+} // namespace parser
+
+#endif // LR0_AUTOMATON_H__
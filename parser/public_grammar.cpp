@@ -95,6 +95,7 @@ void PublicGrammar::AddRule( MapId id, const char* name ) {
 
   // Добавляем правило.
   rules_[id] = Rule(name);
+  rules_[id].source_rule_ = id;
 
   // Меняем минимальное и максимальное значения идентификаторов правил, если необходимо.
   if (max_rule_id_ < id) max_rule_id_ = id;  
@@ -163,6 +164,94 @@ void PublicGrammar::AddRhsSymbol( MapId rule_id, MapId sym_id ) {
   rule_it->second.rhs_list_.push_back(sym_id);
 }
 
+/*!
+ * \brief Добавление символа с оператором EBNF в правой части правила.
+ *
+ * \param rule_id    Идентификатор правила.
+ * \param sym_id     Идентификатор повторяемого символа.
+ * \param repetition Повторение символа.
+ */
+void PublicGrammar::AddRhsSymbol( MapId rule_id, MapId sym_id, Repetition repetition ) {
+  AddRhsSymbol(rule_id, sym_id);
+
+  // Символ без оператора не занимает места в словаре операторов.
+  if (repetition != kOnce) {
+    Rule& rule = rules_[rule_id];
+    rule.rhs_operators_[rule.rhs_list_.size() - 1] = RhsOperator(repetition);
+  }
+}
+
+/*!
+ * \brief Добавление списка с разделителем в правой части правила.
+ *
+ * \param rule_id      Идентификатор правила.
+ * \param sym_id       Идентификатор элемента списка.
+ * \param separator_id Идентификатор разделителя.
+ * \param repetition   kOneOrMore для непустого списка или kZeroOrMore, если список может быть пустым.
+ */
+void PublicGrammar::AddRhsList( MapId rule_id, MapId sym_id, MapId separator_id, Repetition repetition ) {
+  if (repetition != kZeroOrMore and repetition != kOneOrMore) {
+    std::stringstream st;
+    st << "The list in the rule with id = \"" << rule_id << "\" must be repeated zero or more or one or more times";
+    throw std::invalid_argument(st.str().c_str());
+  }
+
+  // Проверяем наличие разделителя в грамматике.
+  if (symbols_.find(separator_id) == symbols_.end()) {
+    std::stringstream st;
+    st << "The symbol with id = \"" << separator_id << "\" does not exist in the grammar's symbol set";
+    throw std::runtime_error( st.str().c_str() );
+  }
+
+  AddRhsSymbol(rule_id, sym_id);
+
+  Rule& rule = rules_[rule_id];
+  rule.rhs_operators_[rule.rhs_list_.size() - 1] = RhsOperator(repetition, separator_id);
+}
+
+/*!
+ * \brief Установка веса правила.
+ *
+ * \param rule_id Идентификатор правила.
+ * \param weight  Логарифм вероятности правила, не больше нуля.
+ */
+void PublicGrammar::SetRuleWeight( MapId rule_id, double weight ) {
+  // Проверяем наличие правила в грамматике.
+  RuleTable::iterator rule_it = rules_.find(rule_id);
+  if (rule_it == rules_.end()) {
+    std::stringstream st;
+    st << "The rule with id = \"" << rule_id << "\" does not exist in the grammar's rule set";
+    throw std::invalid_argument(st.str().c_str());
+  }
+
+  // Вес -- логарифм вероятности, поэтому положительные значения не имеют смысла.
+  if (not (weight <= 0.0)) {
+    std::stringstream st;
+    st << "The weight " << weight << " of the rule with id = \"" << rule_id << "\" is not a log-probability";
+    throw std::invalid_argument(st.str().c_str());
+  }
+
+  rule_it->second.weight_ = weight;
+}
+
+/*!
+ * \brief Установка исходного правила.
+ *
+ * \param rule_id   Идентификатор правила.
+ * \param source_id Идентификатор исходного правила или kUnknownMapId для вспомогательных правил.
+ */
+void PublicGrammar::SetSourceRule( MapId rule_id, MapId source_id ) {
+  // Проверяем наличие правила в грамматике.
+  RuleTable::iterator rule_it = rules_.find(rule_id);
+  if (rule_it == rules_.end()) {
+    std::stringstream st;
+    st << "The rule with id = \"" << rule_id << "\" does not exist in the grammar's rule set";
+    throw std::invalid_argument(st.str().c_str());
+  }
+
+  rule_it->second.source_rule_ = source_id;
+}
+
 /*!
  * \brief Печать содержимого грамматики.
  *
@@ -180,10 +269,23 @@ void PublicGrammar::Print( std::ostream& out ) {
     SymbolTable::iterator symbol_it = symbols_.find(rule_it->second.lhs_symbol_);
     out << symbol_it->second.name_ << " -->";
 
+    // Операторы EBNF печатаются как X?, X*, X+, а списки с разделителем -- как {X s}* и {X s}+.
+    const RhsOperatorTable& operators = rule_it->second.rhs_operators_;
     MapIdList::iterator rhs_symbol_it = rule_it->second.rhs_list_.begin(), rhs_symbol_end = rule_it->second.rhs_list_.end();
-    for (; rhs_symbol_it != rhs_symbol_end; ++rhs_symbol_it) {
+    for (size_t rhs_pos = 0; rhs_symbol_it != rhs_symbol_end; ++rhs_symbol_it, ++rhs_pos) {
       SymbolTable::iterator symbol_it = symbols_.find(*rhs_symbol_it);
-      out << " " << symbol_it->second.name_;
+      RhsOperatorTable::const_iterator operator_it = operators.find(rhs_pos);
+      if (operator_it == operators.end()) {
+        out << " " << symbol_it->second.name_;
+        continue;
+      }
+
+      if (operator_it->second.separator_ != kUnknownMapId) {
+        out << " {" << symbol_it->second.name_ << " " << symbols_.find(operator_it->second.separator_)->second.name_ << "}";
+      } else {
+        out << " " << symbol_it->second.name_;
+      }
+      out << (operator_it->second.repetition_ == kOptional ? "?" : operator_it->second.repetition_ == kZeroOrMore ? "*" : "+");
     }
 
     out << " ]\n";
@@ -30,6 +30,39 @@ public:
   //! Значение неккоректного идентифкатора, заразервированного для внутренних целей.
   static const MapId kUnknownMapId = 0;
 
+  //! Повторение символа правой части правила (оператор EBNF).
+  enum Repetition {
+    kOnce,        //!< Символ ровно один раз.
+    kOptional,    //!< X? -- символ ноль или один раз.
+    kZeroOrMore,  //!< X* -- символ ноль или более раз.
+    kOneOrMore    //!< X+ -- символ один или более раз.
+  };
+
+  /*!
+   * \brief Оператор EBNF над символом правой части правила.
+   *
+   * Для списка с разделителем повторяется символ, а между соседними повторениями стоит разделитель:
+   * {X s}+ -- это X, X s X, X s X s X и так далее.
+   */
+  struct RhsOperator {
+    Repetition  repetition_;  //!< Повторение символа.
+    MapId       separator_;   //!< Идентификатор символа разделителя или kUnknownMapId, если его нет.
+
+    //! Инициализация, по умолчанию -- символ без оператора.
+    explicit RhsOperator( Repetition repetition = kOnce, MapId separator = kUnknownMapId )
+      : repetition_(repetition)
+      , separator_(separator)
+    {}
+
+    //! Оператор сравнения.
+    bool operator==( const RhsOperator& rhs ) const {
+      return repetition_ == rhs.repetition_ and separator_ == rhs.separator_;
+    }
+  };
+
+  //! Тип словаря операторов правой части правила: позиция символа в rhs_list_ --> оператор.
+  typedef std::map<size_t, RhsOperator> RhsOperatorTable;
+
   /*!
    * \brief Класс, представляющий символ грамматики.
    *
@@ -64,11 +97,22 @@ public:
    *    name_: A --> X1 X2 ... Xn
    *    lhs_symbol_: MapId(A)
    *    rhs_list_: MapId(X1), MapId(X2), ..., MapId(Xn).
+   *
+   * Символы правой части могут иметь операторы EBNF, тогда в rhs_list_ хранится повторяемый символ,
+   * а оператор -- в rhs_operators_ под позицией символа. Grammar заменяет такие символы вспомогательными
+   * нетерминалами.
+   *
+   * Вес правила -- логарифм его вероятности, используется для оценки выводов в режиме пучка.
+   * Исходное правило -- правило пользовательской грамматики, из которого получено данное правило
+   * преобразованием GrammarOptimizer; для правил, добавленных пользователем, это само правило.
    */
   struct Rule {
     const char* name_;        //!< Имя правила в читабельном для человека виде.
     int         lhs_symbol_;  //!< Идентификатор символа в левой части правила.
     MapIdList   rhs_list_;    //!< Список идентфикаторов символов в правой части правила.
+    RhsOperatorTable rhs_operators_; //!< Операторы EBNF символов правой части, по позициям в rhs_list_.
+    double      weight_;      //!< Вес правила, по умолчанию 0 (вероятность 1).
+    MapId       source_rule_; //!< Идентификатор исходного правила или kUnknownMapId, если его нет.
 
     /*!
      * \brief Инициализация по умолчанию.
@@ -80,6 +124,8 @@ public:
     Rule()
       : name_(NULL)
       , lhs_symbol_(kUnknownMapId)
+      , weight_(0.0)
+      , source_rule_(kUnknownMapId)
     {}
 
     /*!
@@ -90,6 +136,8 @@ public:
     explicit Rule( const char* name )
       : name_(name)
       , lhs_symbol_(kUnknownMapId)
+      , weight_(0.0)
+      , source_rule_(kUnknownMapId)
     {}
   };
 
@@ -162,6 +210,44 @@ public:
    */
   void AddRhsSymbol( MapId rule_id, MapId sym_id );
 
+  /*!
+   * \brief Добавление символа с оператором EBNF в правой части правила.
+   *
+   * \param rule_id    Идентификатор правила.
+   * \param sym_id     Идентификатор повторяемого символа.
+   * \param repetition Повторение символа.
+   */
+  void AddRhsSymbol( MapId rule_id, MapId sym_id, Repetition repetition );
+
+  /*!
+   * \brief Добавление списка с разделителем в правой части правила.
+   *
+   * \param rule_id      Идентификатор правила.
+   * \param sym_id       Идентификатор элемента списка.
+   * \param separator_id Идентификатор разделителя.
+   * \param repetition   kOneOrMore для непустого списка или kZeroOrMore, если список может быть пустым.
+   */
+  void AddRhsList( MapId rule_id, MapId sym_id, MapId separator_id, Repetition repetition );
+
+  /*!
+   * \brief Установка веса правила.
+   *
+   * \param rule_id Идентификатор правила.
+   * \param weight  Логарифм вероятности правила, не больше нуля.
+   */
+  void SetRuleWeight( MapId rule_id, double weight );
+
+  /*!
+   * \brief Установка исходного правила.
+   *
+   * По умолчанию исходным правилом считается само добавленное правило. Используется преобразованиями
+   * грамматики, чтобы анализатор мог сообщить интерпретатору идентификатор правила пользователя.
+   *
+   * \param rule_id   Идентификатор правила.
+   * \param source_id Идентификатор исходного правила или kUnknownMapId для вспомогательных правил.
+   */
+  void SetSourceRule( MapId rule_id, MapId source_id );
+
   /*!
    * \brief Установка идентификатора начального нетерминала грамматики.
    *
@@ -0,0 +1,118 @@
+
+#include <algorithm>
+
+#include "sppf.h"
+using parser::Sppf;
+
+const Sppf::NodeId Sppf::kNoNode;
+
+//! Получение или добавление узла по ключу.
+Sppf::NodeId Sppf::AddNode(const NodeKey& key, bool& added) {
+  NodeIndex::const_iterator it = index_.find(key);
+  if (it != index_.end()) {
+    added = false;
+    return it->second;
+  }
+
+  NodeId node_id = nodes_.size();
+  nodes_.push_back(Node());
+  Node& node = nodes_.back();
+  node.kind_  = key.kind_;
+  node.start_ = key.start_;
+  node.end_   = key.end_;
+  index_.insert(std::make_pair(key, node_id));
+  added = true;
+  return node_id;
+}
+
+//! Получение или добавление узла символа.
+Sppf::NodeId Sppf::AddSymbolNode(Grammar::SymbolId symbol_id, size_t start, size_t end) {
+  bool added = false;
+  NodeId node_id = AddNode(NodeKey(kSymbolNode, symbol_id, 0, start, end), added);
+  if (added) {
+    nodes_[node_id].symbol_id_ = symbol_id;
+  }
+  return node_id;
+}
+
+//! Получение или добавление промежуточного узла.
+Sppf::NodeId Sppf::AddIntermediateNode(Grammar::RuleId rule_id, unsigned rhs_pos, size_t start, size_t end) {
+  bool added = false;
+  NodeId node_id = AddNode(NodeKey(kIntermediateNode, rule_id, rhs_pos, start, end), added);
+  if (added) {
+    nodes_[node_id].rule_id_ = rule_id;
+    nodes_[node_id].rhs_pos_ = rhs_pos;
+  }
+  return node_id;
+}
+
+//! Получение или добавление терминального узла.
+Sppf::NodeId Sppf::AddTerminalNode(Grammar::SymbolId symbol_id, Token::Ptr token, size_t start, size_t end) {
+  bool added = false;
+  NodeId node_id = AddNode(NodeKey(kTerminalNode, symbol_id, 0, start, end), added);
+  if (added) {
+    nodes_[node_id].symbol_id_ = symbol_id;
+    nodes_[node_id].token_     = token;
+  }
+  return node_id;
+}
+
+//! Добавление варианта вывода узла, если такого еще нет.
+bool Sppf::AddPackedNode(NodeId node_id, const PackedNode& packed) {
+  // Вариант вывода однозначно определяется правилом и точкой разбиения, потомки по ним восстанавливаются.
+  PackedNodeVector& packed_nodes = nodes_[node_id].packed_;
+  for (PackedNodeVector::const_iterator it = packed_nodes.begin(); it != packed_nodes.end(); ++it) {
+    if (it->rule_id_ == packed.rule_id_ and it->split_ == packed.split_) {
+      return false;
+    }
+  }
+
+  packed_nodes.push_back(packed);
+  ++num_of_packed_nodes_;
+  return true;
+}
+
+//! Добавление корня леса, если такого еще нет.
+void Sppf::AddRoot(NodeId node_id) {
+  if (std::find(roots_.begin(), roots_.end(), node_id) == roots_.end()) {
+    roots_.push_back(node_id);
+  }
+}
+
+//! Удаление всех узлов.
+void Sppf::Clear() {
+  nodes_.clear();
+  index_.clear();
+  roots_.clear();
+  num_of_packed_nodes_ = 0;
+}
+
+//! Печать содержимого леса.
+void Sppf::Dump(const Grammar* grammar, std::ostream& out) const {
+  for (NodeId node_id = 0; node_id < nodes_.size(); ++node_id) {
+    const Node& node = nodes_[node_id];
+    out << node_id << " ";
+    if (node.kind_ == kIntermediateNode) {
+      out << "[ " << grammar->GetSymbolName(grammar->GetLhsOfRule(node.rule_id_)) << " --> ";
+      for (unsigned rhs_pos = 0; rhs_pos < node.rhs_pos_; ++rhs_pos) {
+        out << grammar->GetSymbolName(grammar->GetRhsOfRule(node.rule_id_, rhs_pos)) << " ";
+      }
+      out << "* ]";
+    } else {
+      out << grammar->GetSymbolName(node.symbol_id_);
+    }
+    out << " (" << node.start_ << ", " << node.end_ << ")";
+
+    for (PackedNodeVector::const_iterator it = node.packed_.begin(); it != node.packed_.end(); ++it) {
+      out << " {" << it->split_ << ":";
+      if (it->left_ != kNoNode) {
+        out << " " << it->left_;
+      }
+      if (it->right_ != kNoNode) {
+        out << " " << it->right_;
+      }
+      out << "}";
+    }
+    out << "\n";
+  }
+}
@@ -0,0 +1,221 @@
+
+#ifndef SPPF_H__
+#define SPPF_H__
+
+#include <vector>
+#include <ostream>
+
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+
+#include "grammar.h"
+#include "token.h"
+
+namespace parser {
+
+/*!
+ * \brief Бинаризованный разделяемый упакованный лес разбора (SPPF).
+ *
+ * Лес хранит все деревья разбора входной цепочки в полиномиальной памяти. Узел символа (A, i, j) объединяет
+ * все выводы нетерминала A на участке цепочки между состояниями Эрли i и j. Промежуточный узел (A --> alpha * beta,
+ * i, j) объединяет все выводы префикса alpha правила. Терминальный узел соответствует токену. Каждый вариант вывода
+ * узла представлен упакованным узлом с не более чем двумя потомками: левый -- промежуточный узел для префикса
+ * правила без последнего символа, правый -- узел последнего символа префикса. Одинаковые поддеревья разделяются
+ * всеми деревьями, в которые они входят.
+ */
+class Sppf {
+public:
+  typedef size_t NodeId; //!< Тип идентификатора узла леса.
+
+  //! Идентификатор отсутствующего узла.
+  static const NodeId kNoNode = static_cast<NodeId>(-1);
+
+  //! Вид узла леса.
+  enum NodeKind {
+    kSymbolNode,        //!< Узел нетерминала.
+    kIntermediateNode,  //!< Узел префикса правила.
+    kTerminalNode       //!< Узел токена.
+  };
+
+  //! Упакованный узел -- один вариант вывода узла.
+  struct PackedNode {
+    Grammar::RuleId rule_id_; //!< Правило, по которому построен вывод.
+    size_t          split_;   //!< Состояние Эрли, в котором заканчивается левый потомок.
+    NodeId          left_;    //!< Промежуточный узел префикса правила или kNoNode.
+    NodeId          right_;   //!< Узел последнего символа префикса или kNoNode для пустого правила.
+
+    //! Инициализация всех полей.
+    PackedNode(Grammar::RuleId rule_id, size_t split, NodeId left, NodeId right)
+      : rule_id_(rule_id)
+      , split_(split)
+      , left_(left)
+      , right_(right)
+    {}
+  };
+
+  //! Тип вектора упакованных узлов.
+  typedef std::vector<PackedNode> PackedNodeVector;
+
+  //! Узел леса.
+  struct Node {
+    NodeKind          kind_;      //!< Вид узла.
+    Grammar::SymbolId symbol_id_; //!< Символ для узлов символа и терминальных узлов.
+    Grammar::RuleId   rule_id_;   //!< Правило для промежуточного узла.
+    unsigned          rhs_pos_;   //!< Позиция метки для промежуточного узла.
+    size_t            start_;     //!< Состояние Эрли, в котором начинается участок цепочки.
+    size_t            end_;       //!< Состояние Эрли, в котором заканчивается участок цепочки.
+    Token::Ptr        token_;     //!< Токен для терминального узла.
+    PackedNodeVector  packed_;    //!< Варианты вывода узла.
+
+    //! Инициализация по умолчанию.
+    Node()
+      : kind_(kSymbolNode)
+      , symbol_id_(Grammar::kBadSymbolId)
+      , rule_id_(0)
+      , rhs_pos_(0)
+      , start_(0)
+      , end_(0)
+    {}
+  };
+
+  //! Тип вектора узлов.
+  typedef std::vector<Node> NodeVector;
+
+  //! Тип вектора идентификаторов узлов.
+  typedef std::vector<NodeId> NodeIdVector;
+
+public:
+  /*!
+   * \brief Получение или добавление узла символа.
+   *
+   * \param[in] symbol_id Нетерминал.
+   * \param[in] start     Состояние Эрли, в котором начинается вывод.
+   * \param[in] end       Состояние Эрли, в котором заканчивается вывод.
+   * \return              Идентификатор узла.
+   */
+  NodeId AddSymbolNode(Grammar::SymbolId symbol_id, size_t start, size_t end);
+
+  /*!
+   * \brief Получение или добавление промежуточного узла.
+   *
+   * \param[in] rule_id   Правило.
+   * \param[in] rhs_pos   Позиция метки в правой части правила.
+   * \param[in] start     Состояние Эрли, в котором начинается вывод.
+   * \param[in] end       Состояние Эрли, в котором заканчивается вывод.
+   * \return              Идентификатор узла.
+   */
+  NodeId AddIntermediateNode(Grammar::RuleId rule_id, unsigned rhs_pos, size_t start, size_t end);
+
+  /*!
+   * \brief Получение или добавление терминального узла.
+   *
+   * \param[in] symbol_id Терминал.
+   * \param[in] token     Токен.
+   * \param[in] start     Состояние Эрли перед токеном.
+   * \param[in] end       Состояние Эрли, полученное сдвигом токена.
+   * \return              Идентификатор узла.
+   */
+  NodeId AddTerminalNode(Grammar::SymbolId symbol_id, Token::Ptr token, size_t start, size_t end);
+
+  /*!
+   * \brief Добавление варианта вывода узла, если такого еще нет.
+   *
+   * \param[in] node_id   Идентификатор узла.
+   * \param[in] packed    Упакованный узел.
+   * \return              true если вариант добавлен.
+   */
+  bool AddPackedNode(NodeId node_id, const PackedNode& packed);
+
+  //! Добавление корня леса, если такого еще нет.
+  void AddRoot(NodeId node_id);
+
+  //! Получение узла по идентификатору.
+  const Node& GetNode(NodeId node_id) const { return nodes_[node_id]; }
+
+  //! Получение количества узлов.
+  size_t GetNumOfNodes() const { return nodes_.size(); }
+
+  //! Получение количества упакованных узлов.
+  size_t GetNumOfPackedNodes() const { return num_of_packed_nodes_; }
+
+  //! Получение корней леса -- узлов начального символа для каждого последнего состояния разбора.
+  const NodeIdVector& GetRoots() const { return roots_; }
+
+  //! Оценка памяти, занятой узлами, упакованными узлами, индексом узлов и корнями.
+  size_t GetMemoryUsage() const {
+    return nodes_.size() * sizeof(Node) + num_of_packed_nodes_ * sizeof(PackedNode)
+         + index_.size() * (sizeof(NodeIndex::value_type) + 2 * sizeof(void*)) + roots_.size() * sizeof(NodeId);
+  }
+
+  //! Удаление всех узлов.
+  void Clear();
+
+  /*!
+   * \brief Печать содержимого леса.
+   *
+   * \param[in] grammar Указатель на объект грамматики, у которой берутся символьные имена элементов.
+   * \param[in] out     Поток для вывода.
+   */
+  void Dump(const Grammar* grammar, std::ostream& out) const;
+
+  //! Конструктор пустого леса.
+  Sppf()
+    : num_of_packed_nodes_(0)
+  {}
+
+private:
+  //! Ключ для поиска узла: вид, символ или правило, позиция метки и участок цепочки.
+  struct NodeKey {
+    NodeKind          kind_;
+    Grammar::RuleId   id_;
+    unsigned          rhs_pos_;
+    size_t            start_;
+    size_t            end_;
+
+    //! Инициализация всех полей.
+    NodeKey(NodeKind kind, Grammar::RuleId id, unsigned rhs_pos, size_t start, size_t end)
+      : kind_(kind)
+      , id_(id)
+      , rhs_pos_(rhs_pos)
+      , start_(start)
+      , end_(end)
+    {}
+
+    //! Оператор сравнения.
+    bool operator==(const NodeKey& rhs) const {
+      return  kind_ == rhs.kind_
+              and id_ == rhs.id_
+              and rhs_pos_ == rhs.rhs_pos_
+              and start_ == rhs.start_
+              and end_ == rhs.end_;
+    }
+  };
+
+  //! Функция хэширования ключа узла.
+  struct NodeKeyHash {
+    size_t operator()(const NodeKey& key) const {
+      size_t seed = 0;
+      boost::hash_combine(seed, static_cast<int>(key.kind_));
+      boost::hash_combine(seed, key.id_);
+      boost::hash_combine(seed, key.rhs_pos_);
+      boost::hash_combine(seed, key.start_);
+      boost::hash_combine(seed, key.end_);
+      return seed;
+    }
+  };
+
+  //! Тип индекса узлов.
+  typedef boost::unordered_map<NodeKey, NodeId, NodeKeyHash> NodeIndex;
+
+  //! Получение или добавление узла по ключу.
+  NodeId AddNode(const NodeKey& key, bool& added);
+
+  NodeVector    nodes_;               //!< Узлы леса.
+  NodeIndex     index_;               //!< Индекс узлов по ключу.
+  NodeIdVector  roots_;               //!< Корни леса.
+  size_t        num_of_packed_nodes_; //!< Количество упакованных узлов.
+};
+
+} // namespace parser
+
+#endif // SPPF_H__
@@ -0,0 +1,144 @@
+#include <sstream>
+#include <stdexcept>
+
+#include <parser/batch_parser.h>
+
+#include "test_util.h"
+
+namespace tests {
+
+using parser::BatchParser;
+
+namespace {
+
+enum { a = 1, b, A };
+
+//! Терминалы входной цепочки из букв a и b, другие буквы -- ошибка лексического анализа.
+std::vector<PublicGrammar::MapId> GetTypes(const std::string& input) {
+  std::vector<PublicGrammar::MapId> types;
+  for (size_t i = 0; i < input.size(); ++i) {
+    if (input[i] != 'a' and input[i] != 'b') {
+      throw std::runtime_error("unexpected character in \"" + input + "\"");
+    }
+    types.push_back(input[i] == 'a' ? a : b);
+  }
+  return types;
+}
+
+//! Текст деревьев, переданных интерпретатору, в порядке их текстов.
+std::string JoinTrees(const std::multiset<std::string>& trees) {
+  std::string text;
+  for (std::multiset<std::string>::const_iterator it = trees.begin(); it != trees.end(); ++it) {
+    text += *it;
+  }
+  return text;
+}
+
+//! Фабрика без состояния, ее методы можно вызывать из нескольких потоков.
+struct TreeFactory : public BatchParser::Factory {
+  Lexer* CreateLexer(const std::string& input) {
+    return new bench::TokenListLexer(GetTypes(input));
+  }
+
+  EarleyParser::Interpretator* CreateInterpretator() {
+    return new TreeInterpretator();
+  }
+
+  EarleyParser::Context::Ptr TakeResult(EarleyParser::Interpretator* interpretator, bool) {
+    return EarleyParser::Context::Ptr(new TreeInterpretator::TreeContext(JoinTrees(static_cast<TreeInterpretator*>(interpretator)->trees_)));
+  }
+};
+
+//! Входы разной длины, часть из них с ошибкой лексического анализа или отвергаемые.
+BatchParser::InputList GetInputs() {
+  BatchParser::InputList inputs;
+  bench::Random random(7);
+  for (size_t i = 0; i < 200; ++i) {
+    std::string input;
+    size_t length = random.Next(12);
+    for (size_t j = 0; j < length; ++j) {
+      input += random.Next(2) ? 'a' : 'b';
+    }
+    if (i % 17 == 5) {
+      input.insert(input.size() / 2, "x");
+    }
+    inputs.push_back(input);
+  }
+  return inputs;
+}
+
+} // namespace
+
+/*!
+ * \brief Пакетный разбор несколькими потоками.
+ *
+ * Результаты сравниваются с последовательным разбором каждого входа отдельным анализатором: результат, деревья
+ * и счетчики должны совпадать и стоять в порядке входов, а исключение лексического анализа должно попасть в
+ * результат своего входа, не прерывая остальные. Повторный вызов Parse с переиспользованной памятью дает то же.
+ */
+void TestBatch() {
+  PublicGrammar public_grammar("batch");
+  public_grammar.AddTerminal(a, "a");
+  public_grammar.AddTerminal(b, "b");
+  public_grammar.AddNonterminal(A, "A");
+  public_grammar.SetStartSymbolId(A);
+  bench::AddRule(&public_grammar, 1, "A --> A A", A, A, A);
+  bench::AddRule(&public_grammar, 2, "A --> a", A, a);
+  bench::AddRule(&public_grammar, 3, "A --> A b", A, A, b);
+  Grammar grammar(&public_grammar);
+
+  BatchParser::InputList inputs = GetInputs();
+  std::vector<BatchParser::Result> expected(inputs.size());
+  size_t num_of_expected_errors = 0;
+  size_t num_of_accepted = 0;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    try {
+      bench::TokenListLexer lexer(GetTypes(inputs[i]));
+      TreeInterpretator interpretator;
+      EarleyParser parser(&grammar, &lexer, &interpretator);
+      expected[i].accepted_ = parser.Parse();
+      num_of_accepted += expected[i].accepted_;
+      expected[i].stats_ = parser.GetStats();
+      expected[i].context_.reset(new TreeInterpretator::TreeContext(JoinTrees(interpretator.trees_)));
+    } catch (const std::exception& err) {
+      expected[i].error_ = err.what();
+      ++num_of_expected_errors;
+    }
+  }
+
+  Check(num_of_accepted and num_of_accepted + num_of_expected_errors < inputs.size(), "batch: accepted and rejected inputs");
+
+  size_t num_of_threads[] = {1, 2, 4, 7};
+  for (size_t t = 0; t < sizeof(num_of_threads) / sizeof(num_of_threads[0]); ++t) {
+    TreeFactory factory;
+    BatchParser batch(&grammar, &factory, Options(), num_of_threads[t]);
+    Check(batch.GetNumOfThreads() == num_of_threads[t], "batch: number of threads");
+
+    for (size_t run = 0; run < 2; ++run) {
+      std::ostringstream name;
+      name << "batch " << num_of_threads[t] << " threads, run " << run + 1;
+
+      BatchParser::ResultList results;
+      batch.Parse(inputs, results);
+      if (not Check(results.size() == inputs.size(), name.str() + ": number of results")) {
+        continue;
+      }
+
+      size_t num_of_mismatches = 0;
+      size_t num_of_errors = 0;
+      for (size_t i = 0; i < inputs.size(); ++i) {
+        const TreeInterpretator::TreeContext* context = dynamic_cast<const TreeInterpretator::TreeContext*>(results[i].context_.get());
+        const TreeInterpretator::TreeContext* expected_context = dynamic_cast<const TreeInterpretator::TreeContext*>(expected[i].context_.get());
+        bool same = results[i].accepted_ == expected[i].accepted_ and results[i].error_ == expected[i].error_
+                    and (context ? context->text_ : std::string()) == (expected_context ? expected_context->text_ : std::string())
+                    and results[i].stats_.num_of_items_ == expected[i].stats_.num_of_items_;
+        num_of_mismatches += not same;
+        num_of_errors += not results[i].error_.empty();
+      }
+      Check(num_of_mismatches == 0, name.str() + ": results in input order");
+      Check(num_of_expected_errors and num_of_errors == num_of_expected_errors, name.str() + ": lexer errors reported");
+    }
+  }
+}
+
+} // namespace tests
@@ -0,0 +1,47 @@
+#include <sstream>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "test_util.h"
+#include "c_grammar_tables.h"
+
+namespace tests {
+
+namespace {
+
+//! Двоичный образ грамматики.
+std::string SaveImage(const Grammar& grammar) {
+  std::ostringstream stream(std::ios::out | std::ios::binary);
+  grammar.Save(stream);
+  return stream.str();
+}
+
+} // namespace
+
+/*!
+ * \brief Грамматика языка C из таблиц, встроенных при сборке grammar-codegen.
+ *
+ * c_grammar::CreateGrammar должна давать те же таблицы, что и построение по PublicGrammar, и разбирать вход
+ * бенчмарка c так же во всех режимах.
+ */
+void TestCodegen() {
+  PublicGrammar public_grammar("c");
+  c_grammar::init_grammar(&public_grammar);
+  Grammar grammar(&public_grammar);
+  boost::scoped_ptr<Grammar> embedded(c_grammar::CreateGrammar());
+  Check(SaveImage(*embedded) == SaveImage(grammar), "c codegen: same image");
+
+  const std::vector<BenchmarkInput>& inputs = GetBenchmarkInputs();
+  std::vector<Mode> modes = GetModes();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (inputs[i].name_ != "c") {
+      continue;
+    }
+    for (size_t m = 0; m < modes.size(); ++m) {
+      CheckOutcome(Parse(grammar, inputs[i].types_, modes[m].options_), Parse(*embedded, inputs[i].types_, modes[m].options_),
+                   std::string("c codegen ") + modes[m].name_);
+    }
+  }
+}
+
+} // namespace tests
@@ -0,0 +1,23 @@
+#include "test_util.h"
+
+namespace tests {
+
+/*!
+ * \brief Сравнение отложенной семантики с разбором обычными ситуациями.
+ *
+ * Отдельно проверяется сочетание с ситуациями Лео и лесом разбора, в котором выводы раскрываются после
+ * распознавания сразу тремя способами.
+ */
+void TestDeferred() {
+  Mode mode;
+  mode.name_ = "deferred";
+  mode.options_.defer_semantics_ = true;
+  CheckMode(mode);
+
+  mode.name_ = "leo-deferred-forest";
+  mode.options_.use_leo_items_ = true;
+  mode.options_.build_forest_ = true;
+  CheckMode(mode);
+}
+
+} // namespace tests
@@ -0,0 +1,18 @@
+#include "test_util.h"
+
+namespace tests {
+
+/*!
+ * \brief Сравнение леса разбора с выводами ситуаций разбора обычными ситуациями.
+ *
+ * Лес строится после распознавания, интерпретатор при этом не вызывается, поэтому его упакованные узлы
+ * должны совпасть с выводами, собранными обходом ситуаций эталонного разбора.
+ */
+void TestForest() {
+  Mode mode;
+  mode.name_ = "forest";
+  mode.options_.build_forest_ = true;
+  CheckMode(mode);
+}
+
+} // namespace tests
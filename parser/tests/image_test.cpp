@@ -0,0 +1,126 @@
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/cstdint.hpp>
+
+#include "test_util.h"
+
+namespace tests {
+
+namespace {
+
+typedef boost::uint64_t Word;
+
+//! Двоичный образ грамматики.
+std::string SaveImage(const Grammar& grammar) {
+  std::ostringstream stream(std::ios::out | std::ios::binary);
+  grammar.Save(stream);
+  return stream.str();
+}
+
+//! Слово образа по номеру.
+Word GetWord(const std::string& image, size_t index) {
+  Word word;
+  image.copy(reinterpret_cast<char*>(&word), sizeof(word), index * sizeof(word));
+  return word;
+}
+
+//! Замена слова образа по номеру.
+void SetWord(std::string& image, size_t index, Word word) {
+  image.replace(index * sizeof(word), sizeof(word), reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+//! Номер слова, следующего за таблицей, которая начинается словом index, как ее записывает ImageWriter.
+size_t SkipTable(const std::string& image, size_t index, size_t element_size) {
+  return index + 1 + (GetWord(image, index) * element_size + sizeof(Word) - 1) / sizeof(Word);
+}
+
+/*!
+ * \brief Загрузка образа, которая должна закончиться исключением std::runtime_error.
+ *
+ * Любое другое исключение означает, что поврежденное слово не было проверено до выделения памяти.
+ */
+bool IsRejected(const std::string& image) {
+  try {
+    Grammar grammar(image.data(), image.size());
+  } catch (const std::runtime_error&) {
+    return true;
+  } catch (...) {
+    return false;
+  }
+  return false;
+}
+
+//! Загрузка образа, которая может закончиться только исключением std::runtime_error.
+bool LoadsOrRejects(const std::string& image) {
+  try {
+    Grammar grammar(image.data(), image.size());
+  } catch (const std::runtime_error&) {
+  } catch (...) {
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+/*!
+ * \brief Сохранение грамматики в двоичный образ и загрузка из него.
+ *
+ * Загруженная грамматика должна сохраняться в тот же образ и разбирать входы всех бенчмарков во всех режимах
+ * так же, как исходная. Образ, обрезанный в любом месте, и образ с индексом за границей таблицы отвергаются.
+ */
+void TestImage() {
+  const std::vector<BenchmarkInput>& inputs = GetBenchmarkInputs();
+  std::vector<Mode> modes = GetModes();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::string name = inputs[i].name_ + " image";
+    std::string image = SaveImage(*inputs[i].grammar_);
+    Grammar loaded(image.data(), image.size());
+    Check(SaveImage(loaded) == image, name + ": same image");
+    for (size_t m = 0; m < modes.size(); ++m) {
+      CheckOutcome(Parse(*inputs[i].grammar_, inputs[i].types_, modes[m].options_),
+                   Parse(loaded, inputs[i].types_, modes[m].options_), name + " " + modes[m].name_);
+    }
+  }
+
+  const BenchmarkInput& input = inputs.front();
+  const Grammar& grammar = *input.grammar_;
+  std::string image = SaveImage(grammar);
+  std::string name = input.name_ + " image";
+
+  size_t num_of_truncated = 0;
+  for (size_t size = 0; size < image.size(); ++size) {
+    num_of_truncated += IsRejected(image.substr(0, size));
+  }
+  Check(num_of_truncated == image.size(), name + ": truncated images rejected");
+
+  // Поврежденное слово должно либо пройти проверки, либо дать ту же ошибку, что и обрезанный образ.
+  size_t num_of_corrupted = 0;
+  for (size_t index = 0; index < image.size() / sizeof(Word); ++index) {
+    std::string corrupted = image;
+    SetWord(corrupted, index, ~Word(0));
+    num_of_corrupted += LoadsOrRejects(corrupted);
+  }
+  Check(num_of_corrupted == image.size() / sizeof(Word), name + ": corrupted words rejected with std::runtime_error");
+
+  // За заголовком из 15 слов идут таблицы символов, правил, отображения символов и смещений правил.
+  size_t rules = SkipTable(image, 15, sizeof(Grammar::SymbolId));
+  size_t external_map = SkipTable(image, rules, sizeof(Grammar::SymbolId));
+  size_t rule_offsets = SkipTable(image, external_map, sizeof(Grammar::SymbolId));
+  Check(GetWord(image, rules) == grammar.GetRulesSpace() and GetWord(image, rule_offsets) == grammar.GetNumOfRules(),
+        name + ": table layout");
+
+  // Символ правила и смещение правила за границами своих таблиц.
+  std::string bad_symbol = image;
+  Grammar::SymbolId symbol = grammar.GetNumOfTerminals() + grammar.GetNumOfNonterminals() + 1;
+  bad_symbol.replace((rules + 1) * sizeof(Word), sizeof(symbol), reinterpret_cast<const char*>(&symbol), sizeof(symbol));
+  Check(IsRejected(bad_symbol), name + ": rule symbol out of range rejected");
+
+  std::string bad_offset = image;
+  Grammar::RuleId offset = grammar.GetRulesSpace();
+  bad_offset.replace((rule_offsets + 1) * sizeof(Word), sizeof(offset), reinterpret_cast<const char*>(&offset), sizeof(offset));
+  Check(IsRejected(bad_offset), name + ": rule offset out of range rejected");
+}
+
+} // namespace tests
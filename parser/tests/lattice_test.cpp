@@ -0,0 +1,86 @@
+#include <sstream>
+
+#include "test_util.h"
+
+namespace tests {
+
+namespace {
+
+/*!
+ * \brief Лексический анализатор строки из букв a, в которой токенами являются и "a", и "aa", как в примере main.cpp.
+ *
+ * Токены образуют решетку: из каждой позиции выходит токен длины один и, если хватает букв, длины два.
+ */
+class LatticeLexer : public Lexer {
+public:
+  LatticeLexer(size_t length, PublicGrammar::MapId a, PublicGrammar::MapId aa)
+    : length_(length)
+  {
+    for (size_t i = 0; i < length; ++i) {
+      a_.push_back(Token::Ptr(new Token(a, i, "a")));
+      aa_.push_back(Token::Ptr(new Token(aa, i, "aa")));
+    }
+  }
+
+  TokenList GetTokens(Token::Ptr token) {
+    TokenList next;
+    size_t position = token->abs_pos_ + token->length_;
+    if (position + 1 <= length_) {
+      next.push_back(a_[position]);
+    }
+    if (position + 2 <= length_) {
+      next.push_back(aa_[position]);
+    }
+    return next;
+  }
+
+  bool IsEnd(Token::Ptr token) {
+    return token->abs_pos_ + token->length_ == length_;
+  }
+
+private:
+  size_t    length_;  //!< Длина строки.
+  TokenList a_;       //!< Токены "a" по позициям.
+  TokenList aa_;      //!< Токены "aa" по позициям.
+};
+
+} // namespace
+
+/*!
+ * \brief Разбор неоднозначной решетки токенов грамматикой A --> A A | a | aa из примера main.cpp.
+ *
+ * Число полных деревьев вывода строки a^n задано явно: T(1) = 1, T(2) = 2, при n > 2 T(n) -- сумма T(k) T(n - k)
+ * по k от 1 до n - 1.
+ * Режимы алгоритма сравниваются с разбором обычными ситуациями.
+ */
+void TestLattice() {
+  enum { a = 1, aa, A };
+  PublicGrammar public_grammar("lattice");
+  public_grammar.AddTerminal(a, "a");
+  public_grammar.AddTerminal(aa, "aa");
+  public_grammar.AddNonterminal(A, "A");
+  public_grammar.SetStartSymbolId(A);
+  bench::AddRule(&public_grammar, 1, "A --> A A", A, A, A);
+  bench::AddRule(&public_grammar, 2, "A --> a", A, a);
+  bench::AddRule(&public_grammar, 3, "A --> aa", A, aa);
+  Grammar grammar(&public_grammar);
+
+  size_t num_of_trees[] = {0, 1, 2, 4, 12, 40};
+  for (size_t length = 1; length < sizeof(num_of_trees) / sizeof(num_of_trees[0]); ++length) {
+    std::ostringstream name;
+    name << "lattice a^" << length;
+    LatticeLexer lexer(length, a, aa);
+
+    Outcome expected = Parse(grammar, lexer, Options());
+    Check(expected.accepted_, name.str() + ": accepted");
+    Check(expected.num_of_trees_ == num_of_trees[length], name.str() + ": number of trees");
+
+    std::vector<Mode> modes = GetModes();
+    for (size_t i = 1; i < modes.size(); ++i) {
+      std::string mode_name = name.str() + " " + modes[i].name_;
+      CheckOutcome(expected, Parse(grammar, lexer, modes[i].options_), mode_name);
+    }
+  }
+}
+
+} // namespace tests
@@ -0,0 +1,38 @@
+#include "test_util.h"
+
+namespace tests {
+
+namespace {
+
+//! Число ситуаций в замкнутых состояниях после разбора входа.
+size_t CountItems(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types, const Options& options) {
+  bench::TokenListLexer lexer(types);
+  TreeInterpretator interpretator;
+  EarleyParser parser(&grammar, &lexer, &interpretator, options);
+  parser.Parse();
+  return parser.GetStats().num_of_items_;
+}
+
+} // namespace
+
+/*!
+ * \brief Сравнение разбора с ситуациями Лео с разбором обычными ситуациями.
+ *
+ * Кроме совпадения выводов проверяется, что на праворекурсивной грамматике выражений ситуаций строится меньше.
+ */
+void TestLeo() {
+  Mode mode;
+  mode.name_ = "leo";
+  mode.options_.use_leo_items_ = true;
+  CheckMode(mode);
+
+  bench::ExpressionBenchmark expression;
+  PublicGrammar public_grammar(expression.GetName());
+  expression.InitGrammar(&public_grammar);
+  Grammar grammar(&public_grammar);
+  std::vector<PublicGrammar::MapId> types;
+  expression.Generate(100, types);
+  Check(CountItems(grammar, types, mode.options_) < CountItems(grammar, types, Options()), "expression leo: fewer items");
+}
+
+} // namespace tests
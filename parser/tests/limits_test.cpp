@@ -0,0 +1,113 @@
+#include "test_util.h"
+
+namespace tests {
+
+namespace {
+
+//! Ограничение ресурсов и статус, с которым оно останавливает разбор.
+struct Limit {
+  const char*               name_;    //!< Имя ограничения.
+  EarleyParser::ParseStatus status_;  //!< Статус остановки.
+  size_t Options::*         option_;  //!< Поле настроек.
+  size_t                    value_;   //!< Значение, которого не хватает для большого входа.
+};
+
+//! Интерпретатор, запрашивающий отмену разбора на заданном сдвиге терминала.
+struct CancellingInterpretator : public TreeInterpretator {
+  size_t cancel_at_;  //!< Номер сдвига терминала, на котором запрашивается отмена.
+  size_t terminals_;  //!< Число сдвигов терминалов с начала разбора.
+
+  explicit CancellingInterpretator(size_t cancel_at)
+    : cancel_at_(cancel_at)
+    , terminals_(0)
+  {}
+
+  EarleyParser::Context::Ptr HandleTerminal(Token::Ptr token, const Item* item) {
+    if (++terminals_ == cancel_at_) {
+      parser_->Cancel();
+    }
+    return TreeInterpretator::HandleTerminal(token, item);
+  }
+};
+
+/*!
+ * \brief Проверка остановленного разбора и повторного использования анализатора.
+ *
+ * После остановки интерпретатор не должен получить End, а следующий разбор маленького входа тем же
+ * анализатором должен совпасть с разбором новым анализатором.
+ */
+void CheckStopped(const Grammar& grammar, EarleyParser& parser, TreeInterpretator& interpretator, bool accepted,
+                  EarleyParser::ParseStatus status, const Options& options, const std::string& name) {
+  Check(not accepted and parser.GetStatus() == status, name + ": stopped");
+  Check(interpretator.roots_.empty(), name + ": no End calls");
+
+  std::vector<PublicGrammar::MapId> small(3, bench::AmbiguousBenchmark::a);
+  bench::TokenListLexer lexer(small);
+  parser.SetLexer(&lexer);
+  Outcome outcome;
+  outcome.Collect(parser, interpretator, parser.Parse(), true);
+  Check(parser.GetStatus() == EarleyParser::kAccepted, name + ": reused parser accepts");
+  CheckOutcome(Parse(grammar, small, options), outcome, name + ": reused parser");
+}
+
+} // namespace
+
+/*!
+ * \brief Ограничения ресурсов и отмена разбора во всех режимах алгоритма.
+ *
+ * Каждое ограничение должно остановить разбор неоднозначного входа со своим статусом, в том числе в режиме
+ * kLr0Engine, где ситуации хранятся в состояниях автомата.
+ */
+void TestLimits() {
+  bench::AmbiguousBenchmark ambiguous;
+  PublicGrammar public_grammar(ambiguous.GetName());
+  ambiguous.InitGrammar(&public_grammar);
+  Grammar grammar(&public_grammar);
+  std::vector<PublicGrammar::MapId> large;
+  ambiguous.Generate(300, large);
+
+  Limit limits[] = {
+    {"item limit", EarleyParser::kItemLimit, &Options::max_items_, 200},
+    {"state limit", EarleyParser::kStateLimit, &Options::max_states_, 10},
+    {"memory limit", EarleyParser::kMemoryLimit, &Options::max_memory_, 64 * 1024},
+    {"time limit", EarleyParser::kTimeLimit, &Options::time_limit_ms_, 1}
+  };
+
+  std::vector<Mode> modes = GetModes();
+  for (size_t m = 0; m < modes.size(); ++m) {
+    for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); ++l) {
+      std::string name = std::string(limits[l].name_) + " " + modes[m].name_;
+      Options options = modes[m].options_;
+      options.*limits[l].option_ = limits[l].value_;
+
+      bench::TokenListLexer lexer(large);
+      TreeInterpretator interpretator;
+      EarleyParser parser(&grammar, &lexer, &interpretator, options);
+      bool accepted = parser.Parse();
+      CheckStopped(grammar, parser, interpretator, accepted, limits[l].status_, options, name);
+    }
+
+    // Запрос отмены до разбора отменяет следующий разбор.
+    {
+      std::string name = std::string("cancel before parse ") + modes[m].name_;
+      bench::TokenListLexer lexer(large);
+      TreeInterpretator interpretator;
+      EarleyParser parser(&grammar, &lexer, &interpretator, modes[m].options_);
+      parser.Cancel();
+      bool accepted = parser.Parse();
+      CheckStopped(grammar, parser, interpretator, accepted, EarleyParser::kCancelled, modes[m].options_, name);
+    }
+  }
+
+  // Запрос отмены во время разбора, интерпретатор получает сдвиги терминалов только без леса и отложенной семантики.
+  std::vector<PublicGrammar::MapId> input;
+  ambiguous.Generate(100, input);
+  bench::TokenListLexer lexer(input);
+  CancellingInterpretator interpretator(50);
+  EarleyParser parser(&grammar, &lexer, &interpretator);
+  bool accepted = parser.Parse();
+  Check(interpretator.terminals_ >= 50, "cancel during parse: reached cancel point");
+  CheckStopped(grammar, parser, interpretator, accepted, EarleyParser::kCancelled, Options(), "cancel during parse");
+}
+
+} // namespace tests
@@ -0,0 +1,17 @@
+#include "test_util.h"
+
+namespace tests {
+
+/*!
+ * \brief Проверка, что предпросмотр по множествам FIRST не меняет выводов.
+ *
+ * Эталонный разбор выполняется с предпросмотром, поэтому разбор без него должен дать те же выводы.
+ */
+void TestLookahead() {
+  Mode mode;
+  mode.name_ = "no-lookahead";
+  mode.options_.use_lookahead_ = false;
+  CheckMode(mode);
+}
+
+} // namespace tests
@@ -0,0 +1,18 @@
+#include "test_util.h"
+
+namespace tests {
+
+/*!
+ * \brief Сравнение режима LR(0) автомата с разбором обычными ситуациями.
+ *
+ * Выводы в режиме kLr0Engine восстанавливаются после распознавания, поэтому сравнение проверяет и
+ * восстановление, в том числе для грамматики с циклами через пустые выводы.
+ */
+void TestLr0() {
+  Mode mode;
+  mode.name_ = "lr0";
+  mode.options_.engine_ = Options::kLr0Engine;
+  CheckMode(mode);
+}
+
+} // namespace tests
@@ -0,0 +1,97 @@
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include "test_util.h"
+
+namespace tests {
+
+void TestReparse();
+
+void TestPush();
+
+void TestLeo();
+
+void TestLr0();
+
+void TestLookahead();
+
+void TestForest();
+
+void TestDeferred();
+
+void TestLattice();
+
+void TestWeights();
+
+void TestImage();
+
+void TestCodegen();
+
+void TestBatch();
+
+void TestLimits();
+
+void TestStats();
+
+void TestOptimizer();
+
+} // namespace tests
+
+namespace {
+
+//! Набор проверок одной возможности анализатора.
+struct Suite {
+  const char* name_;  //!< Имя набора, по которому его можно запустить отдельно.
+  void (*run_)();     //!< Функция, выполняющая проверки.
+};
+
+} // namespace
+
+/*!
+ * \brief Тесты синтаксического анализатора.
+ *
+ * Использование: parser_tests [<набор>]
+ *
+ * Без аргументов выполняются все наборы проверок, иначе -- только названный. Возвращает ненулевой код, если
+ * хотя бы одна проверка не прошла.
+ */
+int main(int argc, char* argv[]) {
+  Suite suites[] = {
+    {"reparse", tests::TestReparse},
+    {"push", tests::TestPush},
+    {"leo", tests::TestLeo},
+    {"lr0", tests::TestLr0},
+    {"lookahead", tests::TestLookahead},
+    {"forest", tests::TestForest},
+    {"deferred", tests::TestDeferred},
+    {"lattice", tests::TestLattice},
+    {"weights", tests::TestWeights},
+    {"image", tests::TestImage},
+    {"codegen", tests::TestCodegen},
+    {"batch", tests::TestBatch},
+    {"limits", tests::TestLimits},
+    {"stats", tests::TestStats},
+    {"optimizer", tests::TestOptimizer}
+  };
+
+  size_t num_of_suites = 0;
+  try {
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); ++i) {
+      if (argc < 2 or std::strcmp(argv[1], suites[i].name_) == 0) {
+        suites[i].run_();
+        ++num_of_suites;
+      }
+    }
+  } catch (std::exception& err) {
+    std::cout << err.what() << std::endl;
+    return 1;
+  }
+
+  if (num_of_suites == 0) {
+    std::cout << "Unknown test suite " << argv[1] << "\n";
+    return 1;
+  }
+  std::cout << tests::GetNumOfChecks() - tests::GetNumOfFailures() << " of " << tests::GetNumOfChecks() << " checks passed\n";
+  return tests::GetNumOfFailures() ? 1 : 0;
+}
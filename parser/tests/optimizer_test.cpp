@@ -0,0 +1,262 @@
+#include <parser/grammar_optimizer.h>
+
+#include "test_util.h"
+
+namespace tests {
+
+using parser::GrammarOptimizer;
+
+namespace {
+
+enum { a = 1, b, c, d, S, A, U, R };
+
+//! Набор преобразований, проверяемый отдельно.
+struct Transform {
+  const char*               name_;    //!< Имя набора.
+  GrammarOptimizer::Options options_; //!< Настройки оптимизатора.
+};
+
+//! Наборы преобразований: каждое по отдельности, настройки по умолчанию и все вместе.
+std::vector<Transform> GetTransforms() {
+  std::vector<Transform> transforms;
+  GrammarOptimizer::Options none;
+  none.remove_useless_ = false;
+  none.collapse_unit_rules_ = false;
+
+  Transform transform = {"remove useless", none};
+  transform.options_.remove_useless_ = true;
+  transforms.push_back(transform);
+
+  transform.name_ = "collapse unit rules";
+  transform.options_ = none;
+  transform.options_.collapse_unit_rules_ = true;
+  transforms.push_back(transform);
+
+  transform.name_ = "collapse shared unit rules";
+  transform.options_.collapse_shared_unit_rules_ = true;
+  transforms.push_back(transform);
+
+  transform.name_ = "left factor";
+  transform.options_ = none;
+  transform.options_.left_factor_ = true;
+  transform.options_.min_prefix_length_ = 1;
+  transforms.push_back(transform);
+
+  transform.name_ = "default";
+  transform.options_ = GrammarOptimizer::Options();
+  transforms.push_back(transform);
+
+  transform.name_ = "all";
+  transform.options_.collapse_shared_unit_rules_ = true;
+  transform.options_.left_factor_ = true;
+  transforms.push_back(transform);
+  return transforms;
+}
+
+//! Результат разбора: только принят ли вход.
+bool IsAccepted(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types) {
+  bench::TokenListLexer lexer(types);
+  TreeInterpretator interpretator;
+  EarleyParser parser(&grammar, &lexer, &interpretator);
+  return parser.Parse();
+}
+
+//! Входы, полученные из данного заменой, вставкой или удалением случайного терминала, и префиксы входа.
+std::vector<std::vector<PublicGrammar::MapId> > Mutate(const PublicGrammar& grammar, const std::vector<PublicGrammar::MapId>& types) {
+  std::vector<PublicGrammar::MapId> terminals;
+  const PublicGrammar::SymbolTable& symbols = grammar.GetSymbolTable();
+  for (PublicGrammar::SymbolTable::const_iterator sym_it = symbols.begin(); sym_it != symbols.end(); ++sym_it) {
+    if (not sym_it->second.nonterminal_) {
+      terminals.push_back(sym_it->first);
+    }
+  }
+
+  std::vector<std::vector<PublicGrammar::MapId> > inputs(1, types);
+  bench::Random random(11);
+  for (size_t i = 0; i < 30 and not types.empty(); ++i) {
+    std::vector<PublicGrammar::MapId> mutated(types);
+    size_t pos = random.Next(unsigned(mutated.size()));
+    PublicGrammar::MapId terminal = terminals[random.Next(unsigned(terminals.size()))];
+    switch (i % 3) {
+      case 0: mutated[pos] = terminal; break;
+      case 1: mutated.insert(mutated.begin() + pos, terminal); break;
+      default: mutated.erase(mutated.begin() + pos); break;
+    }
+    inputs.push_back(mutated);
+  }
+  for (size_t size = 0; size < types.size(); size += 1 + types.size() / 8) {
+    inputs.push_back(std::vector<PublicGrammar::MapId>(types.begin(), types.begin() + size));
+  }
+  return inputs;
+}
+
+/*!
+ * \brief Грамматика, к которой применимы все преобразования.
+ *
+ *  S --> A (вес -0.5) | U b, A --> a b c (вес -1) | a b d (вес -2), U --> U a, R --> a.
+ *
+ * Нетерминал U непродуктивен, R недостижим, цепное правило S --> A -- единственное вхождение A,
+ * а после его устранения правила S имеют общий префикс a b.
+ */
+void InitGrammar(PublicGrammar& grammar) {
+  grammar.AddTerminal(a, "a");
+  grammar.AddTerminal(b, "b");
+  grammar.AddTerminal(c, "c");
+  grammar.AddTerminal(d, "d");
+  grammar.AddNonterminal(S, "S");
+  grammar.AddNonterminal(A, "A");
+  grammar.AddNonterminal(U, "U");
+  grammar.AddNonterminal(R, "R");
+  grammar.SetStartSymbolId(S);
+  bench::AddRule(&grammar, 1, "S --> A", S, A);
+  bench::AddRule(&grammar, 2, "S --> U b", S, U, b);
+  bench::AddRule(&grammar, 3, "A --> a b c", A, a, b, c);
+  bench::AddRule(&grammar, 4, "A --> a b d", A, a, b, d);
+  bench::AddRule(&grammar, 5, "U --> U a", U, U, a);
+  bench::AddRule(&grammar, 6, "R --> a", R, a);
+  grammar.SetRuleWeight(1, -0.5);
+  grammar.SetRuleWeight(3, -1.0);
+  grammar.SetRuleWeight(4, -2.0);
+}
+
+//! Правило результата с заданной левой и правой частями или NULL.
+const PublicGrammar::Rule* FindRule(const PublicGrammar& grammar, PublicGrammar::MapId lhs, const std::vector<PublicGrammar::MapId>& rhs) {
+  const PublicGrammar::RuleTable& rules = grammar.GetRuleTable();
+  for (PublicGrammar::RuleTable::const_iterator rule_it = rules.begin(); rule_it != rules.end(); ++rule_it) {
+    if (PublicGrammar::MapId(rule_it->second.lhs_symbol_) == lhs and std::vector<PublicGrammar::MapId>(rule_it->second.rhs_list_.begin(), rule_it->second.rhs_list_.end()) == rhs) {
+      return &rule_it->second;
+    }
+  }
+  return NULL;
+}
+
+//! Правая часть из символов, нулевые идентификаторы пропускаются.
+std::vector<PublicGrammar::MapId> Rhs(PublicGrammar::MapId rhs0, PublicGrammar::MapId rhs1 = 0, PublicGrammar::MapId rhs2 = 0) {
+  PublicGrammar::MapId symbols[] = {rhs0, rhs1, rhs2};
+  std::vector<PublicGrammar::MapId> rhs;
+  for (size_t i = 0; i < 3 and symbols[i]; ++i) {
+    rhs.push_back(symbols[i]);
+  }
+  return rhs;
+}
+
+//! Проверка исходного правила и веса правила результата.
+void CheckRule(const PublicGrammar& grammar, PublicGrammar::MapId lhs, const std::vector<PublicGrammar::MapId>& rhs,
+               PublicGrammar::MapId source, double weight, const std::string& name) {
+  const PublicGrammar::Rule* rule = FindRule(grammar, lhs, rhs);
+  Check(rule and rule->source_rule_ == source and rule->weight_ == weight, name);
+}
+
+/*!
+ * \brief Проверка, что Grammar::GetSourceRule возвращает исходные правила, записанные оптимизатором.
+ *
+ * Вспомогательные правила операторов EBNF, которых нет в таблице правил, исходного правила не имеют.
+ */
+void CheckGrammarSourceRules(const PublicGrammar& public_grammar, const Grammar& grammar, const std::string& name) {
+  const PublicGrammar::RuleTable& rules = public_grammar.GetRuleTable();
+  size_t num_of_mismatches = 0;
+  for (Grammar::RuleId id = 0; id < grammar.GetNumOfRules(); ++id) {
+    PublicGrammar::RuleTable::const_iterator rule_it = rules.find(grammar.GetInternalIdByRule(id));
+    PublicGrammar::MapId source = rule_it == rules.end() ? PublicGrammar::kUnknownMapId : rule_it->second.source_rule_;
+    num_of_mismatches += grammar.GetSourceRule(id) != Grammar::RuleId(source);
+  }
+  Check(num_of_mismatches == 0, name + ": Grammar::GetSourceRule");
+}
+
+} // namespace
+
+/*!
+ * \brief Преобразования GrammarOptimizer.
+ *
+ * Каждое преобразование отдельно и все вместе должны сохранять язык грамматик всех бенчмарков: входы бенчмарков,
+ * их префиксы и случайные искажения принимаются или отвергаются так же, как исходной грамматикой. На грамматике,
+ * к которой применимы все преобразования, после каждого из них проверяются исходные правила и веса правил.
+ */
+void TestOptimizer() {
+  std::vector<Transform> transforms = GetTransforms();
+
+  const std::vector<BenchmarkInput>& inputs = GetBenchmarkInputs();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::vector<std::vector<PublicGrammar::MapId> > mutated = Mutate(*inputs[i].public_grammar_, inputs[i].types_);
+    std::vector<bool> expected(mutated.size());
+    for (size_t m = 0; m < mutated.size(); ++m) {
+      expected[m] = IsAccepted(*inputs[i].grammar_, mutated[m]);
+    }
+    Check(expected[0], inputs[i].name_ + " optimizer: benchmark input accepted");
+
+    for (size_t t = 0; t < transforms.size(); ++t) {
+      std::string name = inputs[i].name_ + " optimizer " + transforms[t].name_;
+      GrammarOptimizer optimizer(transforms[t].options_);
+      PublicGrammar optimized(inputs[i].name_.c_str());
+      optimizer.Optimize(*inputs[i].public_grammar_, &optimized);
+      Grammar grammar(&optimized);
+
+      size_t num_of_mismatches = 0;
+      for (size_t m = 0; m < mutated.size(); ++m) {
+        num_of_mismatches += IsAccepted(grammar, mutated[m]) != expected[m];
+      }
+      Check(num_of_mismatches == 0, name + ": same language");
+      CheckGrammarSourceRules(optimized, grammar, name);
+    }
+  }
+
+  PublicGrammar source("optimizer");
+  InitGrammar(source);
+  for (size_t t = 0; t < transforms.size(); ++t) {
+    const GrammarOptimizer::Options& options = transforms[t].options_;
+    std::string name = std::string("optimizer mapping ") + transforms[t].name_;
+    GrammarOptimizer optimizer(options);
+    PublicGrammar optimized("optimizer");
+    optimizer.Optimize(source, &optimized);
+    const GrammarOptimizer::Stats& stats = optimizer.GetStats();
+
+    // Удаление бесполезных символов: U, R и их правила, правила, оставшиеся без изменений, отображаются в себя.
+    bool removed = options.remove_useless_;
+    Check(removed == not optimized.GetSymbolTable().count(U) and removed == not optimized.GetSymbolTable().count(R)
+          and removed == not FindRule(optimized, S, Rhs(U, b)) and removed == not FindRule(optimized, R, Rhs(a)),
+          name + ": useless symbols");
+    if (not removed) {
+      CheckRule(optimized, S, Rhs(U, b), 2, 0.0, name + ": S --> U b");
+      CheckRule(optimized, U, Rhs(U, a), 5, 0.0, name + ": U --> U a");
+    }
+
+    // Устранение S --> A: правила A копируются в S с весом цепочки, после удаления бесполезных A исчезает.
+    bool collapsed = options.collapse_unit_rules_;
+    bool factored = options.left_factor_;
+    Check(collapsed == not FindRule(optimized, S, Rhs(A)), name + ": unit rule");
+    Check(stats.unit_rules_ == size_t(collapsed) and stats.collapsed_rules_ == 2 * size_t(collapsed), name + ": unit rule stats");
+    if (not collapsed) {
+      CheckRule(optimized, S, Rhs(A), 1, -0.5, name + ": S --> A");
+    }
+    if (collapsed and removed) {
+      Check(not optimized.GetSymbolTable().count(A), name + ": collapsed symbol removed");
+    } else if (not factored) {
+      CheckRule(optimized, A, Rhs(a, b, c), 3, -1.0, name + ": A --> a b c");
+      CheckRule(optimized, A, Rhs(a, b, d), 4, -2.0, name + ": A --> a b d");
+    }
+    if (collapsed and not factored) {
+      CheckRule(optimized, S, Rhs(a, b, c), 3, -1.5, name + ": S --> a b c");
+      CheckRule(optimized, S, Rhs(a, b, d), 4, -2.5, name + ": S --> a b d");
+    }
+
+    // Вынесение префикса a b: S --> a b S' без исходного правила, правила S' отображаются в правила A.
+    if (factored) {
+      PublicGrammar::MapId lhs = collapsed ? S : A;
+      PublicGrammar::MapId helper = source.GetMaxSymbolId() + 1;
+      Check(optimized.GetSymbolTable().count(helper) and optimized.GetSymbolTable().find(helper)->second.nonterminal_,
+            name + ": helper nonterminal");
+      CheckRule(optimized, lhs, Rhs(a, b, helper), PublicGrammar::kUnknownMapId, 0.0, name + ": prefix rule");
+      CheckRule(optimized, helper, Rhs(c), 3, collapsed ? -1.5 : -1.0, name + ": helper rule c");
+      CheckRule(optimized, helper, Rhs(d), 4, collapsed ? -2.5 : -2.0, name + ": helper rule d");
+    }
+    Check(stats.factored_prefixes_ == size_t(factored), name + ": factored stats");
+
+    Grammar grammar(&optimized);
+    CheckGrammarSourceRules(optimized, grammar, name);
+  }
+
+  // По умолчанию префиксы не выносятся: интерпретатор получает вызовы только для правил пользователя.
+  Check(not GrammarOptimizer::Options().left_factor_, "optimizer: left factoring off by default");
+}
+
+} // namespace tests
@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "test_util.h"
+
+namespace tests {
+
+namespace {
+
+/*!
+ * \brief Проверка GetExpectedTerminals на каждом префиксе входа.
+ *
+ * Следующий токен входа должен быть среди ожидаемых терминалов, а терминал, которого среди них нет, должен
+ * отбрасываться PushToken без потери уже переданного префикса.
+ */
+void CheckExpectedTerminals(const BenchmarkInput& input) {
+  std::vector<PublicGrammar::MapId> terminals;
+  const PublicGrammar::SymbolTable& symbols = input.public_grammar_->GetSymbolTable();
+  for (PublicGrammar::SymbolTable::const_iterator it = symbols.begin(); it != symbols.end(); ++it) {
+    if (not it->second.nonterminal_) {
+      terminals.push_back(it->first);
+    }
+  }
+
+  std::vector<Token::Ptr> tokens = CreateTokens(input.types_);
+  TreeInterpretator interpretator;
+  EarleyParser parser(input.grammar_.get(), NULL, &interpretator);
+  bool viable = parser.StartPush();
+  for (size_t i = 0; i < tokens.size() and viable; ++i) {
+    std::vector<Grammar::SymbolId> expected;
+    parser.GetExpectedTerminals(expected);
+    viable = Check(std::find(expected.begin(), expected.end(), tokens[i]->type_) != expected.end(), input.name_ + " push: expected terminals");
+
+    for (size_t t = 0; t < terminals.size(); ++t) {
+      if (std::find(expected.begin(), expected.end(), terminals[t]) == expected.end()) {
+        Check(not parser.PushToken(Token::Ptr(new Token(terminals[t], i, "t"))), input.name_ + " push: unexpected terminal");
+        break;
+      }
+    }
+    viable = viable and Check(parser.PushToken(tokens[i]), input.name_ + " push: token after rejected one");
+  }
+  Check(viable and parser.FinishPush(), input.name_ + " push: accepted");
+}
+
+} // namespace
+
+/*!
+ * \brief Сравнение разбора потока токенов с Parse.
+ *
+ * Без лексического анализатора предпросмотр не выполняется, поэтому эталон строится без него. В режиме по
+ * умолчанию состояния освобождаются, и сравниваются только результат, корни и деревья.
+ */
+void TestPush() {
+  const std::vector<BenchmarkInput>& inputs = GetBenchmarkInputs();
+  std::vector<Mode> modes = GetModes();
+  for (size_t n = 0; n < inputs.size(); ++n) {
+    for (size_t i = 0; i < modes.size(); ++i) {
+      std::string name = inputs[n].name_ + " push " + modes[i].name_;
+      Options options = modes[i].options_;
+      options.use_lookahead_ = false;
+      Outcome expected = Parse(*inputs[n].grammar_, inputs[n].types_, options);
+      Outcome actual = Push(*inputs[n].grammar_, inputs[n].types_, options);
+      Check(expected.accepted_ == actual.accepted_ and expected.status_ == actual.status_, name + ": result");
+      Check(expected.roots_ == actual.roots_, name + ": roots");
+      Check(expected.trees_ == actual.trees_, name + ": trees");
+      if (not actual.derivations_.empty()) {
+        CheckDerivations(expected.derivations_, actual.derivations_, name + ": derivations");
+      }
+    }
+    CheckExpectedTerminals(inputs[n]);
+  }
+}
+
+} // namespace tests
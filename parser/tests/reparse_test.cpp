@@ -0,0 +1,37 @@
+#include <algorithm>
+#include <sstream>
+
+#include "test_util.h"
+
+namespace tests {
+
+/*!
+ * \brief Сравнение Reparse с разбором измененного входа заново.
+ *
+ * Первым разбирается вход, у которого все токены начиная с места правки переставлены в обратном порядке.
+ * Правка делается в нескольких местах каждого входа, результат сравнивается во всех режимах алгоритма.
+ */
+void TestReparse() {
+  const std::vector<BenchmarkInput>& inputs = GetBenchmarkInputs();
+  std::vector<Mode> modes = GetModes();
+  for (size_t n = 0; n < inputs.size(); ++n) {
+    const Grammar& grammar = *inputs[n].grammar_;
+    const std::vector<PublicGrammar::MapId>& types = inputs[n].types_;
+
+    for (size_t position = 1; position < types.size(); position += std::max<size_t>(1, types.size() / 3)) {
+      std::vector<PublicGrammar::MapId> before(types);
+      std::reverse(before.begin() + position, before.end());
+      std::ostringstream edit;
+      edit << inputs[n].name_ << " reparse@" << position << " ";
+
+      for (size_t i = 0; i < modes.size(); ++i) {
+        Outcome expected = Parse(grammar, types, modes[i].options_);
+        Outcome actual = Reparse(grammar, before, types, position, modes[i].options_);
+        CheckOutcome(expected, actual, edit.str() + modes[i].name_);
+        Check(expected.trees_ == actual.trees_, edit.str() + modes[i].name_ + ": trees");
+      }
+    }
+  }
+}
+
+} // namespace tests
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <numeric>
+
+#include "test_util.h"
+
+namespace tests {
+
+namespace {
+
+//! Разбор входа новым анализатором, статистика разбора и число вызовов End.
+EarleyParser::Stats ParseStats(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types, const Options& options,
+                               size_t* num_of_roots = 0) {
+  bench::TokenListLexer lexer(types);
+  TreeInterpretator interpretator;
+  EarleyParser parser(&grammar, &lexer, &interpretator, options);
+  parser.Parse();
+  if (num_of_roots) {
+    *num_of_roots = interpretator.roots_.size();
+  }
+  return parser.GetStats();
+}
+
+//! Совпадение счетчиков двух разборов без учета времени.
+bool IsSameCounters(const EarleyParser::Stats& lhs, const EarleyParser::Stats& rhs) {
+  return lhs.num_of_parses_ == rhs.num_of_parses_ and lhs.num_of_states_ == rhs.num_of_states_
+         and lhs.num_of_items_ == rhs.num_of_items_ and lhs.max_state_items_ == rhs.max_state_items_
+         and lhs.state_items_ == rhs.state_items_ and lhs.duplicate_items_ == rhs.duplicate_items_
+         and lhs.completer_calls_ == rhs.completer_calls_ and lhs.predictor_calls_ == rhs.predictor_calls_
+         and lhs.scanner_calls_ == rhs.scanner_calls_ and lhs.nullable_items_ == rhs.nullable_items_
+         and lhs.terminal_calls_ == rhs.terminal_calls_ and lhs.nonterminal_calls_ == rhs.nonterminal_calls_
+         and lhs.end_calls_ == rhs.end_calls_;
+}
+
+//! Счетчики, согласованные между собой в любом режиме.
+void CheckConsistent(const EarleyParser::Stats& stats, size_t input_size, size_t num_of_roots, const std::string& name) {
+  Check(stats.num_of_parses_ == 1, name + ": one parse");
+  Check(stats.num_of_states_ == input_size + 1, name + ": state per token");
+  Check(stats.state_items_.size() == stats.num_of_states_, name + ": items of every state");
+  Check(std::accumulate(stats.state_items_.begin(), stats.state_items_.end(), size_t(0)) == stats.num_of_items_,
+        name + ": total items");
+  Check(not stats.state_items_.empty()
+        and *std::max_element(stats.state_items_.begin(), stats.state_items_.end()) == stats.max_state_items_,
+        name + ": largest state");
+  Check(stats.scanner_calls_ == input_size, name + ": scanner per token");
+  Check(stats.end_calls_ == num_of_roots and num_of_roots > 0, name + ": end calls");
+  Check(stats.completer_calls_ > 0 and stats.terminal_calls_ > 0 and stats.nonterminal_calls_ > 0, name + ": handlers");
+  Check(stats.item_blocks_ > 0, name + ": item blocks");
+  Check(stats.recognition_seconds_ >= 0 and stats.derivation_seconds_ >= 0 and stats.end_seconds_ >= 0, name + ": timings");
+}
+
+} // namespace
+
+/*!
+ * \brief Счетчики статистики разбора.
+ *
+ * На входах всех бенчмарков во всех режимах проверяется согласованность счетчиков с числом токенов, корней
+ * и ситуаций в состояниях, сброс статистики перед каждым разбором и сложение статистик методом Add.
+ */
+void TestStats() {
+  const std::vector<BenchmarkInput>& inputs = GetBenchmarkInputs();
+  std::vector<Mode> modes = GetModes();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    for (size_t m = 0; m < modes.size(); ++m) {
+      std::string name = inputs[i].name_ + " stats " + modes[m].name_;
+      size_t num_of_roots = 0;
+      EarleyParser::Stats stats = ParseStats(*inputs[i].grammar_, inputs[i].types_, modes[m].options_, &num_of_roots);
+      CheckConsistent(stats, inputs[i].types_.size(), num_of_roots, name);
+      if (modes[m].options_.engine_ == Options::kLr0Engine) {
+        Check(stats.predictor_calls_ == 0, name + ": predictions in automaton");
+      } else {
+        Check(stats.predictor_calls_ > 0, name + ": predictor calls");
+      }
+
+      // Второй разбор тем же анализатором начинает статистику заново.
+      bench::TokenListLexer lexer(inputs[i].types_);
+      TreeInterpretator interpretator;
+      EarleyParser parser(inputs[i].grammar_.get(), &lexer, &interpretator, modes[m].options_);
+      parser.Parse();
+      EarleyParser::Stats first = parser.GetStats();
+      bench::TokenListLexer second_lexer(inputs[i].types_);
+      parser.SetLexer(&second_lexer);
+      parser.Parse();
+      Check(IsSameCounters(first, parser.GetStats()) and IsSameCounters(stats, first), name + ": reset per parse");
+    }
+  }
+
+  // Неоднозначная грамматика дает повторные ситуации, грамматика с пустыми правилами -- сдвиги через пустые выводы.
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    EarleyParser::Stats stats = ParseStats(*inputs[i].grammar_, inputs[i].types_, Options());
+    if (inputs[i].name_ == "ambiguous") {
+      Check(stats.duplicate_items_ > 0, "ambiguous stats: duplicate items");
+    } else if (inputs[i].name_ == "epsilon") {
+      Check(stats.nullable_items_ > 0, "epsilon stats: nullable items");
+    }
+  }
+
+  // Add складывает счетчики, берет наибольшие значения и не дополняет список state_items_.
+  const BenchmarkInput& input = inputs.front();
+  EarleyParser::Stats small = ParseStats(*input.grammar_, std::vector<PublicGrammar::MapId>(input.types_.begin(), input.types_.begin() + 1), Options());
+  EarleyParser::Stats large = ParseStats(*input.grammar_, input.types_, Options());
+  EarleyParser::Stats sum = small;
+  sum.Add(large);
+  Check(sum.num_of_parses_ == 2 and sum.num_of_states_ == small.num_of_states_ + large.num_of_states_
+        and sum.num_of_items_ == small.num_of_items_ + large.num_of_items_
+        and sum.scanner_calls_ == small.scanner_calls_ + large.scanner_calls_
+        and sum.completer_calls_ == small.completer_calls_ + large.completer_calls_
+        and sum.end_calls_ == small.end_calls_ + large.end_calls_, "stats add: sums");
+  Check(sum.max_state_items_ == std::max(small.max_state_items_, large.max_state_items_)
+        and sum.item_blocks_ == std::max(small.item_blocks_, large.item_blocks_), "stats add: maxima");
+  Check(sum.state_items_ == small.state_items_, "stats add: state items kept");
+
+  EarleyParser::Stats cleared = sum;
+  cleared.Clear();
+  Check(IsSameCounters(cleared, EarleyParser::Stats()), "stats clear");
+
+  // Остановленный разбор тоже учитывается как один запуск.
+  Options limited;
+  limited.max_items_ = 10;
+  EarleyParser::Stats stopped = ParseStats(*input.grammar_, input.types_, limited);
+  Check(stopped.num_of_parses_ == 1 and stopped.num_of_items_ <= large.num_of_items_, "stopped stats: one parse");
+}
+
+} // namespace tests
@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+#include "test_util.h"
+
+using parser::Sppf;
+using bench::TokenListLexer;
+
+namespace tests {
+
+namespace {
+
+//! Число проверок и число неудачных проверок.
+size_t num_of_checks = 0;
+size_t num_of_failures = 0;
+
+//! Позиция во входном потоке для номера состояния.
+size_t GetPosition(EarleyParser& parser, size_t state_id) {
+  return parser.state_disp_.GetState(state_id)->position_;
+}
+
+//! Текст узла леса, соответствующего ситуации, как в EarleyParser::GetForestNode.
+std::string GetNodeKey(EarleyParser& parser, const Item* item) {
+  std::ostringstream out;
+  if (parser.grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_) == Grammar::kBadSymbolId) {
+    out << "S" << parser.grammar_->GetLhsOfRule(item->rule_id_);
+  } else {
+    out << "I" << item->rule_id_ << "." << item->rhs_pos_;
+  }
+  out << "[" << GetPosition(parser, item->origin_) << "," << GetPosition(parser, item->state_number_) << "]";
+  return out.str();
+}
+
+//! Текст упакованного узла.
+std::string GetPackedKey(const std::string& node, Grammar::RuleId rule_id, size_t split, const std::string& left, const std::string& right) {
+  std::ostringstream out;
+  out << node << " = " << rule_id << "/" << split << " " << left << " " << right;
+  return out.str();
+}
+
+//! Текст узла леса.
+std::string GetForestNodeKey(EarleyParser& parser, Sppf::NodeId node_id) {
+  if (node_id == Sppf::kNoNode) {
+    return "-";
+  }
+  const Sppf::Node& node = parser.GetForest().GetNode(node_id);
+  std::ostringstream out;
+  switch (node.kind_) {
+  case Sppf::kSymbolNode:       out << "S" << node.symbol_id_; break;
+  case Sppf::kIntermediateNode: out << "I" << node.rule_id_ << "." << node.rhs_pos_; break;
+  case Sppf::kTerminalNode:     out << "T" << node.symbol_id_; break;
+  }
+  out << "[" << GetPosition(parser, node.start_) << "," << GetPosition(parser, node.end_) << "]";
+  return out.str();
+}
+
+//! Последовательность внешних идентификаторов терминалов, возвращаемая лексическим анализатором без ветвлений.
+std::vector<PublicGrammar::MapId> GetTypes(Lexer& lexer) {
+  std::vector<PublicGrammar::MapId> types;
+  Token::Ptr token(new Token());
+  for (;;) {
+    Lexer::TokenList next = lexer.GetTokens(token);
+    if (next.empty()) {
+      break;
+    }
+    token = next.front();
+    types.push_back(token->type_);
+    if (lexer.IsEnd(token)) {
+      break;
+    }
+  }
+  return types;
+}
+
+//! Число деревьев вывода ситуации, counts -- уже посчитанные ситуации.
+size_t CountTrees(const Item* item, boost::unordered_map<const Item*, size_t>& counts) {
+  if (not counts.insert(std::make_pair(item, 0)).second) {
+    return counts[item];
+  }
+  if (item->rhs_pos_ == 0) {
+    return counts[item] = 1;
+  }
+
+  size_t right = 0;
+  for (Item::Rptrs::const_iterator it = item->rptrs_.begin(); it != item->rptrs_.end(); ++it) {
+    right += it->item_ and not it->transitive_ ? CountTrees(it->item_, counts) : 1;
+  }
+  return counts[item] = (item->rhs_pos_ > 1 ? CountTrees(item->lptr_, counts) : 1) * right;
+}
+
+} // namespace
+
+bool Check(bool condition, const std::string& name) {
+  ++num_of_checks;
+  if (not condition) {
+    ++num_of_failures;
+    std::cout << "FAILED: " << name << "\n";
+  }
+  return condition;
+}
+
+bool CheckDerivations(const Derivations& expected, const Derivations& actual, const std::string& name) {
+  if (Check(expected == actual, name)) {
+    return true;
+  }
+  std::vector<std::string> missing, extra;
+  std::set_difference(expected.begin(), expected.end(), actual.begin(), actual.end(), std::back_inserter(missing));
+  std::set_difference(actual.begin(), actual.end(), expected.begin(), expected.end(), std::back_inserter(extra));
+  std::cout << "  " << expected.size() << " expected, " << actual.size() << " actual derivations\n";
+  if (not missing.empty()) {
+    std::cout << "  missing: " << missing.front() << "\n";
+  }
+  if (not extra.empty()) {
+    std::cout << "  extra:   " << extra.front() << "\n";
+  }
+  return false;
+}
+
+size_t GetNumOfChecks() {
+  return num_of_checks;
+}
+
+size_t GetNumOfFailures() {
+  return num_of_failures;
+}
+
+void TreeInterpretator::Start(EarleyParser* parser) {
+  parser_ = parser;
+  roots_.clear();
+  trees_.clear();
+}
+
+void TreeInterpretator::End(const Item* item) {
+  roots_.push_back(item);
+  trees_.insert(GetTree(item));
+}
+
+EarleyParser::Context::Ptr TreeInterpretator::HandleTerminal(Token::Ptr token, const Item*) {
+  return EarleyParser::Context::Ptr(new TreeContext(parser_->grammar_->GetSymbolName(parser_->grammar_->GetInternalSymbolByExtrernalId(token->type_))));
+}
+
+EarleyParser::Context::Ptr TreeInterpretator::HandleNonTerminal(const Item* rule_item, const Item*) {
+  return EarleyParser::Context::Ptr(new TreeContext(GetTree(rule_item)));
+}
+
+std::string TreeInterpretator::GetTree(const Item* item) const {
+  std::vector<EarleyParser::Context::Ptr> contexts;
+  parser_->GetChildContexts(item, contexts);
+  std::string text = std::string("(") + parser_->grammar_->GetSymbolName(parser_->grammar_->GetLhsOfRule(item->rule_id_));
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    // В режиме леса разбора интерпретатор не вызывается, и у сдвигов общий контекст.
+    const TreeContext* context = dynamic_cast<const TreeContext*>(contexts[i].get());
+    text += " " + (context ? context->text_ : std::string("?"));
+  }
+  return text + ")";
+}
+
+void CollectItemDerivations(EarleyParser& parser, const std::vector<const Item*>& roots, Derivations& derivations) {
+  std::vector<const Item*> stack(roots.begin(), roots.end());
+  boost::unordered_set<const Item*> visited;
+  for (size_t i = 0; i < roots.size(); ++i) {
+    derivations.insert("root " + GetNodeKey(parser, roots[i]));
+  }
+
+  while (not stack.empty()) {
+    const Item* item = stack.back();
+    stack.pop_back();
+    if (not visited.insert(item).second) {
+      continue;
+    }
+
+    std::string node = GetNodeKey(parser, item);
+    if (item->rhs_pos_ == 0) {
+      derivations.insert(GetPackedKey(node, item->rule_id_, GetPosition(parser, item->origin_), "-", "-"));
+      continue;
+    }
+
+    size_t split = GetPosition(parser, item->lptr_->state_number_);
+    std::string left = "-";
+    if (item->rhs_pos_ > 1) {
+      left = GetNodeKey(parser, item->lptr_);
+      stack.push_back(item->lptr_);
+    }
+
+    for (Item::Rptrs::const_iterator it = item->rptrs_.begin(); it != item->rptrs_.end(); ++it) {
+      std::ostringstream right;
+      if (it->transitive_) {
+        right << "transitive";
+      } else if (it->item_) {
+        right << GetNodeKey(parser, it->item_);
+        stack.push_back(it->item_);
+      } else {
+        right << "T" << parser.grammar_->GetRhsOfRule(item->rule_id_, item->rhs_pos_ - 1)
+              << "[" << split << "," << GetPosition(parser, item->state_number_) << "]";
+      }
+      derivations.insert(GetPackedKey(node, item->rule_id_, split, left, right.str()));
+    }
+  }
+}
+
+void CollectForestDerivations(EarleyParser& parser, Derivations& derivations) {
+  const Sppf& forest = parser.GetForest();
+  std::vector<Sppf::NodeId> stack(forest.GetRoots().begin(), forest.GetRoots().end());
+  std::vector<bool> visited(forest.GetNumOfNodes(), false);
+  for (size_t i = 0; i < stack.size(); ++i) {
+    derivations.insert("root " + GetForestNodeKey(parser, stack[i]));
+  }
+
+  while (not stack.empty()) {
+    Sppf::NodeId node_id = stack.back();
+    stack.pop_back();
+    if (node_id == Sppf::kNoNode or visited[node_id]) {
+      continue;
+    }
+    visited[node_id] = true;
+
+    const Sppf::Node& node = forest.GetNode(node_id);
+    for (size_t i = 0; i < node.packed_.size(); ++i) {
+      const Sppf::PackedNode& packed = node.packed_[i];
+      derivations.insert(GetPackedKey(GetForestNodeKey(parser, node_id), packed.rule_id_, GetPosition(parser, packed.split_),
+                                      GetForestNodeKey(parser, packed.left_), GetForestNodeKey(parser, packed.right_)));
+      stack.push_back(packed.left_);
+      stack.push_back(packed.right_);
+    }
+  }
+}
+
+size_t CountTrees(const std::vector<const Item*>& roots) {
+  boost::unordered_map<const Item*, size_t> counts;
+  std::set<const Item*> unique_roots(roots.begin(), roots.end());
+  size_t num_of_trees = 0;
+  for (std::set<const Item*>::const_iterator it = unique_roots.begin(); it != unique_roots.end(); ++it) {
+    num_of_trees += CountTrees(*it, counts);
+  }
+  return num_of_trees;
+}
+
+void Outcome::Collect(EarleyParser& parser, const TreeInterpretator& interpretator, bool accepted, bool collect_derivations) {
+  accepted_ = accepted;
+  status_ = parser.GetStatus();
+  num_of_trees_ = 0;
+  trees_ = interpretator.trees_;
+  for (size_t i = 0; i < interpretator.roots_.size(); ++i) {
+    std::ostringstream root;
+    root << interpretator.roots_[i]->rule_id_ << "/" << interpretator.roots_[i]->origin_;
+    roots_.insert(root.str());
+  }
+  if (collect_derivations) {
+    CollectItemDerivations(parser, interpretator.roots_, derivations_);
+    CollectForestDerivations(parser, forest_);
+    num_of_trees_ = CountTrees(interpretator.roots_);
+  }
+}
+
+std::vector<Token::Ptr> CreateTokens(const std::vector<PublicGrammar::MapId>& types) {
+  std::vector<Token::Ptr> tokens;
+  for (size_t i = 0; i < types.size(); ++i) {
+    tokens.push_back(Token::Ptr(new Token(types[i], i, std::string(1, 't'))));
+  }
+  return tokens;
+}
+
+Outcome Parse(const Grammar& grammar, Lexer& lexer, const Options& options) {
+  TreeInterpretator interpretator;
+  EarleyParser parser(&grammar, &lexer, &interpretator, options);
+  Outcome outcome;
+  outcome.Collect(parser, interpretator, parser.Parse(), true);
+  return outcome;
+}
+
+Outcome Parse(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types, const Options& options) {
+  TokenListLexer lexer(types);
+  return Parse(grammar, lexer, options);
+}
+
+Outcome Reparse(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& before, const std::vector<PublicGrammar::MapId>& after,
+                size_t position, const Options& options) {
+  TokenListLexer lexer(before);
+  TokenListLexer edited_lexer(after);
+  TreeInterpretator interpretator;
+  EarleyParser parser(&grammar, &lexer, &interpretator, options);
+  parser.Parse();
+  parser.SetLexer(&edited_lexer);
+  Outcome outcome;
+  outcome.Collect(parser, interpretator, parser.Reparse(position), true);
+  return outcome;
+}
+
+Outcome Push(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types, const Options& options) {
+  std::vector<Token::Ptr> tokens = CreateTokens(types);
+  TreeInterpretator interpretator;
+  EarleyParser parser(&grammar, NULL, &interpretator, options);
+  Outcome outcome;
+  bool accepted = parser.StartPush();
+  for (size_t i = 0; i < tokens.size() and accepted; ++i) {
+    accepted = parser.PushToken(tokens[i]);
+  }
+  accepted = accepted and parser.FinishPush();
+  outcome.Collect(parser, interpretator, accepted, not parser.CanReleaseStates());
+  return outcome;
+}
+
+void CheckOutcome(const Outcome& expected, const Outcome& actual, const std::string& name) {
+  Check(expected.accepted_ == actual.accepted_ and expected.status_ == actual.status_, name + ": result");
+  Check(expected.roots_ == actual.roots_, name + ": roots");
+  CheckDerivations(expected.derivations_, actual.derivations_, name + ": derivations");
+}
+
+std::vector<Mode> GetModes() {
+  std::vector<Mode> modes;
+  Mode mode;
+
+  mode.name_ = "default";
+  mode.options_ = Options();
+  modes.push_back(mode);
+
+  mode.name_ = "no-lookahead";
+  mode.options_ = Options();
+  mode.options_.use_lookahead_ = false;
+  modes.push_back(mode);
+
+  mode.name_ = "leo";
+  mode.options_ = Options();
+  mode.options_.use_leo_items_ = true;
+  modes.push_back(mode);
+
+  mode.name_ = "lr0";
+  mode.options_ = Options();
+  mode.options_.engine_ = Options::kLr0Engine;
+  modes.push_back(mode);
+
+  mode.name_ = "forest";
+  mode.options_ = Options();
+  mode.options_.build_forest_ = true;
+  modes.push_back(mode);
+
+  mode.name_ = "deferred";
+  mode.options_ = Options();
+  mode.options_.defer_semantics_ = true;
+  modes.push_back(mode);
+
+  mode.name_ = "leo-deferred-forest";
+  mode.options_ = Options();
+  mode.options_.use_leo_items_ = true;
+  mode.options_.defer_semantics_ = true;
+  mode.options_.build_forest_ = true;
+  modes.push_back(mode);
+
+  return modes;
+}
+
+const std::vector<BenchmarkInput>& GetBenchmarkInputs() {
+  static std::vector<BenchmarkInput> inputs;
+  if (not inputs.empty()) {
+    return inputs;
+  }
+
+  static const bench::AmbiguousBenchmark ambiguous;
+  static const bench::ExpressionBenchmark expression;
+  static const bench::EpsilonBenchmark epsilon;
+  static const bench::OptionalBenchmark optional;
+  static const bench::ListBenchmark list;
+  static const bench::CBenchmark c;
+  struct {
+    const bench::Benchmark* benchmark_;
+    size_t                  size_;
+    bool                    cyclic_;
+  } benchmarks[] = {
+    {&ambiguous, 8, false},
+    {&expression, 12, false},
+    {&epsilon, 4, true},
+    {&optional, 10, false},
+    {&list, 6, false},
+    {&c, 1, false}
+  };
+
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+    const bench::Benchmark& benchmark = *benchmarks[i].benchmark_;
+    BenchmarkInput input;
+    input.name_ = benchmark.GetName();
+    input.public_grammar_.reset(new PublicGrammar(benchmark.GetName()));
+    benchmark.InitGrammar(input.public_grammar_.get());
+    input.grammar_.reset(new Grammar(input.public_grammar_.get()));
+    input.cyclic_ = benchmarks[i].cyclic_;
+
+    size_t num_of_tokens = 0;
+    boost::scoped_ptr<Lexer> lexer(benchmark.CreateLexer(benchmarks[i].size_, num_of_tokens));
+    input.types_ = GetTypes(*lexer);
+    Check(input.types_.size() == num_of_tokens, input.name_ + ": tokens");
+    Check(Parse(*input.grammar_, input.types_, Options()).accepted_, input.name_ + ": accepted");
+    inputs.push_back(input);
+  }
+  return inputs;
+}
+
+void CheckMode(const Mode& mode) {
+  const std::vector<BenchmarkInput>& inputs = GetBenchmarkInputs();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::string name = inputs[i].name_ + " " + mode.name_;
+    Outcome expected = Parse(*inputs[i].grammar_, inputs[i].types_, Options());
+    Outcome actual = Parse(*inputs[i].grammar_, inputs[i].types_, mode.options_);
+    if (inputs[i].cyclic_ and mode.options_.defer_semantics_) {
+      Check(expected.accepted_ == actual.accepted_, name + ": result");
+      continue;
+    }
+    CheckOutcome(expected, actual, name);
+    if (mode.options_.build_forest_) {
+      CheckDerivations(expected.derivations_, actual.forest_, name + ": forest");
+    }
+  }
+}
+
+} // namespace tests
@@ -0,0 +1,166 @@
+#ifndef TEST_UTIL_H__
+#define TEST_UTIL_H__
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <parser/public_grammar.h>
+#include <parser/grammar.h>
+#include <parser/earley_parser.h>
+
+#include "../bench/benchmarks.h"
+
+/*!
+ * \brief Общие средства тестов синтаксического анализатора.
+ *
+ * Режимы алгоритма сравниваются с эталонным разбором обычными ситуациями. Выводы сравниваются как множества
+ * упакованных узлов леса над позициями входа, поэтому не зависят от адресов ситуаций и номеров состояний.
+ */
+namespace tests {
+
+using parser::PublicGrammar;
+using parser::Grammar;
+using parser::EarleyParser;
+using parser::Lexer;
+using parser::Token;
+
+typedef EarleyParser::Item    Item;
+typedef EarleyParser::Options Options;
+
+//! Множество выводов в виде строк упакованных узлов леса.
+typedef std::set<std::string> Derivations;
+
+//! Проверка условия с печатью имени неудачной проверки.
+bool Check(bool condition, const std::string& name);
+
+//! Проверка равенства множеств выводов с печатью первого различия.
+bool CheckDerivations(const Derivations& expected, const Derivations& actual, const std::string& name);
+
+//! Число проверок.
+size_t GetNumOfChecks();
+
+//! Число неудачных проверок.
+size_t GetNumOfFailures();
+
+/*!
+ * \brief Интерпретатор, принимающий все символы и строящий текст дерева по первым выводам.
+ *
+ * Запоминает ситуации, переданные в End, и тексты их деревьев.
+ */
+struct TreeInterpretator : public EarleyParser::Interpretator {
+  //! Контекст с текстом поддерева.
+  struct TreeContext : public EarleyParser::Context {
+    explicit TreeContext(const std::string& text)
+      : text_(text)
+    {}
+
+    std::string text_; //!< Текст поддерева.
+  };
+
+  EarleyParser*               parser_;  //!< Парсер текущего разбора.
+  std::vector<const Item*>    roots_;   //!< Ситуации, переданные в End.
+  std::multiset<std::string>  trees_;   //!< Тексты деревьев этих ситуаций.
+
+  TreeInterpretator()
+    : parser_(NULL)
+  {}
+
+  void Start(EarleyParser* parser);
+  void End(const Item* item);
+  EarleyParser::Context::Ptr HandleTerminal(Token::Ptr token, const Item* item);
+  EarleyParser::Context::Ptr HandleNonTerminal(const Item* rule_item, const Item* left_item);
+
+  //! Текст дерева завершенной ситуации.
+  std::string GetTree(const Item* item) const;
+};
+
+//! Выводы ситуаций, достижимых из переданных в End, в виде упакованных узлов леса, как в EarleyParser::BuildForest.
+void CollectItemDerivations(EarleyParser& parser, const std::vector<const Item*>& roots, Derivations& derivations);
+
+//! Выводы, достижимые из корней леса последнего разбора.
+void CollectForestDerivations(EarleyParser& parser, Derivations& derivations);
+
+/*!
+ * \brief Число деревьев вывода ситуаций, переданных в End.
+ *
+ * Каждая ссылка rptrs_ -- отдельный вариант вывода последнего символа ситуации. Транзитивные ссылки ситуаций Лео
+ * считаются одним вариантом, а циклические выводы не считаются, поэтому число сравнимо с эталонным только без них.
+ */
+size_t CountTrees(const std::vector<const Item*>& roots);
+
+//! Результат одного разбора.
+struct Outcome {
+  bool                        accepted_;    //!< Вход разобран.
+  EarleyParser::ParseStatus   status_;      //!< Результат разбора.
+  Derivations                 derivations_; //!< Выводы ситуаций, переданных в End.
+  Derivations                 forest_;      //!< Выводы леса разбора в режиме build_forest_.
+  std::multiset<std::string>  trees_;       //!< Тексты деревьев по первым выводам.
+  std::set<std::string>       roots_;       //!< Участки входа, выведенные из начального символа.
+  size_t                      num_of_trees_;//!< Число деревьев вывода ситуаций, переданных в End.
+
+  //! Сохранение результата разбора. Если освобождались состояния, выводы не собираются.
+  void Collect(EarleyParser& parser, const TreeInterpretator& interpretator, bool accepted, bool collect_derivations);
+};
+
+//! Создание токенов входа, токен с номером i занимает позицию i, как в bench::TokenListLexer.
+std::vector<Token::Ptr> CreateTokens(const std::vector<PublicGrammar::MapId>& types);
+
+//! Разбор входа лексического анализатора методом Parse.
+Outcome Parse(const Grammar& grammar, Lexer& lexer, const Options& options);
+
+//! Разбор входа методом Parse.
+Outcome Parse(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types, const Options& options);
+
+/*!
+ * \brief Разбор входа методом Reparse после разбора другого входа с тем же началом.
+ *
+ * \param[in] grammar   Грамматика.
+ * \param[in] before    Вход первого разбора.
+ * \param[in] after     Вход повторного разбора.
+ * \param[in] position  Позиция, с которой входы различаются.
+ * \param[in] options   Настройки алгоритма.
+ */
+Outcome Reparse(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& before, const std::vector<PublicGrammar::MapId>& after,
+                size_t position, const Options& options);
+
+//! Разбор входа передачей токенов по одному.
+Outcome Push(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types, const Options& options);
+
+//! Проверка, что разбор совпадает с эталонным: тот же результат, те же корни и те же выводы.
+void CheckOutcome(const Outcome& expected, const Outcome& actual, const std::string& name);
+
+//! Режим алгоритма, сравниваемый с эталонным разбором обычными ситуациями.
+struct Mode {
+  const char* name_;    //!< Имя режима.
+  Options     options_; //!< Настройки алгоритма.
+};
+
+//! Режимы алгоритма, выводы которых должны совпадать с эталонным, первым идет режим по умолчанию.
+std::vector<Mode> GetModes();
+
+//! Небольшой вход бенчмарка parser_bench с построенной грамматикой.
+struct BenchmarkInput {
+  std::string                       name_;      //!< Имя бенчмарка.
+  boost::shared_ptr<PublicGrammar>  public_grammar_; //!< Грамматика бенчмарка.
+  boost::shared_ptr<Grammar>        grammar_;   //!< Грамматика, построенная по public_grammar_.
+  std::vector<PublicGrammar::MapId> types_;     //!< Вход без лексических ветвлений.
+  bool                              cyclic_;    //!< В грамматике есть циклы A -->+ A.
+};
+
+//! Входы всех бенчмарков parser_bench, достаточно маленькие, чтобы сравнивать все выводы.
+const std::vector<BenchmarkInput>& GetBenchmarkInputs();
+
+/*!
+ * \brief Сравнение режима алгоритма с разбором обычными ситуациями на входах всех бенчмарков.
+ *
+ * В режиме леса разбора с эталоном сравнивается и сам лес. Для грамматик с циклами A -->+ A в режиме
+ * defer_semantics_ сравнивается только результат: выводы через циклы в этом режиме отбрасываются.
+ */
+void CheckMode(const Mode& mode);
+
+} // namespace tests
+
+#endif // TEST_UTIL_H__
@@ -0,0 +1,129 @@
+#include "test_util.h"
+
+namespace tests {
+
+namespace {
+
+enum { a = 1, b, c, S, X, Y, Z };
+
+//! Результат разбора в режиме пучка: корни в порядке вызовов End.
+struct WeightedOutcome {
+  bool                      accepted_;  //!< Вход разобран.
+  std::vector<float>        scores_;    //!< Оценки корней.
+  std::vector<std::string>  trees_;     //!< Тексты деревьев корней по первым выводам.
+};
+
+WeightedOutcome ParseWeighted(const Grammar& grammar, const std::vector<PublicGrammar::MapId>& types, const Options& options) {
+  bench::TokenListLexer lexer(types);
+  TreeInterpretator interpretator;
+  EarleyParser parser(&grammar, &lexer, &interpretator, options);
+  WeightedOutcome outcome;
+  outcome.accepted_ = parser.Parse();
+  for (size_t i = 0; i < interpretator.roots_.size(); ++i) {
+    outcome.scores_.push_back(interpretator.roots_[i]->score_);
+    outcome.trees_.push_back(interpretator.GetTree(interpretator.roots_[i]));
+  }
+  return outcome;
+}
+
+//! Настройки режима пучка.
+Options GetBeamOptions(size_t k_best, float beam_threshold) {
+  Options options;
+  options.beam_width_ = 8;
+  options.beam_threshold_ = beam_threshold;
+  options.k_best_ = k_best;
+  return options;
+}
+
+/*!
+ * \brief Грамматика с двумя выводами X из a: X --> a и X --> Y, Y --> a.
+ *
+ * Вес weight получает правило X --> a, если direct, иначе X --> Y. Вывод с нулевым весом завершается в том же
+ * состоянии, что и вывод с весом weight, поэтому одна из ситуаций с X после метки получает второй вывод
+ * уже после построения.
+ */
+void InitGrammar(PublicGrammar& grammar, bool direct, double weight) {
+  grammar.AddTerminal(a, "a");
+  grammar.AddTerminal(b, "b");
+  grammar.AddTerminal(c, "c");
+  grammar.AddNonterminal(S, "S");
+  grammar.AddNonterminal(X, "X");
+  grammar.AddNonterminal(Y, "Y");
+  grammar.AddNonterminal(Z, "Z");
+  grammar.SetStartSymbolId(S);
+  bench::AddRule(&grammar, 1, "X --> a", X, a);
+  bench::AddRule(&grammar, 2, "X --> Y", X, Y);
+  bench::AddRule(&grammar, 3, "Y --> a", Y, a);
+  bench::AddRule(&grammar, 4, "Z --> a", Z, a);
+  grammar.SetRuleWeight(direct ? 1 : 2, weight);
+}
+
+} // namespace
+
+/*!
+ * \brief Выбор лучших выводов по весам правил в режиме пучка.
+ *
+ * Проверяется, что второй, лучший вывод ситуации повышает ее оценку: у корня, у порядка корней и у ситуаций,
+ * переносимых в пучок операцией Scanner. Каждая проверка делается для обоих порядков завершения выводов X.
+ */
+void TestWeights() {
+  std::vector<PublicGrammar::MapId> input_a(1, a);
+  std::vector<PublicGrammar::MapId> input_abc(input_a);
+  input_abc.push_back(b);
+  input_abc.push_back(c);
+
+  for (int direct = 0; direct < 2; ++direct) {
+    std::string best_x = direct ? "(X (Y a))" : "(X a)";
+    std::string name = direct ? "weights X --> a" : "weights X --> Y";
+
+    // S --> X: оценка корня -- оценка лучшего вывода, ноль.
+    {
+      PublicGrammar public_grammar("weights");
+      InitGrammar(public_grammar, direct != 0, -5.0);
+      bench::AddRule(&public_grammar, 5, "S --> X", S, X);
+      Grammar grammar(&public_grammar);
+
+      WeightedOutcome outcome = ParseWeighted(grammar, input_a, GetBeamOptions(0, 10.0f));
+      Check(outcome.accepted_, name + ": accepted");
+      Check(outcome.scores_.size() == 1 and outcome.scores_[0] == 0.0f, name + ": root score");
+      Check(outcome.trees_.size() == 1 and outcome.trees_[0] == "(S " + best_x + ")", name + ": best derivation first");
+    }
+
+    // S --> X | Z: корень с лучшим выводом X идет первым, при k_best_ = 1 остается только он.
+    {
+      PublicGrammar public_grammar("weights k-best");
+      InitGrammar(public_grammar, direct != 0, -5.0);
+      bench::AddRule(&public_grammar, 5, "S --> X", S, X);
+      bench::AddRule(&public_grammar, 6, "S --> Z", S, Z);
+      public_grammar.SetRuleWeight(5, -1.0);
+      public_grammar.SetRuleWeight(6, -2.0);
+      Grammar grammar(&public_grammar);
+
+      WeightedOutcome all = ParseWeighted(grammar, input_a, GetBeamOptions(0, 10.0f));
+      Check(all.accepted_ and all.scores_.size() == 2, name + " k-best: all roots");
+      Check(all.scores_.size() == 2 and all.scores_[0] == -1.0f and all.scores_[1] == -2.0f, name + " k-best: root scores");
+      Check(all.trees_.size() == 2 and all.trees_[0] == "(S " + best_x + ")" and all.trees_[1] == "(S (Z a))",
+            name + " k-best: root order");
+
+      WeightedOutcome best = ParseWeighted(grammar, input_a, GetBeamOptions(1, 10.0f));
+      Check(best.accepted_ and best.trees_.size() == 1 and best.trees_[0] == "(S " + best_x + ")", name + " k-best: best root");
+    }
+
+    // S --> X b c | Z b c: при пороге 2 операция Scanner переносит по b только ситуацию с лучшим выводом X.
+    {
+      PublicGrammar public_grammar("weights beam");
+      InitGrammar(public_grammar, direct != 0, -5.0);
+      bench::AddRule(&public_grammar, 5, "S --> X b c", S, X, b, c);
+      bench::AddRule(&public_grammar, 6, "S --> Z b c", S, Z, b, c);
+      public_grammar.SetRuleWeight(6, -3.0);
+      Grammar grammar(&public_grammar);
+
+      WeightedOutcome outcome = ParseWeighted(grammar, input_abc, GetBeamOptions(0, 2.0f));
+      Check(outcome.accepted_, name + " beam: accepted");
+      Check(outcome.trees_.size() == 1 and outcome.trees_[0] == "(S " + best_x + " b c)", name + " beam: best derivation kept");
+      Check(outcome.scores_.size() == 1 and outcome.scores_[0] == 0.0f, name + " beam: root score");
+    }
+  }
+}
+
+} // namespace tests